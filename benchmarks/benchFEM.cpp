@@ -0,0 +1,151 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "benchmark.h"
+
+#include <elementmatrix.h>
+#include <linSolver.h>
+#include <matrix.h>
+#include <sparsematrix.h>
+
+#include <bert/bertDataContainer.h>
+#include <bert/bertJacobian.h>
+
+namespace GIMLI{
+
+//** arguments: dimension, cells per axis
+
+void buildSparsityPattern(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    while (state.keepRunning()){
+        RSparseMatrix S;
+        S.buildSparsityPattern(mesh);
+        doNotOptimize(S.nVals());
+    }
+    state.setItemsProcessed(double(state.iterations()) * mesh.cellCount());
+}
+GIMLI_BENCHMARK(buildSparsityPattern)->args(2, 100)->args(2, 500)
+                                     ->args(3, 20)->args(3, 50)->unit("ms");
+
+//! Element matrices of all cells only
+void elementMatrix(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    ElementMatrix < double > A;
+    while (state.keepRunning()){
+        for (Index i = 0; i < mesh.cellCount(); i ++){
+            A.ux2uy2uz2(mesh.cell(i));
+            doNotOptimize(A.mat()[0][0]);
+        }
+    }
+    state.setItemsProcessed(double(state.iterations()) * mesh.cellCount());
+}
+GIMLI_BENCHMARK(elementMatrix)->args(2, 100)->args(3, 20)->unit("ms");
+
+//! Element matrices and their assembly into the sparse matrix
+void stiffnessAssembly(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    RVector a(mesh.cellCount(), 1.0);
+    RSparseMatrix S;
+    while (state.keepRunning()){
+        S.fillStiffnessMatrix(mesh, a);
+        doNotOptimize(S.vecVals()[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * mesh.cellCount());
+}
+GIMLI_BENCHMARK(stiffnessAssembly)->args(2, 100)->args(2, 500)
+                                  ->args(3, 20)->args(3, 50)->unit("ms");
+
+//! Regular system matrix: stiffness plus mass matrix
+static void systemMatrix__(const Mesh & mesh, RSparseMatrix & S){
+    RSparseMatrix M;
+    S.fillStiffnessMatrix(mesh);
+    M.fillMassMatrix(mesh);
+    S += M;
+}
+
+void linSolverFactorize(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    RSparseMatrix S;
+    systemMatrix__(mesh, S);
+    while (state.keepRunning()){
+        LinSolver * solver = new LinSolver(S);
+        doNotOptimize(solver);
+        //** freeing the factorization is not part of the measurement
+        state.pauseTiming();
+        delete solver;
+        state.resumeTiming();
+    }
+    LinSolver solver(S);
+    state.setLabel(solver.solverName());
+    state.setItemsProcessed(double(state.iterations()) * S.rows());
+}
+GIMLI_BENCHMARK(linSolverFactorize)->args(2, 100)->args(2, 300)
+                                   ->args(3, 15)->args(3, 30)->unit("ms");
+
+void linSolverSolve(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    RSparseMatrix S;
+    systemMatrix__(mesh, S);
+    LinSolver solver(S);
+    RVector b(benchmarkRandom(S.rows()));
+    RVector x(S.rows());
+    while (state.keepRunning()){
+        solver.solve(b, x);
+        doNotOptimize(x[0]);
+    }
+    state.setLabel(solver.solverName());
+    state.setItemsProcessed(double(state.iterations()) * S.rows());
+}
+GIMLI_BENCHMARK(linSolverSolve)->args(2, 100)->args(2, 300)
+                               ->args(3, 15)->args(3, 30)->unit("ms");
+
+//! DC sensitivity of a dipole-dipole profile at the surface of a 2D mesh
+//! with random potentials, arguments: cells per axis, electrodes
+void sensitivityCol(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(2, state.range(0));
+    Index nElecs = state.range(1);
+    double xMax = mesh.xmax();
+
+    DataContainerERT data;
+    for (Index i = 0; i < nElecs; i ++){
+        data.createSensor(RVector3(xMax * i / (nElecs - 1), mesh.ymax()));
+    }
+    for (Index sep = 1; sep < 7; sep ++){
+        for (Index a = 0; a + sep + 2 < nElecs; a ++){
+            data.addFourPointData(a, a + 1, a + sep + 1, a + sep + 2);
+        }
+    }
+
+    RMatrix pots(nElecs, mesh.nodeCount());
+    for (Index i = 0; i < nElecs; i ++) pots[i] = benchmarkRandom(mesh.nodeCount(), -1.0, 1.0, i + 1);
+    RVector weights(1, 1.0);
+    RVector k(1, 0.0);
+    std::vector < std::pair < Index, Index > > clusterIds;
+
+    RMatrix S;
+    while (state.keepRunning()){
+        createSensitivityCol(S, mesh, data, pots, weights, k, clusterIds,
+                             threadCount(), false);
+        doNotOptimize(S[0][0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * data.size() * mesh.cellCount());
+    state.setLabel("data=" + str(data.size()));
+}
+GIMLI_BENCHMARK(sensitivityCol)->args(50, 21)->args(200, 41)->unit("ms");
+
+} // namespace GIMLI
@@ -0,0 +1,103 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "benchmark.h"
+
+#include <matrix.h>
+#include <sparsematrix.h>
+#include <vector.h>
+#include <vectortemplates.h>
+
+namespace GIMLI{
+
+//! c = a * 2 + b * b, the expression templates of Vector
+void vectorExpression(BenchmarkState & state){
+    Index n = state.range(0);
+    RVector a(benchmarkRandom(n, 0.0, 1.0, 1));
+    RVector b(benchmarkRandom(n, 0.0, 1.0, 2));
+    RVector c(n);
+    while (state.keepRunning()){
+        c = a * 2.0 + b * b;
+        doNotOptimize(c[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * n);
+    state.setBytesProcessed(double(state.iterations()) * n * 3 * sizeof(double));
+}
+GIMLI_BENCHMARK(vectorExpression)->arg(1000)->arg(100000)->arg(10000000);
+
+void vectorDot(BenchmarkState & state){
+    Index n = state.range(0);
+    RVector a(benchmarkRandom(n, 0.0, 1.0, 1));
+    RVector b(benchmarkRandom(n, 0.0, 1.0, 2));
+    double s = 0.0;
+    while (state.keepRunning()){
+        s += dot(a, b);
+    }
+    doNotOptimize(s);
+    state.setItemsProcessed(double(state.iterations()) * n);
+    state.setBytesProcessed(double(state.iterations()) * n * 2 * sizeof(double));
+}
+GIMLI_BENCHMARK(vectorDot)->arg(1000)->arg(100000)->arg(10000000);
+
+//! Dense n x n matrix times vector
+void matrixMult(BenchmarkState & state){
+    Index n = state.range(0);
+    RMatrix A(n, n);
+    for (Index i = 0; i < n; i ++) A[i] = benchmarkRandom(n, -1.0, 1.0, i + 1);
+    RVector x(benchmarkRandom(n));
+    RVector y(n);
+    while (state.keepRunning()){
+        y = A.mult(x);
+        doNotOptimize(y[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * n * n);
+}
+GIMLI_BENCHMARK(matrixMult)->arg(100)->arg(1000)->arg(4000)->unit("us");
+
+void matrixTransMult(BenchmarkState & state){
+    Index n = state.range(0);
+    RMatrix A(n, n);
+    for (Index i = 0; i < n; i ++) A[i] = benchmarkRandom(n, -1.0, 1.0, i + 1);
+    RVector x(benchmarkRandom(n));
+    RVector y(n);
+    while (state.keepRunning()){
+        y = A.transMult(x);
+        doNotOptimize(y[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * n * n);
+}
+GIMLI_BENCHMARK(matrixTransMult)->arg(100)->arg(1000)->arg(4000)->unit("us");
+
+//! Sparse matrix vector product with the stiffness matrix of a 2D or 3D mesh
+void sparseMatrixMult(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    RSparseMatrix S;
+    S.fillStiffnessMatrix(mesh);
+    RVector x(benchmarkRandom(S.cols()));
+    RVector y(S.rows());
+    while (state.keepRunning()){
+        y = S.mult(x);
+        doNotOptimize(y[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * S.nVals());
+    state.setLabel("nnz=" + str(S.nVals()));
+}
+GIMLI_BENCHMARK(sparseMatrixMult)->args(2, 100)->args(2, 500)
+                                 ->args(3, 20)->args(3, 50)->unit("us");
+
+} // namespace GIMLI
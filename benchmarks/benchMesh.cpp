@@ -0,0 +1,127 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "benchmark.h"
+
+#include <datacontainer.h>
+#include <interpolate.h>
+#include <node.h>
+#include <ttdijkstramodelling.h>
+
+#include <cstdio>
+
+namespace GIMLI{
+
+//** arguments: dimension, cells per axis
+
+static R3Vector randomPositions__(const Mesh & mesh, Index n){
+    RVector x(benchmarkRandom(n, mesh.xmin(), mesh.xmax(), 1));
+    RVector y(benchmarkRandom(n, mesh.ymin(), mesh.ymax(), 2));
+    RVector z(benchmarkRandom(n, mesh.zmin(), mesh.zmax(), 3));
+    R3Vector pos(n);
+    for (Index i = 0; i < n; i ++){
+        pos[i] = RVector3(x[i], y[i], mesh.dim() == 3 ? z[i] : 0.0);
+    }
+    return pos;
+}
+
+//! Point location of 1000 random positions
+void findCell(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    R3Vector pos(randomPositions__(mesh, 1000));
+    //** build the search tree outside of the measurement
+    mesh.findCell(pos[0]);
+    while (state.keepRunning()){
+        for (Index i = 0; i < pos.size(); i ++){
+            doNotOptimize(mesh.findCell(pos[i]));
+        }
+    }
+    state.setItemsProcessed(double(state.iterations()) * pos.size());
+}
+GIMLI_BENCHMARK(findCell)->args(2, 100)->args(2, 500)
+                         ->args(3, 20)->args(3, 50)->unit("us");
+
+//! Interpolation of a node based field to 10000 random positions
+void interpolate(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    R3Vector pos(randomPositions__(mesh, 10000));
+    RVector field(benchmarkRandom(mesh.nodeCount()));
+    RVector ret;
+    while (state.keepRunning()){
+        ret = GIMLI::interpolate(mesh, field, pos);
+        doNotOptimize(ret[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * pos.size());
+}
+GIMLI_BENCHMARK(interpolate)->args(2, 100)->args(3, 20)->unit("ms");
+
+//! Load a mesh in binary format from the file system cache
+void loadBinaryV2(BenchmarkState & state){
+    const Mesh & mesh = benchmarkMesh(state.range(0), state.range(1));
+    std::string fileName("gimliBenchmark_" + str(state.range(0)) + "_"
+                         + str(state.range(1)) + ".bms");
+    mesh.saveBinaryV2(fileName);
+    while (state.keepRunning()){
+        Mesh m;
+        m.loadBinaryV2(fileName);
+        doNotOptimize(m.cellCount());
+    }
+    std::remove(fileName.c_str());
+    state.setItemsProcessed(double(state.iterations()) * mesh.cellCount());
+}
+GIMLI_BENCHMARK(loadBinaryV2)->args(2, 500)->args(3, 50)->unit("ms");
+
+//! Dijkstra traveltimes of a crosshole setup, sources on the left and
+//! receivers on the right side of a 2D mesh, arguments: cells per axis, sensors
+void dijkstraResponse(BenchmarkState & state){
+    //** a single region, so the cell ids are no markers
+    Mesh mesh(benchmarkMesh(2, state.range(0)));
+    mesh.setCellMarkers(IVector(mesh.cellCount(), 0));
+    Index nSensors = state.range(1);
+
+    DataContainer data;
+    data.registerSensorIndex("s");
+    data.registerSensorIndex("g");
+    for (Index i = 0; i < nSensors; i ++){
+        double y = mesh.ymin() + (mesh.ymax() - mesh.ymin()) * i / (nSensors - 1);
+        data.createSensor(RVector3(mesh.xmin(), y));
+        data.createSensor(RVector3(mesh.xmax(), y));
+    }
+    data.resize(nSensors * nSensors);
+    RVector s(data.size()), g(data.size());
+    for (Index i = 0; i < nSensors; i ++){
+        for (Index j = 0; j < nSensors; j ++){
+            s[i * nSensors + j] = 2 * i;
+            g[i * nSensors + j] = 2 * j + 1;
+        }
+    }
+    data.set("s", s);
+    data.set("g", g);
+
+    TravelTimeDijkstraModelling fop(mesh, data, false);
+    RVector slowness(benchmarkRandom(mesh.cellCount(), 1.0, 2.0));
+    RVector t;
+    while (state.keepRunning()){
+        t = fop.response(slowness);
+        doNotOptimize(t[0]);
+    }
+    state.setItemsProcessed(double(state.iterations()) * data.size());
+}
+GIMLI_BENCHMARK(dijkstraResponse)->args(50, 11)->args(200, 21)->unit("ms");
+
+} // namespace GIMLI
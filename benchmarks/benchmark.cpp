@@ -0,0 +1,431 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "benchmark.h"
+
+#include <meshgenerators.h>
+#include <vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+
+#if defined(_WIN32)
+    #include <winsock2.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace GIMLI{
+
+BenchmarkState::BenchmarkState(Index iterations, const std::vector < Index > & args)
+    : iterations_(iterations), count_(0), args_(args), running_(false),
+      realTime_(0.0), cpuTime_(0.0), items_(0.0), bytes_(0.0){
+}
+
+void BenchmarkState::pauseTiming(){
+    if (!running_) return;
+    realTime_ += std::chrono::duration< double >(
+                    std::chrono::steady_clock::now() - realStart_).count();
+    cpuTime_ += double(std::clock() - cpuStart_) / CLOCKS_PER_SEC;
+    running_ = false;
+}
+
+void BenchmarkState::resumeTiming(){
+    if (running_) return;
+    running_ = true;
+    cpuStart_ = std::clock();
+    realStart_ = std::chrono::steady_clock::now();
+}
+
+Index BenchmarkState::range(Index i) const {
+    if (i >= args_.size()){
+        throwLengthError(1, WHERE_AM_I + " benchmark has only " + str(args_.size())
+                         + " arguments.");
+    }
+    return args_[i];
+}
+
+void BenchmarkState::skipWithError(const std::string & msg){
+    error_ = msg;
+    count_ = iterations_;
+    pauseTiming();
+}
+
+Benchmark::Benchmark(const std::string & name, BenchmarkFunction f)
+    : name_(name), f_(f), iterations_(0), unit_("ns"){
+}
+
+Benchmark * Benchmark::arg(Index a){
+    args_.push_back(std::vector < Index >(1, a));
+    return this;
+}
+
+Benchmark * Benchmark::args(Index a, Index b){
+    std::vector < Index > ab(2);
+    ab[0] = a; ab[1] = b;
+    args_.push_back(ab);
+    return this;
+}
+
+static std::vector < Benchmark * > & benchmarks__(){
+    static std::vector < Benchmark * > b;
+    return b;
+}
+
+Benchmark * registerBenchmark(const std::string & name, BenchmarkFunction f){
+    Benchmark * b = new Benchmark(name, f);
+    benchmarks__().push_back(b);
+    return b;
+}
+
+const Mesh & benchmarkMesh(Index dim, Index n){
+    static std::map < std::pair < Index, Index >, Mesh > meshes;
+    std::pair < Index, Index > key(dim, n);
+    std::map < std::pair < Index, Index >, Mesh >::iterator it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    Mesh & mesh = meshes[key];
+    if (dim == 2) mesh = createMesh2D(n, n);
+    else mesh = createMesh3D(n, n, n);
+
+    IVector markers(mesh.cellCount());
+    for (Index i = 0; i < markers.size(); i ++) markers[i] = i;
+    mesh.setCellMarkers(markers);
+    mesh.createNeighbourInfos();
+    return mesh;
+}
+
+RVector benchmarkRandom(Index n, double min, double max, Index seed){
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution< double > dist(min, max);
+    RVector ret(n);
+    for (Index i = 0; i < n; i ++) ret[i] = dist(gen);
+    return ret;
+}
+
+namespace {
+
+//! Result of one benchmark run.
+struct BenchmarkRun__{
+    std::string name;
+    std::string runName;
+    std::string runType;
+    std::string aggregate;
+    std::string unit;
+    std::string label;
+    std::string error;
+    Index iterations;
+    Index repetitions;
+    Index repetitionIndex;
+    /*! Times per iteration in seconds */
+    double realTime;
+    double cpuTime;
+    double itemsPerSecond;
+    double bytesPerSecond;
+};
+
+struct BenchmarkOptions__{
+    BenchmarkOptions__() : minTime(0.5), repetitions(1), list(false) {}
+    double minTime;
+    Index repetitions;
+    bool list;
+    std::string filter;
+    std::string json;
+};
+
+double unitScale__(const std::string & unit){
+    if (unit == "s") return 1.0;
+    if (unit == "ms") return 1e3;
+    if (unit == "us") return 1e6;
+    return 1e9;
+}
+
+std::string jsonEscape__(const std::string & str){
+    std::string ret;
+    for (Index i = 0; i < str.size(); i ++){
+        char c = str[i];
+        if (c == '"' || c == '\\') ret += '\\';
+        if ((unsigned char)c >= 0x20) ret += c;
+    }
+    return ret;
+}
+
+std::string hostName__(){
+    char name[256] = "unknown";
+    if (gethostname(name, sizeof(name)) != 0) return "unknown";
+    name[sizeof(name) - 1] = '\0';
+    return name;
+}
+
+BenchmarkState runOnce__(const Benchmark & b, const std::vector < Index > & args,
+                         Index iterations){
+    BenchmarkState state(iterations, args);
+    b.function()(state);
+    return state;
+}
+
+/*! Run the benchmark with increasing amount of iterations until the
+ * minimal time is reached, like Google Benchmark does. */
+BenchmarkRun__ run__(const Benchmark & b, const std::vector < Index > & args,
+                     const BenchmarkOptions__ & opt){
+    Index iterations = b.fixedIterations() > 0 ? b.fixedIterations() : 1;
+    BenchmarkState state(runOnce__(b, args, iterations));
+
+    while (b.fixedIterations() == 0 && state.error().empty() &&
+           state.realTime() < opt.minTime && iterations < Index(1e9)){
+        double multiplier = opt.minTime * 1.4 / std::max(state.realTime(), 1e-9);
+        multiplier = std::min(10.0, std::max(2.0, multiplier));
+        //** a run with more than 10% of the minimal time predicts well
+        if (state.realTime() / opt.minTime > 0.1) multiplier = std::min(
+                    multiplier, opt.minTime * 1.4 / state.realTime());
+        iterations = std::max(iterations + 1, Index(std::ceil(iterations * multiplier)));
+        state = runOnce__(b, args, iterations);
+    }
+
+    BenchmarkRun__ run;
+    run.name = b.name();
+    for (Index i = 0; i < args.size(); i ++) run.name += "/" + str(args[i]);
+    run.runName = run.name;
+    run.runType = "iteration";
+    run.unit = b.timeUnit();
+    run.label = state.label();
+    run.error = state.error();
+    run.iterations = iterations;
+    run.repetitions = opt.repetitions;
+    run.repetitionIndex = 0;
+    run.realTime = state.realTime() / iterations;
+    run.cpuTime = state.cpuTime() / iterations;
+    run.itemsPerSecond = state.realTime() > 0.0 ? state.items() / state.realTime() : 0.0;
+    run.bytesPerSecond = state.realTime() > 0.0 ? state.bytes() / state.realTime() : 0.0;
+    return run;
+}
+
+/*! Mean, median and stddev of the repetitions. */
+void aggregate__(const std::vector < BenchmarkRun__ > & runs,
+                 std::vector < BenchmarkRun__ > & results){
+    Index n = runs.size();
+    std::vector < double > r(n), c(n), it(n), by(n);
+    for (Index i = 0; i < n; i ++){
+        r[i] = runs[i].realTime; c[i] = runs[i].cpuTime;
+        it[i] = runs[i].itemsPerSecond; by[i] = runs[i].bytesPerSecond;
+    }
+    const char * names[3] = {"mean", "median", "stddev"};
+    for (Index a = 0; a < 3; a ++){
+        BenchmarkRun__ agg(runs[0]);
+        agg.runType = "aggregate";
+        agg.aggregate = names[a];
+        agg.name = runs[0].runName + "_" + names[a];
+        std::vector < double > * v[4] = {&r, &c, &it, &by};
+        double res[4];
+        for (Index k = 0; k < 4; k ++){
+            std::vector < double > s(*v[k]);
+            double mean = 0.0;
+            for (Index i = 0; i < n; i ++) mean += s[i];
+            mean /= n;
+            if (a == 0) res[k] = mean;
+            else if (a == 1){
+                std::sort(s.begin(), s.end());
+                res[k] = n % 2 ? s[n / 2] : 0.5 * (s[n / 2 - 1] + s[n / 2]);
+            } else {
+                double var = 0.0;
+                for (Index i = 0; i < n; i ++) var += (s[i] - mean) * (s[i] - mean);
+                res[k] = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+            }
+        }
+        agg.realTime = res[0]; agg.cpuTime = res[1];
+        agg.itemsPerSecond = res[2]; agg.bytesPerSecond = res[3];
+        results.push_back(agg);
+    }
+}
+
+void print__(const BenchmarkRun__ & run){
+    double scale = unitScale__(run.unit);
+    std::cout << std::left << std::setw(48) << run.name << std::right;
+    if (!run.error.empty()){
+        std::cout << " ERROR: " << run.error << std::endl;
+        return;
+    }
+    std::cout.precision(3);
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout << std::setw(14) << run.realTime * scale << " " << std::setw(2) << run.unit
+              << std::setw(14) << run.cpuTime * scale << " " << std::setw(2) << run.unit
+              << std::setw(12) << run.iterations;
+    if (run.itemsPerSecond > 0.0){
+        std::cout.precision(4);
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << " " << run.itemsPerSecond << " items/s";
+    }
+    if (!run.label.empty()) std::cout << " " << run.label;
+    std::cout << std::endl;
+}
+
+/*! Write the results in the JSON format of Google Benchmark, so its
+ * tools, e.g., compare.py, can be used. */
+void saveJSON__(const std::string & fileName,
+                const std::vector < BenchmarkRun__ > & results){
+    std::fstream file;
+    if (!openOutFile(fileName, & file)) return;
+
+    char date[64];
+    std::time_t t = std::time(NULL);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&t));
+
+    file << "{" << std::endl
+         << "  \"context\": {" << std::endl
+         << "    \"date\": \"" << date << "\"," << std::endl
+         << "    \"host_name\": \"" << jsonEscape__(hostName__()) << "\"," << std::endl
+         << "    \"executable\": \"gimliBenchmark\"," << std::endl
+         << "    \"num_cpus\": " << numberOfCPU() << "," << std::endl
+         << "    \"gimli_version\": \"" << jsonEscape__(versionStr()) << "\"," << std::endl
+         << "    \"gimli_threads\": " << threadCount() << "," << std::endl
+#ifdef NDEBUG
+         << "    \"library_build_type\": \"release\"" << std::endl
+#else
+         << "    \"library_build_type\": \"debug\"" << std::endl
+#endif
+         << "  }," << std::endl
+         << "  \"benchmarks\": [" << std::endl;
+
+    file.precision(10);
+    for (Index i = 0; i < results.size(); i ++){
+        const BenchmarkRun__ & r = results[i];
+        double scale = unitScale__(r.unit);
+        file << "    {" << std::endl
+             << "      \"name\": \"" << jsonEscape__(r.name) << "\"," << std::endl
+             << "      \"run_name\": \"" << jsonEscape__(r.runName) << "\"," << std::endl
+             << "      \"run_type\": \"" << r.runType << "\"," << std::endl
+             << "      \"repetitions\": " << r.repetitions << "," << std::endl
+             << "      \"repetition_index\": " << r.repetitionIndex << "," << std::endl;
+        if (r.runType == "aggregate"){
+            file << "      \"aggregate_name\": \"" << r.aggregate << "\"," << std::endl;
+        }
+        if (!r.error.empty()){
+            file << "      \"error_occurred\": true," << std::endl
+                 << "      \"error_message\": \"" << jsonEscape__(r.error) << "\"," << std::endl;
+        }
+        if (!r.label.empty()){
+            file << "      \"label\": \"" << jsonEscape__(r.label) << "\"," << std::endl;
+        }
+        if (r.itemsPerSecond > 0.0){
+            file << "      \"items_per_second\": " << r.itemsPerSecond << "," << std::endl;
+        }
+        if (r.bytesPerSecond > 0.0){
+            file << "      \"bytes_per_second\": " << r.bytesPerSecond << "," << std::endl;
+        }
+        file << "      \"iterations\": " << r.iterations << "," << std::endl
+             << "      \"real_time\": " << r.realTime * scale << "," << std::endl
+             << "      \"cpu_time\": " << r.cpuTime * scale << "," << std::endl
+             << "      \"time_unit\": \"" << r.unit << "\"" << std::endl
+             << "    }" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    file << "  ]" << std::endl << "}" << std::endl;
+    file.close();
+}
+
+void usage__(){
+    std::cout << "Usage: gimliBenchmark [options]" << std::endl
+              << "  --filter=<regex>    run only benchmarks matching regex" << std::endl
+              << "  --min_time=<s>      minimal time per run (default 0.5)" << std::endl
+              << "  --repetitions=<n>   repeat each run and add mean, median and stddev" << std::endl
+              << "  --json=<file>       write the results in Google Benchmark JSON format" << std::endl
+              << "  --threads=<n>       thread count of the library" << std::endl
+              << "  --list              list the benchmarks" << std::endl;
+}
+
+} // namespace
+
+int runBenchmarks(int argc, char * argv[]){
+    BenchmarkOptions__ opt;
+    for (int i = 1; i < argc; i ++){
+        std::string a(argv[i]);
+        std::string val(a.find('=') == std::string::npos ? "" : a.substr(a.find('=') + 1));
+        if (a.find("--filter=") == 0) opt.filter = val;
+        else if (a.find("--min_time=") == 0) opt.minTime = toDouble(val);
+        else if (a.find("--repetitions=") == 0) opt.repetitions = std::max(1, toInt(val));
+        else if (a.find("--json=") == 0) opt.json = val;
+        else if (a.find("--threads=") == 0) setThreadCount(std::max(1, toInt(val)));
+        else if (a == "--list") opt.list = true;
+        else {
+            usage__();
+            return a == "--help" || a == "-h" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    std::regex filter(opt.filter.empty() ? ".*" : opt.filter);
+    std::vector < BenchmarkRun__ > results;
+
+    if (!opt.list){
+        std::cout << std::left << std::setw(48) << "Benchmark" << std::right
+                  << std::setw(17) << "Time" << std::setw(17) << "CPU"
+                  << std::setw(12) << "Iterations" << std::endl
+                  << std::string(94, '-') << std::endl;
+    }
+
+    const std::vector < Benchmark * > & benchmarks = benchmarks__();
+    for (Index i = 0; i < benchmarks.size(); i ++){
+        const Benchmark & b = *benchmarks[i];
+        std::vector < std::vector < Index > > argSets(b.argSets());
+        if (argSets.empty()) argSets.push_back(std::vector < Index >());
+
+        for (Index j = 0; j < argSets.size(); j ++){
+            std::string name(b.name());
+            for (Index k = 0; k < argSets[j].size(); k ++) name += "/" + str(argSets[j][k]);
+            if (!std::regex_search(name, filter)) continue;
+            if (opt.list){
+                std::cout << name << std::endl;
+                continue;
+            }
+
+            std::vector < BenchmarkRun__ > runs;
+            for (Index r = 0; r < opt.repetitions; r ++){
+                BenchmarkRun__ run(run__(b, argSets[j], opt));
+                run.repetitionIndex = r;
+                print__(run);
+                runs.push_back(run);
+                results.push_back(run);
+                if (!run.error.empty()) break;
+            }
+            if (opt.repetitions > 1 && runs.back().error.empty()){
+                Index first = results.size();
+                aggregate__(runs, results);
+                for (Index k = first; k < results.size(); k ++) print__(results[k]);
+            }
+        }
+    }
+
+    if (!opt.json.empty()) saveJSON__(opt.json, results);
+    return EXIT_SUCCESS;
+}
+
+} // namespace GIMLI
+
+int main(int argc, char * argv[]){
+    try {
+        return GIMLI::runBenchmarks(argc, argv);
+    } catch (std::exception & e){
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}
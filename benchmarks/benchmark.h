@@ -0,0 +1,171 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_BENCHMARK__H
+#define _GIMLI_BENCHMARK__H
+
+#include <gimli.h>
+#include <mesh.h>
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#define GIMLI_BENCHMARK_CAT__(a, b) a##b
+#define GIMLI_BENCHMARK_CAT_(a, b) GIMLI_BENCHMARK_CAT__(a, b)
+
+/*! Register the benchmark function f, e.g.:
+ * GIMLI_BENCHMARK(vectorAdd)->arg(1000)->arg(1000000); */
+#define GIMLI_BENCHMARK(f) \
+    static GIMLI::Benchmark * GIMLI_BENCHMARK_CAT_(__gimliBenchmark__, __LINE__) = \
+        GIMLI::registerBenchmark(#f, f)
+
+namespace GIMLI{
+
+//! Timing state of one benchmark run.
+/*! The benchmark function loops while keepRunning() is true, only this
+ * loop is timed:
+ * void f(BenchmarkState & state){
+ *     setup(state.range(0));
+ *     while (state.keepRunning()){ work(); }
+ * } */
+class BenchmarkState{
+public:
+    BenchmarkState(Index iterations, const std::vector < Index > & args);
+
+    /*! Return true while iterations are left. The first call starts
+     * and the last call stops the timer. */
+    inline bool keepRunning(){
+        if (count_ == 0) resumeTiming();
+        if (count_ < iterations_){
+            count_ ++;
+            return true;
+        }
+        pauseTiming();
+        return false;
+    }
+
+    /*! Stop the timer, e.g., for a setup inside the loop. */
+    void pauseTiming();
+
+    /*! Restart the timer after \ref pauseTiming. */
+    void resumeTiming();
+
+    /*! Return the i-th argument of the benchmark. */
+    Index range(Index i=0) const;
+
+    /*! Return the amount of iterations of this run. */
+    inline Index iterations() const { return iterations_; }
+
+    /*! Items processed in all iterations, reported as items_per_second. */
+    void setItemsProcessed(double n) { items_ = n; }
+
+    /*! Bytes processed in all iterations, reported as bytes_per_second. */
+    void setBytesProcessed(double n) { bytes_ = n; }
+
+    /*! Additional information, e.g., the solver name. */
+    void setLabel(const std::string & label) { label_ = label; }
+
+    /*! Mark the run as failed, the benchmark loop should return. */
+    void skipWithError(const std::string & msg);
+
+    inline double realTime() const { return realTime_; }
+    inline double cpuTime() const { return cpuTime_; }
+    inline double items() const { return items_; }
+    inline double bytes() const { return bytes_; }
+    inline const std::string & label() const { return label_; }
+    inline const std::string & error() const { return error_; }
+
+protected:
+    Index iterations_;
+    Index count_;
+    std::vector < Index > args_;
+    bool running_;
+    std::chrono::steady_clock::time_point realStart_;
+    std::clock_t cpuStart_;
+    /*! Accumulated times in seconds */
+    double realTime_;
+    double cpuTime_;
+    double items_;
+    double bytes_;
+    std::string label_;
+    std::string error_;
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkState & state);
+
+//! A registered benchmark function with its argument sets.
+class Benchmark{
+public:
+    Benchmark(const std::string & name, BenchmarkFunction f);
+
+    /*! Add a run with the single argument a. */
+    Benchmark * arg(Index a);
+
+    /*! Add a run with the arguments a and b. */
+    Benchmark * args(Index a, Index b);
+
+    /*! Use a fixed amount of iterations instead of the minimal time,
+     * e.g., for benchmarks with expensive setup. */
+    Benchmark * iterations(Index n) { iterations_ = n; return this; }
+
+    /*! Time unit of the report: "ns", "us", "ms" or "s". */
+    Benchmark * unit(const std::string & unit) { unit_ = unit; return this; }
+
+    inline const std::string & name() const { return name_; }
+    inline BenchmarkFunction function() const { return f_; }
+    inline const std::vector < std::vector < Index > > & argSets() const { return args_; }
+    inline Index fixedIterations() const { return iterations_; }
+    inline const std::string & timeUnit() const { return unit_; }
+
+protected:
+    std::string name_;
+    BenchmarkFunction f_;
+    std::vector < std::vector < Index > > args_;
+    Index iterations_;
+    std::string unit_;
+};
+
+/*! Register a benchmark, use the macro GIMLI_BENCHMARK. */
+Benchmark * registerBenchmark(const std::string & name, BenchmarkFunction f);
+
+/*! Run all registered benchmarks matching the command line options. */
+int runBenchmarks(int argc, char * argv[]);
+
+/*! Prevent the compiler from removing the computation of v. */
+template < class T > inline void doNotOptimize(const T & v){
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&v) : "memory");
+#else
+    const volatile char * p = reinterpret_cast< const volatile char * >(&v);
+    (void)*p;
+#endif
+}
+
+/*! Return a regular 2D (n x n quadrangles) or 3D (n x n x n hexahedra)
+ * mesh with the cell ids as markers. The meshes are cached, so several
+ * benchmarks and runs share the setup. */
+const Mesh & benchmarkMesh(Index dim, Index n);
+
+/*! Reproducible uniform random numbers in [min, max). */
+RVector benchmarkRandom(Index n, double min=0.0, double max=1.0, Index seed=1);
+
+} // namespace GIMLI
+
+#endif // _GIMLI_BENCHMARK__H
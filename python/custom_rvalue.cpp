@@ -1,4 +1,5 @@
 #include <typeinfo>
+#include <limits>
 
 #include "boost/python/object.hpp"  //len function
 #include "boost/python/ssize_t.hpp" //ssize_t type definition
@@ -36,6 +37,70 @@ std::ostream & operator << (std::ostream & os, const bp::object& o){
 }
 namespace r_values_impl{
 
+template < class T, class ValueType > void copyStrided_(const char * src, npy_intp stride,
+                                                       ValueType * dst, GIMLI::Index n){
+    for (GIMLI::Index i = 0; i < n; i ++) {
+        T v = *(const T*)(src + i * stride);
+        // negative values would wrap around in unsigned index arrays
+        if (!std::numeric_limits< ValueType >::is_signed && double(v) < 0.0){
+            GIMLI::throwError(1, "Negative value " + GIMLI::str(double(v)) +
+                              " at position " + GIMLI::str(i) +
+                              " can not be converted into an unsigned index array.");
+        }
+        dst[i] = ValueType(v);
+    }
+}
+
+/*! Let vec refer to the buffer of the 1D numpy array arr without copying if
+ * the array is contiguous, aligned, in native byte order and of the given
+ * dtype. The array is held by the caller during the function call so the
+ * buffer stays valid for the lifetime of the temporary rvalue. */
+template < class ValueType > bool wrapNumpy(PyArrayObject * arr, int npyType,
+                                            GIMLI::Vector< ValueType > & vec){
+    if (PyArray_TYPE(arr) == npyType && PyArray_NDIM(arr) == 1 &&
+        PyArray_ITEMSIZE(arr) == sizeof(ValueType) &&
+        PyArray_ISCARRAY_RO(arr) && PyArray_ISNOTSWAPPED(arr)){
+        __DC(arr << " ** wrap array of type " << PyArray_TYPE(arr))
+        vec.wrap((ValueType*)PyArray_DATA(arr), PyArray_DIM(arr, 0));
+        return true;
+    }
+    return false;
+}
+
+/*! Copy the 1D numpy array arr into vec reading directly from the
+ * (possibly strided) array buffer instead of creating a python scalar for
+ * each element. Returns false for unsupported dtypes. */
+template < class ValueType > bool fillFromNumpy(PyArrayObject * arr,
+                                                GIMLI::Vector< ValueType > & vec){
+    if (PyArray_NDIM(arr) != 1 || !PyArray_ISALIGNED(arr) ||
+        !PyArray_ISNOTSWAPPED(arr)) return false;
+
+    GIMLI::Index n = PyArray_DIM(arr, 0);
+    const char * src = PyArray_BYTES(arr);
+    npy_intp stride = PyArray_STRIDE(arr, 0);
+    vec.resize(n);
+    ValueType * dst = &vec[0];
+    __DC(arr << " ** copy array of type " << PyArray_TYPE(arr))
+
+    switch (PyArray_TYPE(arr)){
+        case NPY_BOOL:    copyStrided_< npy_bool >(src, stride, dst, n); return true;
+        case NPY_INT32:   copyStrided_< npy_int32 >(src, stride, dst, n); return true;
+        case NPY_UINT32:  copyStrided_< npy_uint32 >(src, stride, dst, n); return true;
+        case NPY_INT64:   copyStrided_< npy_int64 >(src, stride, dst, n); return true;
+        case NPY_UINT64:  copyStrided_< npy_uint64 >(src, stride, dst, n); return true;
+        default: break;
+    }
+    // no silent truncation of floating point values into integer arrays
+    if (std::numeric_limits< ValueType >::is_integer) return false;
+
+    switch (PyArray_TYPE(arr)){
+        case NPY_FLOAT32: copyStrided_< npy_float32 >(src, stride, dst, n); return true;
+        case NPY_FLOAT64: copyStrided_< npy_float64 >(src, stride, dst, n); return true;
+        default: break;
+    }
+    return false;
+}
+
 template < class ValueType > void * checkConvertibleSequenz(PyObject * obj){
     //     import_array2("Cannot import numpy c-api from pygimli hand_make_wrapper2", NULL);
     // is obj is a sequence
@@ -194,40 +259,21 @@ struct PySequence2RVector{
         void* memory_chunk = the_storage->storage.bytes;
 
         bp::object py_sequence(bp::handle<>(bp::borrowed(obj)));
-        GIMLI::Vector< double > * vec = new (memory_chunk) GIMLI::Vector< double >(len(py_sequence));
+        GIMLI::Vector< double > * vec = new (memory_chunk) GIMLI::Vector< double >();
         data->convertible = memory_chunk;
 
         if (strcmp(obj->ob_type->tp_name, "numpy.ndarray") == 0){
             PyArrayObject *arr = (PyArrayObject *)obj;
             __DC("type is " << obj->ob_type->tp_name << " " << PyArray_TYPE(arr))
 
-            if (PyArray_TYPE(arr) == 12 && PyArray_ISONESEGMENT(arr)){
-                void * arrData = PyArray_DATA(arr);
-                std::memcpy(&(*vec)[0], arrData, vec->size() * sizeof(double));
-                return;
-            } else if (PyArray_TYPE(arr) == 7 && PyArray_ISONESEGMENT(arr)){ //numpy.int64
-                    __DC(arr << " ** from array of type " << PyArray_TYPE(arr))
-
-                    bp::object element;
-
-                    for (GIMLI::Index i = 0; i < vec->size(); i ++){
-                        element = py_sequence[i];
-                        (*vec)[i] = PyArrayScalar_VAL(element.ptr(), Int64);
-
-    //                     __DC(i << " a " << element);
-    //                     __DC(i << " a " << element.ptr()->ob_type->tp_name)
-    //                     __DC(i << " d " <<  PyArrayScalar_VAL(element.ptr(), Int64));
-
-                    }
-                    return;
-            } else {
-                    __DC("fixme: type=" << PyArray_TYPE(arr))
-            }
+            if (wrapNumpy(arr, NPY_DOUBLE, *vec)) return;
+            if (fillFromNumpy(arr, *vec)) return;
+            __DC("fixme: type=" << PyArray_TYPE(arr))
         }
 
         // convert from list
         __DC(obj << " ** from sequence ")
-
+        vec->resize(len(py_sequence));
         for (GIMLI::Index i = 0; i < vec->size(); i ++){
             (*vec)[i] = bp::extract< double >(py_sequence[i]);
         }
@@ -337,9 +383,17 @@ struct PySequence2IndexArray{
         storage_t* the_storage = reinterpret_cast<storage_t*>(data);
         void* memory_chunk = the_storage->storage.bytes;
 
-        GIMLI::IndexArray * vec = new (memory_chunk) GIMLI::IndexArray(len(py_sequence));
+        GIMLI::IndexArray * vec = new (memory_chunk) GIMLI::IndexArray();
         data->convertible = memory_chunk;
+
+        if (strcmp(obj->ob_type->tp_name, "numpy.ndarray") == 0){
+            PyArrayObject *arr = (PyArrayObject *)obj;
+            if (wrapNumpy(arr, NPY_UINT64, *vec)) return;
+            if (fillFromNumpy(arr, *vec)) return;
+        }
+
         __DC(obj << "\t from list")
+        vec->resize(len(py_sequence));
         for (GIMLI::Index i = 0; i < vec->size(); i ++){
             (*vec)[i] = bp::extract< GIMLI::Index >(py_sequence[i]);
         }
@@ -365,9 +419,17 @@ struct PySequence2IVector{
         storage_t* the_storage = reinterpret_cast<storage_t*>(data);
         void* memory_chunk = the_storage->storage.bytes;
 
-        GIMLI::IVector * vec = new (memory_chunk) GIMLI::IVector(len(py_sequence));
+        GIMLI::IVector * vec = new (memory_chunk) GIMLI::IVector();
         data->convertible = memory_chunk;
+
+        if (strcmp(obj->ob_type->tp_name, "numpy.ndarray") == 0){
+            PyArrayObject *arr = (PyArrayObject *)obj;
+            if (wrapNumpy(arr, NPY_INT64, *vec)) return;
+            if (fillFromNumpy(arr, *vec)) return;
+        }
+
         __DC(obj << "\t from list")
+        vec->resize(len(py_sequence));
         for (GIMLI::Index i = 0; i < vec->size(); i ++){
            
         #ifdef WIN32
@@ -395,9 +457,17 @@ struct PySequence2BVector{
         storage_t* the_storage = reinterpret_cast<storage_t*>(data);
         void* memory_chunk = the_storage->storage.bytes;
 
-        GIMLI::BVector * vec = new (memory_chunk) GIMLI::BVector(len(py_sequence));
+        GIMLI::BVector * vec = new (memory_chunk) GIMLI::BVector();
         data->convertible = memory_chunk;
+
+        if (strcmp(obj->ob_type->tp_name, "numpy.ndarray") == 0){
+            PyArrayObject *arr = (PyArrayObject *)obj;
+            if (wrapNumpy(arr, NPY_BOOL, *vec)) return;
+            if (fillFromNumpy(arr, *vec)) return;
+        }
+
         __DC(obj << "\t from list")
+        vec->resize(len(py_sequence));
         for (GIMLI::Index i = 0; i < vec->size(); i ++){
             (*vec)[i] = PyArrayScalar_VAL(bp::object(py_sequence[i]).ptr(), Bool);
             
@@ -491,20 +561,25 @@ struct Numpy2RMatrix{
                 __DC("nDim=" << nDim)
                 GIMLI::throwToImplement("Only numpy.ndarray with ndim == 2 can be converted to GIMLI::RMatrix");
             }
-            int rows = PyArray_DIM(arr, 0);
-            int cols = PyArray_DIM(arr, 1);
-            GIMLI::Matrix < double > *mat = new (memory_chunk) GIMLI::Matrix < double >(rows, cols);
+            GIMLI::Index rows = PyArray_DIM(arr, 0);
+            GIMLI::Index cols = PyArray_DIM(arr, 1);
+            GIMLI::Matrix < double > *mat = new (memory_chunk) GIMLI::Matrix < double >();
             data->convertible = memory_chunk;
 
-            if (PyArray_ISONESEGMENT(arr)){
-                double * arrData = (double*)PyArray_DATA(arr);
-                for (GIMLI::Index i = 0; i < mat->rows(); i ++ ){
-                    std::memcpy(&(*mat)[i][0],
-                                arrData + (i * mat->cols()),
-                                mat->cols() * sizeof(double));
+            if (PyArray_ISCARRAY_RO(arr) && PyArray_ISNOTSWAPPED(arr)){
+                // rows refer to the numpy buffer, no copy
+                mat->wrap((double*)PyArray_DATA(arr), rows, cols);
+            } else if (PyArray_ISALIGNED(arr) && PyArray_ISNOTSWAPPED(arr)){
+                mat->resize(rows, cols);
+                const char * arrData = PyArray_BYTES(arr);
+                npy_intp rStride = PyArray_STRIDE(arr, 0);
+                npy_intp cStride = PyArray_STRIDE(arr, 1);
+                for (GIMLI::Index i = 0; i < rows; i ++ ){
+                    copyStrided_< double >(arrData + i * rStride, cStride,
+                                           &(*mat)[i][0], cols);
                 }
             } else {
-                GIMLI::throwToImplement("numpy.ndarray is not one segment .. not yet implemented.");
+                GIMLI::throwToImplement("numpy.ndarray is unaligned or byte swapped .. not yet implemented.");
             }
 
             return;
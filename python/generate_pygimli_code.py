@@ -383,6 +383,7 @@ def generate(defined_symbols, extraIncludes):
                   'cerrPtrObject', 'coutPtr', 'coutPtrObject', 'deletePtr',
                   'edge_',
                   'distancePair_', 'IPCMessage', 'PythonGILSave',
+                  'SparseMatrixCacheLock', 'ProfileZone',
                   ]
             )
 
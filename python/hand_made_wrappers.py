@@ -58,12 +58,77 @@ PyObject * RVector_getArray(GIMLI::RVector & vec){
     return ret;
 }
 
+PyObject * RVector_getView(boost::python::object self){
+    import_array2("Cannot import numpy c-api from pygimli hand_make_wrapper", NULL);
+    GIMLI::RVector & vec = boost::python::extract< GIMLI::RVector & >(self);
+    npy_intp length = (ssize_t)vec.size();
+
+    PyObject * ret = PyArray_SimpleNewFromData(1, &length, NPY_DOUBLE,
+                                               (void *)vec.data());
+    // the numpy array holds a reference to the RVector to keep the memory alive
+    Py_INCREF(self.ptr());
+    PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(ret), self.ptr());
+    return ret;
+}
+
 """
 WRAPPER_REGISTRATION_RVector = [
     """def("getData", &RVector_getData,
                 "PyGIMLI Helper Function: extract an python object from a RVector ");""",
     """def("array", &RVector_getArray,
        "PyGIMLI Helper Function: extract a numpy array object from a RVector ");""",
+    """def("view", &RVector_getView,
+       "PyGIMLI Helper Function: numpy array that shares the memory of the RVector. "
+       "The array keeps the RVector alive but is invalid (dangling) after "
+       "the RVector is resized or reallocated. Use array() for a copy.");""",
+]
+
+WRAPPER_DEFINITION_RMatrix =\
+    """
+#include <numpy/arrayobject.h>
+
+PyObject * RMatrix_getArray(boost::python::object self){
+    import_array2("Cannot import numpy c-api from pygimli hand_make_wrapper", NULL);
+    GIMLI::RMatrix & mat = boost::python::extract< GIMLI::RMatrix & >(self);
+    npy_intp dim2 [] = {(npy_intp)mat.rows(), (npy_intp)mat.cols()};
+
+    PyObject * ret = PyArray_SimpleNew(2, dim2, NPY_DOUBLE);
+    double * arrData = (double *)PyArray_DATA(reinterpret_cast<PyArrayObject*>(ret));
+    for (GIMLI::Index i = 0; i < mat.rows(); i ++){
+        std::memcpy(arrData + i * mat.cols(), (void *)&mat[i][0],
+                    mat.cols() * sizeof(double));
+    }
+    return ret;
+}
+
+PyObject * RMatrix_getView(boost::python::object self){
+    import_array2("Cannot import numpy c-api from pygimli hand_make_wrapper", NULL);
+    GIMLI::RMatrix & mat = boost::python::extract< GIMLI::RMatrix & >(self);
+    npy_intp dim2 [] = {(npy_intp)mat.rows(), (npy_intp)mat.cols()};
+
+    bool contiguous = mat.rows() > 0 && mat.cols() > 0;
+    for (GIMLI::Index i = 1; i < mat.rows() && contiguous; i ++){
+        contiguous = (&mat[i][0] == &mat[i - 1][0] + mat.cols());
+    }
+    if (!contiguous) return RMatrix_getArray(self);
+
+    // e.g., wrapped numpy buffer .. share the memory
+    PyObject * ret = PyArray_SimpleNewFromData(2, dim2, NPY_DOUBLE,
+                                               (void *)&mat[0][0]);
+    // the numpy array holds a reference to the RMatrix to keep the memory alive
+    Py_INCREF(self.ptr());
+    PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(ret), self.ptr());
+    return ret;
+}
+
+"""
+WRAPPER_REGISTRATION_RMatrix = [
+    """def("array", &RMatrix_getArray,
+       "PyGIMLI Helper Function: extract a numpy array object from a RMatrix ");""",
+    """def("view", &RMatrix_getView,
+       "PyGIMLI Helper Function: numpy array that shares the memory of the RMatrix "
+       "if its rows are contiguous, e.g., a wrapped buffer, and a copy otherwise. "
+       "The array keeps the RMatrix alive but is invalid after resizing it.");""",
 ]
 
 WRAPPER_DEFINITION_BVector =\
@@ -220,6 +285,10 @@ def apply(mb):
     rt.add_declaration_code(WRAPPER_DEFINITION_RVector)
     apply_reg(rt, WRAPPER_REGISTRATION_RVector)
 
+    rt = mb.class_('Matrix<double>')
+    rt.add_declaration_code(WRAPPER_DEFINITION_RMatrix)
+    apply_reg(rt, WRAPPER_REGISTRATION_RMatrix)
+
     rt = mb.class_('Vector<bool>')
     rt.add_declaration_code(WRAPPER_DEFINITION_BVector)
     apply_reg(rt, WRAPPER_REGISTRATION_BVector)
@@ -97,6 +97,7 @@ namespace pyplusplus{ namespace aliases{
 #include "datacontainer.h"
 #include "gimli.h"
 #include "gravimetry.h"
+#include "hmatrix.h"
 #include "dc1dmodelling.h"
 #include "elementmatrix.h"
 #include "em1dmodelling.h"
@@ -107,8 +108,10 @@ namespace pyplusplus{ namespace aliases{
 #include "inversion.h"
 #include "ipcClient.h"
 #include "ldlWrapper.h"
+#include "ldltWrapper.h"
 #include "line.h"
 #include "linSolver.h"
+#include "mappedmatrix.h"
 #include "matrix.h"
 #include "memwatch.h"
 #include "mesh.h"
@@ -117,10 +120,12 @@ namespace pyplusplus{ namespace aliases{
 #include "modellingbase.h"
 #include "node.h"
 #include "numericbase.h"
+#include "pcgWrapper.h"
 #include "plane.h"
 #include "platform.h"
 #include "pos.h"
 #include "polynomial.h"
+#include "profiler.h"
 #include "quaternion.h"
 #include "regionManager.h"
 #include "shape.h"
@@ -129,6 +134,8 @@ namespace pyplusplus{ namespace aliases{
 #include "sparsematrix.h"
 #include "spline.h"
 #include "stopwatch.h"
+#include "straightraymodelling.h"
+#include "timelapsemodelling.h"
 #include "trans.h"
 #include "triangleWrapper.h"
 #include "ttdijkstramodelling.h"
@@ -303,6 +310,7 @@ DEFINE_XVECTOR_STUFF__(RVector) //RVector last since auto rhs conversion will fa
     template Pos< double > & Pos< double >::transform(const Matrix < double > & mat);
 
     template class SparseMatrix< double >;
+    template class SparseAssembler< double >;
     template class SparseMatrix< GIMLI::Complex >;
 
     template RSparseMatrix operator + (const RSparseMatrix & A, const RSparseMatrix & B);
@@ -550,6 +558,7 @@ namespace pyplusplus{ namespace aliases{
     typedef GIMLI::Singleton< GIMLI::ShapeFunctionCache >   SingletonShapeFunction;
     typedef GIMLI::Singleton< GIMLI::IntegrationRules >     SingletonIntegrationsRules;
     typedef GIMLI::Singleton< GIMLI::MemWatch >             SingletonMemWatch;
+    typedef GIMLI::Singleton< GIMLI::Profiler >             SingletonProfiler;
     typedef GIMLI::Function< double, double >               FunctionDD;
 //     typedef GIMLI::Variable< GIMLI::XAxis >                 VariableXAxis;
 //     typedef GIMLI::Variable< GIMLI::YAxis >                 VariableYAxis;
@@ -760,9 +760,23 @@ def __RVectorArrayCall__(self, dtype=None):
     return self.array()
 
 
+# converter from RVector to numpy array, copies by default since a shared
+# view dangles after the RVector is resized. Only np.asarray(v, copy=False)
+# or v.view() share the memory, the view keeps v alive.
+def __RVectorViewCall__(self, dtype=None, copy=None):
+    if copy is False:
+        a = self.view()
+    else:
+        a = self.array()
+    if dtype is not None:
+        return a.astype(dtype, copy=False)
+    return a
+
+
 # default converter from RVector to numpy array
 
-_pygimli_.RVector.__array__ = __RVectorArrayCall__
+_pygimli_.RVector.__array__ = __RVectorViewCall__
+_pygimli_.RMatrix.__array__ = __RVectorArrayCall__
 # not yet ready handmade_wrappers.py
 _pygimli_.BVector.__array__ = __RVectorArrayCall__
 # not yet ready handmade_wrappers.py
@@ -84,6 +84,11 @@ class TestRVectorMethods(unittest.TestCase):
         self.assertEqual(a.size(), len(x))
         self.assertEqual(pg.sum(a), sum(x))
 
+        # negative values would wrap around
+        x = np.array([0, -1], dtype=np.int64)
+        with self.assertRaises(Exception):
+            pg.IndexArray(x)
+
     def test_NumpyToIVector(self):
         """Implemented in custom_rvalue.cpp."""
         x = np.array(range(-10, 10))
@@ -201,6 +206,14 @@ class TestRVectorMethods(unittest.TestCase):
         self.assertEqual(type(a), np.ndarray)
         self.assertEqual(len(a), 10)
 
+        # asarray copies, the view shares the memory
+        a = np.asarray(v)
+        a[0] = 2.2
+        self.assertEqual(v[0], 1.1)
+        a = v.view()
+        a[0] = 2.2
+        self.assertEqual(v[0], 2.2)
+
     def test_BVectorToNumpy(self):
         """Implemented through hand_made_wrapper.py"""
         # check ob wirklich from array genommen wird!
@@ -20,6 +20,7 @@
 #define _GIMLI_BASEENTITY__H
 
 #include "gimli.h"
+#include "memwatch.h"
 
 namespace GIMLI{
 
@@ -46,6 +47,13 @@ class DLLEXPORT BaseEntity{
 
     virtual ~BaseEntity(){}
 
+    /*! Nodes, cells and boundaries are accounted as \ref MEMORY_MESH.
+     * Both are defined out of line, so the compiler always sees them as
+     * pair and not the global delete against this new. */
+    static void * operator new(std::size_t size);
+
+    static void operator delete(void * p, std::size_t size);
+
     /*! Return entity rtti value. */
     inline virtual uint rtti() const { return MESH_BASEENTITY_RTTI; }
 
@@ -20,6 +20,7 @@
 
 #include <calculateMultiThread.h>
 #include <elementmatrix.h>
+#include <mappedmatrix.h>
 #include <memwatch.h>
 #include <meshentities.h>
 #include <shape.h>
@@ -54,6 +55,15 @@ public:
     weights_(&weights), k_(&k), calc1_(calc1){
         nData_ = data.size();
         nElecs_ = data.sensorCount();
+        dataStart_ = 0;
+        dataEnd_ = nData_;
+    }
+
+    /*! Calculate the data start to end only, they are written into the
+     * rows 0 to end - start of S. */
+    void setDataRange(Index start, Index end){
+        dataStart_ = start;
+        dataEnd_ = end;
     }
 
     virtual ~CreateSensitivityColMT(){}
@@ -104,7 +114,7 @@ public:
                 S_i *= (*k_)[kIdx] * (*k_)[kIdx];
                 S_i += S1_i;
                 int a = 0, b = 0, m = 0, n = 0;
-                for (Index dataIdx = 0; dataIdx < nData_; dataIdx ++ ){
+                for (Index dataIdx = dataStart_; dataIdx < dataEnd_; dataIdx ++ ){
 
                     a = (int)(*da)[dataIdx];
                     b = (int)(*db)[dataIdx];
@@ -116,7 +126,7 @@ public:
                     if (m > -1) vm = &(*pots_)[m + nElecs_ * kIdx]; else vm = &dummy;
                     if (n > -1) vn = &(*pots_)[n + nElecs_ * kIdx]; else vn = &dummy;
 
-                    (*S_)[dataIdx][modelIdx] += S_i.mult((*va), (*vb), (*vm), (*vn)) * (*weights_)[kIdx];
+                    (*S_)[dataIdx - dataStart_][modelIdx] += S_i.mult((*va), (*vb), (*vm), (*vn)) * (*weights_)[kIdx];
                 }
             }
         }
@@ -174,7 +184,7 @@ public:
             //** we integrate from 0 to \infty but need we need from -\infty to \infty
             if (weights_->size() > 1) weightsFactor = 2.0;
 
-            for (Index dataIdx = 0; dataIdx < nData_; dataIdx ++ ){
+            for (Index dataIdx = dataStart_; dataIdx < dataEnd_; dataIdx ++ ){
 
                 if (haveCurrentPatterns){
                     a = currPatternIdx_->find(data_->electrodeToCurrentPattern(a, b))->second;
@@ -196,7 +206,7 @@ public:
                     if (m > -1) vm = &(*pots_)[m + nElecs_ * kIdx]; else vm = &dummy;
                     if (n > -1) vn = &(*pots_)[n + nElecs_ * kIdx]; else vn = &dummy;
 
-                    (*S_)[dataIdx][modelIdx] += S_i.mult((*va), (*vb), (*vm), (*vn)) * (weightsFactor * (*weights_)[kIdx]);
+                    (*S_)[dataIdx - dataStart_][modelIdx] += S_i.mult((*va), (*vb), (*vm), (*vn)) * (weightsFactor * (*weights_)[kIdx]);
                     continue;
 //                     std::cout << cell->id() << std::endl;
                     for (Index i = 0; i < cellNodeCount; i ++){
@@ -240,7 +250,7 @@ public:
 //                   boost::mutex::scoped_lock lock(eraseMutex__); // slows down alot
 //                   #endif
 
-                        (*S_)[dataIdx][modelIdx] += sum * (weightsFactor * (*weights_)[kIdx]);
+                        (*S_)[dataIdx - dataStart_][modelIdx] += sum * (weightsFactor * (*weights_)[kIdx]);
 //                         std::cout << "b: " << dataIdx<<" "<<modelIdx<<" "<<(*S_)[dataIdx][modelIdx]<< " "
 //                         << sum * (weightsFactor * (*weights_)[kIdx]) << std::endl;
                     }
@@ -260,6 +270,8 @@ protected:
     const RVector                   * weights_;
     const RVector                   * k_;
     uint                            nData_;
+    Index                           dataStart_;
+    Index                           dataEnd_;
     uint                            nElecs_;
     bool                            calc1_;
 
@@ -442,6 +454,68 @@ void createSensitivityCol(CMatrix & S,
 }
 
 
+void createSensitivityCol(MappedMatrix & S,
+                          const Mesh & mesh,
+                          const DataContainerERT & data,
+                          const RMatrix & pots,
+                          const RVector & weights,
+                          const RVector & k,
+                          uint nThreads, bool verbose){
+
+    Index nData  = data.size();
+    Index nModel = max(mesh.cellMarkers()) + 1;
+    Index maxRows = weights.size() * data.sensorCount();
+
+    if (pots.rows() < maxRows){
+        throwLengthError(EXIT_MATRIX_SIZE_INVALID, WHERE_AM_I +
+                         " potential matrix rowsize to small." +
+                         str(pots.rows()) + " < " + str(maxRows));
+    }
+    if (S.rows() != nData || S.cols() != nModel) S.resize(nData, nModel);
+
+    Stopwatch swatch(true);
+    std::map< long, uint > currPatternIdx;
+
+    std::vector< Cell * > cells(mesh.findCellByMarker(0, -1));
+    std::sort(cells.begin(), cells.end(), lessCellMarker);
+
+    //** avoid MT problems
+    for (std::vector< Cell * >::iterator it = cells.begin();
+         it != cells.end(); it ++){
+        (*it)->pShape()->invJacobian();
+    }
+
+    //** the rows of one block are calculated in memory
+    double maxMemSize = getEnvironment("SENSMATMAXMEM", 0.0, verbose);
+    if (maxMemSize <= 0.0) maxMemSize = 1024.0;
+    Index blockRows = Index(maxMemSize * 1024.0 * 1024.0 / (nModel * sizeof(double)));
+    blockRows = std::max(Index(1), std::min(blockRows, nData));
+
+    if (verbose){
+        std::cout << "S(" << nData << "x" << nModel << ") -> " << S.fileName()
+                  << " in blocks of " << blockRows << " rows" << std::endl;
+    }
+
+    bool calc1 = getEnvironment("SENSMAT1", false, verbose);
+    RMatrix block;
+    for (Index start = 0; start < nData; start += blockRows){
+        Index end = std::min(nData, start + blockRows);
+        if (block.rows() != end - start) block.resize(end - start, nModel);
+        block *= 0.0;
+
+        CreateSensitivityColMT< double > calc(block, cells, data, pots,
+                                              currPatternIdx, weights, k,
+                                              calc1, false);
+        calc.setDataRange(start, end);
+        distributeCalc(calc, cells.size(), nThreads, false);
+
+        S.setRows(start, block);
+    }
+    S.flush();
+
+    if (verbose) swatch.stop(verbose);
+}
+
 void sensitivityDCFEMSingle(const std::vector < Cell * > & para, const RVector & p1, const RVector & p2,
 		       RVector & sens, bool verbose){
     uint nCells = para.size();
@@ -49,6 +49,17 @@ DLLEXPORT void createSensitivityCol(RMatrix & S,
                                     std::vector < std::pair < Index, Index > > & matrixClusterIds,
                                     uint nThreads, bool verbose);
 
+/*! Out-of-core variant, the data are calculated in blocks of rows that
+ * are written into the memory-mapped S. The block size is given in MB by
+ * the environment variable SENSMATMAXMEM (default 1024). */
+DLLEXPORT void createSensitivityCol(MappedMatrix & S,
+                                    const Mesh & mesh,
+                                    const DataContainerERT & data,
+                                    const RMatrix & pots,
+                                    const RVector & weights,
+                                    const RVector & k,
+                                    uint nThreads, bool verbose);
+
 DLLEXPORT void createSensitivityCol(CMatrix & S,
                                     const Mesh & mesh,
                                     const DataContainerERT & data,
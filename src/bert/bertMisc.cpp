@@ -21,6 +21,8 @@
 #include "bertDataContainer.h"
 #include "electrode.h"
 
+#include <calculateMultiThread.h>
+#include <matrix.h>
 #include <mesh.h>
 #include <node.h>
 #include <numericbase.h>
@@ -251,6 +253,127 @@ RVector exactDCSolution(const Mesh & mesh, const ElectrodeShape * elec,
     return solution;
 }
 
+//! Analytical solution for a list of sources at the nodes start_ to end_.
+class ExactDCSolutionMT : public BaseCalcMT{
+public:
+    ExactDCSolutionMT(RMatrix & pots, const RVector & px, const RVector & py,
+                      const RVector & pz, const std::vector < RVector3 > & src,
+                      double k, double surfaceZ, bool verbose=false)
+    : BaseCalcMT(verbose), pots_(&pots), px_(&px), py_(&py), pz_(&pz),
+      src_(&src), k_(k), surfaceZ_(surfaceZ){
+    }
+
+    virtual ~ExactDCSolutionMT(){}
+
+    virtual void calc(Index tNr=0){
+        //** node blocks of 256 keep the coordinates in L1 for all sources
+        Index end = std::min(end_, px_->size());
+        for (Index nStart = start_; nStart < end; nStart += 256){
+            Index nEnd = std::min(end, nStart + 256);
+            for (Index e = 0; e < src_->size(); e ++){
+                calcBlock_((*pots_)[e], (*src_)[e], nStart, nEnd);
+            }
+        }
+    }
+
+protected:
+    /*! Same cases and operations as exactDCSolution(pot, src, k, surfaceZ, 0.0),
+     * so the values are identical. */
+    void calcBlock_(RVector & pot, const RVector3 & source, Index start, Index end){
+        const double * x = &(*px_)[0];
+        const double * y = &(*py_)[0];
+        const double * z = &(*pz_)[0];
+        double * u = &pot[0];
+        double sx = source[0], sy = source[1], sz = source[2];
+
+        uint dim = 3;
+        if (k_ > 0) dim = 2;
+        RVector3 sourceMirror(source);
+        sourceMirror[dim - 1] = 2.0 * surfaceZ_ - source[dim - 1];
+        double mx = sourceMirror[0], my = sourceMirror[1], mz = sourceMirror[2];
+        bool fullSpace = (surfaceZ_ == -MAX_DOUBLE || std::isnan(surfaceZ_));
+
+        if (k_ == 0.0){
+            if (fullSpace){
+                for (Index i = start; i < end; i ++){
+                    double r = std::sqrt((x[i] - sx) * (x[i] - sx) +
+                                         (y[i] - sy) * (y[i] - sy) +
+                                         (z[i] - sz) * (z[i] - sz));
+                    u[i] = r < TOLERANCE ? 0.0 : 1.0 / (4.0 * PI * r);
+                }
+            } else {
+                for (Index i = start; i < end; i ++){
+                    double r = std::sqrt((x[i] - sx) * (x[i] - sx) +
+                                         (y[i] - sy) * (y[i] - sy) +
+                                         (z[i] - sz) * (z[i] - sz));
+                    double rm = std::sqrt((x[i] - mx) * (x[i] - mx) +
+                                          (y[i] - my) * (y[i] - my) +
+                                          (z[i] - mz) * (z[i] - mz));
+                    u[i] = r < TOLERANCE ? 0.0 : (1.0 / r + 1.0 / rm) / (4.0 * PI);
+                }
+            }
+        } else {
+            bool flatEarth = (source == sourceMirror);
+            for (Index i = start; i < end; i ++){
+                double r = std::sqrt((x[i] - sx) * (x[i] - sx) +
+                                     (y[i] - sy) * (y[i] - sy) +
+                                     (z[i] - sz) * (z[i] - sz));
+                if (r < TOLERANCE){
+                    u[i] = 0.0;
+                } else if (fullSpace){
+                    u[i] = besselK0(r * k_) / (2.0 * PI);
+                } else if (flatEarth){
+                    u[i] = besselK0(r * k_) / PI;
+                } else {
+                    double rm = std::sqrt((x[i] - mx) * (x[i] - mx) +
+                                          (y[i] - my) * (y[i] - my) +
+                                          (z[i] - mz) * (z[i] - mz));
+                    u[i] = (besselK0(r * k_) + besselK0(rm * k_)) / (2.0 * PI);
+                }
+            }
+        }
+    }
+
+    RMatrix * pots_;
+    const RVector * px_;
+    const RVector * py_;
+    const RVector * pz_;
+    const std::vector < RVector3 > * src_;
+    double k_;
+    double surfaceZ_;
+};
+
+void exactDCSolution(RMatrix & pots, const Mesh & mesh,
+                     const std::vector < ElectrodeShape * > & elecs,
+                     double k, double surfaceZ, bool setSingValue,
+                     Index nThreads){
+    Index nNodes = mesh.nodeCount();
+    pots.resize(elecs.size(), nNodes);
+    if (elecs.empty() || nNodes == 0) return;
+
+    RVector px(nNodes), py(nNodes), pz(nNodes);
+    for (Index i = 0; i < nNodes; i ++){
+        const RVector3 & p = mesh.node(i).pos();
+        px[i] = p[0]; py[i] = p[1]; pz[i] = p[2];
+    }
+    std::vector < RVector3 > src(elecs.size());
+    for (Index i = 0; i < elecs.size(); i ++) src[i] = elecs[i]->pos();
+
+    if (nThreads == 0) nThreads = threadCount();
+    Index nBlocks = (nNodes + 255) / 256;
+    nThreads = std::max(Index(1), std::min(nThreads, nBlocks));
+    Index blockSize = (nBlocks + nThreads - 1) / nThreads * 256;
+
+    //** ranges of whole blocks, so the threads do not share cache lines
+    distributeCalc(ExactDCSolutionMT(pots, px, py, pz, src, k, surfaceZ),
+                   blockSize * nThreads, nThreads);
+
+    if (setSingValue){
+        for (Index i = 0; i < elecs.size(); i ++) elecs[i]->setSingValue(pots[i], 0.0, k);
+    }
+    pots.rowFlag().fill(1);
+}
+
 RVector exactDCSolution(const Mesh & mesh, int aID, int bID,
                         double k, double surfaceZ){
     RVector solution(exactDCSolution(mesh, aID, k, surfaceZ));
@@ -44,6 +44,17 @@ DLLEXPORT RVector exactDCSolution(const Mesh & mesh,
                                   double k, double surfaceZ=0.0,
                                   bool setSingValue=true);
 
+/*! Calculate the analytical solution for all electrodes at once. Row i of
+ * pots is the solution for elecs[i] at all mesh nodes, see
+ * \ref exactDCSolution(const Mesh & mesh, const ElectrodeShape * elec, double k,
+ * double surfaceZ, bool setSingValue). The nodes are distributed in blocks
+ * over nThreads threads (0 for \ref threadCount) and each block is
+ * calculated for all electrodes while its coordinates are in cache. */
+DLLEXPORT void exactDCSolution(RMatrix & pots, const Mesh & mesh,
+                               const std::vector < ElectrodeShape * > & elecs,
+                               double k, double surfaceZ=0.0,
+                               bool setSingValue=true, Index nThreads=0);
+
 DLLEXPORT RVector exactDCSolution(const Mesh & mesh, int aID, int bID, double k,
                                   double surfaceZ=0.0);
 DLLEXPORT RVector exactDCSolution(const Mesh & mesh, int aID, double k=0.0,
@@ -23,16 +23,20 @@
 #include "datamap.h"
 #include "electrode.h"
 
+#include <calculateMultiThread.h>
 #include <datacontainer.h>
 #include <elementmatrix.h>
 #include <expressions.h>
 
 #include <interpolate.h>
+#include <kdtreeWrapper.h>
 #include <linSolver.h>
+#include <mappedmatrix.h>
 #include <matrix.h>
 #include <memwatch.h>
 #include <mesh.h>
 #include <numericbase.h>
+#include <profiler.h>
 
 #include <regionManager.h>
 #include <shape.h>
@@ -162,6 +166,7 @@ template < class ValueType >
 void dcfemDomainAssembleStiffnessMatrix(SparseMatrix < ValueType > & S, const Mesh & mesh,
                                         const Vector < ValueType > & atts,
                                         double k, bool fix){
+    GIMLI_PROFILE("dcfemDomainAssembleStiffnessMatrix");
     S.clean();
     uint countRho0 = 0, countforcedHomDirichlet = 0;
 
@@ -245,6 +250,7 @@ void dcfemBoundaryAssembleStiffnessMatrix(SparseMatrix < ValueType > & S,
                                           const Vector < ValueType > & atts,
                                           const RVector3 & source,
                                           double k){
+    GIMLI_PROFILE("dcfemBoundaryAssembleStiffnessMatrix");
     ElementMatrix < double > Se;
     std::set < Node * > homDirNodes;
     for (Index i = 0, imax = mesh.boundaryCount(); i < imax; i++){
@@ -539,6 +545,7 @@ DCMultiElectrodeModelling::~DCMultiElectrodeModelling(){
     if (primDataMap_) delete primDataMap_;
 
     for_each(electrodes_.begin(), electrodes_.end(), deletePtr());
+    freeFactorizations_();
 }
 
 void DCMultiElectrodeModelling::init_(){
@@ -562,6 +569,8 @@ void DCMultiElectrodeModelling::init_(){
 
     byPassFile_ = "bypass.map";
 
+    factorReuse_ = 0.0;
+    solverType_ = AUTOMATIC;
 
     Index nThreads = getEnvironment("BERTTHREADS", 0, verbose_);
     nThreads = getEnvironment("BERT_NUM_THREADS", 0, verbose_);
@@ -587,6 +596,69 @@ DataContainerERT & DCMultiElectrodeModelling::dataContainer() const{
 void DCMultiElectrodeModelling::deleteMeshDependency_(){
     for_each(electrodes_.begin(), electrodes_.end(), deletePtr()); electrodes_.clear();
     electrodeRef_        = NULL;
+    freeFactorizations_();
+}
+
+void DCMultiElectrodeModelling::setFactorizationReuse(double threshold){
+    factorReuse_ = threshold;
+    freeFactorizations_();
+}
+
+void DCMultiElectrodeModelling::setSolverType(SolverType solverType){
+    solverType_ = solverType;
+    freeFactorizations_();
+}
+
+Index DCMultiElectrodeModelling::factorizationReuseCount() const {
+    Index count = 0;
+    for (Index i = 0; i < kReuseCount_.size(); i ++) count += kReuseCount_[i];
+    return count;
+}
+
+Index DCMultiElectrodeModelling::factorizationCount() const {
+    Index count = 0;
+    for (Index i = 0; i < kFactorCount_.size(); i ++) count += kFactorCount_[i];
+    return count;
+}
+
+void DCMultiElectrodeModelling::freeFactorizations_(){
+    for_each(kSolver_.begin(), kSolver_.end(), deletePtr());
+    for_each(kMatrix_.begin(), kMatrix_.end(), deletePtr());
+    kSolver_.clear();
+    kMatrix_.clear();
+    kModel_.clear();
+    kReuseCount_.clear();
+    kFactorCount_.clear();
+}
+
+LinSolver * DCMultiElectrodeModelling::cachedSolver_(RSparseMatrix & S,
+                                                     Index kIdx, bool & refine){
+    refine = false;
+    if (factorReuse_ <= 0.0 || kIdx >= kSolver_.size()) return NULL;
+
+    RVector rho(mesh_->cellAttributes());
+
+    if (kSolver_[kIdx] && kMatrix_[kIdx]->rows() == S.rows() &&
+        kMatrix_[kIdx]->nVals() == S.nVals() && kModel_[kIdx].size() == rho.size()){
+        //** iterative refinement converges with max(|sigma/sigma_0 - 1|)
+        if (max(abs(kModel_[kIdx] / rho - 1.0)) < factorReuse_){
+            refine = true;
+            kReuseCount_[kIdx] ++;
+            return kSolver_[kIdx];
+        }
+        *kMatrix_[kIdx] = S;
+        kSolver_[kIdx]->refactorize(*kMatrix_[kIdx], 1);
+    } else {
+        if (kSolver_[kIdx]) delete kSolver_[kIdx];
+        if (kMatrix_[kIdx]) delete kMatrix_[kIdx];
+        kMatrix_[kIdx] = new RSparseMatrix(S);
+        kSolver_[kIdx] = new LinSolver(verbose_);
+        kSolver_[kIdx]->setSolverType(solverType_);
+        kSolver_[kIdx]->setMatrix(*kMatrix_[kIdx], 1);
+    }
+    kModel_[kIdx] = rho;
+    kFactorCount_[kIdx] ++;
+    return kSolver_[kIdx];
 }
 
 void DCMultiElectrodeModelling::assembleStiffnessMatrixDCFEMByPass(RSparseMatrix & S){
@@ -871,6 +943,17 @@ void DCMultiElectrodeModelling::searchElectrodes_(){
             }
         }
 
+        //!!** search the node-electrodes close to all sensor positions at once
+        std::vector < Node * > sourceNodes;
+        for (Index i = 0; i < sourceIdx.size(); i ++) {
+            sourceNodes.push_back(&mesh_->node(sourceIdx[i]));
+        }
+        KDTreeWrapper sourceTree;
+        sourceTree.build(sourceNodes);
+        std::vector < std::vector < Node * > > sourceCandidates(
+                                            sourceTree.radius(ePos, 0.01)); //CR 1cm?? really??
+        std::set < Index > sourceUsed;
+
         for (uint i = 0; i < ePos.size(); i ++){
             bool match = false;
             //** match the known CEM-electrodes
@@ -912,21 +995,23 @@ void DCMultiElectrodeModelling::searchElectrodes_(){
 
             //** match the known node-electrodes
             if (!match){
-                for (std::vector< Index >::iterator it = sourceIdx.begin(); it != sourceIdx.end(); it ++){
-//                     std::cout << ePos[i] << " " << mesh_->node(*it).pos() <<
-//                             " " << ePos[i].dist(mesh_->node(*it).pos()) << std::endl;
-                    if (ePos[i].dist(mesh_->node(*it).pos()) < 0.01){ //CR 1cm?? really??
-                        electrodes_.push_back(new ElectrodeShapeNode(mesh_->node(*it)));
-                        electrodes_.back()->setId(i);
-                        sourceIdx.erase(it);
-                        nodeECounter++;
-                        match = true;
-                        break;
+                Node * node = NULL;
+                for (Index j = 0; j < sourceCandidates[i].size(); j ++){
+                    Node * n = sourceCandidates[i][j];
+                    if (sourceUsed.count(n->id())) continue;
+                    if (!node || ePos[i].dist(n->pos()) < ePos[i].dist(node->pos())){
+                        node = n;
                     }
                 }
+                if (node){
+                    electrodes_.push_back(new ElectrodeShapeNode(*node));
+                    electrodes_.back()->setId(i);
+                    sourceUsed.insert(node->id());
+                    nodeECounter++;
+                    match = true;
+                }
             }
 
-
             //** fill the missing with node independent electrodes
             if (!match){
                 Cell * cell = mesh_->findCell(ePos[i]);
@@ -1416,7 +1501,28 @@ void DCMultiElectrodeModelling::createJacobian_(const CVector & model,
                          matrixClusterIds, this->nThreads_, this->verbose_);
 }
 
+void DCMultiElectrodeModelling::createJacobian_(const RVector & model,
+                                                const RMatrix & u, MappedMatrix * J){
+    createSensitivityCol(*J, *mesh_, this->dataContainer(), u, weights_, kValues_,
+                         nThreads_, verbose_);
+
+    if (model.size() == J->cols()){
+        J->scale(dataContainer_->get("k"), 1.0 / (model * model));
+    }
+}
+
+void DCMultiElectrodeModelling::setJacobianFile(const std::string & fileName){
+    if (fileName != jacobianFile_ && dynamic_cast< MappedMatrix * >(jacobian_)){
+        delete jacobian_;
+        jacobian_ = new RMatrix();
+        JIsRMatrix_ = true;
+    }
+    jacobianFile_ = fileName;
+}
+
 void DCMultiElectrodeModelling::createJacobian(const RVector & model){
+    GIMLI_PROFILE("DCMultiElectrodeModelling::createJacobian");
+    MemoryScope memoryScope(MEMORY_JACOBIAN);
     if (complex_){
 
         CMatrix * u = prepareJacobianT_(toComplex(model(0, model.size()/2),
@@ -1427,6 +1533,19 @@ void DCMultiElectrodeModelling::createJacobian(const RVector & model){
 
     } else {
         RMatrix * u = prepareJacobianT_(model);
+
+        if (!jacobianFile_.empty()){
+            MappedMatrix * J = dynamic_cast< MappedMatrix * >(jacobian_);
+            if (!J){
+                delete jacobian_;
+                J = new MappedMatrix(jacobianFile_, 0, 0, verbose_);
+                jacobian_ = J;
+                JIsRMatrix_ = false;
+            }
+            createJacobian_(model, *u, J);
+            return;
+        }
+
         if (!JIsRMatrix_){
             delete jacobian_;
             jacobian_ = new RMatrix();
@@ -1614,9 +1733,13 @@ class CalculateMT{
     CalculateMT(DCMultiElectrodeModelling * fop, const std::vector < ElectrodeShape * > & eA,
                  const std::vector < ElectrodeShape * > & eB,
                  uint kIdx, RMatrix & mat)
-    : fop_(fop), eA_(&eA), eB_(&eB), kIdx_(kIdx), mat_(& mat) {
+    : fop_(fop), eA_(&eA), eB_(&eB), kIdx_(kIdx), mat_(& mat),
+      memoryTag_(memoryTag()) {
     }
     void operator()(){
+        //** the wavenumbers are already distributed, no nested threads
+        insideCalcMT() = true;
+        MemoryScope memoryScope(memoryTag_);
         fop_->calculateK(*eA_, *eB_, *mat_, kIdx_);
     }
 
@@ -1626,10 +1749,12 @@ class CalculateMT{
     const std::vector < ElectrodeShape * > * eB_;
     uint kIdx_;
     RMatrix * mat_;
+    MemoryTag memoryTag_;
 };
 
 void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * > & eA,
                                           const std::vector < ElectrodeShape * > & eB){
+    MemoryScope memoryScope(MEMORY_POTENTIALS);
 
     if (!subSolutions_) {
         subpotOwner_ = true;
@@ -1657,6 +1782,15 @@ void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * >
 
     preCalculate(eA, eB);
 
+    if (factorReuse_ > 0.0 && !complex_ && kSolver_.size() != kValues_.size()){
+        freeFactorizations_();
+        kSolver_.resize(kValues_.size(), NULL);
+        kMatrix_.resize(kValues_.size(), NULL);
+        kModel_.resize(kValues_.size());
+        kReuseCount_.resize(kValues_.size(), 0);
+        kFactorCount_.resize(kValues_.size(), 0);
+    }
+
 #ifdef HAVE_LIBBOOST_THREAD
     uint kIdx = 0;
     while (kIdx < kValues_.size()){
@@ -1730,10 +1864,32 @@ void DCMultiElectrodeModelling::calculateKAnalyt(const std::vector < ElectrodeSh
     }
 }
 
+/*! Correct sol for S * sol = rhs, with solver holding the factorization
+ * of a similar matrix. */
+template < class ValueType >
+void iterativeRefinement(const SparseMatrix < ValueType > & S, LinSolver & solver,
+                         const Vector < ValueType > & rhs, Vector < ValueType > & sol,
+                         double tol=1e-10, Index maxIter=100){
+    double normB = norml2(rhs);
+    Vector < ValueType > dx(sol.size());
+    for (Index i = 0; i < maxIter; i ++){
+        Vector < ValueType > r(rhs - S * sol);
+        if (norml2(r) <= tol * normB) return;
+        solver.solve(r, dx);
+        sol += dx;
+    }
+    double res = norml2(rhs - S * sol);
+    if (res > tol * normB){
+        log(Warning, "iterative refinement stopped after " + str(maxIter) +
+            " iterations with relative residual " + str(res / normB));
+    }
+}
+
 template < class ValueType >
 void DCMultiElectrodeModelling::calculateK_(const std::vector < ElectrodeShape * > & eA,
                                             const std::vector < ElectrodeShape * > & eB,
                                             Matrix < ValueType > & solutionK, int kIdx){
+    GIMLI_PROFILE("DCMultiElectrodeModelling::calculateK");
     bool debug = false;
     Stopwatch swatch(true);
 
@@ -1817,12 +1973,17 @@ MEMINFO
 
     //** START solving
 
-    LinSolver solver(verbose_);
-    //solver.setSolverType(LDL);
+    LinSolver tmpSolver(verbose_);
+    tmpSolver.setSolverType(solverType_);
     //    std::cout << "solver: " << solver.solverName() << std::endl;
 
-    if (verbose_) std::cout << "Factorize (" << solver.solverName() << ") matrix ... ";
-    solver.setMatrix(S_, 1);
+    bool refine = false;
+    LinSolver * cached = cachedSolver_(S_, kIdx, refine);
+    LinSolver & solver = cached ? *cached : tmpSolver;
+    if (!cached){
+        if (verbose_) std::cout << "Factorize (" << solver.solverName() << ") matrix ... ";
+        solver.setMatrix(S_, 1);
+    }
 
 MEMINFO
 
@@ -1838,7 +1999,14 @@ MEMINFO
         if (eB[i]) eB[i]->assembleRHS(rTmp, -1.0, oldMatSize);
         Vector < ValueType >rhs(rTmp);
 
+        //** warm start the iterative solver with the last solution of this
+        //** source and wavenumber, i.e., the one of the previous model
+        if (solver.solverType() == PCG){
+            sol.fill(ValueType(0.0));
+            sol.setVal(solutionK[i + kIdx * nCurrentPattern], 0, oldMatSize);
+        }
         solver.solve(rhs, sol);
+        if (refine) iterativeRefinement(S_, solver, rhs, sol);
 
 //         if (i==4){
 //             S_.save("S-gimli.matrix");
@@ -2052,15 +2220,13 @@ MEMINFO
                 //!** primary potential vector is unknown
 
                 if (primPotFileBody_.find(NOT_DEFINED) != std::string::npos){
-                //!** primary potential file body is NOT_DEFINED so we try to determine ourself
+                //!** primary potential file body is NOT_DEFINED so we calculate
+                //!** them analytically on demand, see analyticalPrimpotentials_
                     if (initVerbose){
                         std::cout << std::endl << " No primary potential for secondary field calculation. Calculating analytically..." << std::endl;
                         initVerbose = false;
                     }
-                    // PLS CHECK some redundancy here see DCMultiElectrodeModelling::calculateKAnalyt
-                    if (eA[i]) (*primPot_)[potID]  = exactDCSolution(*mesh_, eA[i], k, surfaceZ_, setSingValue_);
-                    if (eB[i]) (*primPot_)[potID] -= exactDCSolution(*mesh_, eB[i], k, surfaceZ_, setSingValue_);
-
+                    continue;
                 } else {
                     if (initVerbose){
                         std::cout << std::endl << " No primary potential for secondary field calculation. Loading potentials." << std::endl;
@@ -2097,10 +2263,90 @@ MEMINFO
 //     exit(0);
 }
 
+static void hashBytes__(uint64 & hash, const void * data, Index size){
+    //** FNV-1a
+    const unsigned char * p = (const unsigned char *)data;
+    for (Index i = 0; i < size; i ++){
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+void DCSRMultiElectrodeModelling::analyticalPrimpotentials_(const std::vector < ElectrodeShape * > & eA,
+                                                            const std::vector < ElectrodeShape * > & eB,
+                                                            Index kIdx){
+    Index nCurrentPattern = eA.size();
+    Index start = kIdx * nCurrentPattern;
+    bool missing = false;
+    for (Index i = 0; i < nCurrentPattern; i ++){
+        if (primPot_->rowFlag()[start + i] == 0) missing = true;
+    }
+    if (!missing) return;
+
+    //** every electrode once, a current pattern is the difference of two
+    std::vector < ElectrodeShape * > elecs;
+    std::map < const ElectrodeShape *, Index > elecRow;
+    for (Index i = 0; i < nCurrentPattern; i ++){
+        if (eA[i] && !elecRow.count(eA[i])){
+            elecRow[eA[i]] = elecs.size(); elecs.push_back(eA[i]);
+        }
+        if (eB[i] && !elecRow.count(eB[i])){
+            elecRow[eB[i]] = elecs.size(); elecs.push_back(eB[i]);
+        }
+    }
+
+    double k = kValues_[kIdx];
+    RMatrix pots;
+    std::string cacheName;
+    if (!primPotCache_.empty()){
+        uint64 hash = 14695981039346656037ULL;
+        for (Index i = 0; i < mesh_->nodeCount(); i ++){
+            hashBytes__(hash, &mesh_->node(i).pos()[0], 3 * sizeof(double));
+        }
+        for (Index i = 0; i < elecs.size(); i ++){
+            RVector3 pos(elecs[i]->pos());
+            int id = elecs[i]->id();
+            hashBytes__(hash, &pos[0], 3 * sizeof(double));
+            hashBytes__(hash, &id, sizeof(int));
+        }
+        hashBytes__(hash, &surfaceZ_, sizeof(double));
+        hashBytes__(hash, &setSingValue_, sizeof(bool));
+        if (kValues_.size()) hashBytes__(hash, &kValues_[0], kValues_.size() * sizeof(double));
+
+        std::stringstream key; key << std::hex << hash;
+        cacheName = primPotCache_ + "." + key.str() + "." + str(kIdx) + MATRIXBINSUFFIX;
+        primPotCacheFiles_[kIdx] = cacheName;
+        if (fileExist(cacheName)){
+            loadMatrixSingleBin(pots, cacheName);
+            if (verbose_) std::cout << "Load primary potentials: " << cacheName << std::endl;
+        }
+    }
+
+    if (pots.rows() != elecs.size() || pots.cols() != mesh_->nodeCount()){
+        exactDCSolution(pots, *mesh_, elecs, k, surfaceZ_, setSingValue_,
+                        insideCalcMT() ? 1 : nThreads_);
+        if (!cacheName.empty()) saveMatrix(pots, cacheName);
+    } else {
+        primPotCacheHits_[kIdx] ++;
+    }
+
+    for (Index i = 0; i < nCurrentPattern; i ++){
+        Index potID = start + i;
+        if (primPot_->rowFlag()[potID] != 0) continue;
+        RVector & prim = (*primPot_)[potID];
+        prim *= 0.0;
+        if (eA[i]) prim += pots[elecRow[eA[i]]];
+        if (eB[i]) prim -= pots[elecRow[eB[i]]];
+        primPot_->rowFlag()[potID] = 1;
+    }
+}
+
 void DCSRMultiElectrodeModelling::preCalculate(const std::vector < ElectrodeShape * > & eA,
                                                 const std::vector < ElectrodeShape * > & eB){
     //! check for valid primary potentials, calculate analytical or numerical if nessecary
     checkPrimpotentials_(eA, eB);
+    primPotCacheHits_.resize(kValues_.size(), 0);
+    primPotCacheFiles_.resize(kValues_.size());
     mesh1_ = *mesh_;
     mesh1_.setCellAttributes(1.0);
 MEMINFO
@@ -2127,6 +2373,8 @@ void DCSRMultiElectrodeModelling::calculateK(const std::vector < ElectrodeShape
     }
 MEMINFO
 
+    analyticalPrimpotentials_(eA, eB, kIdx);
+
     RSparseMatrix S_;
     S_.buildSparsityPattern(*mesh_);
     bool singleVerbose = verbose_;
@@ -2152,6 +2400,7 @@ MEMINFO
 
 MEMINFO
     LinSolver solver(false);
+    solver.setSolverType(solverType_);
     solver.setMatrix(S_, 1);
 //     if (verbose_) std::cout << "Factorize (" << solver.solverName() << ") matrix ... " << swatch.duration() << std::endl;
 
@@ -22,6 +22,7 @@
 #include "bert.h"
 #include "datamap.h"
 
+#include <linSolver.h>
 #include <modellingbase.h>
 #include <sparsematrix.h>
 #include <pos.h>
@@ -262,6 +263,42 @@ public:
     /*! Return true if singular value estimation is switched on.*/
     bool isSetSingValue() const { return setSingValue_;}
 
+    /*! Keep the factorized system matrix for each wave number. As long as
+     * the relative change of all cell resistivities to the factorized model
+     * is below threshold, the old factorization is used and the solution
+     * is corrected by iterative refinement. Otherwise the matrix is
+     * factorized again reusing the symbolic analysis, see
+     * \ref LinSolver::refactorize. Useful for time-lapse frames and
+     * small model updates. 0 (default) switches this off. Real valued
+     * calculation only. */
+    void setFactorizationReuse(double threshold);
+
+    /*! Return the threshold for the reuse of the factorization. */
+    double factorizationReuse() const { return factorReuse_; }
+
+    /*! Set the solver type of the system matrix, e.g. LDLT for complex
+     * valued (IP) calculations. AUTOMATIC (default) chooses the best
+     * direct solver installed, see \ref LinSolver::setSolverType. */
+    void setSolverType(SolverType solverType);
+
+    /*! Return the solver type of the system matrix. */
+    SolverType solverType() const { return solverType_; }
+
+    /*! Return how often a factorization was reused and how often the
+     * system matrix was factorized since \ref setFactorizationReuse. */
+    Index factorizationReuseCount() const;
+    Index factorizationCount() const;
+
+    /*! Store the Jacobian out-of-core in the memory-mapped file fileName,
+     * see \ref MappedMatrix. Only a block of rows is held in memory
+     * during the calculation, see \ref createSensitivityCol.
+     * An empty name (default) keeps the Jacobian in memory.
+     * Real valued calculation only. */
+    void setJacobianFile(const std::string & fileName);
+
+    /*! Return the file of the out-of-core Jacobian. */
+    const std::string & jacobianFile() const { return jacobianFile_; }
+
 private:
     void init_();
 
@@ -287,6 +324,7 @@ protected:
 
     void createJacobian_(const RVector & model, const RMatrix & u, RMatrix * J);
     void createJacobian_(const CVector & model, const CMatrix & u, CMatrix * J);
+    void createJacobian_(const RVector & model, const RMatrix & u, MappedMatrix * J);
 
     virtual void deleteMeshDependency_();
     virtual void updateMeshDependency_();
@@ -294,6 +332,16 @@ protected:
 
     virtual void searchElectrodes_();
 
+    void freeFactorizations_();
+
+    /*! Return the cached solver for wave number kIdx, factorized for S if
+     * necessary, or NULL if there is no reuse. refine is set true if the
+     * solver holds the factorization of an older model. */
+    LinSolver * cachedSolver_(RSparseMatrix & S, Index kIdx, bool & refine);
+    LinSolver * cachedSolver_(CSparseMatrix & S, Index kIdx, bool & refine){
+        refine = false; return NULL;
+    }
+
     MatrixBase * subSolutions_;
 
     bool complex_;
@@ -308,6 +356,7 @@ protected:
     bool setSingValue_;
 
     std::string byPassFile_;
+    std::string jacobianFile_;
 
     RVector kValues_;
     RVector weights_;
@@ -333,6 +382,15 @@ protected:
     RVector vContactImpedance_;
 
     DataMap * primDataMap_;
+
+    /*! Factorization reuse, one entry for each wave number */
+    double factorReuse_;
+    SolverType solverType_;
+    std::vector < LinSolver * > kSolver_;
+    std::vector < RSparseMatrix * > kMatrix_;
+    std::vector < RVector > kModel_;
+    std::vector < Index > kReuseCount_;
+    std::vector < Index > kFactorCount_;
 };
 
 class DLLEXPORT DCSRMultiElectrodeModelling : public DCMultiElectrodeModelling {
@@ -367,6 +425,32 @@ public:
 
     inline void setPrimaryPotential(RMatrix & primPot) { primPot_=& primPot; }
 
+    /*! Store the analytical primary potentials of all electrodes in binary
+     * matrix files fileBody.KEY.kIdx.bmat, one file per wavenumber.
+     * KEY is a hash of the mesh nodes, the electrodes, surfaceZ and the
+     * wavenumbers, so the files are only reused for the same setup.
+     * Existing files are loaded when the wavenumber is needed. */
+    inline void setPrimaryPotentialCache(const std::string & fileBody){
+        primPotCache_ = fileBody;
+    }
+
+    /*! Return the file body of the primary potential cache. */
+    inline const std::string & primaryPotentialCache() const { return primPotCache_; }
+
+    /*! Return the cache file of wavenumber kIdx, empty before the first response. */
+    inline std::string primaryPotentialCacheFile(Index kIdx) const {
+        if (kIdx < primPotCacheFiles_.size()) return primPotCacheFiles_[kIdx];
+        return "";
+    }
+
+    /*! Return how often primary potentials of a wavenumber have been
+     * loaded from the cache instead of being calculated. */
+    inline Index primaryPotentialCacheHits() const {
+        Index hits = 0;
+        for (Index i = 0; i < primPotCacheHits_.size(); i ++) hits += primPotCacheHits_[i];
+        return hits;
+    }
+
     inline RMatrix & primaryPotential() { return *primPot_; }
 
     inline void setPrimaryMesh(Mesh & mesh){ primMesh_=&mesh; }
@@ -398,7 +482,18 @@ protected:
     void checkPrimpotentials_(const std::vector < ElectrodeShape * > & eA,
                                const std::vector < ElectrodeShape * > & eB);
 
+    /*! Fill the missing analytical primary potentials of wavenumber kIdx
+     * from the electrode potentials, which are loaded from the cache or
+     * calculated by \ref exactDCSolution for all electrodes at once. */
+    void analyticalPrimpotentials_(const std::vector < ElectrodeShape * > & eA,
+                                   const std::vector < ElectrodeShape * > & eB,
+                                   Index kIdx);
+
     std::string primPotFileBody_;
+    std::string primPotCache_;
+    //** one counter per wavenumber, so the threads of CalculateMT do not share one
+    std::vector < Index > primPotCacheHits_;
+    std::vector < std::string > primPotCacheFiles_;
 
     bool primPotOwner_;
     RMatrix * primPot_;
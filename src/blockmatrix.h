@@ -26,9 +26,30 @@
 #endif
 
 #include "matrix.h"
+#include "calculateMultiThread.h"
 
 namespace GIMLI{
 
+/*! Block products of one thread, see \ref BlockMatrix::mult. */
+template < class ValueType > class BlockMatrixMultMT : public BaseCalcMT{
+public:
+    BlockMatrixMultMT(const BlockMatrix< ValueType > & A,
+                      const Vector < ValueType > & b,
+                      std::vector < Vector < ValueType > * > & bufs, bool trans)
+    : BaseCalcMT(false), A_(&A), b_(&b), bufs_(&bufs), trans_(trans){
+    }
+
+    virtual ~BlockMatrixMultMT(){}
+
+    virtual void calc(Index tNr=0);
+
+protected:
+    const BlockMatrix< ValueType > * A_;
+    const Vector < ValueType > * b_;
+    std::vector < Vector < ValueType > * > * bufs_;
+    bool trans_;
+};
+
 //! Block matrices for easier inversion, see appendix E in GIMLi tutorial
 template < class ValueType >
 class DLLEXPORT BlockMatrix : public MatrixBase{
@@ -41,7 +62,8 @@ public:
     };
 
     BlockMatrix(bool verbose=false)
-        : MatrixBase(verbose), rows_(0), cols_(0) {
+        : MatrixBase(verbose), planValid_(false), rows_(0), cols_(0) {
+        nThreads_ = threadCount();
     }
 
     virtual ~BlockMatrix(){
@@ -74,6 +96,9 @@ public:
     virtual void clear(){
         matrices_.clear();
         entries_.clear();
+        planValid_ = false;
+        rows_ = 0;
+        cols_ = 0;
     }
     virtual void clean(){
         for (Index i = 0; i < matrices_.size(); i ++ ){
@@ -132,9 +157,17 @@ public:
         entry.scale = scale;
 
         entries_.push_back(entry);
+        planValid_ = false;
         recalcMatrixSize();
     }
 
+    /*! Set the amount of threads for the block products.
+     * Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) {
+        nThreads_ = std::max(Index(1), nThreads);
+        planValid_ = false;
+    }
+
     virtual Vector < ValueType > mult(const Vector < ValueType > & b) const{
         if (b.size() != this->cols()){
             throwLengthError(1, WHERE_AM_I + " wrong size of vector b (" +
@@ -142,20 +175,7 @@ public:
 
         }
 
-        Vector < ValueType > ret(rows_);
-
-        for (Index i = 0; i < entries_.size(); i ++ ){
-            BlockMatrixEntry entry = entries_[i];
-
-            MatrixBase *mat = matrices_[entry.matrixID];
-
-            ret.addVal(mat->mult(b.getVal(entry.colStart,
-                                         entry.colStart + mat->cols())) *
-                       entry.scale,
-                       entry.rowStart, entry.rowStart + mat->rows());
-        }
-
-        return ret;
+        return this->multPlan_(b, false);
     }
 
     virtual Vector < ValueType > transMult(const Vector < ValueType > & b) const {
@@ -165,27 +185,32 @@ public:
 
         }
 
-        Vector < ValueType > ret(cols_);
-         for (Index i = 0; i < entries_.size(); i++){
-            BlockMatrixEntry entry = entries_[i];
-
-            MatrixBase *mat = matrices_[entry.matrixID];
-
-            ret.addVal(mat->transMult(b.getVal(entry.rowStart,
-                                               entry.rowStart + mat->rows())) *
-                       entry.scale,
-                       entry.colStart, entry.colStart + mat->cols());
-        }
-        return ret;
+        return this->multPlan_(b, true);
     }
 
+    /*! Update the size from the current size of all blocks. The blocks
+     * can be resized after adding them, e.g., Jacobian matrices,
+     * so this needs one pass over the entries. A changed block size
+     * invalidates the cached thread plan. */
     void recalcMatrixSize() const {
+        if (entryRows_.size() != entries_.size()){
+            entryRows_.resize(entries_.size());
+            entryCols_.resize(entries_.size());
+            planValid_ = false;
+        }
+        rows_ = 0;
+        cols_ = 0;
         for (Index i = 0; i < entries_.size(); i++){
-            BlockMatrixEntry entry(entries_[i]);
-            MatrixBase *mat = matrices_[entry.matrixID];
-
-            rows_ = max(rows_, entry.rowStart + mat->rows());
-            cols_ = max(cols_, entry.colStart + mat->cols());
+            const BlockMatrixEntry & entry = entries_[i];
+            const MatrixBase *mat = matrices_[entry.matrixID];
+            Index r = mat->rows(), c = mat->cols();
+            if (r != entryRows_[i] || c != entryCols_[i]){
+                entryRows_[i] = r;
+                entryCols_[i] = c;
+                planValid_ = false;
+            }
+            rows_ = max(rows_, entry.rowStart + r);
+            cols_ = max(cols_, entry.colStart + c);
         }
     }
 
@@ -229,8 +254,179 @@ public:
     }
 
 protected:
+    friend class BlockMatrixMultMT< ValueType >;
+
+    /*! Rough amount of operations for a product with the matrix of entry i. */
+    double blockCost_(Index i) const {
+        const MatrixBase * mat = matrices_[entries_[i].matrixID];
+        double cost = 0.0;
+        switch (mat->rtti()){
+            case GIMLI_MATRIX_RTTI:
+                cost = double(entryRows_[i]) * entryCols_[i]; break;
+            case GIMLI_SPARSE_MAP_MATRIX_RTTI:{
+                const RSparseMapMatrix * S = dynamic_cast< const RSparseMapMatrix * >(mat);
+                if (S) cost = S->nVals();
+            } break;
+            case GIMLI_SPARSE_CRS_MATRIX_RTTI:{
+                const RSparseMatrix * S = dynamic_cast< const RSparseMatrix * >(mat);
+                if (S) cost = S->nVals();
+            } break;
+            default: break;
+        }
+        return std::max(cost, double(entryRows_[i] + entryCols_[i]));
+    }
+
+    /*! True if the ranges [start, start + size) of all entries are disjoint. */
+    bool disjoint_(bool rowRange) const {
+        std::vector < std::pair < Index, Index > > r;
+        for (Index i = 0; i < entries_.size(); i ++){
+            if (rowRange) r.push_back(std::make_pair(entries_[i].rowStart, entryRows_[i]));
+            else r.push_back(std::make_pair(entries_[i].colStart, entryCols_[i]));
+        }
+        std::sort(r.begin(), r.end());
+        for (Index i = 1; i < r.size(); i ++){
+            if (r[i - 1].first + r[i - 1].second > r[i].first) return false;
+        }
+        return true;
+    }
+
+    /*! True if concurrent products with the matrix of entry i are safe,
+     * i.e., the matrix has no lazy caches besides those built by
+     * \ref prepareMatrices_. */
+    bool concurrentMult_(Index i) const {
+        switch (matrices_[entries_[i].matrixID]->rtti()){
+            case GIMLI_MATRIX_RTTI:
+            case GIMLI_SPARSE_MAP_MATRIX_RTTI:
+            case GIMLI_SPARSE_CRS_MATRIX_RTTI: return true;
+            default: return false;
+        }
+    }
+
+    /*! Build the lazy caches of the sparse matrices before they are shared
+     * between the threads. */
+    void prepareMatrices_(bool trans) const {
+        for (Index i = 0; i < matrices_.size(); i ++){
+            const MatrixBase * mat = matrices_[i];
+            if (mat->rtti() == GIMLI_SPARSE_MAP_MATRIX_RTTI){
+                const SparseMapMatrix< ValueType, Index > * S =
+                    dynamic_cast< const SparseMapMatrix< ValueType, Index > * >(mat);
+                if (S) S->vecRowPtr();
+            } else if (mat->rtti() == GIMLI_SPARSE_CRS_MATRIX_RTTI){
+                const SparseMatrix< ValueType > * S =
+                    dynamic_cast< const SparseMatrix< ValueType > * >(mat);
+                if (S && S->valid() && (trans || S->stype() != 0)) S->buildTransposed();
+            }
+        }
+    }
+
+    /*! Distribute the blocks to threads. Independent blocks are
+     * multiplied in parallel if no single block dominates the costs.
+     * Otherwise the blocks are multiplied one after another and the
+     * block matrices use their own threads. Entries sharing a matrix
+     * without thread safe products are kept in one thread. */
+    void updatePlan_() const {
+        recalcMatrixSize();
+        if (planValid_) return;
+
+        Index nEntries = entries_.size();
+        //** units of entries that need to be multiplied by one thread
+        std::vector < std::vector < Index > > units;
+        std::map < Index, Index > unitOfMatrix;
+        for (Index i = 0; i < nEntries; i ++){
+            if (concurrentMult_(i)){
+                units.push_back(std::vector < Index >(1, i));
+            } else {
+                Index id = entries_[i].matrixID;
+                if (!unitOfMatrix.count(id)){
+                    unitOfMatrix[id] = units.size();
+                    units.push_back(std::vector < Index >());
+                }
+                units[unitOfMatrix[id]].push_back(i);
+            }
+        }
+
+        Index nUnits = units.size();
+        std::vector < std::pair < double, Index > > costs(nUnits);
+        double sumCost = 0.0, maxCost = 0.0;
+        for (Index u = 0; u < nUnits; u ++){
+            double cost = 0.0;
+            for (Index i = 0; i < units[u].size(); i ++) cost += blockCost_(units[u][i]);
+            costs[u] = std::make_pair(cost, u);
+            sumCost += cost;
+            maxCost = std::max(maxCost, cost);
+        }
+
+        Index nBins = std::min(nThreads_, nUnits);
+        if (nBins < 2 || maxCost > 0.5 * sumCost || sumCost < 1e4) nBins = 1;
+
+        // longest units first into the least loaded bin
+        std::sort(costs.rbegin(), costs.rend());
+        bins_.assign(nBins, std::vector < Index >());
+        std::vector < double > load(nBins, 0.0);
+        for (Index u = 0; u < nUnits; u ++){
+            Index b = std::min_element(load.begin(), load.end()) - load.begin();
+            const std::vector < Index > & unit = units[costs[u].second];
+            bins_[b].insert(bins_[b].end(), unit.begin(), unit.end());
+            load[b] += costs[u].first;
+        }
+        for (Index b = 0; b < nBins; b ++) std::sort(bins_[b].begin(), bins_[b].end());
+
+        rowsDisjoint_ = disjoint_(true);
+        colsDisjoint_ = disjoint_(false);
+        planValid_ = true;
+    }
+
+    /*! Add scale * block(i) * b (or the transposed) to ret. */
+    void multEntry_(Index i, const Vector < ValueType > & b,
+                    Vector < ValueType > & ret, bool trans) const {
+        const BlockMatrixEntry & entry = entries_[i];
+        const MatrixBase *mat = matrices_[entry.matrixID];
+        Index outStart = trans ? entry.colStart : entry.rowStart;
+        Index inStart = trans ? entry.rowStart : entry.colStart;
+        Index inSize = trans ? entryRows_[i] : entryCols_[i];
+
+        Vector < ValueType > y(trans ?
+                    mat->transMult(b.getVal(inStart, inStart + inSize)) :
+                    mat->mult(b.getVal(inStart, inStart + inSize)));
+        for (Index j = 0; j < y.size(); j ++) ret[outStart + j] += y[j] * entry.scale;
+    }
+
+    Vector < ValueType > multPlan_(const Vector < ValueType > & b, bool trans) const {
+        updatePlan_();
+        Vector < ValueType > ret(trans ? cols_ : rows_, ValueType(0.0));
+        Index nBins = bins_.size();
+
+        if (nBins < 2){
+            for (Index i = 0; i < entries_.size(); i ++) multEntry_(i, b, ret, trans);
+            return ret;
+        }
+
+        // overlapping output ranges need one accumulation buffer per thread
+        bool disjoint = trans ? colsDisjoint_ : rowsDisjoint_;
+        std::vector < Vector < ValueType > > bufs(disjoint ? 0 : nBins - 1,
+                                           Vector < ValueType >(ret.size(), ValueType(0.0)));
+        std::vector < Vector < ValueType > * > out(nBins, &ret);
+        for (Index t = 1; t < out.size() && !disjoint; t ++) out[t] = &bufs[t - 1];
+
+        prepareMatrices_(trans);
+        distributeCalc(BlockMatrixMultMT< ValueType >(*this, b, out, trans),
+                       nBins, nBins);
+
+        for (Index t = 0; t < bufs.size(); t ++) ret += bufs[t];
+        return ret;
+    }
+
     std::vector< MatrixBase * > matrices_;
     std::vector< BlockMatrixEntry > entries_;
+
+    /*! Cached block sizes and thread plan, see \ref updatePlan_ */
+    mutable std::vector < Index > entryRows_;
+    mutable std::vector < Index > entryCols_;
+    mutable std::vector < std::vector < Index > > bins_;
+    mutable bool rowsDisjoint_;
+    mutable bool colsDisjoint_;
+    mutable bool planValid_;
+    Index nThreads_;
 private:
     /*! Max row size.*/
     mutable Index rows_;
@@ -239,6 +435,16 @@ private:
     mutable Index cols_;
 };
 
+template < class ValueType >
+void BlockMatrixMultMT< ValueType >::calc(Index tNr){
+    for (Index bin = start_; bin < end_; bin ++){
+        const std::vector < Index > & ids = A_->bins_[bin];
+        for (Index i = 0; i < ids.size(); i ++){
+            A_->multEntry_(ids[i], *b_, *(*bufs_)[bin], trans_);
+        }
+    }
+}
+
 inline RVector transMult(const RBlockMatrix & A, const RVector & b){
     return A.transMult(b);
 }
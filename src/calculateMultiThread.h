@@ -20,6 +20,9 @@
 #define _GIMLI_CALCULATE_MULTI_THREAD__H
 
 #include "gimli.h"
+#include "memwatch.h"
+
+#include <algorithm>
 
 #ifdef USE_BOOST_THREAD
     #include <boost/thread.hpp>
@@ -29,22 +32,33 @@
 
 namespace GIMLI{
 
+/*! True inside the threads started by \ref distributeCalc. */
+inline bool & insideCalcMT(){
+    static thread_local bool inside = false;
+    return inside;
+}
+
 class BaseCalcMT{
 public:
     BaseCalcMT(Index count=0, bool verbose=false)
-        : verbose_(verbose), start_(0), end_(0), threadNumber_(count){
+        : verbose_(verbose), start_(0), end_(0), threadNumber_(count),
+          memoryTag_(memoryTag()){
     }
 
     virtual ~BaseCalcMT(){ }
 
-    void operator () () { calc(threadNumber_); }
+    /*! Thread entry point, see \ref distributeCalc. Allocations of the
+     * thread are accounted to the memory tag of the creating thread. */
+    void operator () () {
+        insideCalcMT() = true;
+        MemoryScope memoryScope(memoryTag_);
+        calc(threadNumber_);
+    }
 
     void setRange(Index start, Index end, Index threadNumber=0){
         start_ = start;
         end_ = end;
-        if (threadNumber_ > 0){
-            threadNumber_ = threadNumber;
-        }
+        threadNumber_ = threadNumber;
     }
 
     virtual void calc(Index tNr=0)=0;
@@ -54,12 +68,16 @@ protected:
     Index start_;
     Index end_;
     Index threadNumber_;
+    MemoryTag memoryTag_;
 };
 
+/*! Split the range [0, nCalcs) to nThreads threads. Nested calls, e.g.,
+ * of a matrix product inside the thread of a block matrix product, run
+ * in the calling thread, so the threads are not oversubscribed. */
 template < class T > void distributeCalc(T calc, uint nCalcs, uint nThreads, bool verbose=false){
-    if (nThreads == 1){
+    if (nThreads == 1 || insideCalcMT()){
         calc.setRange(0, nCalcs);
-        calc();
+        calc.calc(0);
     } else {
         uint singleCalcCount = (uint)ceil((double)nCalcs / (double)nThreads);
 
@@ -95,6 +113,61 @@ template < class T > void distributeCalc(T calc, uint nCalcs, uint nThreads, boo
     }
 }
 
+template < class ValueType > class SortMT : public BaseCalcMT{
+public:
+    SortMT(std::vector < ValueType > & v, const std::vector < Index > & bounds,
+           Index width)
+    : BaseCalcMT(false), v_(&v), bounds_(&bounds), width_(width){
+    }
+
+    virtual ~SortMT(){}
+
+    /*! width == 0: sort the chunks [bounds[i], bounds[i+1]).
+     * Else merge the sorted ranges of width chunks pairwise. */
+    virtual void calc(Index tNr=0){
+        const std::vector < Index > & b = *bounds_;
+        Index nChunks = b.size() - 1;
+        for (Index i = start_; i < end_; i ++){
+            if (width_ == 0){
+                std::sort(v_->begin() + b[i], v_->begin() + b[i + 1]);
+            } else {
+                Index first = 2 * i * width_;
+                Index mid = std::min(first + width_, nChunks);
+                Index last = std::min(first + 2 * width_, nChunks);
+                if (mid < last){
+                    std::inplace_merge(v_->begin() + b[first],
+                                       v_->begin() + b[mid],
+                                       v_->begin() + b[last]);
+                }
+            }
+        }
+    }
+
+protected:
+    std::vector < ValueType > * v_;
+    const std::vector < Index > * bounds_;
+    Index width_;
+};
+
+/*! Sort v with nThreads threads. Every thread sorts one chunk and the
+ * sorted chunks are merged pairwise in log2(nThreads) parallel rounds. */
+template < class ValueType >
+void parallelSort(std::vector < ValueType > & v, Index nThreads){
+    nThreads = std::max(Index(1), std::min(nThreads, Index(v.size() / 4096)));
+    if (nThreads == 1){
+        std::sort(v.begin(), v.end());
+        return;
+    }
+    std::vector < Index > bounds(nThreads + 1);
+    for (Index i = 0; i <= nThreads; i ++) bounds[i] = (i * v.size()) / nThreads;
+
+    distributeCalc(SortMT< ValueType >(v, bounds, 0), nThreads, nThreads);
+    for (Index width = 1; width < nThreads; width *= 2){
+        Index nMerges = (nThreads + 2 * width - 1) / (2 * width);
+        distributeCalc(SortMT< ValueType >(v, bounds, width), nMerges, nMerges);
+    }
+}
+
 } // namespace GIMLI{
 
 #endif //_GIMLI_IPC_CLIENT__H
@@ -17,6 +17,7 @@
  ******************************************************************************/
 
 #include "cholmodWrapper.h"
+#include "memwatch.h"
 #include "vector.h"
 #include "sparsematrix.h"
 
@@ -54,6 +55,7 @@ CHOLMODWrapper::CHOLMODWrapper(CSparseMatrix & S, bool verbose, int stype)
 }
 
 CHOLMODWrapper::~CHOLMODWrapper(){
+    memoryReleased(MEMORY_SOLVER, memory_);
 #if USE_CHOLMOD
     if (L_) cholmod_free_factor((cholmod_factor**)(&L_), (cholmod_common*)c_);
 //     ** We did not allocate the matrix so we dont need to free it
@@ -94,6 +96,7 @@ void CHOLMODWrapper::init_(SparseMatrix < ValueType > & S, int stype){
     Ai_ = NULL;
     ApR_ = NULL;
     AiR_ = NULL;
+    memory_ = 0;
 
     if (stype == -2){
         stype_ = S.stype();
@@ -273,6 +276,7 @@ int CHOLMODWrapper::factorise(){
                         (cholmod_factor*)L_,
                         (cholmod_common*)c_);		    /* factorize */
 
+        trackMemory_();
         if (verbose_) std::cout << "Cholmod analyze .. preordering: " << ((cholmod_factor *)(L_))->ordering << std::endl;
         if (verbose_) cholmod_print_factor((cholmod_factor *)L_, "L", (cholmod_common*)c_);
     }
@@ -284,6 +288,52 @@ int CHOLMODWrapper::factorise(){
     return 0;
 }
 
+template < class ValueType >
+int CHOLMODWrapper::refactorise_(SparseMatrix < ValueType > & S, int xType){
+#if USE_CHOLMOD
+    if (dummy_ || useUmfpack_ || !A_ || !L_) return 0;
+    cholmod_sparse * A = (cholmod_sparse*)A_;
+    if (A->xtype != xType || A->nrow != S.nRows() || A->nzmax != S.nVals()) return 0;
+
+    A->p = (void*)S.colPtr();
+    A->i = (void*)S.rowIdx();
+    A->x = S.vals();
+    cholmod_factorize(A, (cholmod_factor*)L_, (cholmod_common*)c_);
+    trackMemory_();
+    int status = ((cholmod_common*)c_)->status;
+    if (status != CHOLMOD_OK){
+        //** the caller falls back to a full analyze and factorize
+        log(Warning, "cholmod refactorisation failed with status " + str(status));
+        return 0;
+    }
+    return 1;
+#endif
+    return 0;
+}
+
+void CHOLMODWrapper::trackMemory_(){
+#if USE_CHOLMOD
+    Index inUse = ((cholmod_common*)c_)->memory_inuse;
+    if (inUse > memory_) memoryAllocated(MEMORY_SOLVER, inUse - memory_);
+    else memoryReleased(MEMORY_SOLVER, memory_ - inUse);
+    memory_ = inUse;
+#endif
+}
+
+int CHOLMODWrapper::refactorise(RSparseMatrix & S){
+#if USE_CHOLMOD
+    return refactorise_(S, CHOLMOD_REAL);
+#endif
+    return 0;
+}
+
+int CHOLMODWrapper::refactorise(CSparseMatrix & S){
+#if USE_CHOLMOD
+    return refactorise_(S, CHOLMOD_COMPLEX);
+#endif
+    return 0;
+}
+
 template < class ValueType >
     int CHOLMODWrapper::solveCHOL_(const Vector < ValueType > & rhs,
                                    Vector < ValueType > & solution){
@@ -40,6 +40,11 @@ public:
 
     virtual int solve(const CVector & rhs, CVector & solution);
 
+    /*! Numerical factorization only, the analysis of the initial matrix is kept. */
+    virtual int refactorise(RSparseMatrix & S);
+
+    virtual int refactorise(CSparseMatrix & S);
+
 protected:
     void init();
 
@@ -53,6 +58,9 @@ protected:
     template < class ValueType >
     int initMatrixChol_(SparseMatrix < ValueType > & S, int xType);
 
+    template < class ValueType >
+    int refactorise_(SparseMatrix < ValueType > & S, int xType);
+
     template < class ValueType >
     int solveCHOL_(const Vector < ValueType > & rhs, Vector < ValueType > & solution);
 
@@ -60,6 +68,8 @@ protected:
     template < class ValueType >
     int solveUmf_(const Vector < ValueType > & rhs, Vector < ValueType > & solution);
 
+    /*! Account the memory in use by cholmod as \ref MEMORY_SOLVER. */
+    void trackMemory_();
 
     int stype_;
 
@@ -78,6 +88,9 @@ protected:
     RVector *AxV_;
     RVector *AzV_;
 
+    /*! Bytes accounted by trackMemory_ */
+    Index memory_;
+
 };
 
 } //namespace GIMLI;
@@ -17,12 +17,215 @@
  ******************************************************************************/
 
 #include "datacontainer.h"
+#include "calculateMultiThread.h"
 #include "pos.h"
 #include "numericbase.h"
+#include "profiler.h"
 #include "vectortemplates.h"
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
 namespace GIMLI{
 
+namespace {
+
+const char __DATA_BIN_MAGIC__[8] = {'G', 'I', 'M', 'L', 'I', 'D', 'A', 'T'};
+
+enum DataBinType{ DATA_DOUBLE=0, DATA_SENSORINDEX=1, DATA_VALID=2 };
+
+inline bool isSpace__(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//** row without values, i.e., empty or comment only
+bool emptyRow__(const char * p, const char * end){
+    for (; p < end && *p != '#'; p ++) if (!isSpace__(*p)) return false;
+    return true;
+}
+
+const double __POW10__[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22};
+
+/*! Convert the token [s, e) like strtod. Decimal numbers with at most 19
+ * digits, a mantissa below 2^53 and a decimal exponent in [-22, 22] are
+ * converted by one exact floating point operation, so the result is the
+ * same as from strtod. All other tokens (inf, nan, long mantissas, ...)
+ * are given to strtod. The token needs to be followed by a non number
+ * character. */
+double toDouble__(const char * s, const char * e){
+    const char * p = s;
+    bool neg = false;
+    if (p < e && (*p == '-' || *p == '+')) neg = (*(p ++) == '-');
+
+    uint64 m = 0;
+    int digits = 0;
+    int exp10 = 0;
+    bool exact = true, any = false;
+    for (; p < e && *p >= '0' && *p <= '9'; p ++){
+        any = true;
+        if (digits < 19){
+            m = m * 10 + (*p - '0');
+            if (m > 0) digits ++;
+        } else {
+            exp10 ++;
+            if (*p != '0') exact = false;
+        }
+    }
+    if (p < e && *p == '.'){
+        for (p ++; p < e && *p >= '0' && *p <= '9'; p ++){
+            any = true;
+            if (digits < 19){
+                m = m * 10 + (*p - '0');
+                if (m > 0) digits ++;
+                exp10 --;
+            } else if (*p != '0') exact = false;
+        }
+    }
+    if (any && p < e && (*p == 'e' || *p == 'E')){
+        p ++;
+        bool negExp = false;
+        if (p < e && (*p == '-' || *p == '+')) negExp = (*(p ++) == '-');
+        if (p == e || *p < '0' || *p > '9') return std::strtod(s, NULL);
+        int ex = 0;
+        for (; p < e && *p >= '0' && *p <= '9'; p ++) if (ex < 10000) ex = ex * 10 + (*p - '0');
+        exp10 += negExp ? -ex : ex;
+    }
+
+    if (!any || p != e || !exact || m > (uint64(1) << 53) ||
+        exp10 < -22 || exp10 > 22) return std::strtod(s, NULL);
+
+    double v = double(m);
+    if (exp10 < 0) v /= __POW10__[-exp10]; else v *= __POW10__[exp10];
+    return neg ? -v : v;
+}
+
+//! Parse the data rows start to end of the unified data format.
+class DataRowParserMT : public BaseCalcMT{
+public:
+    DataRowParserMT(const char * buf, const char * bufEnd,
+                    const std::vector < Index > & rows,
+                    std::vector < RVector > & cols,
+                    std::vector < Index > & colCount, bool verbose=false)
+    : BaseCalcMT(verbose), buf_(buf), bufEnd_(bufEnd), rows_(&rows),
+      cols_(&cols), colCount_(&colCount){
+    }
+
+    virtual ~DataRowParserMT(){}
+
+    virtual void calc(Index tNr=0){
+        std::vector < RVector > & cols = *cols_;
+        Index nCols = cols.size();
+        Index maxCols = 0;
+
+        for (Index i = start_; i < end_; i ++){
+            const char * p = buf_ + (*rows_)[i];
+            Index j = 0;
+            while (j < nCols){
+                while (p < bufEnd_ && isSpace__(*p)) p ++;
+                if (p == bufEnd_ || *p == '\n' || *p == '#') break;
+
+                const char * e = p;
+                while (e < bufEnd_ && !isSpace__(*e) && *e != '\n' && *e != '#') e ++;
+                cols[j][i] = toDouble__(p, e);
+                p = e;
+                j ++;
+            }
+            maxCols = std::max(maxCols, j);
+        }
+        (*colCount_)[tNr] = maxCols;
+    }
+
+protected:
+    const char * buf_;
+    const char * bufEnd_;
+    const std::vector < Index > * rows_;
+    std::vector < RVector > * cols_;
+    std::vector < Index > * colCount_;
+};
+
+/*! Read nData non empty rows from the current position of file, see
+ * \ref DataContainer::load. The rows are located serially and parsed in
+ * parallel. file is set behind the last row. */
+void readDataRows__(std::fstream & file, const std::string & fileName,
+                    const std::vector < std::string > & format, Index nData,
+                    std::map< std::string, RVector > & tmpMap){
+    GIMLI_PROFILE("DataContainer::readDataRows");
+    std::streamoff pos = file.tellg();
+    std::ifstream raw(fileName.c_str(), std::ios::in | std::ios::binary);
+    raw.seekg(0, std::ios::end);
+    std::streamoff len = raw.tellg() - pos;
+    if (pos < 0 || len < 0){
+        throwError(EXIT_DATACONTAINER_DATASIZE, WHERE_AM_I + " cannot read " + fileName);
+    }
+    //** trailing zero for strtod
+    std::vector < char > buffer(len + 1, '\0');
+    raw.seekg(pos);
+    raw.read(&buffer[0], len);
+    raw.close();
+    const char * buf = &buffer[0];
+    const char * end = buf + len;
+
+    std::vector < Index > rows(nData);
+    const char * p = buf;
+    Index n = 0;
+    while (n < nData && p < end){
+        const char * eol = (const char *)std::memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        if (!emptyRow__(p, eol)) rows[n ++] = p - buf;
+        p = eol < end ? eol + 1 : end;
+    }
+    if (n < nData){
+        throwError(EXIT_DATACONTAINER_DATASIZE,
+                   WHERE_AM_I + " To few data. " + str(nData) +
+                   " data expected and " + str(n) + " data found.");
+    }
+
+    std::vector < RVector > cols(format.size(), RVector(nData, 0.0));
+    Index nThreads = std::max(Index(1), std::min(threadCount(), nData / 10000));
+    std::vector < Index > colCount(nThreads, 0);
+    distributeCalc(DataRowParserMT(buf, end, rows, cols, colCount),
+                   nData, nThreads);
+
+    //** only columns that are present in any row
+    Index nCols = *std::max_element(colCount.begin(), colCount.end());
+    for (Index j = 0; j < nCols; j ++){
+        tmpMap[format[j]] = cols[j];
+    }
+
+    file.clear();
+    file.seekg(pos + std::streamoff(p - buf));
+}
+
+template < class ValueType > void writeBin__(FILE * file, const ValueType * v, Index count){
+    if (count > 0 && fwrite(v, sizeof(ValueType), count, file) != count){
+        throwError(EXIT_OPEN_FILE, WHERE_AM_I + strerror(errno) + " " + str(errno));
+    }
+}
+
+template < class ValueType > void readBin__(FILE * file, ValueType * v, Index count){
+    if (count > 0 && fread(v, sizeof(ValueType), count, file) != count){
+        throwError(EXIT_DATACONTAINER_FILE, WHERE_AM_I + " unexpected end of file.");
+    }
+}
+
+//** close the file also if reading or writing throws
+struct FileCloser__{
+    ~FileCloser__(){ if (file) fclose(file); }
+    FILE * file;
+};
+
+void writePadding__(FILE * file, Index & pos){
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    Index pad = (8 - pos % 8) % 8;
+    writeBin__(file, zeros, pad);
+    pos += pad;
+}
+
+} // namespace
+
 DataContainer::DataContainer(){
     initDefaults();
     //std::cout << "DataContainer(){" << std::endl;
@@ -194,11 +397,24 @@ bool DataContainer::isSensorIndex(const std::string & token) const {
 int DataContainer::load(const std::string & fileName,
                         bool sensorIndicesFromOne,
                         bool removeInvalid){
+    GIMLI_PROFILE("DataContainer::load");
     clear();
     setSensorIndexOnFileFromOne(sensorIndicesFromOne);
 
 	std::fstream file; openInFile(fileName, & file, true);
 
+    char magic[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    file.read(magic, 8);
+    if (std::memcmp(magic, __DATA_BIN_MAGIC__, 8) == 0){
+        file.close();
+        this->loadBinary(fileName);
+        setSensorIndexOnFileFromOne(sensorIndicesFromOne);
+        this->checkDataValidity(removeInvalid);
+        return 1;
+    }
+    file.clear();
+    file.seekg(0);
+
     std::vector < std::string > row(getNonEmptyRow(file));
 
     if (row.size() != 1){
@@ -301,26 +517,7 @@ int DataContainer::load(const std::string & fileName,
 
     std::map< std::string, RVector > tmpMap;
 
-    for (int data = 0; data < nData; data ++){
-        row = getNonEmptyRow(file);
-
-        if (row.empty()){
-            throwError(EXIT_DATACONTAINER_DATASIZE,
-                       WHERE_AM_I + " To few data. " + str(nData) +
-                       " data expected and " + str(data) + " data found.");
-        }
-
-        for (uint j = 0; j < row.size(); j ++){
-            if (j == format.size()) break;
-
-            if (!tmpMap.count(format[j])){
-                tmpMap.insert(std::pair< std::string, RVector > (format[j], RVector(nData, 0.0))) ;
-            }
-// 	    std::cout << format[j] << " " << tmpMap[format[j]].size() << std::endl;
-// 	    std::cout << row[j] << " " << toDouble(row[j]) << std::endl;
-            tmpMap[format[j]][data] = toDouble(row[j]);
-        }
-    }
+    if (nData > 0) readDataRows__(file, fileName, format, nData, tmpMap);
 
     //** renaming formats with the token translator (tT_):
     for (std::map< std::string, RVector >::iterator it = tmpMap.begin();
@@ -473,6 +670,7 @@ int DataContainer::save(const std::string & fileName,
                         const std::string & formatSensor,
                         bool noFilter,
                         bool verbose) const {
+    GIMLI_PROFILE("DataContainer::save");
 
     std::fstream file; if (!openOutFile(fileName, & file)) return 0;
 
@@ -584,6 +782,167 @@ int DataContainer::save(const std::string & fileName,
     return 1;
 }
 
+int DataContainer::saveBinary(const std::string & fileName, bool verbose) const {
+    GIMLI_PROFILE("DataContainer::saveBinary");
+
+    FILE * file = fopen(fileName.c_str(), "w+b");
+    if (!file) {
+        throwError(EXIT_OPEN_FILE, WHERE_AM_I + " " + fileName + ": " + strerror(errno));
+    }
+    FileCloser__ closer = {file};
+
+    uint64 nData = this->size();
+    uint64 head[6] = {sensorPoints_.size(), nData, topoPoints_.size(),
+                      dataMap_.size(), 0, 0};
+    uint32 version[2] = {1, 0};
+    writeBin__(file, __DATA_BIN_MAGIC__, 8);
+    writeBin__(file, version, 2);
+    writeBin__(file, head, 6);
+
+    std::vector < double > pos(3 * std::max(sensorPoints_.size(), topoPoints_.size()));
+    for (Index i = 0; i < sensorPoints_.size(); i ++){
+        for (Index j = 0; j < 3; j ++) pos[i * 3 + j] = sensorPoints_[i][j];
+    }
+    writeBin__(file, pos.data(), 3 * sensorPoints_.size());
+    for (Index i = 0; i < topoPoints_.size(); i ++){
+        for (Index j = 0; j < 3; j ++) pos[i * 3 + j] = topoPoints_[i][j];
+    }
+    writeBin__(file, pos.data(), 3 * topoPoints_.size());
+
+    //** field directory, the offsets are known in advance
+    Index offset = 64 + 24 * (sensorPoints_.size() + topoPoints_.size());
+    for (std::map< std::string, RVector >::const_iterator it = dataMap_.begin();
+         it != dataMap_.end(); it ++){
+        offset += 16 + (it->first.size() + 7) / 8 * 8;
+    }
+    std::vector < uint32 > types;
+    for (std::map< std::string, RVector >::const_iterator it = dataMap_.begin();
+         it != dataMap_.end(); it ++){
+        uint32 type = DATA_DOUBLE;
+        Index valSize = sizeof(double);
+        if (isSensorIndex(it->first)){
+            type = DATA_SENSORINDEX; valSize = sizeof(int32);
+        } else if (it->first == "valid"){
+            type = DATA_VALID; valSize = sizeof(int8);
+        }
+        types.push_back(type);
+
+        uint32 rec[2] = {type, uint32(it->first.size())};
+        uint64 off = offset;
+        writeBin__(file, rec, 2);
+        writeBin__(file, &off, 1);
+        Index namePos = it->first.size();
+        writeBin__(file, it->first.c_str(), namePos);
+        writePadding__(file, namePos);
+        offset += (nData * valSize + 7) / 8 * 8;
+    }
+
+    //** columns
+    Index i = 0;
+    for (std::map< std::string, RVector >::const_iterator it = dataMap_.begin();
+         it != dataMap_.end(); it ++, i ++){
+        const RVector & v = it->second;
+        Index bytes = 0;
+        if (types[i] == DATA_SENSORINDEX){
+            std::vector < int32 > col(nData);
+            for (Index k = 0; k < nData; k ++) col[k] = int32(v[k]);
+            writeBin__(file, col.data(), nData);
+            bytes = nData * sizeof(int32);
+        } else if (types[i] == DATA_VALID){
+            std::vector < int8 > col(nData);
+            for (Index k = 0; k < nData; k ++) col[k] = int8(v[k]);
+            writeBin__(file, col.data(), nData);
+            bytes = nData * sizeof(int8);
+        } else {
+            writeBin__(file, nData ? &v[0] : NULL, nData);
+        }
+        writePadding__(file, bytes);
+    }
+
+    if (verbose){
+        std::cout << "Wrote: " << fileName << " with " << sensorPoints_.size()
+                  << " sensors and " << nData << " data." <<  std::endl;
+    }
+    return 1;
+}
+
+int DataContainer::loadBinary(const std::string & fileName){
+    GIMLI_PROFILE("DataContainer::loadBinary");
+    clear();
+
+    FILE * file = fopen(fileName.c_str(), "rb");
+    if (!file) {
+        throwError(EXIT_OPEN_FILE, WHERE_AM_I + " " + fileName + ": " + strerror(errno));
+    }
+    FileCloser__ closer = {file};
+
+    char magic[8]; uint32 version[2]; uint64 head[6];
+    readBin__(file, magic, 8);
+    if (std::memcmp(magic, __DATA_BIN_MAGIC__, 8) != 0){
+        throwError(EXIT_DATACONTAINER_FILE, WHERE_AM_I + " " + fileName +
+                   " is no binary data file.");
+    }
+    readBin__(file, version, 2);
+    if (version[0] != 1){
+        throwError(EXIT_DATACONTAINER_FILE, WHERE_AM_I + " unknown version " +
+                   str(version[0]) + " of " + fileName);
+    }
+    readBin__(file, head, 6);
+    Index nSensors = head[0], nData = head[1], nTopo = head[2], nFields = head[3];
+
+    std::vector < double > pos(3 * std::max(nSensors, nTopo));
+    readBin__(file, pos.data(), 3 * nSensors);
+    sensorPoints_.reserve(nSensors);
+    for (Index i = 0; i < nSensors; i ++){
+        sensorPoints_.push_back(RVector3(pos[3 * i], pos[3 * i + 1], pos[3 * i + 2]));
+    }
+    readBin__(file, pos.data(), 3 * nTopo);
+    for (Index i = 0; i < nTopo; i ++){
+        topoPoints_.push_back(RVector3(pos[3 * i], pos[3 * i + 1], pos[3 * i + 2]));
+    }
+
+    std::vector < uint32 > types(nFields);
+    std::vector < std::string > names(nFields);
+    for (Index i = 0; i < nFields; i ++){
+        uint32 rec[2]; uint64 off;
+        readBin__(file, rec, 2);
+        readBin__(file, &off, 1);
+        std::vector < char > name((rec[1] + 7) / 8 * 8 + 1, '\0');
+        readBin__(file, &name[0], name.size() - 1);
+        types[i] = rec[0];
+        names[i] = std::string(&name[0], rec[1]);
+    }
+
+    dataMap_.clear();
+    inputFormatString_.clear();
+    for (Index i = 0; i < nFields; i ++){
+        RVector & v = dataMap_[names[i]];
+        v.resize(nData);
+        Index bytes = 0;
+        if (types[i] == DATA_SENSORINDEX){
+            std::vector < int32 > col(nData);
+            readBin__(file, col.data(), nData);
+            for (Index k = 0; k < nData; k ++) v[k] = col[k];
+            bytes = nData * sizeof(int32);
+            dataSensorIdx_.insert(names[i]);
+        } else if (types[i] == DATA_VALID){
+            std::vector < int8 > col(nData);
+            readBin__(file, col.data(), nData);
+            for (Index k = 0; k < nData; k ++) v[k] = col[k];
+            bytes = nData * sizeof(int8);
+        } else {
+            readBin__(file, nData ? &v[0] : NULL, nData);
+        }
+        char pad[8];
+        readBin__(file, pad, (8 - bytes % 8) % 8);
+        inputFormatString_ += names[i] + " ";
+    }
+
+    if (!dataMap_.count("valid")) dataMap_["valid"] = RVector(nData, 1.0);
+    inputFormatStringSensors_ = "x y z ";
+    return 1;
+}
+
 std::string DataContainer::tokenList(bool withAnnotation) const {
     std::string tokenList;
     if (withAnnotation) tokenList += "SensorIdx: ";
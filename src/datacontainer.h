@@ -252,7 +252,9 @@ public:
 
     /*! Loads the data from a file. See save for details on the fileformat.
      On default remove all invalid data that have been marked by checkDataValidity
-     and checkDataValidityLocal.*/
+     and checkDataValidityLocal. Binary files written by \ref saveBinary
+     are recognized and loaded by \ref loadBinary. The data rows of the
+     ascii format are parsed in parallel, see \ref threadCount.*/
     virtual int load(const std::string & fileName,
                      bool sensorIndicesFromOne=true,
                      bool removeInvalid=true);
@@ -285,6 +287,22 @@ public:
                     bool verbose=false) const {
         return save(fileName, formatData, "x y z", noFilter, verbose); }
 
+    /*! Save all data inclusive invalid data in the binary format:\n\n
+     * char[8] "GIMLIDAT", uint32 version, uint32 reserved\n
+     * uint64 nSensors, nData, nTopo, nFields, uint64[2] reserved\n
+     * double[3 * nSensors] sensor positions\n
+     * double[3 * nTopo] additional points\n
+     * nFields times: uint32 type, uint32 name length, uint64 offset, name padded to 8 byte\n
+     * Column of every field at its offset, 8 byte aligned. Types are 0: double[nData],
+     * 1: int32[nData] sensor index starting with 0 (-1 unset), 2: int8[nData] validity flag.\n\n
+     * All columns are aligned, so the file can be memory-mapped and the
+     * columns can be accessed without conversion. */
+    int saveBinary(const std::string & fileName, bool verbose=false) const;
+
+    /*! Load the data from a binary file written by \ref saveBinary. The data
+     * are restored as saved, there is no validity check. */
+    int loadBinary(const std::string & fileName);
+
     /*! Show some information that belongs to the DataContainer.*/
     void showInfos() const ;
 
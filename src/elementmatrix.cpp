@@ -36,16 +36,9 @@ ElementMatrix < double >::u(const MeshEntity & ent,
     std::map< uint, RVector >::const_iterator it = uCache_.find(ent.rtti());
 
     if (it == uCache_.end()) {
-        uint nRules = w.size();
-
         RVector u(nVerts);
-        RMatrix N(nVerts, nRules);
+        const RMatrix & N = ShapeFunctionCache::instance().shapeFunctionTable(ent, x).N;
 
-        RVector tmp;
-        for (uint i = 0; i < nRules; i ++){
-            tmp = ent.N(x[i]);
-            N.setCol(i, tmp);
-        }
         for (uint i = 0; i < nVerts; i ++){
             u[i] = sum(w * N[i]);
         }
@@ -75,21 +68,8 @@ template <> DLLEXPORT ElementMatrix < double > & ElementMatrix < double >::dudi(
     for (Index i = 0; i < nVerts; i ++) idx_[i] = ent.node(i).id();
     *this *= 0.0;
 
-    if (dNdr_.rows() != nVerts){
-        dNdr_.resize(nVerts, nRules);
-        for (Index i = 0; i < nRules; i ++){
-            dNdr_.setCol(i, ent.dNdL(x[i], 0));
-            if (ent.dim() > 1){
-                dNds_.resize(nVerts, nRules);
-                dNds_.setCol(i, ent.dNdL(x[i], 1));
-            }
-            if (ent.dim() > 2){
-                dNdt_.resize(nVerts, nRules);
-                dNdt_.setCol(i, ent.dNdL(x[i], 2));
-            }
-        }
-        dNdx_.resize(nVerts, nRules);
-    }
+    const ShapeFunctionTable & T = ShapeFunctionCache::instance().shapeFunctionTable(ent, x);
+    if (dNdx_.rows() != nVerts || dNdx_.cols() != nRules) dNdx_.resize(nVerts, nRules);
 
     double drdi = ent.shape().drstdxyz(0, dim);
     double dsdi = ent.shape().drstdxyz(1, dim);
@@ -99,9 +79,9 @@ template <> DLLEXPORT ElementMatrix < double > & ElementMatrix < double >::dudi(
 
     for (Index i = 0; i < nVerts; i ++){
         switch (ent.dim()){
-            case 1: dNdx_[i].assign(drdi * dNdr_[i]); break;
-            case 2: dNdx_[i].assign(drdi * dNdr_[i] + dsdi * dNds_[i]); break;
-            case 3: dNdx_[i].assign(drdi * dNdr_[i] + dsdi * dNds_[i] + dtdi * dNdt_[i]); break;
+            case 1: dNdx_[i].assign(drdi * T.dNdr[i]); break;
+            case 2: dNdx_[i].assign(drdi * T.dNdr[i] + dsdi * T.dNds[i]); break;
+            case 3: dNdx_[i].assign(drdi * T.dNdr[i] + dsdi * T.dNds[i] + dtdi * T.dNdt[i]); break;
         }
 
         mat_[i][i] = sum(w * dNdx_[i]);
@@ -122,16 +102,9 @@ DLLEXPORT ElementMatrix < double > & ElementMatrix < double >::u2(const MeshEnti
     std::map< uint, RMatrix>::const_iterator it = u2Cache_.find(ent.rtti());
 
     if (it == u2Cache_.end()) {
-        uint nRules = w.size();
-
         RMatrix u2(nVerts, nVerts);
-        RMatrix N(nVerts, nRules);
+        const RMatrix & N = ShapeFunctionCache::instance().shapeFunctionTable(ent, x).N;
 
-        RVector tmp;
-        for (uint i = 0; i < nRules; i ++){
-            tmp = ent.N(x[i]);
-            N.setCol(i, tmp);
-        }
         for (uint i = 0; i < nVerts; i ++){
             for (uint j = i; j < nVerts; j ++){
                 u2[i][j] = sum(w * N[j] * N[i]);
@@ -163,14 +136,8 @@ DLLEXPORT ElementMatrix < double > & ElementMatrix < double >::ux2(const MeshEnt
                                                          bool verbose){
 
     uint nVerts = ent.nodeCount();
-    uint nRules = w.size();
 
-    if (dNdr_.rows() != nVerts){
-        dNdr_.resize(nVerts, nRules);
-        for (uint i = 0; i < nRules; i ++){
-            dNdr_.setCol(i, ent.dNdL(x[i], 0));
-        }
-    }
+    const RMatrix & dNdr = ShapeFunctionCache::instance().shapeFunctionTable(ent, x).dNdr;
 
     double drdx = ent.shape().drstdxyz(0, 0);
 //     double drdx = ent.shape().invJacobian()[0];
@@ -179,7 +146,7 @@ DLLEXPORT ElementMatrix < double > & ElementMatrix < double >::ux2(const MeshEnt
 
     for (uint i = 0; i < nVerts; i ++){
         for (uint j = i; j < nVerts; j ++){
-            mat_[i][j] = A * sum(w * (drdx * dNdr_[i] * drdx * dNdr_[j]));
+            mat_[i][j] = A * sum(w * (drdx * dNdr[i] * drdx * dNdr[j]));
             mat_[j][i] = mat_[i][j];
         }
     }
@@ -193,31 +160,16 @@ DLLEXPORT ElementMatrix < double >::ux2uy2(const MeshEntity & ent,
                                  const R3Vector & x,
                                  bool verbose){
 
-//     __MS(w)
-
     Index nVerts = ent.nodeCount();
     Index nRules = w.size();
 
-    if (dNdr_.rows() != nVerts){
-        dNdr_.resize(nVerts, nRules);
-        dNds_.resize(nVerts, nRules);
-
-        for (uint i = 0; i < nRules; i ++){
-            dNdr_.setCol(i, ent.dNdL(x[i], 0));
-            dNds_.setCol(i, ent.dNdL(x[i], 1));
-
-//             __MS(i << " " << dNdr_[i])
-        }
+    const ShapeFunctionTable & T = ShapeFunctionCache::instance().shapeFunctionTable(ent, x);
 
+    if (dNdx_.rows() != nVerts || dNdx_.cols() != nRules){
         dNdx_.resize(nVerts, nRules);
         dNdy_.resize(nVerts, nRules);
     }
 
-//     double drdx = ent.shape().invJacobian()[0]; //ent.shape().drstdxyz(0,0)
-//     double drdy = ent.shape().invJacobian()[1];
-//     double dsdx = ent.shape().invJacobian()[2];
-//     double dsdy = ent.shape().invJacobian()[3];
-
     double drdx = ent.shape().drstdxyz(0, 0);
     double drdy = ent.shape().drstdxyz(0, 1);
     double dsdx = ent.shape().drstdxyz(1, 0);
@@ -225,22 +177,28 @@ DLLEXPORT ElementMatrix < double >::ux2uy2(const MeshEntity & ent,
 
     double A = ent.shape().domainSize();
     for (Index i = 0; i < nVerts; i ++){
-        dNdx_[i].assign(drdx * dNdr_[i] + dsdx * dNds_[i]);
-        dNdy_[i].assign(drdy * dNdr_[i] + dsdy * dNds_[i]);
+        const double * dr = &T.dNdr[i][0];
+        const double * ds = &T.dNds[i][0];
+        double * dx = &dNdx_[i][0];
+        double * dy = &dNdy_[i][0];
+        for (Index k = 0; k < nRules; k ++){
+            dx[k] = drdx * dr[k] + dsdx * ds[k];
+            dy[k] = drdy * dr[k] + dsdy * ds[k];
+        }
     }
 
-
+    const double * wk = &w[0];
     for (Index i = 0; i < nVerts; i ++){
-//         dNidx_.assign(drdx * dNdr_[i] + dsdx * dNds_[i]);
-//         dNidy_.assign(drdy * dNdr_[i] + dsdy * dNds_[i]);
-
+        const double * xi = &dNdx_[i][0];
+        const double * yi = &dNdy_[i][0];
         for (Index j = i; j < nVerts; j ++){
-            mat_[i][j] = A * sum(w * (dNdx_[i] * dNdx_[j] + dNdy_[i] * dNdy_[j]));
-
-//             mat_[i][j] = A * sum(w * (dNidx_ * (drdx * dNdr_[j] + dsdx * dNds_[j]) +
-//                                       dNidy_ * (drdy * dNdr_[j] + dsdy * dNds_[j])));
-//             mat_[i][j] = A * sum(w * ((drdx * dNdr_[i] + dsdx * dNds_[i]) * (drdx * dNdr_[j] + dsdx * dNds_[j]) +
-//                                       (drdy * dNdr_[i] + dsdy * dNds_[i]) * (drdy * dNdr_[j] + dsdy * dNds_[j])));
+            const double * xj = &dNdx_[j][0];
+            const double * yj = &dNdy_[j][0];
+            double s = 0.0;
+            for (Index k = 0; k < nRules; k ++){
+                s += wk[k] * (xi[k] * xj[k] + yi[k] * yj[k]);
+            }
+            mat_[i][j] = A * s;
             mat_[j][i] = mat_[i][j];
         }
     }
@@ -258,17 +216,9 @@ ElementMatrix < double >::ux2uy2uz2(const MeshEntity & ent,
     Index nVerts = ent.nodeCount();
     Index nRules = w.size();
 
-    if (dNdr_.rows() != nVerts){
-        dNdr_.resize(nVerts, nRules);
-        dNds_.resize(nVerts, nRules);
-        dNdt_.resize(nVerts, nRules);
-
-        for (Index i = 0; i < nRules; i ++){
-            dNdr_.setCol(i, ent.dNdL(x[i], 0));
-            dNds_.setCol(i, ent.dNdL(x[i], 1));
-            dNdt_.setCol(i, ent.dNdL(x[i], 2));
-        }
+    const ShapeFunctionTable & T = ShapeFunctionCache::instance().shapeFunctionTable(ent, x);
 
+    if (dNdx_.rows() != nVerts || dNdx_.cols() != nRules){
         dNdx_.resize(nVerts, nRules);
         dNdy_.resize(nVerts, nRules);
         dNdz_.resize(nVerts, nRules);
@@ -286,39 +236,39 @@ ElementMatrix < double >::ux2uy2uz2(const MeshEntity & ent,
     double dtdy = ent.shape().drstdxyz(2, 1);
     double dtdz = ent.shape().drstdxyz(2, 2);
 
-    // double drdx = ent.shape().invJacobian()[0];
-    // double drdy = ent.shape().invJacobian()[1];
-    // double drdz = ent.shape().invJacobian()[2];
-    //
-    // double dsdx = ent.shape().invJacobian()[3];
-    // double dsdy = ent.shape().invJacobian()[4];
-    // double dsdz = ent.shape().invJacobian()[5];
-    //
-    // double dtdx = ent.shape().invJacobian()[6];
-    // double dtdy = ent.shape().invJacobian()[7];
-    // double dtdz = ent.shape().invJacobian()[8];
-
     double A = ent.shape().domainSize();
     for (Index i = 0; i < nVerts; i ++){
-        dNdx_[i].assign(drdx * dNdr_[i] + dsdx * dNds_[i] + dtdx * dNdt_[i]);
-        dNdy_[i].assign(drdy * dNdr_[i] + dsdy * dNds_[i] + dtdy * dNdt_[i]);
-        dNdz_[i].assign(drdz * dNdr_[i] + dsdz * dNds_[i] + dtdz * dNdt_[i]);
+        const double * dr = &T.dNdr[i][0];
+        const double * ds = &T.dNds[i][0];
+        const double * dt = &T.dNdt[i][0];
+        double * dx = &dNdx_[i][0];
+        double * dy = &dNdy_[i][0];
+        double * dz = &dNdz_[i][0];
+        for (Index k = 0; k < nRules; k ++){
+            dx[k] = drdx * dr[k] + dsdx * ds[k] + dtdx * dt[k];
+            dy[k] = drdy * dr[k] + dsdy * ds[k] + dtdy * dt[k];
+            dz[k] = drdz * dr[k] + dsdz * ds[k] + dtdz * dt[k];
+        }
     }
 
+    const double * wk = &w[0];
     for (Index i = 0; i < nVerts; i ++){
+        const double * xi = &dNdx_[i][0];
+        const double * yi = &dNdy_[i][0];
+        const double * zi = &dNdz_[i][0];
         for (Index j = i; j < nVerts; j ++){
-            mat_[i][j] = A * sum(w * (dNdx_[i] * dNdx_[j] + dNdy_[i] * dNdy_[j] + dNdz_[i] * dNdz_[j]));
-
-//             mat_[i][j] = A * sum(w * ((drdx * dNdr_[i] + dsdx * dNds_[i] + dtdx * dNdt_[i]) *
-//                                       (drdx * dNdr_[j] + dsdx * dNds_[j] + dtdx * dNdt_[j]) +
-//                                       (drdy * dNdr_[i] + dsdy * dNds_[i] + dtdy * dNdt_[i]) *
-//                                       (drdy * dNdr_[j] + dsdy * dNds_[j] + dtdy * dNdt_[j]) +
-//                                       (drdz * dNdr_[i] + dsdz * dNds_[i] + dtdz * dNdt_[i]) *
-//                                       (drdz * dNdr_[j] + dsdz * dNds_[j] + dtdz * dNdt_[j])));
-
+            const double * xj = &dNdx_[j][0];
+            const double * yj = &dNdy_[j][0];
+            const double * zj = &dNdz_[j][0];
+            double s = 0.0;
+            for (Index k = 0; k < nRules; k ++){
+                s += wk[k] * (xi[k] * xj[k] + yi[k] * yj[k] + zi[k] * zj[k]);
+            }
+            mat_[i][j] = A * s;
             mat_[j][i] = mat_[i][j];
         }
     }
+
     if (verbose) std::cout << "int ux2uy2uz2 " << *this << std::endl;
     return *this;
 }
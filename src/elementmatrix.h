@@ -199,10 +199,6 @@ protected:
     std::map< uint, RVector > uCache_;
     std::map< uint, Matrix < ValueType > > u2Cache_;
 
-    RMatrix dNdr_;
-    RMatrix dNds_;
-    RMatrix dNdt_;
-
     RMatrix dNdx_; // (nVerts, nRules)
     RMatrix dNdy_; // (nVerts, nRules)
     RMatrix dNdz_; // (nVerts, nRules)
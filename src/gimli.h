@@ -214,6 +214,10 @@ static const uint8 GIMLI_MATRIX_RTTI            = 1;
 static const uint8 GIMLI_SPARSE_MAP_MATRIX_RTTI = 2;
 static const uint8 GIMLI_SPARSE_CRS_MATRIX_RTTI = 3;
 static const uint8 GIMLI_BLOCKMATRIX_RTTI       = 4;
+static const uint8 GIMLI_HMATRIX_RTTI           = 5;
+static const uint8 GIMLI_INTERPOLATIONOPERATOR_RTTI = 6;
+static const uint8 GIMLI_DIFFERENCEOPERATOR_RTTI = 7;
+static const uint8 GIMLI_MAPPEDMATRIX_RTTI      = 8;
 
 /*! Flag load/save Ascii or binary */
 enum IOFormat{Ascii, Binary};
@@ -222,7 +226,11 @@ enum IOFormat{Ascii, Binary};
 class Boundary;
 class Cell;
 class DataContainer;
+class InterpolationOperator;
+class DifferenceOperator;
 class Line;
+class LinSolver;
+class MappedMatrix;
 class MatrixBase;
 class Mesh;
 class MeshEntity;
@@ -249,6 +257,9 @@ typedef SparseMapMatrix< int, Index >     ISparseMapMatrix;
 typedef SparseMapMatrix< double, Index >  RSparseMapMatrix;
 typedef SparseMapMatrix< Complex, Index >  CSparseMapMatrix;
 
+template < class ValueType > class SparseAssembler;
+typedef SparseAssembler< double > RSparseAssembler;
+
 template < class ValueType > class Matrix;
 template < class ValueType > class BlockMatrix;
 template < class ValueType > class Matrix3;
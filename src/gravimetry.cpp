@@ -19,6 +19,7 @@
 
 #include "gravimetry.h"
 
+#include "datacontainer.h"
 #include "integration.h"
 #include "mesh.h"
 #include "pos.h"
@@ -28,27 +29,62 @@
 
 namespace GIMLI {
 
-GravimetryModelling::GravimetryModelling( Mesh & mesh, DataContainer & dataContainer, bool verbose ){
+static const double GRAVITY_SCALE = 6.67384e-11 * 1e5;
+
+GravimetryModelling::GravimetryModelling( Mesh & mesh, DataContainer & dataContainer, bool verbose )
+    : ModellingBase( dataContainer, verbose ), tol_( 1e-6 ), eta_( 2.0 ){
+    this->setMesh( mesh );
+    this->initJacobian();
 }
 
 RVector GravimetryModelling::createDefaultStartModel( ){
-    RVector ret;
-    THROW_TO_IMPL
-    return ret;
+    return RVector( mesh_->cellCount(), 0.0 );
 }
 
 RVector GravimetryModelling::response( const RVector & model ){
-    RVector ret;
-    THROW_TO_IMPL
-    return ret;
+    if ( jacobian_->rows() == 0 ) this->createJacobian( model );
+    return jacobian_->mult( model );
 }
 
 void GravimetryModelling::createJacobian( const RVector & model ){
-    THROW_TO_IMPL
+    HMatrix * J = dynamic_cast< HMatrix * >( jacobian_ );
+    if ( !J ) throwError( 1, WHERE_AM_I + " Jacobian is not a HMatrix." );
+
+    //** linear problem, the kernel does not depend on the model
+    if ( J->rows() == this->data().sensorCount() && J->cols() == mesh_->cellCount() &&
+         jacobianSensors_ == this->data().sensorPositions() ) return;
+
+    J->setVerbose( verbose_ );
+    J->build( GravimetryCellKernel( this->data().sensorPositions(), *mesh_ ), tol_, eta_ );
+    jacobianSensors_ = this->data().sensorPositions();
+}
+
+void GravimetryModelling::updateMeshDependency_( ){
+    jacobianSensors_.clear();
+    if ( jacobian_ ) jacobian_->clear();
+}
+
+void GravimetryModelling::updateDataDependency_( ){
+    jacobianSensors_.clear();
+    if ( jacobian_ ) jacobian_->clear();
 }
 
 void GravimetryModelling::initJacobian( ){
-    THROW_TO_IMPL
+    if ( jacobian_ && ownJacobian_ ){
+        delete jacobian_;
+    }
+    jacobian_ = new HMatrix( verbose_ );
+    ownJacobian_ = true;
+}
+
+GravimetryCellKernel::GravimetryCellKernel( const std::vector< RVector3 > & pos, const Mesh & mesh, uint nInt )
+    : HMatrixKernel(), pos_( pos ), mesh_( &mesh ), nInt_( nInt ){
+    centers_.reserve( mesh.cellCount() );
+    for ( Index i = 0; i < mesh.cellCount(); i ++ ) centers_.push_back( mesh.cell( i ).center() );
+}
+
+double GravimetryCellKernel::entry( Index row, Index col ) const {
+    return calcGCell( pos_[ row ], mesh_->cell( col ), nInt_ ) * GRAVITY_SCALE;
 }
 
 
@@ -121,6 +157,22 @@ double f_gz( const RVector3 & x, const RVector3 & p ){
     return (p[1]-x[1]) / (r*r);
 }
 
+double calcGCell( const RVector3 & pos, const Cell & c, uint nInt ){
+    double Z = 0.;
+    if ( nInt == 0 ){
+        for ( uint j = 0; j < c.nodeCount(); j ++ ){
+            // negative Z because all cells are numbered counterclockwise
+            Z -= 2.0 * lineIntegraldGdz( c.node( j ).pos() - pos, c.node( (j+1)%c.nodeCount() ).pos() - pos );
+        }
+    } else {
+        for ( uint j = 0; j < IntegrationRules::instance().triAbscissa( nInt ).size(); j ++ ){
+            Z += IntegrationRules::instance().triWeights( nInt )[ j ] *
+                            f_gz( c.shape().xyz( IntegrationRules::instance().triAbscissa( nInt )[ j ] ), pos );
+        }
+    }
+    return -Z;
+}
+
 RVector calcGCells( const std::vector< RVector3 > & pos, const Mesh & mesh, const RVector & model, uint nInt ){
     /*! Ensure neighbourInfos() */
     RMatrix Jacobian( pos.size(), mesh.cellCount() );
@@ -129,25 +181,11 @@ RVector calcGCells( const std::vector< RVector3 > & pos, const Mesh & mesh, cons
 
     for ( uint i = 0; i < pos.size(); i ++ ){
         for ( std::vector< Cell * >::const_iterator it = mesh.cells().begin(); it != mesh.cells().end(); it ++ ){
-            Cell *c = *it;
-            double Z = 0.;
-            if ( nInt == 0 ){
-                for ( uint j = 0; j < c->nodeCount(); j ++ ){
-                    // negative Z because all cells are numbered counterclockwise
-                    Z -= 2.0 * lineIntegraldGdz( c->node( j ).pos() - pos[ i ], c->node( (j+1)%c->nodeCount() ).pos() - pos[ i ] );
-                }
-            } else {
-                for ( uint j = 0; j < IntegrationRules::instance().triAbscissa( nInt ).size(); j ++ ){
-                    Z += IntegrationRules::instance().triWeights( nInt )[ j ] *
-                                    f_gz( c->shape().xyz( IntegrationRules::instance().triAbscissa( nInt )[ j ] ), pos[ i ] );
-                }
-            }
-
-            Jacobian[ i ][ c->id() ] = -Z;
+            Jacobian[ i ][ (*it)->id() ] = calcGCell( pos[ i ], **it, nInt );
         }
     }
 
-    return Jacobian * model * 6.67384e-11 * 1e5;
+    return Jacobian * model * GRAVITY_SCALE;
 }
 
 } // namespace GIMLI{
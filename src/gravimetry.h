@@ -20,12 +20,16 @@
 #define _GIMLI_GRAVIMETRY__H
 
 #include "gimli.h"
+#include "hmatrix.h"
 #include "modellingbase.h"
 
 namespace GIMLI {
 
 //! Modelling class for gravimetry calculation using polygon integration
-/*! Modelling class for gravimetry calculation using polygon integration */
+/*! Modelling class for gravimetry calculation using polygon integration.
+ * The problem is linear so the Jacobian is created once as compressed
+ * \ref HMatrix of the \ref GravimetryCellKernel for all sensor positions
+ * and all mesh cells. */
 class DLLEXPORT GravimetryModelling : public ModellingBase {
 public:
     GravimetryModelling( Mesh & mesh, DataContainer & dataContainer, bool verbose = false );
@@ -43,7 +47,45 @@ public:
     /*! Interface. */
     virtual void initJacobian( );
 
+    /*! Set the accuracy of the compressed Jacobian, see \ref HMatrix::build. */
+    void setCompression( double tol, double eta=2.0 ){ tol_ = tol; eta_ = eta; }
+
 protected:
+    /*! The Jacobian changes with the mesh. */
+    virtual void updateMeshDependency_( );
+
+    /*! The Jacobian changes with the sensors. */
+    virtual void updateDataDependency_( );
+
+    double tol_;
+    double eta_;
+
+    /*! Sensor positions of the recent Jacobian. */
+    std::vector< RVector3 > jacobianSensors_;
+};
+
+//! Gravimetry sensitivity kernel dgz/drho for \ref HMatrix.
+/*! Gravimetry sensitivity kernel: entry( i, j ) is the vertical gravity
+ * component in mGal at pos[ i ] for a unit density (kg/m^3) of cell j.
+ * HMatrix( GravimetryCellKernel( pos, mesh ) ) * model is the compressed
+ * equivalent of \ref calcGCells. */
+class DLLEXPORT GravimetryCellKernel : public HMatrixKernel {
+public:
+    GravimetryCellKernel( const std::vector< RVector3 > & pos, const Mesh & mesh, uint nInt = 0 );
+
+    virtual ~GravimetryCellKernel() { }
+
+    virtual double entry( Index row, Index col ) const;
+
+    virtual const std::vector< RVector3 > & rowPositions() const { return pos_; }
+
+    virtual const std::vector< RVector3 > & colPositions() const { return centers_; }
+
+protected:
+    std::vector< RVector3 > pos_;
+    std::vector< RVector3 > centers_;
+    const Mesh * mesh_;
+    uint nInt_;
 };
 
 
@@ -55,6 +97,9 @@ DLLEXPORT double lineIntegraldGdz( const RVector3 & p1, const RVector3 & p2 );
 /*! Do not use until u know what u do. */
 DLLEXPORT RVector calcGBounds( const std::vector< RVector3 > & pos, const Mesh & mesh, const RVector & model );
 
+/*! Do not use until u know what u do. */
+DLLEXPORT double calcGCell( const RVector3 & pos, const Cell & cell, uint nInt = 0 );
+
 /*! Do not use until u know what u do. */
 DLLEXPORT RVector calcGCells( const std::vector< RVector3 > & pos, const Mesh & mesh, const RVector & model, uint nInt = 0 );
 
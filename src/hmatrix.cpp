@@ -0,0 +1,478 @@
+/******************************************************************************
+ *   Copyright (C) 2018 by the GIMLi development team                         *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "hmatrix.h"
+
+#include "calculateMultiThread.h"
+#include "stopwatch.h"
+
+#include <cmath>
+
+namespace GIMLI{
+
+bool aca(const HMatrixKernel & kernel,
+         const IndexArray & rows, const IndexArray & cols,
+         std::vector < RVector > & U, std::vector < RVector > & V,
+         double tol, Index maxRank){
+
+    Index m = rows.size();
+    Index n = cols.size();
+
+    U.clear();
+    V.clear();
+
+    std::vector < bool > usedRow(m, false);
+    Index iStar = 0;
+    double normS2 = 0.0;
+    Index nFails = 0;
+    //** magnitude of the first pivot, scales the test for zero rows
+    double pivot0 = 0.0;
+
+    while (U.size() < maxRank){
+        usedRow[iStar] = true;
+
+        //** residual row iStar
+        RVector r(n);
+        for (Index j = 0; j < n; j ++) r[j] = kernel.entry(rows[iStar], cols[j]);
+        for (Index l = 0; l < U.size(); l ++) r -= V[l] * U[l][iStar];
+
+        Index jStar = 0;
+        double rMax = 0.0;
+        for (Index j = 0; j < n; j ++){
+            if (std::fabs(r[j]) > rMax){ rMax = std::fabs(r[j]); jStar = j; }
+        }
+
+        if (rMax == 0.0 || rMax <= tol * pivot0){
+            //** this row is already approximated, try the next unused one
+            nFails ++;
+            Index next = m;
+            for (Index i = 0; i < m; i ++) if (!usedRow[i]) { next = i; break; }
+            if (next == m || nFails > 3) return true;
+            iStar = next;
+            continue;
+        }
+
+        if (pivot0 == 0.0) pivot0 = rMax;
+
+        RVector v(r / r[jStar]);
+
+        //** residual column jStar
+        RVector u(m);
+        for (Index i = 0; i < m; i ++) u[i] = kernel.entry(rows[i], cols[jStar]);
+        for (Index l = 0; l < U.size(); l ++) u -= U[l] * V[l][jStar];
+
+        double uNorm2 = dot(u, u);
+        double vNorm2 = dot(v, v);
+
+        double cross = 0.0;
+        for (Index l = 0; l < U.size(); l ++) cross += dot(u, U[l]) * dot(v, V[l]);
+        normS2 += uNorm2 * vNorm2 + 2.0 * cross;
+
+        U.push_back(u);
+        V.push_back(v);
+
+        if (std::sqrt(uNorm2 * vNorm2) <= tol * std::sqrt(std::fabs(normS2))) return true;
+
+        //** next pivot row is the largest entry of the new column
+        double uMax = -1.0;
+        for (Index i = 0; i < m; i ++){
+            if (!usedRow[i] && std::fabs(u[i]) > uMax){
+                uMax = std::fabs(u[i]); iStar = i;
+            }
+        }
+        if (uMax < 0.0) return true; // all rows used, exact
+    }
+    return false;
+}
+
+class HMatrixBlockFillMT : public BaseCalcMT{
+public:
+    HMatrixBlockFillMT(std::vector < HMatrix::Block > & blocks,
+                       const HMatrixKernel & kernel,
+                       const IndexArray & rowPerm,
+                       const IndexArray & colPerm,
+                       double tol, bool verbose)
+    : BaseCalcMT(verbose), blocks_(&blocks), kernel_(&kernel),
+      rowPerm_(&rowPerm), colPerm_(&colPerm), tol_(tol){
+    }
+
+    virtual ~HMatrixBlockFillMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index b = start_; b < end_; b ++){
+            HMatrix::Block & block = (*blocks_)[b];
+
+            Index m = block.rowEnd - block.rowStart;
+            Index n = block.colEnd - block.colStart;
+
+            IndexArray rows(m);
+            IndexArray cols(n);
+            for (Index i = 0; i < m; i ++) rows[i] = (*rowPerm_)[block.rowStart + i];
+            for (Index j = 0; j < n; j ++) cols[j] = (*colPerm_)[block.colStart + j];
+
+            if (block.lowRank){
+                //** only worth it if the factors are smaller than the block
+                Index maxRank = (m * n) / (m + n);
+                if (maxRank > 0 &&
+                    aca(*kernel_, rows, cols, block.U, block.V, tol_, maxRank)){
+                    continue;
+                }
+                block.lowRank = false;
+                block.U.clear();
+                block.V.clear();
+            }
+
+            block.D.resize(m, n);
+            for (Index i = 0; i < m; i ++){
+                for (Index j = 0; j < n; j ++){
+                    block.D[i][j] = kernel_->entry(rows[i], cols[j]);
+                }
+            }
+        }
+    }
+
+protected:
+    std::vector < HMatrix::Block >  * blocks_;
+    const HMatrixKernel             * kernel_;
+    const IndexArray                * rowPerm_;
+    const IndexArray                * colPerm_;
+    double tol_;
+};
+
+class HMatrixMultMT : public BaseCalcMT{
+public:
+    HMatrixMultMT(const std::vector < HMatrix::Block > & blocks,
+                  const RVector & x, std::vector < RVector > & y,
+                  bool trans, bool verbose)
+    : BaseCalcMT(verbose), blocks_(&blocks), x_(&x), y_(&y), trans_(trans){
+    }
+
+    virtual ~HMatrixMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        RVector & y = (*y_)[tNr];
+        const RVector & x = *x_;
+
+        for (Index b = start_; b < end_; b ++){
+            const HMatrix::Block & block = (*blocks_)[b];
+
+            Index rS = block.rowStart, rE = block.rowEnd;
+            Index cS = block.colStart, cE = block.colEnd;
+
+            if (trans_){
+                std::swap(rS, cS);
+                std::swap(rE, cE);
+            }
+
+            if (block.lowRank){
+                const std::vector < RVector > & A = trans_ ? block.U : block.V;
+                const std::vector < RVector > & B = trans_ ? block.V : block.U;
+                for (Index l = 0; l < A.size(); l ++){
+                    const double * a = &A[l][0];
+                    const double * b = &B[l][0];
+                    double s = 0.0;
+                    for (Index j = cS; j < cE; j ++) s += a[j - cS] * x[j];
+                    for (Index i = rS; i < rE; i ++) y[i] += b[i - rS] * s;
+                }
+            } else if (trans_){
+                for (Index j = 0; j < block.D.rows(); j ++){
+                    const double * d = &block.D[j][0];
+                    double xj = x[cS + j];
+                    for (Index i = rS; i < rE; i ++) y[i] += d[i - rS] * xj;
+                }
+            } else {
+                for (Index i = rS; i < rE; i ++){
+                    const double * d = &block.D[i - rS][0];
+                    double s = 0.0;
+                    for (Index j = cS; j < cE; j ++) s += d[j - cS] * x[j];
+                    y[i] += s;
+                }
+            }
+        }
+    }
+
+protected:
+    const std::vector < HMatrix::Block > * blocks_;
+    const RVector                        * x_;
+    std::vector < RVector >              * y_;
+    bool trans_;
+};
+
+HMatrix::HMatrix(bool verbose)
+    : MatrixBase(verbose), rows_(0), cols_(0), eta_(2.0),
+      nThreads_(std::max(Index(1), threadCount())){
+}
+
+HMatrix::HMatrix(const HMatrixKernel & kernel, double tol, double eta,
+                 Index leafSize, bool verbose)
+    : MatrixBase(verbose), rows_(0), cols_(0), eta_(eta),
+      nThreads_(std::max(Index(1), threadCount())){
+    build(kernel, tol, eta, leafSize);
+}
+
+void HMatrix::clear(){
+    rows_ = 0;
+    cols_ = 0;
+    rowPerm_.clear();
+    colPerm_.clear();
+    rowTree_.clear();
+    colTree_.clear();
+    blocks_.clear();
+}
+
+void HMatrix::buildClusterTree_(const std::vector < RVector3 > & pos,
+                                IndexArray & perm,
+                                std::vector < Cluster > & tree,
+                                Index leafSize){
+    perm.resize(pos.size());
+    for (Index i = 0; i < perm.size(); i ++) perm[i] = i;
+    tree.clear();
+    if (pos.empty()) return;
+
+    Cluster root;
+    root.start = 0; root.end = pos.size();
+    root.left = -1; root.right = -1;
+    tree.push_back(root);
+
+    std::vector < Index > stack(1, 0);
+    while (!stack.empty()){
+        Index cId = stack.back(); stack.pop_back();
+
+        Index start = tree[cId].start;
+        Index end = tree[cId].end;
+
+        RVector3 pMin(pos[perm[start]]);
+        RVector3 pMax(pos[perm[start]]);
+        for (Index i = start; i < end; i ++){
+            const RVector3 & p = pos[perm[i]];
+            for (Index d = 0; d < 3; d ++){
+                pMin[d] = std::min(pMin[d], p[d]);
+                pMax[d] = std::max(pMax[d], p[d]);
+            }
+        }
+        tree[cId].min = pMin;
+        tree[cId].max = pMax;
+
+        RVector3 ext(pMax - pMin);
+        if (end - start <= leafSize || ext.abs() < TOLERANCE) continue;
+
+        //** split at the median of the longest extension
+        Index dim = 0;
+        if (ext[1] > ext[dim]) dim = 1;
+        if (ext[2] > ext[dim]) dim = 2;
+
+        Index mid = start + (end - start) / 2;
+        std::nth_element(&perm[start], &perm[mid], &perm[0] + end,
+                         [&pos, dim](Index a, Index b){
+                             return pos[a][dim] < pos[b][dim]; });
+
+        Cluster left;
+        left.start = start; left.end = mid;
+        left.left = -1; left.right = -1;
+        Cluster right;
+        right.start = mid; right.end = end;
+        right.left = -1; right.right = -1;
+
+        tree[cId].left = tree.size();
+        tree.push_back(left);
+        tree[cId].right = tree.size();
+        tree.push_back(right);
+
+        stack.push_back(tree[cId].left);
+        stack.push_back(tree[cId].right);
+    }
+}
+
+void HMatrix::buildBlockTree_(Index rc, Index cc){
+    const Cluster & r = rowTree_[rc];
+    const Cluster & c = colTree_[cc];
+
+    double diamR = r.min.dist(r.max);
+    double diamC = c.min.dist(c.max);
+
+    //** distance between the bounding boxes
+    double dist2 = 0.0;
+    for (Index d = 0; d < 3; d ++){
+        double gap = std::max(0.0, std::max(r.min[d] - c.max[d],
+                                            c.min[d] - r.max[d]));
+        dist2 += gap * gap;
+    }
+    double dist = std::sqrt(dist2);
+
+    bool rLeaf = r.left < 0;
+    bool cLeaf = c.left < 0;
+
+    bool admissible = dist > TOLERANCE && std::min(diamR, diamC) <= eta_ * dist;
+
+    if (admissible || (rLeaf && cLeaf)){
+        Block block;
+        block.rowStart = r.start; block.rowEnd = r.end;
+        block.colStart = c.start; block.colEnd = c.end;
+        block.lowRank = admissible;
+        blocks_.push_back(block);
+        return;
+    }
+
+    if (rLeaf){
+        buildBlockTree_(rc, c.left);
+        buildBlockTree_(rc, c.right);
+    } else if (cLeaf){
+        buildBlockTree_(r.left, cc);
+        buildBlockTree_(r.right, cc);
+    } else {
+        SIndex rl = r.left, rr = r.right, cl = c.left, cr = c.right;
+        buildBlockTree_(rl, cl);
+        buildBlockTree_(rl, cr);
+        buildBlockTree_(rr, cl);
+        buildBlockTree_(rr, cr);
+    }
+}
+
+void HMatrix::build(const HMatrixKernel & kernel, double tol, double eta,
+                    Index leafSize){
+    Stopwatch swatch(true);
+    this->clear();
+
+    eta_ = eta;
+    rows_ = kernel.rows();
+    cols_ = kernel.cols();
+
+    if (kernel.rowPositions().size() != rows_ ||
+        kernel.colPositions().size() != cols_){
+        throwLengthError(1, WHERE_AM_I + " kernel positions do not match "
+                         "the kernel size.");
+    }
+    if (rows_ == 0 || cols_ == 0) return;
+
+    leafSize = std::max(Index(1), leafSize);
+    buildClusterTree_(kernel.rowPositions(), rowPerm_, rowTree_, leafSize);
+    buildClusterTree_(kernel.colPositions(), colPerm_, colTree_, leafSize);
+
+    buildBlockTree_(0, 0);
+
+    //** fill the blocks, the bigger ones first for better load balancing
+    std::sort(blocks_.begin(), blocks_.end(), [](const Block & a, const Block & b){
+        return (a.rowEnd - a.rowStart) * (a.colEnd - a.colStart) >
+               (b.rowEnd - b.rowStart) * (b.colEnd - b.colStart); });
+
+    distributeCalc(HMatrixBlockFillMT(blocks_, kernel, rowPerm_, colPerm_,
+                                      tol, verbose_),
+                   blocks_.size(), nThreads_, verbose_);
+
+    if (verbose_){
+        std::cout << "HMatrix(" << rows_ << "x" << cols_ << "): "
+                  << denseBlockCount() << " dense and "
+                  << lowRankBlockCount() << " low-rank blocks, compression: "
+                  << compressionRate() << " (" << swatch.duration() << " s)"
+                  << std::endl;
+    }
+}
+
+RVector HMatrix::mult(const RVector & a) const {
+    if (a.size() != cols_){
+        throwLengthError(1, WHERE_AM_I + " vector/matrix lengths do not match " +
+                         str(cols_) + " " + str(a.size()));
+    }
+    RVector xp(cols_);
+    for (Index j = 0; j < cols_; j ++) xp[j] = a[colPerm_[j]];
+
+    Index nThreads = std::max(Index(1), std::min(nThreads_, Index(blocks_.size())));
+    std::vector < RVector > yp(nThreads, RVector(rows_, 0.0));
+
+    distributeCalc(HMatrixMultMT(blocks_, xp, yp, false, verbose_),
+                   blocks_.size(), nThreads, verbose_);
+
+    RVector ret(rows_, 0.0);
+    for (Index t = 1; t < yp.size(); t ++) yp[0] += yp[t];
+    for (Index i = 0; i < rows_; i ++) ret[rowPerm_[i]] = yp[0][i];
+    return ret;
+}
+
+RVector HMatrix::transMult(const RVector & a) const {
+    if (a.size() != rows_){
+        throwLengthError(1, WHERE_AM_I + " matrix/vector lengths do not match " +
+                         str(a.size()) + " " + str(rows_));
+    }
+    RVector xp(rows_);
+    for (Index i = 0; i < rows_; i ++) xp[i] = a[rowPerm_[i]];
+
+    Index nThreads = std::max(Index(1), std::min(nThreads_, Index(blocks_.size())));
+    std::vector < RVector > yp(nThreads, RVector(cols_, 0.0));
+
+    distributeCalc(HMatrixMultMT(blocks_, xp, yp, true, verbose_),
+                   blocks_.size(), nThreads, verbose_);
+
+    RVector ret(cols_, 0.0);
+    for (Index t = 1; t < yp.size(); t ++) yp[0] += yp[t];
+    for (Index j = 0; j < cols_; j ++) ret[colPerm_[j]] = yp[0][j];
+    return ret;
+}
+
+Index HMatrix::storedValues() const {
+    Index count = 0;
+    for (Index b = 0; b < blocks_.size(); b ++){
+        const Block & block = blocks_[b];
+        if (block.lowRank){
+            count += block.U.size() * ((block.rowEnd - block.rowStart) +
+                                       (block.colEnd - block.colStart));
+        } else {
+            count += (block.rowEnd - block.rowStart) *
+                     (block.colEnd - block.colStart);
+        }
+    }
+    return count;
+}
+
+double HMatrix::compressionRate() const {
+    if (rows_ * cols_ == 0) return 0.0;
+    return double(storedValues()) / (double(rows_) * double(cols_));
+}
+
+Index HMatrix::denseBlockCount() const {
+    Index count = 0;
+    for (Index b = 0; b < blocks_.size(); b ++) if (!blocks_[b].lowRank) count ++;
+    return count;
+}
+
+Index HMatrix::lowRankBlockCount() const {
+    return blocks_.size() - denseBlockCount();
+}
+
+RMatrix HMatrix::toDense() const {
+    RMatrix ret(rows_, cols_);
+    for (Index b = 0; b < blocks_.size(); b ++){
+        const Block & block = blocks_[b];
+        for (Index i = block.rowStart; i < block.rowEnd; i ++){
+            for (Index j = block.colStart; j < block.colEnd; j ++){
+                double v = 0.0;
+                if (block.lowRank){
+                    for (Index l = 0; l < block.U.size(); l ++){
+                        v += block.U[l][i - block.rowStart] *
+                             block.V[l][j - block.colStart];
+                    }
+                } else {
+                    v = block.D[i - block.rowStart][j - block.colStart];
+                }
+                ret[rowPerm_[i]][colPerm_[j]] = v;
+            }
+        }
+    }
+    return ret;
+}
+
+} // namespace GIMLI
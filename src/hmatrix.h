@@ -0,0 +1,182 @@
+/******************************************************************************
+ *   Copyright (C) 2018 by the GIMLi development team                         *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_HMATRIX__H
+#define _GIMLI_HMATRIX__H
+
+#include "gimli.h"
+#include "matrix.h"
+#include "pos.h"
+#include "vector.h"
+
+namespace GIMLI{
+
+//! Interface for matrix entry generators used by \ref HMatrix.
+/*! A kernel returns the single entry (row, col) of a (potentially huge) dense
+ * matrix together with a representative position for each row and column.
+ * The positions are used to build the cluster trees, e.g., station positions
+ * for the rows and cell centers for the columns.
+ * entry() need to be thread safe. */
+class DLLEXPORT HMatrixKernel{
+public:
+    HMatrixKernel(){}
+
+    virtual ~HMatrixKernel(){}
+
+    /*! Return the number of rows. */
+    virtual Index rows() const { return rowPositions().size(); }
+
+    /*! Return the number of columns. */
+    virtual Index cols() const { return colPositions().size(); }
+
+    /*! Return the matrix entry (row, col). */
+    virtual double entry(Index row, Index col) const = 0;
+
+    /*! Return representative positions for all rows. */
+    virtual const std::vector < RVector3 > & rowPositions() const = 0;
+
+    /*! Return representative positions for all columns. */
+    virtual const std::vector < RVector3 > & colPositions() const = 0;
+};
+
+//! Hierarchical matrix with adaptive cross approximation for far-field blocks.
+/*! Hierarchical (H-) matrix representation of a dense kernel matrix.
+ * Rows and columns are recursively bisected into cluster trees by their
+ * kernel positions. Pairs of clusters that are well separated
+ * (min(diam(r), diam(c)) <= eta * dist(r, c)) are compressed into low-rank
+ * blocks U * V^T by adaptive cross approximation (ACA) with partial pivoting
+ * up to the relative tolerance tol. All other blocks on leaf level are
+ * stored dense. The memory grows nearly linear with rows + cols for smooth
+ * kernels, e.g., potential field sensitivities.
+ * Block assembly and the matrix vector products are multithreaded. */
+class DLLEXPORT HMatrix : public MatrixBase{
+public:
+    /*! Default constructor (empty matrix). */
+    HMatrix(bool verbose=false);
+
+    /*! Construct and compress the matrix given by kernel, see \ref build. */
+    HMatrix(const HMatrixKernel & kernel, double tol=1e-6, double eta=2.0,
+            Index leafSize=32, bool verbose=false);
+
+    /*! Default destructor. */
+    virtual ~HMatrix(){}
+
+    /*! Return entity rtti value. */
+    virtual uint rtti() const { return GIMLI_HMATRIX_RTTI; }
+
+    /*! Create the hierarchical representation for the kernel.
+     * tol is the relative accuracy for the low-rank blocks, eta the
+     * admissibility parameter and leafSize the maximal cluster size
+     * that is not further subdivided. */
+    void build(const HMatrixKernel & kernel, double tol=1e-6, double eta=2.0,
+               Index leafSize=32);
+
+    /*! Return number of rows */
+    virtual Index rows() const { return rows_; }
+
+    /*! Return number of cols */
+    virtual Index cols() const { return cols_; }
+
+    /*! Clear the data, set size to zero and frees memory. */
+    virtual void clear();
+
+    /*! Return this * a  */
+    virtual RVector mult(const RVector & a) const;
+
+    /*! Return this.T * a */
+    virtual RVector transMult(const RVector & a) const;
+
+    /*! Return the amount of stored values (dense + low-rank factors). */
+    Index storedValues() const;
+
+    /*! Return the ratio of stored values to rows * cols. */
+    double compressionRate() const;
+
+    /*! Return the amount of dense and low-rank blocks. */
+    Index denseBlockCount() const;
+    Index lowRankBlockCount() const;
+
+    /*! Return the dense matrix. For testing purposes and small matrices only. */
+    RMatrix toDense() const;
+
+    /*! Set the amount of threads for the matrix vector products.
+     * Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) { nThreads_ = std::max(Index(1), nThreads); }
+
+    /*! A single block of the hierarchical matrix. Indices are given
+     * in the permuted (clustered) order. */
+    struct Block {
+        Index rowStart;
+        Index rowEnd;
+        Index colStart;
+        Index colEnd;
+        bool lowRank;
+        /*! Dense entries (lowRank == false) */
+        RMatrix D;
+        /*! Low-rank factors, one vector per rank. */
+        std::vector < RVector > U;
+        std::vector < RVector > V;
+    };
+
+    /*! Read only access to the blocks. */
+    const std::vector < Block > & blocks() const { return blocks_; }
+
+protected:
+
+    struct Cluster {
+        Index start;
+        Index end;
+        RVector3 min;
+        RVector3 max;
+        SIndex left;
+        SIndex right;
+    };
+
+    void buildClusterTree_(const std::vector < RVector3 > & pos,
+                           IndexArray & perm,
+                           std::vector < Cluster > & tree,
+                           Index leafSize);
+
+    void buildBlockTree_(Index rc, Index cc);
+
+    Index rows_;
+    Index cols_;
+    double eta_;
+    Index nThreads_;
+
+    IndexArray rowPerm_;
+    IndexArray colPerm_;
+
+    std::vector < Cluster > rowTree_;
+    std::vector < Cluster > colTree_;
+
+    std::vector < Block > blocks_;
+};
+
+/*! Approximate the block (rows x cols) of kernel with adaptive cross
+ * approximation with partial pivoting. Returns false if the required rank
+ * would exceed maxRank. All tests are relative to the first pivot and the
+ * estimated block norm, so they do not depend on the scale of the kernel. */
+DLLEXPORT bool aca(const HMatrixKernel & kernel,
+                   const IndexArray & rows, const IndexArray & cols,
+                   std::vector < RVector > & U, std::vector < RVector > & V,
+                   double tol, Index maxRank);
+
+} // namespace GIMLI
+
+#endif // _GIMLI_HMATRIX__H
@@ -18,62 +18,294 @@
 
 #include "interpolate.h"
 
+#include "calculateMultiThread.h"
 #include "meshentities.h"
 #include "mesh.h"
 #include "node.h"
 #include "shape.h"
 
+#include <cerrno>
+#include <cstring>
+
 namespace GIMLI{
 
-void interpolate(const Mesh & mesh, const RMatrix & vData,
-                 const R3Vector & ipos, RMatrix & iData,
-                 bool verbose, double fillValue){ ALLOW_PYTHON_THREADS
+//** y[i] = sum_k vals[k] * x[colIdx[k]] for the rows [start, end)
+static void interpolationMult_(const IndexArray & rowPtr,
+                               const IndexArray & colIdx,
+                               const RVector & vals,
+                               const double * x, double * y,
+                               Index start, Index end, double fillValue){
+    for (Index i = start; i < end; i ++){
+        Index kS = rowPtr[i], kE = rowPtr[i + 1];
+        if (kS == kE){
+            y[i] = fillValue;
+        } else {
+            double v = 0.0;
+            for (Index k = kS; k < kE; k ++) v += vals[k] * x[colIdx[k]];
+            y[i] = v;
+        }
+    }
+}
+
+class InterpolationMultMT : public BaseCalcMT{
+public:
+    InterpolationMultMT(const IndexArray & rowPtr, const IndexArray & colIdx,
+                        const RVector & vals, const double * x, double * y,
+                        double fillValue)
+    : BaseCalcMT(false), rowPtr_(&rowPtr), colIdx_(&colIdx), vals_(&vals),
+      x_(x), y_(y), fillValue_(fillValue){
+    }
+
+    virtual ~InterpolationMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        interpolationMult_(*rowPtr_, *colIdx_, *vals_, x_, y_,
+                           start_, end_, fillValue_);
+    }
+
+protected:
+    const IndexArray * rowPtr_;
+    const IndexArray * colIdx_;
+    const RVector * vals_;
+    const double * x_;
+    double * y_;
+    double fillValue_;
+};
+
+class InterpolationApplyMT : public BaseCalcMT{
+public:
+    InterpolationApplyMT(const InterpolationOperator & I, const RMatrix & A,
+                         RMatrix & B, double fillValue)
+    : BaseCalcMT(false), I_(&I), A_(&A), B_(&B), fillValue_(fillValue){
+    }
+
+    virtual ~InterpolationApplyMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index i = start_; i < end_; i ++){
+            interpolationMult_(I_->rowPtr(), I_->colIndices(), I_->vals(),
+                               &(*A_)[i][0], &(*B_)[i][0],
+                               0, I_->rows(), fillValue_);
+        }
+    }
+
+protected:
+    const InterpolationOperator * I_;
+    const RMatrix * A_;
+    RMatrix * B_;
+    double fillValue_;
+};
+
+InterpolationOperator::InterpolationOperator(bool verbose)
+    : MatrixBase(verbose), cols_(0), cellBased_(false){
+    nThreads_ = threadCount();
+}
+
+InterpolationOperator::InterpolationOperator(const Mesh & mesh,
+                                             const R3Vector & pos,
+                                             bool cellBased, bool verbose)
+    : MatrixBase(verbose), cols_(0), cellBased_(false){
+    nThreads_ = threadCount();
+    build(mesh, pos, cellBased);
+}
+
+void InterpolationOperator::clear(){
+    cols_ = 0;
+    rowPtr_.clear();
+    colIdx_.clear();
+    vals_.clear();
+}
 
+void InterpolationOperator::build(const Mesh & mesh, const R3Vector & ipos,
+                                  bool cellBased){
     R3Vector pos(ipos);
 
     if (mesh.dim() == 2){
         if ((zVari(pos) || max(abs(z(pos))) > 0.) &&
             (!yVari(pos) && max(abs(y(pos))) < 1e-8)) {
-            if (verbose)
+            if (verbose_)
                 std::cout << "Warning! swap YZ coordinates for query "
                             "positions to meet mesh dimensions." << std::endl;
             swapYZ(pos);
         }
     }
 
+    this->clear();
+    cellBased_ = cellBased;
+    cols_ = cellBased ? mesh.cellCount() : mesh.nodeCount();
+
+    IVector cellIds;
+    RVector rst;
+    mesh.findCells(pos, cellIds, rst);
+
+    //** count first to fill the compressed row storage in one go
+    rowPtr_.resize(pos.size() + 1, 0);
+    for (Index j = 0; j < pos.size(); j ++) {
+        Index n = 0;
+        if (cellIds[j] > -1){
+            n = cellBased ? 1 : mesh.cell(cellIds[j]).nodeCount();
+        }
+        rowPtr_[j + 1] = rowPtr_[j] + n;
+    }
+    colIdx_.resize(rowPtr_[pos.size()]);
+    vals_.resize(rowPtr_[pos.size()]);
+
+    RVector N;
+    for (Index j = 0; j < pos.size(); j ++) {
+        if (cellIds[j] < 0) continue;
+
+        const Cell & c = mesh.cell(cellIds[j]);
+        Index k = rowPtr_[j];
+        if (cellBased){
+            colIdx_[k] = c.id();
+            vals_[k] = 1.0;
+        } else {
+            N.resize(c.nodeCount());
+            c.N(RVector3(rst[3 * j], rst[3 * j + 1], rst[3 * j + 2]), N);
+            for (Index i = 0; i < c.nodeCount(); i ++){
+                colIdx_[k + i] = c.node(i).id();
+                vals_[k + i] = N[i];
+            }
+        }
+    }
+}
+
+RVector InterpolationOperator::mult(const RVector & a) const {
+    return apply(a, 0.0);
+}
+
+RVector InterpolationOperator::apply(const RVector & a, double fillValue) const {
+    if (a.size() != cols_){
+        throwLengthError(1, WHERE_AM_I + " vector/matrix lengths do not match " +
+                         str(cols_) + " " + str(a.size()));
+    }
+    RVector ret(this->rows());
+    if (ret.size() == 0) return ret;
+
+    Index nThreads = std::min(nThreads_, ret.size() / 10000 + 1);
+    distributeCalc(InterpolationMultMT(rowPtr_, colIdx_, vals_,
+                                       &a[0], &ret[0], fillValue),
+                   ret.size(), nThreads, verbose_);
+    return ret;
+}
+
+RMatrix InterpolationOperator::apply(const RMatrix & A, double fillValue) const {
+    for (Index i = 0; i < A.rows(); i ++){
+        if (A[i].size() != cols_){
+            throwLengthError(1, WHERE_AM_I + " vector/matrix lengths do not match " +
+                             str(cols_) + " " + str(A[i].size()));
+        }
+    }
+    RMatrix ret(A.rows(), this->rows());
+    if (A.rows() == 0 || this->rows() == 0) return ret;
+
+    if (A.rows() == 1){
+        ret[0] = apply(A[0], fillValue);
+    } else {
+        Index nThreads = std::min(nThreads_, A.rows());
+        distributeCalc(InterpolationApplyMT(*this, A, ret, fillValue),
+                       A.rows(), nThreads, verbose_);
+    }
+    return ret;
+}
+
+RVector InterpolationOperator::transMult(const RVector & a) const {
+    if (a.size() != this->rows()){
+        throwLengthError(1, WHERE_AM_I + " matrix/vector lengths do not match " +
+                         str(a.size()) + " " + str(this->rows()));
+    }
+    RVector ret(cols_, 0.0);
+    for (Index i = 0; i < this->rows(); i ++){
+        for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++){
+            ret[colIdx_[k]] += vals_[k] * a[i];
+        }
+    }
+    return ret;
+}
+
+BVector InterpolationOperator::valid() const {
+    BVector ret(this->rows(), false);
+    for (Index i = 0; i < ret.size(); i ++) ret[i] = rowPtr_[i + 1] > rowPtr_[i];
+    return ret;
+}
+
+void InterpolationOperator::save(const std::string & filename) const {
+    FILE * file = fopen(filename.c_str(), "w+b");
+    if (!file) throwError(1, filename + ": " + strerror(errno));
+
+    int64 head[4] = {(int64)this->rows(), (int64)cols_,
+                     (int64)vals_.size(), (int64)cellBased_};
+    bool ok = fwrite(head, sizeof(int64), 4, file) == 4;
+
+    std::vector < int64 > idx(rowPtr_.size());
+    for (Index i = 0; i < idx.size(); i ++) idx[i] = rowPtr_[i];
+    if (ok && idx.size()) ok = fwrite(&idx[0], sizeof(int64), idx.size(), file) == idx.size();
+
+    idx.resize(colIdx_.size());
+    for (Index i = 0; i < idx.size(); i ++) idx[i] = colIdx_[i];
+    if (ok && idx.size()) ok = fwrite(&idx[0], sizeof(int64), idx.size(), file) == idx.size();
+
+    if (ok && vals_.size()) ok = fwrite(&vals_[0], sizeof(double), vals_.size(), file) == vals_.size();
+    fclose(file);
+
+    if (!ok) throwError(1, WHERE_AM_I + " cannot write: " + filename);
+}
+
+void InterpolationOperator::load(const std::string & filename){
+    FILE * file = fopen(filename.c_str(), "r+b");
+    if (!file) throwError(1, filename + ": " + strerror(errno));
+
+    this->clear();
+    int64 head[4];
+    bool ok = fread(head, sizeof(int64), 4, file) == 4 && head[0] >= 0 && head[2] >= 0;
+
+    std::vector < int64 > idx;
+    if (ok){
+        idx.resize(head[0] + 1);
+        ok = fread(&idx[0], sizeof(int64), idx.size(), file) == idx.size();
+        rowPtr_.resize(idx.size());
+        for (Index i = 0; i < idx.size(); i ++) rowPtr_[i] = idx[i];
+    }
+    if (ok && head[2] > 0){
+        idx.resize(head[2]);
+        ok = fread(&idx[0], sizeof(int64), idx.size(), file) == idx.size();
+        colIdx_.resize(idx.size());
+        for (Index i = 0; i < idx.size(); i ++) colIdx_[i] = idx[i];
+
+        vals_.resize(head[2]);
+        if (ok) ok = fread(&vals_[0], sizeof(double), vals_.size(), file) == vals_.size();
+    }
+    fclose(file);
+
+    if (!ok || rowPtr_[rowPtr_.size() - 1] != (Index)head[2]){
+        this->clear();
+        throwError(1, WHERE_AM_I + " cannot read interpolation operator: " + filename);
+    }
+    cols_ = head[1];
+    cellBased_ = head[3] != 0;
+}
+
+void interpolate(const Mesh & mesh, const RMatrix & vData,
+                 const R3Vector & pos, RMatrix & iData,
+                 bool verbose, double fillValue){ ALLOW_PYTHON_THREADS
+
     if (iData.rows() != vData.rows()){
         iData.resize(vData.rows(), pos.size());
     }
 
-    std::vector < Cell * > cells(pos.size());
-    size_t count = 0;
-
-    Cell * c = 0;
-    for (uint i = 0; i < pos.size(); i ++) {
-//         __MS(pos[i])
-        c = mesh.findCell(pos[i], count, false);
-//         if (!c) {
-//             __MS(pos[i])
-// //             c = mesh.findCell(pos[i], count, true);
-// //             if (!c) exit(0);
-//         }
-        cells[i] = c;
-//         if (verbose) std::cout << "\r" << i + 1 << " \t/ " << pos.size()
-//                                << "\t searched: " << count << std::endl;
-    }
-    if (verbose) std::cout << std::endl;
+    //** locate all positions once and apply the weights to each data vector
+    InterpolationOperator I(verbose);
+    I.build(mesh, pos, false);
 
     for (uint i = 0; i < vData.rows(); i ++) {
         if (verbose) std::cout << "\r" << i + 1 << " \t/ " << vData.rows();
 
-        RVector data;
-
         if (vData[i].size() != 0){
 
             if (vData[i].size() == mesh.nodeCount()){
-                data = vData[i];
+                iData[i] = I.apply(vData[i], fillValue);
             } else if (vData[i].size() == mesh.cellCount()){
-                data = cellDataToPointData(mesh, vData[i]);
+                iData[i] = I.apply(cellDataToPointData(mesh, vData[i]), fillValue);
             } else {
                 throwLengthError(EXIT_VECTOR_SIZE_INVALID,
                                  WHERE_AM_I +
@@ -83,32 +315,6 @@ void interpolate(const Mesh & mesh, const RMatrix & vData,
                                  toStr(mesh.nodeCount()) + " != " +
                                  toStr(mesh.cellCount()));
             }
-
-            for (uint j = 0; j < pos.size(); j ++) {
-                if (cells[j]){
-                    iData[i][j] = cells[j]->pot(pos[j], data);
-
-//              this check is obsolete if the findCell (from above) is working properly
-//                     if (cells[j]->shape().isInside(pos[j])){
-//                         iData[i][j] = cells[j]->pot(pos[j], data);
-//                     } else {
-//                         std::cout << WHERE_AM_I << " here is somethng wrong" << std::endl;
-//                     }
-
-//                    std::cout << j << " " << iData[i][j] << std::endl;
-                    //** return cell data
-//                    iData[i][j] = vData[i][cells[j]->id()];
-                } else {
-                    iData[i][j] = fillValue;
-                    //std::cout << "Cant find cell for " << pos[j]<< std::endl;
-//                     for (uint i = 0; i < mesh.cellCount(); i ++){
-//                     	if (mesh.cell(i).shape().isInside(pos[j], true)){
-//                         	std::cout << mesh.cell(i) << std::endl;
-//                         }
-//                     }
-//                     exit(0);
-                }
-            }
         } // if vData.size() != 0
     }  // for each in vData
     if (verbose) std::cout << std::endl;
@@ -264,10 +470,9 @@ RVector cellDataToPointData(const Mesh & mesh, const RVector & cellData){
 
     RVector ret(mesh.nodeCount());
 
-    std::set < Cell * > cset;
-    for (uint i = 0; i < mesh.nodeCount(); i ++){
-        cset = mesh.node(i).cellSet();
-        for (std::set < Cell * >::iterator it = cset.begin(); it != cset.end(); it ++){
+    for (Index i = 0; i < mesh.nodeCount(); i ++){
+        const std::set < Cell * > & cset = mesh.node(i).cellSet();
+        for (std::set < Cell * >::const_iterator it = cset.begin(); it != cset.end(); it ++){
             ret[i] += cellData[(*it)->id()];
         }
         ret[i] /= cset.size();
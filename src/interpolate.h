@@ -25,6 +25,92 @@
 
 namespace GIMLI{
 
+//! Compiled interpolation operator in compressed row storage.
+/*! Linear operator from values given on a source mesh to a set of
+ * destination positions. The expensive point location and shape function
+ * evaluation is done once in \ref build, afterwards the operator can be
+ * applied to any number of data vectors by a multithreaded sparse
+ * matrix vector product, e.g., for repeated mesh to mesh transfers in
+ * time-lapse inversion.
+ * Node based values are interpolated with the shape functions of the cell
+ * containing the position (cols = mesh.nodeCount()). If cellBased is set,
+ * the value of the containing cell is taken (cols = mesh.cellCount()).
+ * Rows for positions outside the mesh are empty and will be set to the
+ * fill value by \ref apply. */
+class DLLEXPORT InterpolationOperator : public MatrixBase{
+public:
+    /*! Default constructor (empty operator). */
+    InterpolationOperator(bool verbose=false);
+
+    /*! Construct the operator from mesh to the positions pos, see \ref build. */
+    InterpolationOperator(const Mesh & mesh, const R3Vector & pos,
+                          bool cellBased=false, bool verbose=false);
+
+    /*! Default destructor. */
+    virtual ~InterpolationOperator(){}
+
+    /*! Return entity rtti value. */
+    virtual uint rtti() const { return GIMLI_INTERPOLATIONOPERATOR_RTTI; }
+
+    /*! Create the operator from mesh to the positions pos. */
+    void build(const Mesh & mesh, const R3Vector & pos, bool cellBased=false);
+
+    /*! Return number of rows, i.e., the number of destination positions. */
+    virtual Index rows() const { return rowPtr_.size() > 0 ? rowPtr_.size() - 1 : 0; }
+
+    /*! Return number of cols, i.e., nodeCount or cellCount of the source mesh. */
+    virtual Index cols() const { return cols_; }
+
+    /*! Clear the data, set size to zero and frees memory. */
+    virtual void clear();
+
+    /*! Return this * a. Positions outside the mesh are 0. */
+    virtual RVector mult(const RVector & a) const;
+
+    /*! Return this.T * a */
+    virtual RVector transMult(const RVector & a) const;
+
+    /*! Return this * a with fillValue for all positions outside the mesh. */
+    RVector apply(const RVector & a, double fillValue=0.0) const;
+
+    /*! Apply the operator to each row of A and return the results row wise.
+     * The rows are processed in parallel. */
+    RMatrix apply(const RMatrix & A, double fillValue=0.0) const;
+
+    /*! Return true if the operator works on cell values. */
+    bool cellBased() const { return cellBased_; }
+
+    /*! Return true for all positions inside the source mesh. */
+    BVector valid() const;
+
+    /*! Return the amount of nonzero entries. */
+    Index nVals() const { return vals_.size(); }
+
+    /*! Read only access to the compressed row storage. */
+    const IndexArray & rowPtr() const { return rowPtr_; }
+    const IndexArray & colIndices() const { return colIdx_; }
+    const RVector & vals() const { return vals_; }
+
+    /*! Set the amount of threads for \ref mult and \ref apply.
+     * Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) { nThreads_ = std::max(Index(1), nThreads); }
+
+    /*! Save the operator into a binary file. */
+    virtual void save(const std::string & filename) const;
+
+    /*! Load the operator from a binary file written by \ref save. */
+    void load(const std::string & filename);
+
+protected:
+    Index cols_;
+    bool cellBased_;
+    Index nThreads_;
+
+    IndexArray rowPtr_;
+    IndexArray colIdx_;
+    RVector vals_;
+};
+
 /*! Utility function for interpolation. */
 DLLEXPORT void interpolate(const Mesh & srcMesh, const RVector & inVec,
                            const R3Vector & destPos, RVector & outVec,
@@ -22,9 +22,11 @@
 
 #include "vector.h"
 #include "inversionBase.h"
+#include "memwatch.h"
 #include "mesh.h"
 #include "modellingbase.h"
 #include "numericbase.h"
+#include "profiler.h"
 #include "regionManager.h"
 #include "solver.h"
 #include "stopwatch.h"
@@ -412,6 +414,7 @@ public:
             forward_->constraints()->rows() == 0){
             if (verbose_) std::cout << "Building constraints matrix" << std::endl;
             //forward_->regionManager().fillConstraints(forward_->constraints());
+            MemoryScope memoryScope(MEMORY_CONSTRAINTS);
             forward_->createConstraints();
         } else {
             if (verbose_) std::cout << " found valid constraints matrix. omit rebuild" << std::endl;
@@ -455,6 +458,8 @@ public:
         }
         Stopwatch swatch(true);
         if (verbose_) std::cout << "calculating jacobian matrix ...";
+        GIMLI_PROFILE("Jacobian");
+        MemoryScope memoryScope(MEMORY_JACOBIAN);
         forward_->createJacobian(model_);
         if (verbose_) std::cout << "... " << swatch.duration(true) << " s" << std::endl;
     }
@@ -699,6 +704,7 @@ public:
 
     /*! Start with linear interpolation, followed by quadratic fit if linesearch parameter tau is lower than 0.03. Tries to return values between 0.03 and 1 */
     double linesearch(const Vec & modelNew, const Vec & responseNew) const {
+        GIMLI_PROFILE("Inversion::linesearch");
         Vec phiVector(101, getPhi());
         Vec phiDVector(101 , getPhiD());
 
@@ -934,6 +940,7 @@ const Vector < ModelValType > & Inversion< ModelValType >::start(){
 /*! Run inversion with current model. */
 template < class ModelValType >
 const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_THREADS
+    GIMLI_PROFILE("Inversion::run");
 
     if (model_.size() == 0) setModel(forward_->startModel());
 
@@ -1046,6 +1053,7 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
         if (verbose_) std::cout << "Iter: " << iter_ << std::endl;
 
         if (!oneStep()) break;
+        if (verbose_) std::cout << memoryReport();
         //** no idea why this should be saved
         //DOSAVE save(*forward_->jacobian() * model_, "dataJac_"  + toStr(iter_) PLUS_TMP_VECSUFFIX);
         DOSAVE save(response_,    "response_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
@@ -1075,10 +1083,15 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
     } //** while iteration;
     isRunning_ = false;
     ipc_.setBool("running", false);
+    DOSAVE {
+        std::fstream file;
+        if (openOutFile("memory.log", & file)) file << memoryReport();
+    }
     return model_;
 } //** run
 
 template < class Vec > bool Inversion< Vec>::oneStep() {
+    GIMLI_PROFILE("Inversion::oneStep");
     iter_++;
     ipc_.setInt("Iter", iter_);
 
@@ -1098,6 +1111,8 @@ template < class Vec > bool Inversion< Vec>::oneStep() {
     if ((recalcJacobian_ && iter_ > 1) || jacobiNeedRecalc_ ) {
         Stopwatch swatch(true);
         if (verbose_) std::cout << "recalculating jacobian matrix ...";
+        GIMLI_PROFILE("Jacobian");
+        MemoryScope memoryScope(MEMORY_JACOBIAN);
         forward_->createJacobian(model_);
         if (verbose_) std::cout << swatch.duration(true) << " s" << std::endl;
     }
@@ -17,12 +17,338 @@
  ******************************************************************************/
 
 #include "ipcClient.h"
+#include "mesh.h"
+#include "meshentities.h"
+#include "node.h"
 
 //#include <boost/thread.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 namespace GIMLI{
 
+//** 'GSHM', written after the values so incomplete segments are refused
+static const uint32 __SHM_MAGIC__ = 0x4d485347;
+
+//** values start at a cache line
+struct SHMHeader__{
+    uint32 magic;
+    uint32 type;
+    uint64 rows;
+    uint64 cols;
+    uint64 valSize;
+    char pad[32];
+};
+
+static const char * __SHM_MESH_PARTS__[8] = {"nodes", "nodeMarkers",
+    "cellOffsets", "cellNodes", "cellMarkers",
+    "boundaryOffsets", "boundaryNodes", "boundaryMarkers"};
+
+IPCStoreSHM::IPCStoreSHM(const std::string & name, bool verbose)
+    : name_(name), verbose_(verbose){
+    if (name.find('/') != std::string::npos){
+        throwError(1, WHERE_AM_I + " no '/' allowed in store name: " + name);
+    }
+}
+
+IPCStoreSHM::~IPCStoreSHM(){
+#if !defined(_WIN32)
+    for (std::map < std::string, Segment >::iterator it = segments_.begin();
+         it != segments_.end(); it ++){
+        munmap(it->second.base, it->second.size);
+    }
+#endif
+}
+
+std::string IPCStoreSHM::segmentName(const std::string & key) const {
+    if (key.find('/') != std::string::npos){
+        throwError(1, WHERE_AM_I + " no '/' allowed in key: " + key);
+    }
+    return "/" + name_ + "." + key;
+}
+
+void IPCStoreSHM::publish_(const std::string & key, TypeID type,
+                           const void * data, Index rows, Index cols,
+                           Index valSize){
+    char * vals = create_(key, type, rows, cols, valSize);
+    if (rows * cols > 0) std::memcpy(vals, data, rows * cols * valSize);
+    commit_(key, vals);
+}
+
+char * IPCStoreSHM::create_(const std::string & key, TypeID type,
+                            Index rows, Index cols, Index valSize){
+#if defined(_WIN32)
+    throwError(1, WHERE_AM_I + " shared memory store is POSIX only.");
+    return NULL;
+#else
+    std::string name(segmentName(key));
+    Index size = sizeof(SHMHeader__) + rows * cols * valSize;
+
+    //** attached processes keep the old object
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0){
+        throwError(1, WHERE_AM_I + " cannot create " + name + ": " + strerror(errno));
+    }
+    if (ftruncate(fd, size) != 0){
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throwError(1, WHERE_AM_I + " cannot resize " + name + " to " + str(size)
+                   + " bytes: " + strerror(errno));
+    }
+    void * base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED){
+        shm_unlink(name.c_str());
+        throwError(1, WHERE_AM_I + " cannot map " + name + ": " + strerror(errno));
+    }
+
+    SHMHeader__ * header = (SHMHeader__ *)base;
+    header->type = type;
+    header->rows = rows;
+    header->cols = cols;
+    header->valSize = valSize;
+    return (char *)base + sizeof(SHMHeader__);
+#endif
+}
+
+void IPCStoreSHM::commit_(const std::string & key, char * vals){
+#if !defined(_WIN32)
+    SHMHeader__ * header = (SHMHeader__ *)(vals - sizeof(SHMHeader__));
+    Index size = sizeof(SHMHeader__) + header->rows * header->cols * header->valSize;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = __SHM_MAGIC__;
+
+    if (verbose_) std::cout << "Published " << segmentName(key) << " ("
+                            << header->rows << "x" << header->cols
+                            << ", " << size << " bytes)" << std::endl;
+    munmap(header, size);
+#endif
+}
+
+const void * IPCStoreSHM::attach_(const std::string & key, TypeID type,
+                                  Index & rows, Index & cols){
+#if defined(_WIN32)
+    throwError(1, WHERE_AM_I + " shared memory store is POSIX only.");
+    return NULL;
+#else
+    std::string name(segmentName(key));
+    std::map < std::string, Segment >::iterator it = segments_.find(key);
+
+    if (it == segments_.end()){
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0){
+            throwError(1, WHERE_AM_I + " " + name + " is not published: " + strerror(errno));
+        }
+        struct stat st;
+        fstat(fd, &st);
+        Index size = st.st_size;
+        if (size < sizeof(SHMHeader__)){
+            ::close(fd);
+            throwError(1, WHERE_AM_I + " " + name + " is not complete.");
+        }
+        void * base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED){
+            throwError(1, WHERE_AM_I + " cannot map " + name + ": " + strerror(errno));
+        }
+
+        const SHMHeader__ * header = (const SHMHeader__ *)base;
+        if (header->magic != __SHM_MAGIC__ ||
+            size < sizeof(SHMHeader__) + header->rows * header->cols * header->valSize){
+            munmap(base, size);
+            throwError(1, WHERE_AM_I + " " + name + " is not complete.");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        Segment seg;
+        seg.base = base;
+        seg.size = size;
+        it = segments_.insert(std::make_pair(key, seg)).first;
+        if (verbose_) std::cout << "Attached " << name << " (" << header->rows
+                                << "x" << header->cols << ")" << std::endl;
+    }
+
+    const SHMHeader__ * header = (const SHMHeader__ *)it->second.base;
+    if (header->type != uint32(type)){
+        throwError(1, WHERE_AM_I + " " + name + " has type " + str(header->type)
+                   + " but " + str(int(type)) + " is requested.");
+    }
+    rows = header->rows;
+    cols = header->cols;
+    return (const char *)it->second.base + sizeof(SHMHeader__);
+#endif
+}
+
+void IPCStoreSHM::publish(const std::string & key, const RVector & v){
+    publish_(key, RVECTOR, v.size() ? &v[0] : NULL, 1, v.size(), sizeof(double));
+}
+
+void IPCStoreSHM::publish(const std::string & key, const IVector & v){
+    publish_(key, IVECTOR, v.size() ? &v[0] : NULL, 1, v.size(), sizeof(SIndex));
+}
+
+void IPCStoreSHM::publish(const std::string & key, const IndexArray & v){
+    publish_(key, INDEXARRAY, v.size() ? &v[0] : NULL, 1, v.size(), sizeof(Index));
+}
+
+void IPCStoreSHM::publish(const std::string & key, const RMatrix & A){
+    for (Index i = 0; i < A.rows(); i ++){
+        if (A[i].size() != A.cols()){
+            throwLengthError(1, WHERE_AM_I + " row " + str(i) + " has "
+                             + str(A[i].size()) + " values, " + str(A.cols())
+                             + " are expected.");
+        }
+    }
+    //** the rows of a RMatrix are not contiguous, copy them one by one
+    Index rowSize = A.cols() * sizeof(double);
+    char * vals = create_(key, RMATRIX, A.rows(), A.cols(), sizeof(double));
+    if (rowSize > 0){
+        for (Index i = 0; i < A.rows(); i ++){
+            std::memcpy(vals + i * rowSize, &A[i][0], rowSize);
+        }
+    }
+    commit_(key, vals);
+}
+
+template < class Ent > void flatTopology__(const std::vector < Ent * > & ents,
+                                           IndexArray & offsets, IndexArray & ids,
+                                           IVector & markers){
+    offsets.resize(ents.size() + 1);
+    markers.resize(ents.size());
+    offsets[0] = 0;
+    for (Index i = 0; i < ents.size(); i ++){
+        offsets[i + 1] = offsets[i] + ents[i]->nodeCount();
+        markers[i] = ents[i]->marker();
+    }
+    ids.resize(offsets[ents.size()]);
+    for (Index i = 0; i < ents.size(); i ++){
+        for (Index j = 0; j < ents[i]->nodeCount(); j ++){
+            ids[offsets[i] + j] = ents[i]->node(j).id();
+        }
+    }
+}
+
+void IPCStoreSHM::publish(const std::string & key, const Mesh & mesh){
+    Index dim = mesh.dim();
+    RMatrix nodes(mesh.nodeCount(), dim);
+    IVector nodeMarkers(mesh.nodeCount());
+    for (Index i = 0; i < mesh.nodeCount(); i ++){
+        const RVector3 & p = mesh.node(i).pos();
+        for (Index j = 0; j < dim; j ++) nodes[i][j] = p[j];
+        nodeMarkers[i] = mesh.node(i).marker();
+    }
+
+    IndexArray offsets, ids;
+    IVector markers;
+
+    publish(key + "." + __SHM_MESH_PARTS__[0], nodes);
+    publish(key + "." + __SHM_MESH_PARTS__[1], nodeMarkers);
+    flatTopology__(mesh.cells(), offsets, ids, markers);
+    publish(key + "." + __SHM_MESH_PARTS__[2], offsets);
+    publish(key + "." + __SHM_MESH_PARTS__[3], ids);
+    publish(key + "." + __SHM_MESH_PARTS__[4], markers);
+    flatTopology__(mesh.boundaries(), offsets, ids, markers);
+    publish(key + "." + __SHM_MESH_PARTS__[5], offsets);
+    publish(key + "." + __SHM_MESH_PARTS__[6], ids);
+    publish(key + "." + __SHM_MESH_PARTS__[7], markers);
+}
+
+const RVector & IPCStoreSHM::vector(const std::string & key){
+    Index rows = 0, cols = 0;
+    double * data = (double *)attach_(key, RVECTOR, rows, cols);
+    RVector & v = segments_[key].r;
+    if (v.size() != cols || (cols && &v[0] != data)) v.wrap(data, cols);
+    return v;
+}
+
+const IVector & IPCStoreSHM::ivector(const std::string & key){
+    Index rows = 0, cols = 0;
+    SIndex * data = (SIndex *)attach_(key, IVECTOR, rows, cols);
+    IVector & v = segments_[key].i;
+    if (v.size() != cols || (cols && &v[0] != data)) v.wrap(data, cols);
+    return v;
+}
+
+const IndexArray & IPCStoreSHM::indexArray(const std::string & key){
+    Index rows = 0, cols = 0;
+    Index * data = (Index *)attach_(key, INDEXARRAY, rows, cols);
+    IndexArray & v = segments_[key].idx;
+    if (v.size() != cols || (cols && &v[0] != data)) v.wrap(data, cols);
+    return v;
+}
+
+const RMatrix & IPCStoreSHM::matrix(const std::string & key){
+    Index rows = 0, cols = 0;
+    double * data = (double *)attach_(key, RMATRIX, rows, cols);
+    RMatrix & A = segments_[key].A;
+    if (A.rows() != rows || A.cols() != cols) A.wrap(data, rows, cols);
+    return A;
+}
+
+Mesh IPCStoreSHM::mesh(const std::string & key){
+    const RMatrix & nodes = matrix(key + "." + __SHM_MESH_PARTS__[0]);
+    const IVector & nodeMarkers = ivector(key + "." + __SHM_MESH_PARTS__[1]);
+    const IndexArray & cellOffsets = indexArray(key + "." + __SHM_MESH_PARTS__[2]);
+    const IndexArray & cellNodes = indexArray(key + "." + __SHM_MESH_PARTS__[3]);
+    const IVector & cellMarkers = ivector(key + "." + __SHM_MESH_PARTS__[4]);
+    const IndexArray & boundOffsets = indexArray(key + "." + __SHM_MESH_PARTS__[5]);
+    const IndexArray & boundNodes = indexArray(key + "." + __SHM_MESH_PARTS__[6]);
+    const IVector & boundMarkers = ivector(key + "." + __SHM_MESH_PARTS__[7]);
+
+    Mesh mesh(nodes.cols());
+    for (Index i = 0; i < nodes.rows(); i ++){
+        RVector3 p;
+        for (Index j = 0; j < nodes.cols(); j ++) p[j] = nodes[i][j];
+        mesh.createNode(p, nodeMarkers[i]);
+    }
+
+    std::vector < Node * > ns;
+    for (Index i = 0; i < cellMarkers.size(); i ++){
+        ns.resize(cellOffsets[i + 1] - cellOffsets[i]);
+        for (Index j = 0; j < ns.size(); j ++) ns[j] = &mesh.node(cellNodes[cellOffsets[i] + j]);
+        mesh.createCell(ns, cellMarkers[i]);
+    }
+    for (Index i = 0; i < boundMarkers.size(); i ++){
+        ns.resize(boundOffsets[i + 1] - boundOffsets[i]);
+        for (Index j = 0; j < ns.size(); j ++) ns[j] = &mesh.node(boundNodes[boundOffsets[i] + j]);
+        mesh.createBoundary(ns, boundMarkers[i], false);
+    }
+    mesh.createNeighbourInfos();
+    return mesh;
+}
+
+bool IPCStoreSHM::exists(const std::string & key) const {
+#if defined(_WIN32)
+    return false;
+#else
+    int fd = shm_open(segmentName(key).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+#endif
+}
+
+void IPCStoreSHM::remove(const std::string & key){
+#if !defined(_WIN32)
+    shm_unlink(segmentName(key).c_str());
+    for (Index i = 0; i < 8; i ++){
+        shm_unlink(segmentName(key + "." + __SHM_MESH_PARTS__[i]).c_str());
+    }
+    if (verbose_) std::cout << "Removed " << segmentName(key) << std::endl;
+#endif
+}
+
+
 // boost::asio::io_service io_service;
 // boost::mutex __sendMsgMutex__;
 //
@@ -20,8 +20,11 @@
 #define _GIMLI_IPC_CLIENT__H
 
 #include "gimli.h"
+#include "matrix.h"
+#include "vector.h"
 
 #include <deque>
+#include <map>
 
 #ifndef USE_IPC
     #define USE_IPC 0
@@ -201,6 +204,116 @@ protected:
 #endif
 };
 
+//! Store for large read-only data in POSIX shared memory.
+/*! Publish a vector, matrix or the flat topology of a mesh once, and
+ * attach it from other processes on the same host without copying,
+ * e.g., many worker processes that share a mesh and its Jacobian:
+ * Publisher:
+ * IPCStoreSHM store("survey"); store.publish("J", J);
+ * Worker:
+ * IPCStoreSHM store("survey"); const RMatrix & J = store.matrix("J");
+ * Each key is a shared memory object /name.key that persists until it is
+ * removed by \ref remove or the host reboots. Attached data are mapped
+ * read only and stay valid as long as the store lives, writing into
+ * them crashes, copy them to change the values. Publishing an existing
+ * key replaces it for later attaches, already attached processes keep
+ * the old values. POSIX only. */
+class DLLEXPORT IPCStoreSHM{
+public:
+    /*! Store with the namespace name for all keys. */
+    IPCStoreSHM(const std::string & name, bool verbose=false);
+
+    /*! Unmap all attached data. Published data remain. */
+    ~IPCStoreSHM();
+
+    /*! Publish the values of v under key. */
+    void publish(const std::string & key, const RVector & v);
+
+    /*! Publish the values of v under key. */
+    void publish(const std::string & key, const IVector & v);
+
+    /*! Publish the values of v under key. */
+    void publish(const std::string & key, const IndexArray & v);
+
+    /*! Publish the values of the matrix A under key. */
+    void publish(const std::string & key, const RMatrix & A);
+
+    /*! Publish the flat topology of mesh under key: node positions and
+     * markers, node ids and markers of cells and boundaries. The parts
+     * are available by the keys key.nodes (matrix nodes x dimension),
+     * key.nodeMarkers, key.cellOffsets, key.cellNodes, key.cellMarkers,
+     * key.boundaryOffsets, key.boundaryNodes and key.boundaryMarkers.
+     * The nodes of cell i are cellNodes[cellOffsets[i]:cellOffsets[i+1]]. */
+    void publish(const std::string & key, const Mesh & mesh);
+
+    /*! Return the shared vector key without copying. */
+    const RVector & vector(const std::string & key);
+
+    /*! Return the shared vector key without copying. */
+    const IVector & ivector(const std::string & key);
+
+    /*! Return the shared index array key without copying. */
+    const IndexArray & indexArray(const std::string & key);
+
+    /*! Return the shared matrix key without copying. */
+    const RMatrix & matrix(const std::string & key);
+
+    /*! Return a new mesh created from the shared flat topology key. */
+    Mesh mesh(const std::string & key);
+
+    /*! Return true if key is published. */
+    bool exists(const std::string & key) const;
+
+    /*! Remove the published key and all parts of a published mesh.
+     * Attached processes keep their data until they unmap it. */
+    void remove(const std::string & key);
+
+    /*! Return the namespace of the store. */
+    inline const std::string & name() const { return name_; }
+
+    /*! Return the name of the shared memory object for key. */
+    std::string segmentName(const std::string & key) const;
+
+    /*! Type of the shared data */
+    enum TypeID { RVECTOR = 1, IVECTOR = 2, INDEXARRAY = 3, RMATRIX = 4 };
+
+protected:
+    /*! Create the segment key with rows x cols values of size valSize. */
+    void publish_(const std::string & key, TypeID type, const void * data,
+                  Index rows, Index cols, Index valSize);
+
+    /*! Create and map the segment key and return its first value to be
+     * filled. The segment is invisible until \ref commit_. */
+    char * create_(const std::string & key, TypeID type,
+                   Index rows, Index cols, Index valSize);
+
+    /*! Mark the segment key, filled at vals, as complete and unmap it. */
+    void commit_(const std::string & key, char * vals);
+
+    /*! Attach the segment key and return the first value. */
+    const void * attach_(const std::string & key, TypeID type,
+                         Index & rows, Index & cols);
+
+    struct Segment{
+        void * base;
+        Index size;
+        RVector r;
+        IVector i;
+        IndexArray idx;
+        RMatrix A;
+    };
+
+    std::string name_;
+    bool verbose_;
+    std::map < std::string, Segment > segments_;
+
+private:
+    /*! Copy constructor is private, so don't use it */
+    IPCStoreSHM(const IPCStoreSHM &){};
+    /*! Assignment operator is private, so don't use it */
+    void operator = (const IPCStoreSHM &){ };
+};
+
 // using boost::asio::ip::tcp;
 //
 // inline void writeToData( char * data, const std::string & val, int & count ){
@@ -18,35 +18,342 @@
 
 #include "kdtreeWrapper.h"
 
+#include "calculateMultiThread.h"
 #include "node.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace GIMLI{
 
-inline double tac( Node * n, size_t i ) { return n->pos()[ i ]; }
+//! Ranges smaller than this are searched brute force.
+static const Index KDTREE_LEAFSIZE = 8;
+//! Amount of inserted nodes that are searched linear before merging.
+static const Index KDTREE_BUFFERSIZE = 64;
+
+class KDTreeAxisLess{
+public:
+    KDTreeAxisLess(const R3Vector & pos, Index axis) : pos_(&pos), axis_(axis){}
+    inline bool operator()(Index a, Index b) const {
+        return (*pos_)[a][axis_] < (*pos_)[b][axis_];
+    }
+protected:
+    const R3Vector * pos_;
+    Index axis_;
+};
+
+void StaticKDTree::build(const R3Vector & pos, const IndexArray & ids){
+    if (pos.size() != ids.size()){
+        throwLengthError(1, WHERE_AM_I + " pos.size() != ids.size() " +
+                         str(pos.size()) + " " + str(ids.size()));
+    }
+    Index n = pos.size();
+    IndexArray perm(n);
+    for (Index i = 0; i < n; i ++) perm[i] = i;
+
+    axis_.assign(n, 0);
+    build_(0, n, perm, pos);
+
+    xyz_.resize(3 * n);
+    ids_.resize(n);
+    for (Index i = 0; i < n; i ++){
+        const RVector3 & p = pos[perm[i]];
+        xyz_[3 * i]     = p[0];
+        xyz_[3 * i + 1] = p[1];
+        xyz_[3 * i + 2] = p[2];
+        ids_[i] = ids[perm[i]];
+    }
+}
+
+void StaticKDTree::build_(Index start, Index end, IndexArray & perm,
+                          const R3Vector & pos){
+    if (end - start <= KDTREE_LEAFSIZE) return;
+
+    //** split along the axis with the largest extent
+    RVector3 pMin(pos[perm[start]]), pMax(pos[perm[start]]);
+    for (Index i = start + 1; i < end; i ++){
+        const RVector3 & p = pos[perm[i]];
+        for (Index d = 0; d < 3; d ++){
+            pMin[d] = std::min(pMin[d], p[d]);
+            pMax[d] = std::max(pMax[d], p[d]);
+        }
+    }
+    RVector3 ext(pMax - pMin);
+    Index axis = 0;
+    if (ext[1] > ext[axis]) axis = 1;
+    if (ext[2] > ext[axis]) axis = 2;
+
+    Index mid = (start + end) / 2;
+    std::nth_element(&perm[start], &perm[mid], &perm[0] + end,
+                     KDTreeAxisLess(pos, axis));
+    axis_[mid] = axis;
+
+    build_(start, mid, perm, pos);
+    build_(mid + 1, end, perm, pos);
+}
+
+void StaticKDTree::nearest(const RVector3 & pos, Index & id, double & dist2) const {
+    if (ids_.size() == 0) return;
+    double p[3] = {pos[0], pos[1], pos[2]};
+    Index best = ids_.size();
+    nearest_(0, ids_.size(), p, best, dist2);
+    if (best < ids_.size()) id = ids_[best];
+}
+
+void StaticKDTree::nearest_(Index start, Index end, const double * p,
+                            Index & id, double & dist2) const {
+    if (end - start <= KDTREE_LEAFSIZE){
+        for (Index i = start; i < end; i ++){
+            double d2 = dist2_(i, p);
+            if (d2 < dist2){ dist2 = d2; id = i; }
+        }
+        return;
+    }
+    Index mid = (start + end) / 2;
+    double d2 = dist2_(mid, p);
+    if (d2 < dist2){ dist2 = d2; id = mid; }
 
-KDTreeWrapper::KDTreeWrapper(){
-    tree_ = new NodeKDTree( std::ptr_fun( tac ) );
+    double diff = p[axis_[mid]] - xyz_[3 * mid + axis_[mid]];
+    if (diff < 0.0){
+        nearest_(start, mid, p, id, dist2);
+        if (diff * diff < dist2) nearest_(mid + 1, end, p, id, dist2);
+    } else {
+        nearest_(mid + 1, end, p, id, dist2);
+        if (diff * diff < dist2) nearest_(start, mid, p, id, dist2);
+    }
+}
+
+void StaticKDTree::kNearest(const RVector3 & pos, Index k,
+                            std::vector < std::pair < double, Index > > & heap) const {
+    if (ids_.size() == 0 || k == 0) return;
+    double p[3] = {pos[0], pos[1], pos[2]};
+    kNearest_(0, ids_.size(), p, k, heap);
+}
+
+static inline void pushHeap_(std::vector < std::pair < double, Index > > & heap,
+                      Index k, double d2, Index id){
+    if (heap.size() < k){
+        heap.push_back(std::pair< double, Index >(d2, id));
+        std::push_heap(heap.begin(), heap.end());
+    } else if (d2 < heap.front().first){
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = std::pair< double, Index >(d2, id);
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+void StaticKDTree::kNearest_(Index start, Index end, const double * p, Index k,
+                             std::vector < std::pair < double, Index > > & heap) const {
+    if (end - start <= KDTREE_LEAFSIZE){
+        for (Index i = start; i < end; i ++) pushHeap_(heap, k, dist2_(i, p), ids_[i]);
+        return;
+    }
+    Index mid = (start + end) / 2;
+    pushHeap_(heap, k, dist2_(mid, p), ids_[mid]);
+
+    double diff = p[axis_[mid]] - xyz_[3 * mid + axis_[mid]];
+    Index s1 = start, e1 = mid, s2 = mid + 1, e2 = end;
+    if (diff >= 0.0) { std::swap(s1, s2); std::swap(e1, e2); }
+
+    kNearest_(s1, e1, p, k, heap);
+    if (heap.size() < k || diff * diff < heap.front().first){
+        kNearest_(s2, e2, p, k, heap);
+    }
+}
+
+void StaticKDTree::radius(const RVector3 & pos, double r2, std::vector < Index > & ret) const {
+    if (ids_.size() == 0) return;
+    double p[3] = {pos[0], pos[1], pos[2]};
+    radius_(0, ids_.size(), p, r2, ret);
+}
+
+void StaticKDTree::radius_(Index start, Index end, const double * p, double r2,
+                           std::vector < Index > & ret) const {
+    if (end - start <= KDTREE_LEAFSIZE){
+        for (Index i = start; i < end; i ++){
+            if (dist2_(i, p) <= r2) ret.push_back(ids_[i]);
+        }
+        return;
+    }
+    Index mid = (start + end) / 2;
+    if (dist2_(mid, p) <= r2) ret.push_back(ids_[mid]);
+
+    double diff = p[axis_[mid]] - xyz_[3 * mid + axis_[mid]];
+    if (diff <= 0.0 || diff * diff <= r2) radius_(start, mid, p, r2, ret);
+    if (diff >= 0.0 || diff * diff <= r2) radius_(mid + 1, end, p, r2, ret);
+}
+
+KDTreeWrapper::KDTreeWrapper()
+    : nThreads_(threadCount()){
 }
 
 KDTreeWrapper::~KDTreeWrapper(){
-    if ( tree_ ) delete tree_;
 }
 
-void KDTreeWrapper::insert( Node * node ){
-    tree_->insert( node );
+void KDTreeWrapper::clear(){
+    nodes_.clear();
+    base_ = StaticKDTree();
+    levels_.clear();
+    buffer_.clear();
+}
+
+void KDTreeWrapper::build(const std::vector < Node * > & nodes){
+    clear();
+    nodes_ = nodes;
+
+    R3Vector pos(nodes_.size());
+    IndexArray ids(nodes_.size());
+    for (Index i = 0; i < nodes_.size(); i ++){
+        pos[i] = nodes_[i]->pos();
+        ids[i] = i;
+    }
+    base_.build(pos, ids);
+}
+
+void KDTreeWrapper::insert(Node * node){
+    buffer_.push_back(nodes_.size());
+    nodes_.push_back(node);
+    if (buffer_.size() >= KDTREE_BUFFERSIZE) merge_();
+}
+
+void KDTreeWrapper::merge_(){
+    //** binary counter: collect the buffer and all full levels until the
+    //** first empty level and build a new tree there
+    IndexArray ids(buffer_);
+    Index level = 0;
+    for (; level < levels_.size(); level ++){
+        if (levels_[level].size() == 0) break;
+        const IndexArray & lIds = levels_[level].ids();
+        for (Index i = 0; i < lIds.size(); i ++) ids.push_back(lIds[i]);
+        levels_[level] = StaticKDTree();
+    }
+    if (level == levels_.size()) levels_.push_back(StaticKDTree());
+
+    R3Vector pos(ids.size());
+    for (Index i = 0; i < ids.size(); i ++) pos[i] = nodes_[ids[i]]->pos();
+    levels_[level].build(pos, ids);
+    buffer_.clear();
+}
+
+uint KDTreeWrapper::size() const{
+    return nodes_.size();
+}
+
+Node * KDTreeWrapper::nearest(const RVector3 & pos) const {
+    if (nodes_.empty()) return NULL;
+
+    Index id = 0;
+    double dist2 = std::numeric_limits< double >::max();
+    base_.nearest(pos, id, dist2);
+    for (Index i = 0; i < levels_.size(); i ++) levels_[i].nearest(pos, id, dist2);
+    for (Index i = 0; i < buffer_.size(); i ++){
+        double d2 = pos.distSquared(nodes_[buffer_[i]]->pos());
+        if (d2 < dist2) { dist2 = d2; id = buffer_[i]; }
+    }
+    return nodes_[id];
 }
 
-Node * KDTreeWrapper::nearest( const RVector3 & pos ){
-    Node testNode( pos );
-    return *tree_->find_nearest( &testNode ).first;
+std::vector < Node * > KDTreeWrapper::kNearest(const RVector3 & pos, Index k) const {
+    std::vector < std::pair < double, Index > > heap;
+    heap.reserve(k + 1);
+    base_.kNearest(pos, k, heap);
+    for (Index i = 0; i < levels_.size(); i ++) levels_[i].kNearest(pos, k, heap);
+    for (Index i = 0; i < buffer_.size(); i ++){
+        pushHeap_(heap, k, pos.distSquared(nodes_[buffer_[i]]->pos()), buffer_[i]);
+    }
+    std::sort_heap(heap.begin(), heap.end());
+
+    std::vector < Node * > ret(heap.size());
+    for (Index i = 0; i < heap.size(); i ++) ret[i] = nodes_[heap[i].second];
+    return ret;
+}
+
+std::vector < Node * > KDTreeWrapper::radius(const RVector3 & pos, double r) const {
+    std::vector < Index > ids;
+    double r2 = r * r;
+    base_.radius(pos, r2, ids);
+    for (Index i = 0; i < levels_.size(); i ++) levels_[i].radius(pos, r2, ids);
+    for (Index i = 0; i < buffer_.size(); i ++){
+        if (pos.distSquared(nodes_[buffer_[i]]->pos()) <= r2) ids.push_back(buffer_[i]);
+    }
+    std::vector < Node * > ret(ids.size());
+    for (Index i = 0; i < ids.size(); i ++) ret[i] = nodes_[ids[i]];
+    return ret;
+}
+
+class KDTreeQueryMT : public BaseCalcMT{
+public:
+    KDTreeQueryMT(const KDTreeWrapper & tree, const R3Vector & pos,
+                  std::vector < std::vector < Node * > > & ret,
+                  Index k, double r)
+    : BaseCalcMT(false), tree_(&tree), pos_(&pos), ret_(&ret), k_(k), r_(r){
+    }
+
+    virtual ~KDTreeQueryMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index i = start_; i < end_; i ++){
+            if (k_ > 0) {
+                (*ret_)[i] = tree_->kNearest((*pos_)[i], k_);
+            } else {
+                (*ret_)[i] = tree_->radius((*pos_)[i], r_);
+            }
+        }
+    }
+
+protected:
+    const KDTreeWrapper * tree_;
+    const R3Vector * pos_;
+    std::vector < std::vector < Node * > > * ret_;
+    Index k_;
+    double r_;
+};
+
+class KDTreeNearestMT : public BaseCalcMT{
+public:
+    KDTreeNearestMT(const KDTreeWrapper & tree, const R3Vector & pos,
+                    std::vector < Node * > & ret)
+    : BaseCalcMT(false), tree_(&tree), pos_(&pos), ret_(&ret){
+    }
+
+    virtual ~KDTreeNearestMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index i = start_; i < end_; i ++){
+            (*ret_)[i] = tree_->nearest((*pos_)[i]);
+        }
+    }
+
+protected:
+    const KDTreeWrapper * tree_;
+    const R3Vector * pos_;
+    std::vector < Node * > * ret_;
+};
+
+std::vector < Node * > KDTreeWrapper::nearest(const R3Vector & pos) const {
+    std::vector < Node * > ret(pos.size(), NULL);
+    if (pos.size() == 0) return ret;
+    distributeCalc(KDTreeNearestMT(*this, pos, ret), pos.size(),
+                   std::min(nThreads_, pos.size()));
+    return ret;
 }
 
-uint KDTreeWrapper::size( ) const{
-    return tree_->size();
+std::vector < std::vector < Node * > > KDTreeWrapper::kNearest(const R3Vector & pos,
+                                                               Index k) const {
+    std::vector < std::vector < Node * > > ret(pos.size());
+    if (pos.size() == 0 || k == 0) return ret;
+    distributeCalc(KDTreeQueryMT(*this, pos, ret, k, 0.0), pos.size(),
+                   std::min(nThreads_, pos.size()));
+    return ret;
 }
 
-NodeKDTree * KDTreeWrapper::tree() {
-    return tree_;
+std::vector < std::vector < Node * > > KDTreeWrapper::radius(const R3Vector & pos,
+                                                             double r) const {
+    std::vector < std::vector < Node * > > ret(pos.size());
+    if (pos.size() == 0) return ret;
+    distributeCalc(KDTreeQueryMT(*this, pos, ret, 0, r), pos.size(),
+                   std::min(nThreads_, pos.size()));
+    return ret;
 }
 
 } // namespace GIMLI
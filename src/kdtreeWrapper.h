@@ -20,25 +20,81 @@
 #define _GIMLI_KDTREEWRAPPER__H
 
 #include "gimli.h"
+#include "pos.h"
+#include "vector.h"
 
 #include <iostream>
 
-#ifdef _MSC_VER
-	// warning from kdtree
-	#pragma warning( disable: 4396)
-#endif
+namespace GIMLI{
 
-//#define KDTREE_DEFINE_OSTREAM_OPERATORS
-#include <kdtree++/kdtree.hpp>
+//! Static kd-tree for three-dimensional points in a flat memory layout.
+/*! The tree is build once for a given point set. The points are reordered
+ * such that the median of each range [start, end) is the splitting point,
+ * so the tree need no node pointers and all coordinates are stored
+ * contiguously. Every query returns the ids given on build. */
+class DLLEXPORT StaticKDTree{
+public:
+    /*! Standard constructor (empty tree) */
+    StaticKDTree(){}
 
-typedef KDTree::KDTree< 3, GIMLI::Node *, std::pointer_to_binary_function< GIMLI::Node *, size_t, double > > NodeKDTree;
+    /*! Build the tree for the positions pos with the corresponding ids. */
+    void build(const R3Vector & pos, const IndexArray & ids);
 
-namespace GIMLI{
+    /*! Return the amount of points inside the tree. */
+    inline Index size() const { return ids_.size(); }
+
+    /*! Return the ids of the points in tree order. */
+    inline const IndexArray & ids() const { return ids_; }
+
+    /*! Search the nearest point to pos. id and dist2 (squared distance)
+     * are only updated if a point closer than sqrt(dist2) is found. */
+    void nearest(const RVector3 & pos, Index & id, double & dist2) const;
+
+    /*! Update the max-heap (squared distance, id) with the k nearest points
+     * to pos. */
+    void kNearest(const RVector3 & pos, Index k,
+                  std::vector < std::pair < double, Index > > & heap) const;
+
+    /*! Append the ids of all points with squared distance <= r2 to pos. */
+    void radius(const RVector3 & pos, double r2, std::vector < Index > & ret) const;
+
+protected:
+    void build_(Index start, Index end, IndexArray & perm,
+                const R3Vector & pos);
+
+    void nearest_(Index start, Index end, const double * p,
+                  Index & id, double & dist2) const;
+
+    void kNearest_(Index start, Index end, const double * p, Index k,
+                   std::vector < std::pair < double, Index > > & heap) const;
+
+    void radius_(Index start, Index end, const double * p, double r2,
+                 std::vector < Index > & ret) const;
+
+    inline double dist2_(Index i, const double * p) const {
+        const double * x = &xyz_[3 * i];
+        return (x[0] - p[0]) * (x[0] - p[0]) +
+               (x[1] - p[1]) * (x[1] - p[1]) +
+               (x[2] - p[2]) * (x[2] - p[2]);
+    }
+
+    /*! Coordinates of the reordered points: x0, y0, z0, x1, ... */
+    std::vector < double > xyz_;
+    /*! Splitting axis for the median of each range */
+    std::vector < unsigned char > axis_;
+    IndexArray ids_;
+};
 
 //! Interface class for a kd-search tree. We use it for fast nearest neighbor point search in three dimensions.
-/*! Interface class for a kd-search tree. Currently we use libkdtree++ from: http://libkdtreeplus-pplus-p.sourcearchive.com/
-We use it for fast nearest neighbor point search in three dimensions. The tree is designed to cooperate with \ref Mesh thus it has to be feeded by pointers of \ref Node. */
-class KDTreeWrapper{
+/*! Interface class for a kd-search tree for fast nearest, k-nearest and
+radius point search in three dimensions. The tree is designed to cooperate
+with \ref Mesh thus it has to be feeded by pointers of \ref Node.
+All nodes given by \ref build are stored in one \ref StaticKDTree.
+Nodes added by \ref insert are collected in a small buffer and merged into
+static trees of growing size (logarithmic method), so single inserts,
+e.g., from \ref Mesh::createNodeWithCheck, stay cheap as well.
+The batch queries for many positions are multithreaded. */
+class DLLEXPORT KDTreeWrapper{
 public:
     /*! Standard constructor */
     KDTreeWrapper();
@@ -46,20 +102,56 @@ public:
     /*! Standard destructor */
     ~KDTreeWrapper();
 
+    /*! Remove all nodes from the tree. */
+    void clear();
+
+    /*! Replace the content of the tree by nodes (bulk build). */
+    void build(const std::vector < Node * > & nodes);
+
     /*! Insert new node to the tree */
-    void insert( Node * node );
+    void insert(Node * node);
+
+    /*! Find the nearest \ref Node to the coordinates pos.
+     * Return NULL for an empty tree. */
+    Node * nearest(const RVector3 & pos) const;
+
+    /*! Find the k nearest \ref Node to the coordinates pos sorted by distance. */
+    std::vector < Node * > kNearest(const RVector3 & pos, Index k) const;
+
+    /*! Find all \ref Node within the distance r to the coordinates pos. */
+    std::vector < Node * > radius(const RVector3 & pos, double r) const;
 
-    /*! Find the nearest \ref Node to the coordinates pos. */
-    Node * nearest( const RVector3 & pos );
+    /*! Find the nearest \ref Node for each position in pos. */
+    std::vector < Node * > nearest(const R3Vector & pos) const;
+
+    /*! Find the k nearest \ref Node for each position in pos. */
+    std::vector < std::vector < Node * > > kNearest(const R3Vector & pos,
+                                                    Index k) const;
+
+    /*! Find all \ref Node within the distance r for each position in pos. */
+    std::vector < std::vector < Node * > > radius(const R3Vector & pos,
+                                                  double r) const;
 
     /*! Return the amount of nodes inside the tree. */
-    uint size( ) const;
+    uint size() const;
 
-    /*! Return a pointer to the base libkdetree++  */
-    NodeKDTree * tree();
+    /*! Set the amount of threads for the batch queries.
+     * Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) { nThreads_ = std::max(Index(1), nThreads); }
 
 protected:
-    NodeKDTree * tree_;
+    void merge_();
+
+    std::vector < Node * > nodes_;
+
+    /*! Tree for the nodes from the bulk build. */
+    StaticKDTree base_;
+    /*! Trees for inserted nodes, level i holds 0 or bufferSize * 2^i nodes */
+    std::vector < StaticKDTree > levels_;
+    /*! Inserted nodes not yet in any tree */
+    IndexArray buffer_;
+
+    Index nThreads_;
 };
 
 } // namespace GIMLI
@@ -0,0 +1,352 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "ldltWrapper.h"
+#include "sparsematrix.h"
+#include "stopwatch.h"
+
+namespace GIMLI{
+
+IndexArray nestedDissection(const std::vector < int > & rowPtr,
+                            const std::vector < int > & colIdx,
+                            Index leafSize){
+    Index n = rowPtr.size() - 1;
+    IndexArray perm(n);
+    if (n == 0) return perm;
+
+    std::vector < int > owner(n, -1);
+    std::vector < int > seen(n, -1);
+    std::vector < int > lev(n, 0);
+    int stamp = 0, visit = 0;
+
+    //** breadth first search inside the current part (owner == stamp)
+    std::vector < int > order;
+    std::vector < int > levelStart;
+    auto bfs = [&](int root){
+        visit ++;
+        order.clear();
+        levelStart.clear();
+        order.push_back(root);
+        seen[root] = visit;
+        lev[root] = 0;
+        for (Index q = 0; q < order.size(); q ++){
+            int v = order[q];
+            if (levelStart.size() == Index(lev[v])) levelStart.push_back(q);
+            for (int k = rowPtr[v]; k < rowPtr[v + 1]; k ++){
+                int w = colIdx[k];
+                if (owner[w] == stamp && seen[w] != visit){
+                    seen[w] = visit;
+                    lev[w] = lev[v] + 1;
+                    order.push_back(w);
+                }
+            }
+        }
+        levelStart.push_back(order.size());
+    };
+
+    //** parts with their first position in perm, separators are ordered last
+    std::vector < std::pair < std::vector < int >, Index > > stack;
+    stack.push_back(std::make_pair(std::vector < int >(n), 0));
+    for (Index i = 0; i < n; i ++) stack.back().first[i] = i;
+
+    while (!stack.empty()){
+        std::vector < int > nodes;
+        nodes.swap(stack.back().first);
+        Index start = stack.back().second;
+        stack.pop_back();
+
+        if (nodes.size() <= leafSize){
+            for (Index i = 0; i < nodes.size(); i ++) perm[start + i] = nodes[i];
+            continue;
+        }
+        stamp ++;
+        for (Index i = 0; i < nodes.size(); i ++) owner[nodes[i]] = stamp;
+
+        //** pseudo peripheral root
+        bfs(nodes[0]);
+        for (Index iter = 0; iter < 3 && order.size() == nodes.size(); iter ++){
+            Index nLev = levelStart.size() - 1;
+            int root = order[levelStart[nLev - 1]];
+            int minDeg = rowPtr[root + 1] - rowPtr[root];
+            for (Index q = levelStart[nLev - 1]; q < order.size(); q ++){
+                int deg = rowPtr[order[q] + 1] - rowPtr[order[q]];
+                if (deg < minDeg) { minDeg = deg; root = order[q]; }
+            }
+            bfs(root);
+            if (levelStart.size() - 1 <= nLev) break;
+        }
+
+        std::vector < int > a, b, sep;
+        if (order.size() < nodes.size()){
+            //** not connected: first component and the rest
+            a = order;
+            for (Index i = 0; i < nodes.size(); i ++){
+                if (seen[nodes[i]] != visit) b.push_back(nodes[i]);
+            }
+        } else {
+            Index nLev = levelStart.size() - 1;
+            if (nLev < 3){
+                for (Index i = 0; i < nodes.size(); i ++) perm[start + i] = nodes[i];
+                continue;
+            }
+            //** middle level as separator
+            Index m = 1;
+            while (m < nLev - 2 && Index(levelStart[m + 1]) < order.size() / 2) m ++;
+
+            for (Index q = 0; q < Index(levelStart[m]); q ++) a.push_back(order[q]);
+            for (Index q = levelStart[m]; q < Index(levelStart[m + 1]); q ++){
+                int v = order[q];
+                bool touchesB = false;
+                for (int k = rowPtr[v]; k < rowPtr[v + 1]; k ++){
+                    int w = colIdx[k];
+                    if (owner[w] == stamp && lev[w] > int(m)) { touchesB = true; break; }
+                }
+                if (touchesB) sep.push_back(v);
+                else a.push_back(v);
+            }
+            for (Index q = levelStart[m + 1]; q < order.size(); q ++) b.push_back(order[q]);
+        }
+
+        for (Index i = 0; i < sep.size(); i ++){
+            perm[start + a.size() + b.size() + i] = sep[i];
+        }
+        Index startB = start + a.size();
+        stack.push_back(std::make_pair(std::vector < int >(), start));
+        stack.back().first.swap(a);
+        stack.push_back(std::make_pair(std::vector < int >(), startB));
+        stack.back().first.swap(b);
+    }
+    return perm;
+}
+
+LDLTWrapper::LDLTWrapper(RSparseMatrix & S, bool verbose, int stype)
+    : SolverWrapper(S, verbose){
+    dim_ = S.rows();
+    stype_ = stype;
+    if (factorise_(S, stype, Lxr_, Dr_)) dummy_ = false;
+}
+
+LDLTWrapper::LDLTWrapper(CSparseMatrix & S, bool verbose, int stype)
+    : SolverWrapper(S, verbose){
+    dim_ = S.rows();
+    stype_ = stype;
+    if (factorise_(S, stype, Lxc_, Dc_)) dummy_ = false;
+}
+
+LDLTWrapper::~LDLTWrapper(){
+}
+
+int LDLTWrapper::refactorise(RSparseMatrix & S){
+    if (isComplex_ || S.rows() != dim_ || perm_.size() != dim_) return 0;
+    dummy_ = (factorise_(S, stype_, Lxr_, Dr_, true) == 0);
+    //** a failed factorization lets the caller start from scratch
+    return dummy_ ? 0 : 1;
+}
+
+int LDLTWrapper::refactorise(CSparseMatrix & S){
+    if (!isComplex_ || S.rows() != dim_ || perm_.size() != dim_) return 0;
+    dummy_ = (factorise_(S, stype_, Lxc_, Dc_, true) == 0);
+    //** a failed factorization lets the caller start from scratch
+    return dummy_ ? 0 : 1;
+}
+
+template < class ValueType >
+int LDLTWrapper::factorise_(const SparseMatrix < ValueType > & S, int stype,
+                            Vector < ValueType > & Lx, Vector < ValueType > & D,
+                            bool keepOrdering){
+    Stopwatch swatch(true);
+    if (S.rows() != S.cols()){
+        throwLengthError(1, WHERE_AM_I + " matrix needs to be square.");
+    }
+    Index n = S.rows();
+    if (stype == -2 || S.stype() != 0) stype = S.stype();
+
+    const std::vector < int > & ptr = S.vecColPtr();
+    const std::vector < int > & idx = S.vecRowIdx();
+    const Vector < ValueType > & val = S.vecVals();
+
+    //** lower triangle (r >= c) as given by stype
+    std::vector < int > rows, cols;
+    std::vector < ValueType > vals;
+    rows.reserve(S.nVals());
+    cols.reserve(S.nVals());
+    vals.reserve(S.nVals());
+    for (Index i = 0; i < n; i ++){
+        for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+            int j = idx[k];
+            if (stype < 0){
+                if (j < int(i)) continue;
+                rows.push_back(j); cols.push_back(i);
+            } else {
+                if (j > int(i)) continue;
+                rows.push_back(i); cols.push_back(j);
+            }
+            vals.push_back(val[k]);
+        }
+    }
+
+    //** ordering on the symmetric graph, kept for refactorization
+    std::vector < int > pos;
+    if (!keepOrdering || perm_.size() != n){
+        std::vector < int > gPtr(n + 1, 0);
+        for (Index k = 0; k < rows.size(); k ++){
+            if (rows[k] != cols[k]) { gPtr[rows[k] + 1] ++; gPtr[cols[k] + 1] ++; }
+        }
+        for (Index i = 0; i < n; i ++) gPtr[i + 1] += gPtr[i];
+        std::vector < int > gIdx(gPtr[n]);
+        pos.assign(gPtr.begin(), gPtr.end() - 1);
+        for (Index k = 0; k < rows.size(); k ++){
+            if (rows[k] != cols[k]) {
+                gIdx[pos[rows[k]] ++] = cols[k];
+                gIdx[pos[cols[k]] ++] = rows[k];
+            }
+        }
+        perm_ = nestedDissection(gPtr, gIdx);
+    }
+
+    std::vector < int > pinv(n);
+    for (Index k = 0; k < n; k ++) pinv[perm_[k]] = k;
+
+    //** upper triangle of P A P^T column wise
+    std::vector < int > cPtr(n + 1, 0);
+    for (Index k = 0; k < rows.size(); k ++){
+        cPtr[std::max(pinv[rows[k]], pinv[cols[k]]) + 1] ++;
+    }
+    for (Index i = 0; i < n; i ++) cPtr[i + 1] += cPtr[i];
+    std::vector < int > cIdx(cPtr[n]);
+    std::vector < ValueType > cVal(cPtr[n]);
+    pos.assign(cPtr.begin(), cPtr.end() - 1);
+    for (Index k = 0; k < rows.size(); k ++){
+        int i = pinv[rows[k]], j = pinv[cols[k]];
+        int p = pos[std::max(i, j)] ++;
+        cIdx[p] = std::min(i, j);
+        cVal[p] = vals[k];
+    }
+    std::vector < int >().swap(rows);
+    std::vector < int >().swap(cols);
+    std::vector < ValueType >().swap(vals);
+
+    //** symbolic: elimination tree and column counts
+    std::vector < int > parent(n), lnz(n), flag(n);
+    for (Index k = 0; k < n; k ++){
+        parent[k] = -1;
+        flag[k] = k;
+        lnz[k] = 0;
+        for (int p = cPtr[k]; p < cPtr[k + 1]; p ++){
+            for (int i = cIdx[p]; flag[i] != int(k); i = parent[i]){
+                if (parent[i] == -1) parent[i] = k;
+                lnz[i] ++;
+                flag[i] = k;
+            }
+        }
+    }
+    Lp_.assign(n + 1, 0);
+    for (Index k = 0; k < n; k ++) Lp_[k + 1] = Lp_[k] + lnz[k];
+    Li_.resize(Lp_[n]);
+    Lx.resize(Lp_[n]);
+    D.resize(n);
+
+    //** numeric, row by row (up-looking), transposed without conjugation
+    std::vector < ValueType > y(n, ValueType(0));
+    std::vector < int > pattern(n);
+    for (Index k = 0; k < n; k ++){
+        Index top = n;
+        flag[k] = k;
+        lnz[k] = 0;
+        for (int p = cPtr[k]; p < cPtr[k + 1]; p ++){
+            int i = cIdx[p];
+            y[i] += cVal[p];
+            Index len = 0;
+            for (; flag[i] != int(k); i = parent[i]){
+                pattern[len ++] = i;
+                flag[i] = k;
+            }
+            while (len > 0) pattern[-- top] = pattern[-- len];
+        }
+        D[k] = y[k];
+        y[k] = ValueType(0);
+        for (; top < n; top ++){
+            int i = pattern[top];
+            ValueType yi = y[i];
+            y[i] = ValueType(0);
+            int p2 = Lp_[i] + lnz[i];
+            for (int p = Lp_[i]; p < p2; p ++) y[Li_[p]] -= Lx[p] * yi;
+            ValueType lki = yi / D[i];
+            D[k] -= lki * yi;
+            Li_[p2] = k;
+            Lx[p2] = lki;
+            lnz[i] ++;
+        }
+        if (D[k] == ValueType(0)){
+            std::cerr << WHERE_AM_I << " zero pivot in row " << perm_[k]
+                      << ", matrix is singular or needs pivoting." << std::endl;
+            return 0;
+        }
+    }
+
+    if (verbose_) std::cout << "LDL^T: n = " << n << " nnz(L) = " << Li_.size()
+                            << " (" << swatch.duration() << "s)" << std::endl;
+    return 1;
+}
+
+template < class ValueType >
+int LDLTWrapper::solve_(const Vector < ValueType > & Lx, const Vector < ValueType > & D,
+                        const Vector < ValueType > & rhs, Vector < ValueType > & solution) const {
+    if (dummy_) return 0;
+    Index n = dim_;
+    if (rhs.size() != n){
+        throwLengthError(1, WHERE_AM_I + " rhs size mismatch: " + str(n) + " != " + str(rhs.size()));
+    }
+    Vector < ValueType > x(n);
+    for (Index k = 0; k < n; k ++) x[k] = rhs[perm_[k]];
+
+    for (Index j = 0; j < n; j ++){
+        for (int p = Lp_[j]; p < Lp_[j + 1]; p ++) x[Li_[p]] -= Lx[p] * x[j];
+    }
+    for (Index j = 0; j < n; j ++) x[j] /= D[j];
+    for (Index j = n; j > 0; j --){
+        for (int p = Lp_[j - 1]; p < Lp_[j]; p ++) x[j - 1] -= Lx[p] * x[Li_[p]];
+    }
+
+    solution.resize(n);
+    for (Index k = 0; k < n; k ++) solution[perm_[k]] = x[k];
+    return 1;
+}
+
+int LDLTWrapper::solve(const RVector & rhs, RVector & solution){
+    if (isComplex_){
+        CVector sol;
+        int ret = solve_(Lxc_, Dc_, toComplex(rhs, RVector(rhs.size(), 0.0)), sol);
+        solution = real(sol);
+        return ret;
+    }
+    return solve_(Lxr_, Dr_, rhs, solution);
+}
+
+int LDLTWrapper::solve(const CVector & rhs, CVector & solution){
+    if (!isComplex_){
+        RVector re, im;
+        int ret = solve_(Lxr_, Dr_, RVector(real(rhs)), re);
+        solve_(Lxr_, Dr_, RVector(imag(rhs)), im);
+        solution = toComplex(re, im);
+        return ret;
+    }
+    return solve_(Lxc_, Dc_, rhs, solution);
+}
+
+} //namespace GIMLI;
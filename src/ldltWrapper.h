@@ -0,0 +1,93 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_LDLTWRAPPER__H
+#define _GIMLI_LDLTWRAPPER__H
+
+#include "gimli.h"
+#include "solverWrapper.h"
+#include "vector.h"
+
+namespace GIMLI{
+
+//! Sparse LDL^T factorization for real and complex symmetric matrices.
+/*! Direct solver without external dependencies. The factorization
+ * A = P^T L D L^T P uses the transpose without conjugation, so complex
+ * symmetric (non Hermitian) matrices, e.g., from complex resistivity
+ * FEM, need only the half of the memory and work of a general LU.
+ * P is a nested dissection ordering of the matrix graph. There is no
+ * pivoting, so the matrix should be (complex) definite, e.g., from a
+ * positive definite real part. */
+class DLLEXPORT LDLTWrapper : public SolverWrapper {
+public:
+    /*! stype = -2 -> use S.stype(). If S stores only one triangle it will
+     * be mirrored, else the given triangle of S (1: j <= i, -1: j >= i)
+     * is used, or the lower one for stype 0. */
+    LDLTWrapper(RSparseMatrix & S, bool verbose=false, int stype=-2);
+
+    LDLTWrapper(CSparseMatrix & S, bool verbose=false, int stype=-2);
+
+    virtual ~LDLTWrapper();
+
+    static bool valid(){ return true; }
+
+    virtual int solve(const RVector & rhs, RVector & solution);
+
+    virtual int solve(const CVector & rhs, CVector & solution);
+
+    /*! Factorize again with the nested dissection ordering of the
+     * initial matrix. */
+    virtual int refactorise(RSparseMatrix & S);
+
+    virtual int refactorise(CSparseMatrix & S);
+
+    /*! Amount of nonzeros of the factor L without the diagonal. */
+    Index factorNonZeros() const { return Li_.size(); }
+
+    /*! Return the fill reducing permutation: row perm[k] of A is row k of L. */
+    const IndexArray & permutation() const { return perm_; }
+
+protected:
+    template < class ValueType >
+    int factorise_(const SparseMatrix < ValueType > & S, int stype,
+                   Vector < ValueType > & Lx, Vector < ValueType > & D,
+                   bool keepOrdering=false);
+
+    template < class ValueType >
+    int solve_(const Vector < ValueType > & Lx, const Vector < ValueType > & D,
+               const Vector < ValueType > & rhs, Vector < ValueType > & solution) const;
+
+    int stype_;
+    IndexArray perm_;
+    std::vector < int > Lp_;
+    std::vector < int > Li_;
+
+    RVector Lxr_, Dr_;
+    CVector Lxc_, Dc_;
+};
+
+/*! Nested dissection ordering for the graph of the sparse pattern given
+ * by (rowPtr, colIdx), which is assumed to be symmetric. Return perm with
+ * perm[k] = node eliminated in step k. */
+DLLEXPORT IndexArray nestedDissection(const std::vector < int > & rowPtr,
+                                      const std::vector < int > & colIdx,
+                                      Index leafSize=32);
+
+} //namespace GIMLI;
+
+#endif // _GIMLI_LDLTWRAPPER__H
@@ -20,6 +20,12 @@
 #include "sparsematrix.h"
 #include "ldlWrapper.h"
 #include "cholmodWrapper.h"
+#include "pcgWrapper.h"
+#include "ldltWrapper.h"
+#include "memwatch.h"
+#include "profiler.h"
+
+#include <atomic>
 
 namespace GIMLI{
 
@@ -79,6 +85,9 @@ void LinSolver::init_(){
     cols_ = 0;
     solver_ = 0;
     cacheMatrix_ = 0;
+    preconditioner_ = PCG_AMG;
+    pcgTol_ = 1e-10;
+    pcgMaxIter_ = 1000;
 }
 
 LinSolver::~LinSolver(){
@@ -103,6 +112,16 @@ void LinSolver::setSolverType(SolverType solverType){
         if (CHOLMODWrapper::valid()){
             solverType_ = CHOLMOD;
         }
+        //** no direct solver installed
+        if (solverType_ == UNKNOWN){
+            solverType_ = PCG;
+            static std::atomic < bool > reported(false);
+            if (!reported.exchange(true)){
+                log(Warning, "No direct solver installed, LinSolver uses " +
+                             solverName() + ".");
+            }
+        }
+        if (verbose_) log(Info, "LinSolver uses " + solverName() + ".");
     }
 }
 
@@ -114,12 +133,29 @@ void LinSolver::setMatrix(CSparseMatrix & S, int stype){
     initialize_(S, stype);
 }
 
+void LinSolver::refactorize(RSparseMatrix & S, int stype){
+    GIMLI_PROFILE("LinSolver::refactorize");
+    MemoryScope memoryScope(MEMORY_SOLVER);
+    if (solver_ && S.rows() == rows_ && S.cols() == cols_ &&
+        solver_->refactorise(S)) return;
+    initialize_(S, stype);
+}
+
+void LinSolver::refactorize(CSparseMatrix & S, int stype){
+    GIMLI_PROFILE("LinSolver::refactorize");
+    MemoryScope memoryScope(MEMORY_SOLVER);
+    if (solver_ && S.rows() == rows_ && S.cols() == cols_ &&
+        solver_->refactorise(S)) return;
+    initialize_(S, stype);
+}
+
 // template <> void LinSolver::solve(const RVector & rhs, RVector & solution);
 // template <> void LinSolver::solve(const CVector & rhs, CVector & solution);
 // template <> RVector LinSolver::solve(const RVector & rhs);
 // template <> CVector LinSolver::solve(const CVector & rhs);
 
 void LinSolver::solve(const RVector & rhs, RVector & solution){
+    GIMLI_PROFILE("LinSolver::solve");
     solution.resize(rows_);
     if (rhs.size() != cols_){
         std::cerr << WHERE_AM_I << " rhs size mismatch: " << cols_ << "  " << rhs.size() << std::endl;
@@ -128,12 +164,14 @@ void LinSolver::solve(const RVector & rhs, RVector & solution){
 }
 
 RVector LinSolver::solve(const RVector & rhs){
+    GIMLI_PROFILE("LinSolver::solve");
     RVector solution(rhs.size());
     if (solver_) solver_->solve(rhs, solution);
     return solution;
 }
 
 void LinSolver::solve(const CVector & rhs, CVector & solution){
+    GIMLI_PROFILE("LinSolver::solve");
     solution.resize(rows_);
     if (rhs.size() != cols_){
         std::cerr << WHERE_AM_I << " rhs size mismatch: " << cols_ << "  " << rhs.size() << std::endl;
@@ -142,19 +180,34 @@ void LinSolver::solve(const CVector & rhs, CVector & solution){
 }
 
 CVector LinSolver::solve(const CVector & rhs){
+    GIMLI_PROFILE("LinSolver::solve");
     CVector solution(rhs.size());
     if (solver_) solver_->solve(rhs, solution);
     return solution;
 }
 
 void LinSolver::initialize_(RSparseMatrix & S, int stype){
+    GIMLI_PROFILE("LinSolver::factorize");
+    MemoryScope memoryScope(MEMORY_SOLVER);
     rows_ = S.rows();
     cols_ = S.cols();
     setSolverType(solverType_);
 
+    if (solver_) {
+        delete solver_;
+        solver_ = 0;
+    }
+
     switch(solverType_){
         case LDL:     solver_ = new LDLWrapper(S, verbose_); break;
         case CHOLMOD: solver_ = new CHOLMODWrapper(S, verbose_, stype); break;
+        case PCG:{
+            PCGWrapper * pcg = new PCGWrapper(S, verbose_, stype, preconditioner_);
+            pcg->setTolerance(pcgTol_);
+            pcg->setMaxIter(pcgMaxIter_);
+            solver_ = pcg;
+        } break;
+        case LDLT:    solver_ = new LDLTWrapper(S, verbose_, stype); break;
         case UNKNOWN:
     default:
             std::cerr << WHERE_AM_I << " no valid solver found"  << std::endl;
@@ -162,13 +215,23 @@ void LinSolver::initialize_(RSparseMatrix & S, int stype){
 }
 
 void LinSolver::initialize_(CSparseMatrix & S, int stype){
+    GIMLI_PROFILE("LinSolver::factorize");
+    MemoryScope memoryScope(MEMORY_SOLVER);
     rows_ = S.rows();
     cols_ = S.cols();
     setSolverType(solverType_);
 
+    if (solver_) {
+        delete solver_;
+        solver_ = 0;
+    }
+
     switch(solverType_){
         case LDL:     solver_ = new LDLWrapper(S, verbose_); break;
         case CHOLMOD: solver_ = new CHOLMODWrapper(S, verbose_, stype); break;
+        //** no iterative solver for complex matrices yet
+        case PCG:     solverType_ = LDLT; // fall through
+        case LDLT:    solver_ = new LDLTWrapper(S, verbose_, stype); break;
         case UNKNOWN:
     default:
             std::cerr << WHERE_AM_I << " no valid solver found"  << std::endl;
@@ -180,6 +243,14 @@ std::string LinSolver::solverName() const {
   switch(solverType_){
   case LDL:     return "LDL"; break;
   case CHOLMOD: return "CHOLMOD"; break;
+  case LDLT:    return "LDLT"; break;
+  case PCG:
+      switch(preconditioner_){
+      case PCG_IC:     return "PCG/IC"; break;
+      case PCG_JACOBI: return "PCG/Jacobi"; break;
+      default: return "PCG/AMG";
+      }
+      break;
   case UNKNOWN:
   default: return " no valid solver installed";
   }
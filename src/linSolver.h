@@ -26,7 +26,11 @@ namespace GIMLI{
 
 class SolverWrapper;
 
-enum SolverType{AUTOMATIC,LDL,CHOLMOD,UNKNOWN};
+//** new types are appended to keep the values of the existing ones
+enum SolverType{AUTOMATIC,LDL,CHOLMOD,UNKNOWN,PCG,LDLT};
+
+/*! Preconditioner for the iterative solver type PCG. */
+enum PCGPreconditioner{PCG_AMG,PCG_IC,PCG_JACOBI};
 
 class DLLEXPORT LinSolver{
 public:
@@ -61,8 +65,25 @@ public:
     /*! Verbose level = -1, use Linsolver.verbose(). */
     void setMatrix(CSparseMatrix & S, int stype=-2);
 
+    /*! Factorize S which has the same sparsity pattern as the last matrix,
+     * e.g., after a model update. The symbolic analysis (ordering) is reused
+     * if the solver supports it, else this is the same as \ref setMatrix. */
+    void refactorize(RSparseMatrix & S, int stype=-2);
+
+    void refactorize(CSparseMatrix & S, int stype=-2);
+
     SolverType solverType() const { return solverType_; }
 
+    /*! Set the preconditioner for the solver type PCG. Default is PCG_AMG.
+     * Takes effect with the next \ref setMatrix. */
+    void setPreconditioner(PCGPreconditioner preconditioner) { preconditioner_ = preconditioner; }
+
+    PCGPreconditioner preconditioner() const { return preconditioner_; }
+
+    /*! Set relative residual tolerance and maximum iterations for the solver type PCG.
+     * Takes effect with the next \ref setMatrix. */
+    void setIterativeParameter(double tolerance, Index maxIter) { pcgTol_ = tolerance; pcgMaxIter_ = maxIter; }
+
     std::string solverName() const;
 
 protected:
@@ -73,6 +94,9 @@ protected:
 
     MatrixBase * cacheMatrix_;
     SolverType      solverType_;
+    PCGPreconditioner preconditioner_;
+    double          pcgTol_;
+    Index           pcgMaxIter_;
     SolverWrapper * solver_;
     bool            verbose_;
     uint rows_;
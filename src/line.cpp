@@ -91,7 +91,8 @@ bool Line::intersectRay(const RVector3 & start, const RVector3 & dir,
     double t1 = (v2[0] * v1[1] - v1[0] * v2[1]) / d;
     double t2 = v1.dot(v3) / d;
 
-    if (t1 >= 0.0 && t2 >= 0.0 && t2 <= 1.0) {
+    //** rays through the end points hit the line
+    if (t1 >= 0.0 && t2 >= -TOLERANCE && t2 <= 1.0 + TOLERANCE) {
         pos = start + t1 * dirN;
         return true;
     }
@@ -0,0 +1,469 @@
+/******************************************************************************
+ *   Copyright (C) 2018 by the GIMLi development team                         *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "mappedmatrix.h"
+
+#include "calculateMultiThread.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace GIMLI{
+
+/*! uint32 rows and cols, see saveMatrix */
+static const Index __MAPPEDMATRIX_HEADER__ = 2 * sizeof(uint32);
+
+static Index pageSize__(){
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+class MappedMatrixMultMT : public BaseCalcMT{
+public:
+    MappedMatrixMultMT(const MappedMatrix & A, const RVector & x,
+                       std::vector < RVector > & y, bool trans, bool verbose)
+    : BaseCalcMT(verbose), A_(&A), x_(&x), y_(&y), trans_(trans){
+        tileRows_ = A.tileRows();
+    }
+
+    virtual ~MappedMatrixMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        const MappedMatrix & A = *A_;
+        const RVector & x = *x_;
+        Index nRows = A.rows();
+        Index nCols = A.cols();
+
+        //** mult writes disjunct rows into one vector
+        RVector & y = trans_ ? (*y_)[tNr] : (*y_)[0];
+
+        A.prefetch(start_ * tileRows_, std::min(nRows, (start_ + 1) * tileRows_));
+        for (Index t = start_; t < end_; t ++){
+            Index rS = t * tileRows_;
+            Index rE = std::min(nRows, rS + tileRows_);
+            if (t + 1 < end_){
+                A.prefetch(rE, std::min(nRows, rE + tileRows_));
+            }
+
+            if (trans_){
+                double * yp = &y[0];
+                for (Index i = rS; i < rE; i ++){
+                    const double * a = A.rowData(i);
+                    double xi = x[i];
+                    for (Index j = 0; j < nCols; j ++) yp[j] += a[j] * xi;
+                }
+            } else {
+                const double * xp = &x[0];
+                for (Index i = rS; i < rE; i ++){
+                    const double * a = A.rowData(i);
+                    double s = 0.0;
+                    for (Index j = 0; j < nCols; j ++) s += a[j] * xp[j];
+                    y[i] = s;
+                }
+            }
+            A.release(rS, rE);
+        }
+    }
+
+protected:
+    const MappedMatrix * A_;
+    const RVector * x_;
+    std::vector < RVector > * y_;
+    bool trans_;
+    Index tileRows_;
+};
+
+class MappedMatrixScaleMT : public BaseCalcMT{
+public:
+    MappedMatrixScaleMT(MappedMatrix & A, const RVector & rowScale,
+                        const RVector & colScale, bool verbose)
+    : BaseCalcMT(verbose), A_(&A), rowScale_(&rowScale), colScale_(&colScale){
+        tileRows_ = A.tileRows();
+    }
+
+    virtual ~MappedMatrixScaleMT(){}
+
+    virtual void calc(Index tNr=0){
+        MappedMatrix & A = *A_;
+        Index nCols = A.cols();
+        for (Index t = start_; t < end_; t ++){
+            Index rS = t * tileRows_;
+            Index rE = std::min(A.rows(), rS + tileRows_);
+            if (t + 1 < end_) A.prefetch(rE, std::min(A.rows(), rE + tileRows_));
+
+            for (Index i = rS; i < rE; i ++){
+                double * a = A.rowData(i);
+                if (colScale_->size()){
+                    const double * c = &(*colScale_)[0];
+                    for (Index j = 0; j < nCols; j ++) a[j] *= c[j];
+                }
+                if (rowScale_->size()){
+                    double r = (*rowScale_)[i];
+                    for (Index j = 0; j < nCols; j ++) a[j] *= r;
+                }
+            }
+            A.release(rS, rE);
+        }
+    }
+
+protected:
+    MappedMatrix * A_;
+    const RVector * rowScale_;
+    const RVector * colScale_;
+    Index tileRows_;
+};
+
+MappedMatrix::MappedMatrix()
+    : MatrixBase(false), writable_(false), rows_(0), cols_(0),
+      tileSize_(32 * 1024 * 1024), nThreads_(threadCount()), dropPages_(false),
+      mapBase_(NULL), mapSize_(0), data_(NULL){
+#if defined(_WIN32)
+    fileHandle_ = NULL;
+    mapHandle_ = NULL;
+#else
+    fd_ = -1;
+#endif
+}
+
+MappedMatrix::MappedMatrix(const std::string & fileName, Index rows, Index cols,
+                           bool verbose)
+    : MatrixBase(verbose), writable_(false), rows_(0), cols_(0),
+      tileSize_(32 * 1024 * 1024), nThreads_(threadCount()), dropPages_(false),
+      mapBase_(NULL), mapSize_(0), data_(NULL){
+#if defined(_WIN32)
+    fileHandle_ = NULL;
+    mapHandle_ = NULL;
+#else
+    fd_ = -1;
+#endif
+    create(fileName, rows, cols);
+}
+
+MappedMatrix::MappedMatrix(const std::string & fileName, bool writable)
+    : MatrixBase(false), writable_(false), rows_(0), cols_(0),
+      tileSize_(32 * 1024 * 1024), nThreads_(threadCount()), dropPages_(false),
+      mapBase_(NULL), mapSize_(0), data_(NULL){
+#if defined(_WIN32)
+    fileHandle_ = NULL;
+    mapHandle_ = NULL;
+#else
+    fd_ = -1;
+#endif
+    open(fileName, writable);
+}
+
+MappedMatrix::~MappedMatrix(){
+    close();
+}
+
+void MappedMatrix::map_(Index size, bool create){
+#if defined(_WIN32)
+    DWORD access = writable_ ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    fileHandle_ = CreateFileA(fileName_.c_str(), access, FILE_SHARE_READ, NULL,
+                              create ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle_ == INVALID_HANDLE_VALUE){
+        fileHandle_ = NULL;
+        throwError(1, WHERE_AM_I + " cannot open " + fileName_);
+    }
+    if (!create){
+        LARGE_INTEGER fSize;
+        GetFileSizeEx(fileHandle_, &fSize);
+        size = fSize.QuadPart;
+    }
+    mapHandle_ = CreateFileMappingA(fileHandle_, NULL,
+                                    writable_ ? PAGE_READWRITE : PAGE_READONLY,
+                                    DWORD(uint64(size) >> 32),
+                                    DWORD(uint64(size) & 0xffffffff), NULL);
+    if (!mapHandle_){
+        throwError(1, WHERE_AM_I + " cannot map " + fileName_);
+    }
+    mapBase_ = (char *)MapViewOfFile(mapHandle_, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                     0, 0, size);
+    if (!mapBase_){
+        throwError(1, WHERE_AM_I + " cannot map " + fileName_);
+    }
+#else
+    int flags = writable_ ? O_RDWR : O_RDONLY;
+    if (create) flags |= O_CREAT | O_TRUNC;
+    fd_ = ::open(fileName_.c_str(), flags, 0644);
+    if (fd_ < 0){
+        throwError(1, WHERE_AM_I + " cannot open " + fileName_ + ": " + strerror(errno));
+    }
+    if (create){
+        if (ftruncate(fd_, size) != 0){
+            throwError(1, WHERE_AM_I + " cannot resize " + fileName_ + " to "
+                       + str(size) + " bytes: " + strerror(errno));
+        }
+    } else {
+        struct stat st;
+        fstat(fd_, &st);
+        size = st.st_size;
+    }
+    if (size < __MAPPEDMATRIX_HEADER__){
+        throwError(1, WHERE_AM_I + " " + fileName_ + " is no binary matrix file.");
+    }
+    void * base = mmap(NULL, size, writable_ ? PROT_READ | PROT_WRITE : PROT_READ,
+                       MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED){
+        throwError(1, WHERE_AM_I + " cannot map " + fileName_ + ": " + strerror(errno));
+    }
+    mapBase_ = (char *)base;
+    //** the products read sequential, this doubles the read ahead
+    madvise(mapBase_, size, MADV_SEQUENTIAL);
+#endif
+    mapSize_ = size;
+    data_ = (double *)(mapBase_ + __MAPPEDMATRIX_HEADER__);
+}
+
+void MappedMatrix::create(const std::string & fileName, Index rows, Index cols){
+    close();
+    if (rows > 0xffffffff || cols > 0xffffffff){
+        throwLengthError(1, WHERE_AM_I + " matrix size exceeds the binary matrix format.");
+    }
+    fileName_ = fileName;
+    writable_ = true;
+    try {
+        map_(__MAPPEDMATRIX_HEADER__ + rows * cols * sizeof(double), true);
+    } catch(...) {
+        //** a failing constructor does not run the destructor
+        close();
+        throw;
+    }
+
+    uint32 header[2] = {uint32(rows), uint32(cols)};
+    std::memcpy(mapBase_, header, __MAPPEDMATRIX_HEADER__);
+    rows_ = rows;
+    cols_ = cols;
+}
+
+void MappedMatrix::open(const std::string & fileName, bool writable){
+    close();
+    fileName_ = fileName;
+    writable_ = writable;
+    try {
+        map_(0, false);
+    } catch(...) {
+        close();
+        throw;
+    }
+
+    uint32 header[2];
+    std::memcpy(header, mapBase_, __MAPPEDMATRIX_HEADER__);
+    rows_ = header[0];
+    cols_ = header[1];
+    if (mapSize_ < __MAPPEDMATRIX_HEADER__ + rows_ * cols_ * sizeof(double)){
+        Index r = rows_, c = cols_;
+        close();
+        throwLengthError(1, WHERE_AM_I + " " + fileName + " is too small for a matrix "
+                         + str(r) + " x " + str(c));
+    }
+}
+
+void MappedMatrix::close(){
+    if (mapBase_){
+        flush();
+#if defined(_WIN32)
+        UnmapViewOfFile(mapBase_);
+#else
+        munmap(mapBase_, mapSize_);
+#endif
+    }
+#if defined(_WIN32)
+    if (mapHandle_) CloseHandle(mapHandle_);
+    if (fileHandle_) CloseHandle(fileHandle_);
+    mapHandle_ = NULL;
+    fileHandle_ = NULL;
+#else
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+#endif
+    mapBase_ = NULL;
+    mapSize_ = 0;
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+}
+
+void MappedMatrix::resize(Index rows, Index cols){
+    if (fileName_.empty()){
+        throwError(1, WHERE_AM_I + " need a file name, use create.");
+    }
+    create(fileName_, rows, cols);
+}
+
+void MappedMatrix::clean(){
+    if (!writable_) throwError(1, WHERE_AM_I + " " + fileName_ + " is read only.");
+    Index tr = tileRows();
+    for (Index rS = 0; rS < rows_; rS += tr){
+        Index rE = std::min(rows_, rS + tr);
+        std::memset(rowData(rS), 0, (rE - rS) * cols_ * sizeof(double));
+        release(rS, rE);
+    }
+}
+
+void MappedMatrix::clear(){
+    close();
+}
+
+RVector MappedMatrix::row(Index i) const {
+    ASSERT_RANGE(i, 0, rows_)
+    RVector ret(cols_);
+    std::memcpy(&ret[0], rowData(i), cols_ * sizeof(double));
+    return ret;
+}
+
+void MappedMatrix::setRows(Index start, const RMatrix & A){
+    if (!writable_) throwError(1, WHERE_AM_I + " " + fileName_ + " is read only.");
+    if (start + A.rows() > rows_ || (A.rows() && A.cols() != cols_)){
+        throwLengthError(1, WHERE_AM_I + " block " + str(A.rows()) + " x " + str(A.cols())
+                         + " at row " + str(start) + " does not fit into "
+                         + str(rows_) + " x " + str(cols_));
+    }
+    for (Index i = 0; i < A.rows(); i ++){
+        std::memcpy(rowData(start + i), &A[i][0], cols_ * sizeof(double));
+    }
+    release(start, start + A.rows());
+}
+
+Index MappedMatrix::tileRows() const {
+    return std::max(Index(1), tileSize_ / std::max(Index(1), cols_ * sizeof(double)));
+}
+
+void MappedMatrix::prefetch(Index start, Index end) const {
+#if !defined(_WIN32)
+    if (start >= end) return;
+    static const Index pageSize = pageSize__();
+    Index s = ((char *)rowData(start) - mapBase_) / pageSize * pageSize;
+    Index e = (char *)rowData(end) - mapBase_;
+    madvise(mapBase_ + s, e - s, MADV_WILLNEED);
+#endif
+}
+
+void MappedMatrix::release(Index start, Index end) const {
+#if !defined(_WIN32)
+    if (!dropPages_ || start >= end) return;
+    static const Index pageSize = pageSize__();
+    //** only whole pages of the rows, the neighbours may be in use
+    Index s = ((char *)rowData(start) - mapBase_ + pageSize - 1) / pageSize * pageSize;
+    Index e = ((char *)rowData(end) - mapBase_) / pageSize * pageSize;
+    //** written pages stay in the page cache of the shared mapping
+    if (s < e) madvise(mapBase_ + s, e - s, MADV_DONTNEED);
+#endif
+}
+
+void MappedMatrix::scale(const RVector & rowScale, const RVector & colScale){
+    if (!writable_) throwError(1, WHERE_AM_I + " " + fileName_ + " is read only.");
+    if ((rowScale.size() && rowScale.size() != rows_) ||
+        (colScale.size() && colScale.size() != cols_)){
+        throwLengthError(1, WHERE_AM_I + " scale vector sizes do not match " +
+                         str(rows_) + " x " + str(cols_));
+    }
+    Index nTiles = (rows_ + tileRows() - 1) / tileRows();
+    if (nTiles == 0) return;
+    Index nThreads = std::max(Index(1), std::min(nThreads_, nTiles));
+    distributeCalc(MappedMatrixScaleMT(*this, rowScale, colScale, verbose_),
+                   nTiles, nThreads, verbose_);
+}
+
+RVector MappedMatrix::mult(const RVector & a) const {
+    if (a.size() != cols_){
+        throwLengthError(1, WHERE_AM_I + " vector/matrix lengths do not match " +
+                         str(cols_) + " " + str(a.size()));
+    }
+    std::vector < RVector > y(1, RVector(rows_, 0.0));
+    Index nTiles = (rows_ + tileRows() - 1) / tileRows();
+    if (nTiles == 0) return y[0];
+    Index nThreads = std::max(Index(1), std::min(nThreads_, nTiles));
+
+    distributeCalc(MappedMatrixMultMT(*this, a, y, false, verbose_),
+                   nTiles, nThreads, verbose_);
+    return y[0];
+}
+
+RVector MappedMatrix::transMult(const RVector & a) const {
+    if (a.size() != rows_){
+        throwLengthError(1, WHERE_AM_I + " matrix/vector lengths do not match " +
+                         str(a.size()) + " " + str(rows_));
+    }
+    Index nTiles = (rows_ + tileRows() - 1) / tileRows();
+    if (nTiles == 0) return RVector(cols_, 0.0);
+    Index nThreads = std::max(Index(1), std::min(nThreads_, nTiles));
+    std::vector < RVector > y(nThreads, RVector(cols_, 0.0));
+
+    distributeCalc(MappedMatrixMultMT(*this, a, y, true, verbose_),
+                   nTiles, nThreads, verbose_);
+
+    for (Index t = 1; t < y.size(); t ++) y[0] += y[t];
+    return y[0];
+}
+
+void MappedMatrix::flush(){
+    if (!mapBase_ || !writable_) return;
+#if defined(_WIN32)
+    FlushViewOfFile(mapBase_, 0);
+#else
+    msync(mapBase_, mapSize_, MS_SYNC);
+#endif
+}
+
+void MappedMatrix::save(const std::string & fileName) const {
+    std::string fname(fileName);
+    if (fname.rfind('.') == std::string::npos) fname += MATRIXBINSUFFIX;
+    if (fname == fileName_){
+        const_cast< MappedMatrix * >(this)->flush();
+        return;
+    }
+    std::ofstream file(fname.c_str(), std::ios::binary);
+    if (!file){
+        throwError(1, WHERE_AM_I + " cannot open " + fname);
+    }
+    Index tr = tileRows();
+    file.write(mapBase_, __MAPPEDMATRIX_HEADER__);
+    for (Index rS = 0; rS < rows_; rS += tr){
+        Index rE = std::min(rows_, rS + tr);
+        prefetch(rE, std::min(rows_, rE + tr));
+        file.write((const char *)rowData(rS), (rE - rS) * cols_ * sizeof(double));
+        release(rS, rE);
+    }
+}
+
+RMatrix MappedMatrix::toDense() const {
+    RMatrix ret(rows_, cols_);
+    for (Index i = 0; i < rows_; i ++){
+        std::memcpy(&ret[i][0], rowData(i), cols_ * sizeof(double));
+    }
+    return ret;
+}
+
+} // namespace GIMLI
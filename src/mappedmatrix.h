@@ -0,0 +1,170 @@
+/******************************************************************************
+ *   Copyright (C) 2018 by the GIMLi development team                         *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_MAPPEDMATRIX__H
+#define _GIMLI_MAPPEDMATRIX__H
+
+#include "gimli.h"
+#include "matrix.h"
+#include "vector.h"
+
+namespace GIMLI{
+
+//! Dense matrix stored in a memory-mapped file.
+/*! Out-of-core dense matrix for Jacobians that do not fit into the main
+ * memory. The file has the binary format of \ref saveMatrix (uint32 rows,
+ * uint32 cols, row-major double values), so a mapped matrix can be loaded
+ * as \ref RMatrix and every binary matrix file can be opened out-of-core.
+ * The matrix is filled row-block-wise, e.g., by \ref setRows, and the
+ * matrix vector products stream the file in tiles of rows. Each thread
+ * announces its next tile to the operating system while working on the
+ * current one, so the products run with disk or page cache bandwidth. */
+class DLLEXPORT MappedMatrix : public MatrixBase{
+public:
+    /*! Default constructor (empty matrix). */
+    MappedMatrix();
+
+    /*! Create a zero matrix rows x cols in the file fileName, see \ref create. */
+    MappedMatrix(const std::string & fileName, Index rows, Index cols,
+                 bool verbose=false);
+
+    /*! Open the existing matrix file fileName, see \ref open. */
+    MappedMatrix(const std::string & fileName, bool writable=false);
+
+    /*! Unmap the file. The file itself remains. */
+    virtual ~MappedMatrix();
+
+    /*! Return entity rtti value. */
+    virtual uint rtti() const { return GIMLI_MAPPEDMATRIX_RTTI; }
+
+    /*! Create or overwrite the file fileName for a zero matrix
+     * rows x cols and map it writable. */
+    void create(const std::string & fileName, Index rows, Index cols);
+
+    /*! Map the existing binary matrix file fileName. */
+    void open(const std::string & fileName, bool writable=false);
+
+    /*! Write changes back to the file and unmap it. */
+    void close();
+
+    /*! Return the name of the mapped file. */
+    inline const std::string & fileName() const { return fileName_; }
+
+    /*! Return true if the values can be changed. */
+    inline bool writable() const { return writable_; }
+
+    /*! Return number of rows */
+    virtual Index rows() const { return rows_; }
+
+    /*! Return number of cols */
+    virtual Index cols() const { return cols_; }
+
+    /*! Recreate the file with the new size, all values are zero. */
+    virtual void resize(Index rows, Index cols);
+
+    /*! Set all values to zero. */
+    virtual void clean();
+
+    /*! Unmap the file and set the size to zero. */
+    virtual void clear();
+
+    /*! Return a pointer to the values of row i. */
+    inline double * rowData(Index i) { return data_ + i * cols_; }
+
+    /*! Return a pointer to the values of row i. */
+    inline const double * rowData(Index i) const { return data_ + i * cols_; }
+
+    /*! Return a copy of row i. */
+    RVector row(Index i) const;
+
+    /*! Copy the rows of A into the rows start to start + A.rows(). */
+    void setRows(Index start, const RMatrix & A);
+
+    /*! Multiply row i with rowScale[i] and column j with colScale[j].
+     * Empty vectors are ignored. */
+    void scale(const RVector & rowScale, const RVector & colScale);
+
+    /*! Return this * a  */
+    virtual RVector mult(const RVector & a) const;
+
+    /*! Return this.T * a */
+    virtual RVector transMult(const RVector & a) const;
+
+    /*! Write changed values back to the file. */
+    void flush();
+
+    /*! Save the matrix into the binary matrix file fileName. */
+    virtual void save(const std::string & fileName) const;
+
+    /*! Return the dense matrix. For testing purposes and small matrices only. */
+    RMatrix toDense() const;
+
+    /*! Set the amount of bytes that are streamed as one tile. Default 32 MB. */
+    void setTileSize(Index bytes) { tileSize_ = std::max(Index(1), bytes); }
+
+    /*! Set the amount of threads for the matrix vector products.
+     * Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) { nThreads_ = std::max(Index(1), nThreads); }
+
+    /*! Release finished tiles from the address space of the process. This
+     * keeps the resident memory small, the file stays in the page cache
+     * as long as the operating system can afford it. Default false. */
+    void setDropPages(bool drop) { dropPages_ = drop; }
+
+    /*! Return the amount of rows of one tile. */
+    Index tileRows() const;
+
+    /*! Announce the rows start to end for reading. */
+    void prefetch(Index start, Index end) const;
+
+    /*! Release the rows start to end from the address space. */
+    void release(Index start, Index end) const;
+
+protected:
+    void map_(Index size, bool create);
+
+    std::string fileName_;
+    bool writable_;
+    Index rows_;
+    Index cols_;
+    Index tileSize_;
+    Index nThreads_;
+    bool dropPages_;
+
+    /*! Mapped file with header and values. */
+    char * mapBase_;
+    Index mapSize_;
+    double * data_;
+
+#if defined(_WIN32)
+    void * fileHandle_;
+    void * mapHandle_;
+#else
+    int fd_;
+#endif
+
+private:
+    /*! Copy constructor is private, so don't use it */
+    MappedMatrix(const MappedMatrix &) : MatrixBase() {};
+    /*! Assignment operator is private, so don't use it */
+    void operator = (const MappedMatrix &){ };
+};
+
+} // namespace GIMLI
+
+#endif // _GIMLI_MAPPEDMATRIX__H
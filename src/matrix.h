@@ -406,6 +406,20 @@ public:
     /*! Clear the matrix and free memory. */
     inline void clear() { mat_.clear(); }
 
+    /*! Use the external, row-major and contiguous memory
+     * [data, data + rows * cols) as storage without copying,
+     * e.g., the buffer of a C-contiguous numpy array.
+     * Each row refers to its part of the buffer, see \ref Vector::wrap.
+     * The caller needs to keep the buffer alive during the lifetime of
+     * this matrix. */
+    Matrix < ValueType > & wrap(ValueType * data, Index rows, Index cols){
+        mat_.clear();
+        mat_.resize(rows);
+        for (Index i = 0; i < rows; i ++) mat_[i].wrap(data + i * cols, cols);
+        rowFlag_.resize(rows);
+        return *this;
+    }
+
     /*! Fill Vector with 0.0. Don't change size.*/
     inline void clean() {
         for (Index i = 0; i < mat_.size(); i ++) mat_[i].clear();
@@ -17,9 +17,13 @@
  ******************************************************************************/
 
 #include "memwatch.h"
+#include "baseentity.h"
 #include "stopwatch.h"
 
+#include <atomic>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 #ifdef WIN32_LEAN_AND_MEAN
     #include <psapi.h>
@@ -99,6 +103,88 @@ double MemWatch::inUse() {
     return 0;
 }
 
+static std::atomic < long long > __memoryUsage__[MEMORY_TAG_COUNT];
+static std::atomic < long long > __memoryPeak__[MEMORY_TAG_COUNT];
+static thread_local MemoryTag __memoryTag__ = MEMORY_OTHER;
+
+std::string memoryTagName(MemoryTag tag){
+    switch (tag){
+        case MEMORY_OTHER:       return "other";
+        case MEMORY_MESH:        return "mesh";
+        case MEMORY_JACOBIAN:    return "jacobian";
+        case MEMORY_CONSTRAINTS: return "constraints";
+        case MEMORY_SOLVER:      return "solver";
+        case MEMORY_POTENTIALS:  return "potentials";
+        default: return "unknown";
+    }
+}
+
+MemoryTag memoryTag(){
+    return __memoryTag__;
+}
+
+void setMemoryTag(MemoryTag tag){
+    __memoryTag__ = tag;
+}
+
+void memoryAllocated(MemoryTag tag, Index bytes){
+    if (tag >= MEMORY_TAG_COUNT) tag = MEMORY_OTHER;
+    long long now = __memoryUsage__[tag].fetch_add(bytes) + (long long)bytes;
+    long long peak = __memoryPeak__[tag].load();
+    while (now > peak && !__memoryPeak__[tag].compare_exchange_weak(peak, now)){}
+}
+
+void memoryReleased(MemoryTag tag, Index bytes){
+    if (tag >= MEMORY_TAG_COUNT) tag = MEMORY_OTHER;
+    __memoryUsage__[tag].fetch_sub(bytes);
+}
+
+void * BaseEntity::operator new(std::size_t size){
+    void * p = ::operator new(size);
+    memoryAllocated(MEMORY_MESH, size);
+    return p;
+}
+
+void BaseEntity::operator delete(void * p, std::size_t size){
+    memoryReleased(MEMORY_MESH, size);
+    ::operator delete(p);
+}
+
+Index memoryUsage(MemoryTag tag){
+    if (tag >= MEMORY_TAG_COUNT) return 0;
+    return Index(std::max(0LL, __memoryUsage__[tag].load()));
+}
+
+Index memoryPeak(MemoryTag tag){
+    if (tag >= MEMORY_TAG_COUNT) return 0;
+    return Index(std::max(0LL, __memoryPeak__[tag].load()));
+}
+
+void resetMemoryPeak(){
+    for (Index i = 0; i < MEMORY_TAG_COUNT; i ++){
+        __memoryPeak__[i] = __memoryUsage__[i].load();
+    }
+}
+
+std::string memoryReport(){
+    std::stringstream str;
+    str.precision(2);
+    str.setf(std::ios::fixed, std::ios::floatfield);
+    str << std::left << std::setw(14) << "Memory/MByte" << std::right
+        << std::setw(12) << "current" << std::setw(12) << "peak" << std::endl;
+    Index sum = 0;
+    for (Index i = 0; i < MEMORY_TAG_COUNT; i ++){
+        MemoryTag tag = MemoryTag(i);
+        sum += memoryUsage(tag);
+        str << std::left << std::setw(14) << memoryTagName(tag) << std::right
+            << std::setw(12) << mByte(memoryUsage(tag))
+            << std::setw(12) << mByte(memoryPeak(tag)) << std::endl;
+    }
+    str << std::left << std::setw(14) << "sum" << std::right
+        << std::setw(12) << mByte(sum) << std::endl;
+    return str.str();
+}
+
 void MemWatch::info(const std::string & str){
     if (debug()){
 #if defined(WIN32_LEAN_AND_MEAN) || USE_PROC_READPROC
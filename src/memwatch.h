@@ -21,6 +21,10 @@
 
 #include "gimli.h"
 
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
 #define MEMINFO GIMLI::MemWatch::instance().info(WHERE);
 
 namespace GIMLI{
@@ -72,6 +76,109 @@ inline double memoryInUse(){
     return GIMLI::MemWatch::instance().inUse();
 }
 
+//! Subsystems for the memory accounting.
+enum MemoryTag{MEMORY_OTHER, MEMORY_MESH, MEMORY_JACOBIAN, MEMORY_CONSTRAINTS,
+               MEMORY_SOLVER, MEMORY_POTENTIALS, MEMORY_TAG_COUNT};
+
+/*! Return the name of the memory tag. */
+DLLEXPORT std::string memoryTagName(MemoryTag tag);
+
+/*! Return the tag the current thread accounts its allocations to. */
+DLLEXPORT MemoryTag memoryTag();
+
+/*! Set the tag the current thread accounts its allocations to.
+ * Prefer the scoped \ref MemoryScope. */
+DLLEXPORT void setMemoryTag(MemoryTag tag);
+
+/*! Account bytes allocated for tag. Called by the storage of \ref Vector,
+ * \ref Matrix, \ref SparseMapMatrix, the mesh entities and the solvers. */
+DLLEXPORT void memoryAllocated(MemoryTag tag, Index bytes);
+
+/*! Account bytes released for tag. */
+DLLEXPORT void memoryReleased(MemoryTag tag, Index bytes);
+
+/*! Return the bytes currently accounted for tag. */
+DLLEXPORT Index memoryUsage(MemoryTag tag);
+
+/*! Return the maximum of bytes accounted for tag since the start or the
+ * last \ref resetMemoryPeak. */
+DLLEXPORT Index memoryPeak(MemoryTag tag);
+
+/*! Set the high-water marks of all tags to their current usage. */
+DLLEXPORT void resetMemoryPeak();
+
+/*! Return a table of the current and peak usage of all tags in MByte. */
+DLLEXPORT std::string memoryReport();
+
+//! Account all allocations of the current thread inside a scope to a tag.
+/*! E.g.: { MemoryScope scope(MEMORY_JACOBIAN); fop.createJacobian(model); }
+ * Scopes can be nested, the innermost tag is used. */
+class DLLEXPORT MemoryScope{
+public:
+    MemoryScope(MemoryTag tag) : last_(memoryTag()) { setMemoryTag(tag); }
+
+    ~MemoryScope(){ setMemoryTag(last_); }
+
+protected:
+    MemoryTag last_;
+};
+
+//! Allocator for std containers accounting its memory to a \ref MemoryTag.
+/*! The tag is taken from \ref memoryTag on the first allocation and
+ * moves with the content, so allocation and release always account the
+ * same tag. Used for the nodes of \ref SparseMapMatrix. */
+template < class T > class MemoryAllocator {
+public:
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template < class U > struct rebind { typedef MemoryAllocator< U > other; };
+
+    MemoryAllocator() : tag_(MEMORY_TAG_COUNT) {}
+
+    template < class U > MemoryAllocator(const MemoryAllocator< U > & a)
+        : tag_(a.tag()) {}
+
+    T * allocate(std::size_t n){
+        if (tag_ == MEMORY_TAG_COUNT) tag_ = memoryTag();
+        T * p = static_cast< T * >(::operator new(n * sizeof(T)));
+        memoryAllocated(tag_, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T * p, std::size_t n){
+        memoryReleased(tag_, n * sizeof(T));
+        ::operator delete(p);
+    }
+
+    /*! Copies of a container account to the tag of their own scope. */
+    MemoryAllocator select_on_container_copy_construction() const {
+        return MemoryAllocator();
+    }
+
+    MemoryTag tag() const { return tag_; }
+
+protected:
+    MemoryTag tag_;
+};
+
+template < class T, class U >
+bool operator == (const MemoryAllocator< T > & a, const MemoryAllocator< U > & b){
+    return a.tag() == b.tag();
+}
+
+template < class T, class U >
+bool operator != (const MemoryAllocator< T > & a, const MemoryAllocator< U > & b){
+    return !(a == b);
+}
+
 
 } // namespace GIMLI
 
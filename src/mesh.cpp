@@ -18,7 +18,9 @@
 
 #include "mesh.h"
 
+#include "calculateMultiThread.h"
 #include "kdtreeWrapper.h"
+#include "ldltWrapper.h"
 #include "memwatch.h"
 #include "meshentities.h"
 #include "node.h"
@@ -119,6 +121,8 @@ void Mesh::copy_(const Mesh & mesh){
 
     setExportDataMap(mesh.exportDataMap());
     setCellAttributes(mesh.cellAttributes());
+    nodeOrigin_ = mesh.nodeOrigin_;
+    cellOrigin_ = mesh.cellOrigin_;
 
     if (mesh.neighboursKnown()){
         this->createNeighbourInfos(true);
@@ -160,6 +164,9 @@ void Mesh::clear(){
         delete cellToBoundaryInterpolationCache_;
     }
 
+    nodeOrigin_.clear();
+    cellOrigin_.clear();
+
     rangesKnown_ = false;
     neighboursKnown_ = false;
 }
@@ -542,6 +549,14 @@ Index Mesh::findNearestNode(const RVector3 & pos){
     return tree_->nearest(pos)->id();
 }
 
+IndexArray Mesh::findNearestNodes(const R3Vector & pos){
+    fillKDTree_();
+    std::vector < Node * > nodes(tree_->nearest(pos));
+    IndexArray ret(nodes.size());
+    for (Index i = 0; i < nodes.size(); i ++) ret[i] = nodes[i]->id();
+    return ret;
+}
+
 IndexArray cellIDX__;
 
 Cell * Mesh::findCellBySlopeSearch_(const RVector3 & pos, Cell * start,
@@ -685,11 +700,274 @@ Cell * Mesh::findCell(const RVector3 & pos, size_t & count,
     return cell;
 }
 
+//! Thread safe neighbour walk from start to the cell containing pos.
+static Cell * findCellByWalk_(const RVector3 & pos, Cell * start, Index maxSteps){
+    Cell * cell = start;
+    RVector sf;
+    for (Index i = 0; i < maxSteps && cell; i ++){
+        if (cell->shape().isInside(pos, sf, false)) return cell;
+        cell = cell->neighbourCell(sf);
+    }
+    return NULL;
+}
+
+static inline uint64 mortonSpread_(uint64 a){
+    a &= 0x1fffff;
+    a = (a | a << 32) & 0x1f00000000ffff;
+    a = (a | a << 16) & 0x1f0000ff0000ff;
+    a = (a | a << 8)  & 0x100f00f00f00f00f;
+    a = (a | a << 4)  & 0x10c30c30c30c30c3;
+    a = (a | a << 2)  & 0x1249249249249249;
+    return a;
+}
+
+class FindCellsMT : public BaseCalcMT{
+public:
+    FindCellsMT(const R3Vector & pos, const IndexArray & order,
+                IVector & cellIds, RVector & rst, const KDTreeWrapper & tree,
+                const BoundingBox & bbox)
+    : BaseCalcMT(false), pos_(&pos), order_(&order),
+      cellIds_(&cellIds), rst_(&rst), tree_(&tree), bbox_(bbox){
+    }
+
+    virtual ~FindCellsMT(){}
+
+    virtual void calc(Index tNr=0){
+        Cell * last = NULL;
+        for (Index o = start_; o < end_; o ++){
+            Index i = (*order_)[o];
+            const RVector3 & p = (*pos_)[i];
+            Cell * cell = NULL;
+
+            if (!bbox_.isInside(p)){
+                (*cellIds_)[i] = -1;
+                continue;
+            }
+
+            if (last) cell = findCellByWalk_(p, last, 50);
+
+            if (!cell){
+                //** same like Mesh::findCell but without tagging
+                Node * refNode = tree_->nearest(p);
+                if (refNode && !refNode->cellSet().empty()){
+                    for (std::set< Cell * >::iterator it = refNode->cellSet().begin();
+                         it != refNode->cellSet().end(); it ++){
+                        if ((*it)->shape().isInside(p, false)) {
+                            cell = *it;
+                            break;
+                        }
+                    }
+                    if (!cell) cell = findCellByWalk_(p,
+                                            *refNode->cellSet().begin(), 50);
+                }
+            }
+
+            if (cell){
+                last = cell;
+                (*cellIds_)[i] = cell->id();
+                RVector3 r(cell->shape().rst(p));
+                (*rst_)[3 * i]     = r[0];
+                (*rst_)[3 * i + 1] = r[1];
+                (*rst_)[3 * i + 2] = r[2];
+            } else {
+                (*cellIds_)[i] = -1;
+            }
+        }
+    }
+
+protected:
+    const R3Vector * pos_;
+    const IndexArray * order_;
+    IVector * cellIds_;
+    RVector * rst_;
+    const KDTreeWrapper * tree_;
+    BoundingBox bbox_;
+};
+
+void Mesh::findCells(const R3Vector & pos, IVector & cellIds, RVector & rst) const {
+    cellIds.resize(pos.size());
+    cellIds.fill(-1);
+    rst.resize(pos.size() * 3);
+    rst.fill(0.0);
+    if (pos.size() == 0 || cellCount() == 0) return;
+
+    fillKDTree_();
+    if (!neighboursKnown_) const_cast<Mesh*>(this)->createNeighbourInfos();
+
+    //** prepare the lazy caches of the shapes, they are not thread safe
+    std::set < uint > rttis;
+    for (Index i = 0; i < cellCount(); i ++){
+        const Cell & c = *cellVector_[i];
+        c.shape().invJacobian();
+        if (rttis.insert(c.rtti()).second){
+            c.N(RVector3(0.0, 0.0, 0.0));
+            c.shape().N(RVector3(0.0, 0.0, 0.0));
+        }
+    }
+
+    //** sort the query positions along a Morton curve
+    RVector3 pMin(pos[0]), pMax(pos[0]);
+    for (Index i = 1; i < pos.size(); i ++){
+        for (Index d = 0; d < 3; d ++){
+            pMin[d] = std::min(pMin[d], pos[i][d]);
+            pMax[d] = std::max(pMax[d], pos[i][d]);
+        }
+    }
+    RVector3 ext(pMax - pMin);
+    std::vector < std::pair < uint64, Index > > keys(pos.size());
+    for (Index i = 0; i < pos.size(); i ++){
+        uint64 key = 0;
+        for (Index d = 0; d < 3; d ++){
+            double t = ext[d] > 0.0 ? (pos[i][d] - pMin[d]) / ext[d] : 0.0;
+            key |= mortonSpread_(uint64(t * 2097151.0)) << d;
+        }
+        keys[i] = std::pair< uint64, Index >(key, i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    IndexArray order(pos.size());
+    for (Index i = 0; i < pos.size(); i ++) order[i] = keys[i].second;
+
+    //** positions outside the bounding box are rejected without search
+    BoundingBox bbox(this->boundingBox());
+    RVector3 tol(bbox.max() - bbox.min());
+    tol = RVector3(1.0, 1.0, 1.0) * (tol.abs() * 1e-9 + TOUCH_TOLERANCE);
+    bbox.setMin(bbox.min() - tol);
+    bbox.setMax(bbox.max() + tol);
+
+    distributeCalc(FindCellsMT(pos, order, cellIds, rst, *tree_, bbox),
+                   pos.size(), std::min(threadCount(), Index(pos.size() / 1000 + 1)));
+}
+
+typedef std::vector < std::pair < double, Index > > RayHits;
+
+/*! Ray parameters of the intersections of the ray with the boundaries of c. */
+static void rayHits_(Cell * c, const RVector3 & start, const RVector3 & dir,
+                     RayHits & hits){
+    hits.clear();
+    RVector3 p;
+    for (Index i = 0; i < c->boundaryCount(); i ++){
+        Boundary * b = c->boundary(i);
+        if (b && b->pShape()->intersectRay(start, dir, p)){
+            hits.push_back(std::pair< double, Index >((p - start).dot(dir), i));
+        }
+    }
+}
+
+/*! Return true if the ray enters c at t0 or starts inside c. */
+static bool rayEnters_(Cell * c, const RVector3 & start, const RVector3 & dir,
+                       double t0, double tol, RayHits & hits){
+    rayHits_(c, start, dir, hits);
+    if (hits.empty()) return false;
+    double tMin = hits[0].first, tMax = hits[0].first;
+    for (Index i = 1; i < hits.size(); i ++){
+        tMin = std::min(tMin, hits[i].first);
+        tMax = std::max(tMax, hits[i].first);
+    }
+    if (tMax <= t0 + tol) return false;
+    //** the entry is behind the start if the ray only leaves the cell
+    return tMin <= t0 + tol || tMax - tMin < tol;
+}
+
+/*! Find the cell behind a node or edge at t0, i.e., one of the cells
+ * sharing the nodes. hits holds its intersections. */
+static Cell * rayNextCell_(const std::vector < Node * > & nodes, Cell * last,
+                           const RVector3 & start, const RVector3 & dir,
+                           double t0, double tol, RayHits & hits){
+    std::vector < Cell * > cells;
+    for (Index i = 0; i < nodes.size(); i ++){
+        cells.insert(cells.end(), nodes[i]->cellSet().begin(),
+                     nodes[i]->cellSet().end());
+    }
+    //** unique and reproducible order
+    std::sort(cells.begin(), cells.end(), lesserId< Cell >);
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+    for (Index i = 0; i < cells.size(); i ++){
+        if (cells[i] == last) continue;
+        if (rayEnters_(cells[i], start, dir, t0, tol, hits)) return cells[i];
+    }
+    return NULL;
+}
+
+void Mesh::walkRay(Cell * c, const RVector3 & start, const RVector3 & dir,
+                   double length, double tol,
+                   std::vector < Cell * > & cells, std::vector < double > & t) const {
+    if (!c) return;
+
+    RayHits hits;
+    rayHits_(c, start, dir, hits);
+
+    Cell * last = NULL;
+    std::vector < Node * > exitNodes;
+    double tIn = 0.0;
+    t.push_back(tIn);
+
+    while (c){
+        //** nearest exit behind the entry
+        double tOut = MAX_DOUBLE;
+        Index exit = 0;
+        for (Index i = 0; i < hits.size(); i ++){
+            if (hits[i].first > tIn + tol && hits[i].first < tOut){
+                tOut = hits[i].first;
+                exit = hits[i].second;
+            }
+        }
+
+        if (tOut == MAX_DOUBLE){
+            //** the neighbour only touches the ray at a node or an edge
+            if (!last) break;
+            c = rayNextCell_(exitNodes, last, start, dir, tIn, tol, hits);
+            last = NULL;
+            continue;
+        }
+
+        cells.push_back(c);
+        if (tOut >= length){
+            t.push_back(length);
+            break;
+        }
+        t.push_back(tOut);
+
+        last = c;
+        exitNodes = c->boundaryNodes(exit);
+        tIn = tOut;
+        c = c->neighbourCell(exit);
+
+        if (c){
+            rayHits_(c, start, dir, hits);
+        } else {
+            //** mesh boundary or a node of it, the ray may continue behind it
+            c = rayNextCell_(exitNodes, last, start, dir, tIn, tol, hits);
+            last = NULL;
+        }
+    }
+}
+
+Cell * Mesh::findRayStartCell(const RVector3 & start, const RVector3 & dir) const {
+    if (!neighboursKnown_) const_cast<Mesh*>(this)->createNeighbourInfos();
+
+    RVector3 d(dir.norm());
+    double tol = 1e-10 * std::max(1.0, this->boundingBox().max().dist(
+                                       this->boundingBox().min()));
+    RayHits hits;
+
+    Cell * c = this->findCell(start + d * tol);
+    if (!c) c = this->findCell(start);
+    if (!c) return NULL;
+    if (rayEnters_(c, start, d, 0.0, tol, hits)) return c;
+
+    //** start at a node or an edge of the found cell
+    c = rayNextCell_(c->nodes(), c, start, d, 0.0, tol, hits);
+    return c;
+}
+
 std::vector < Cell * > Mesh::findCellsAlongRay(const RVector3 & start,
                                                const RVector3 & dir,
                                                R3Vector & pos) const {
     pos.clean();
     std::vector < Cell * > cells;
+    if (this->cellCount() == 0) return cells;
 
     RVector3 inPos(start);
 
@@ -697,34 +975,40 @@ std::vector < Cell * > Mesh::findCellsAlongRay(const RVector3 & start,
         inPos = tree_->nearest(inPos)->pos();
     }
 
-    pos.push_back(inPos);
+    RVector3 d(dir.norm());
+    double tol = 1e-10 * std::max(1.0, this->boundingBox().max().dist(
+                                       this->boundingBox().min()));
 
-    double stepTol = 1e-1;
+    std::vector < double > t;
+    this->walkRay(this->findRayStartCell(inPos, d), inPos, d, MAX_DOUBLE, tol,
+                  cells, t);
 
-    while (1){
-        Cell *c = this->findCell(inPos + dir*stepTol, false);
-        if (!c) break;
+    if (cells.empty()) {
+        pos.push_back(inPos);
+        return cells;
+    }
+    for (Index i = 0; i < t.size(); i ++) pos.push_back(inPos + d * t[i]);
+    return cells;
+}
 
-        RVector3 outPos(false);
-        for (Index i = 0; i < c->boundaryCount(); i++){
-            Shape * s = c->boundary(i)->pShape();
+std::vector < Cell * > Mesh::findCellsAlongSegment(const RVector3 & start,
+                                                   const RVector3 & end,
+                                                   RVector & lengths) const {
+    std::vector < Cell * > cells;
+    lengths.clear();
+    double length = start.dist(end);
+    if (this->cellCount() == 0 || length == 0.0) return cells;
 
-            if (s->intersectRay(inPos, dir, outPos)){
-                if (outPos.dist(inPos) > stepTol){
-                    outPos.setValid(true);
-                    break;
-                } else {
-                    outPos.setValid(false);
-                }
-            }
-        }
+    RVector3 d((end - start) / length);
+    double tol = 1e-10 * std::max(1.0, this->boundingBox().max().dist(
+                                       this->boundingBox().min()));
 
-        if (outPos.valid()){
-            pos.push_back(outPos);
-            cells.push_back(c);
-            inPos = outPos;
-        }
-    }
+    std::vector < double > t;
+    this->walkRay(this->findRayStartCell(start, d), start, d, length, tol,
+                  cells, t);
+
+    lengths.resize(cells.size());
+    for (Index i = 0; i < cells.size(); i ++) lengths[i] = t[i + 1] - t[i];
     return cells;
 }
 
@@ -967,12 +1251,288 @@ R3Vector & Mesh::boundarySizedNormals() const {
     return boundarySizedNormCache_;
 }
 
-void Mesh::sortNodes(const IndexArray & perm){
+void Mesh::permuteData_(const IndexArray & perm, Index size){
+    for (std::map < std::string, RVector >::iterator
+         it = exportDataMap_.begin(); it != exportDataMap_.end(); it ++){
+        if (it->second.size() != size) continue;
+        RVector v(size);
+        for (Index i = 0; i < size; i ++) v[perm[i]] = it->second[i];
+        it->second = v;
+    }
+}
 
+/*! Update the original ids origin for the permutation perm. */
+static void permuteOrigin_(IndexArray & origin, const IndexArray & perm){
+    IndexArray o(perm.size());
+    for (Index i = 0; i < perm.size(); i ++){
+        o[perm[i]] = origin.size() == perm.size() ? origin[i] : i;
+    }
+    origin = o;
+}
+
+void Mesh::sortNodes(const IndexArray & perm){
+    if (perm.size() != nodeCount()){
+        throwLengthError(1, WHERE_AM_I + " " + str(perm.size()) + " != " + str(nodeCount()));
+    }
     for (Index i = 0; i < nodeVector_.size(); i ++) nodeVector_[i]->setId(perm[i]);
   //    sort(nodeVector_.begin(), nodeVector_.end(), std::less< int >(mem_fun(&BaseEntity::id)));
     sort(nodeVector_.begin(), nodeVector_.end(), lesserId< Node >);
     recountNodes();
+
+    //** data of cell size take precedence, like everywhere else
+    if (nodeCount() != cellCount()) permuteData_(perm, nodeCount());
+    permuteOrigin_(nodeOrigin_, perm);
+}
+
+void Mesh::sortCells(const IndexArray & perm){
+    if (perm.size() != cellCount()){
+        throwLengthError(1, WHERE_AM_I + " " + str(perm.size()) + " != " + str(cellCount()));
+    }
+    for (Index i = 0; i < cellVector_.size(); i ++) cellVector_[i]->setId(perm[i]);
+    sort(cellVector_.begin(), cellVector_.end(), lesserId< Cell >);
+    for (Index i = 0; i < cellVector_.size(); i ++) cellVector_[i]->setId(i);
+
+    //** caches in cell order
+    cellSizesCache_.resize(0);
+    if (cellToBoundaryInterpolationCache_){
+        delete cellToBoundaryInterpolationCache_;
+        cellToBoundaryInterpolationCache_ = 0;
+    }
+
+    permuteData_(perm, cellCount());
+    permuteOrigin_(cellOrigin_, perm);
+}
+
+/*! Return perm with perm[order[k]] = k. */
+static IndexArray inversePermutation_(const IndexArray & order){
+    IndexArray perm(order.size());
+    for (Index k = 0; k < order.size(); k ++) perm[order[k]] = k;
+    return perm;
+}
+
+/*! 3D Hilbert index of the transposed coordinates X with bits bits
+ * per axis (J. Skilling, AIP Conf. Proc. 707, 2004). */
+static uint64 hilbertKey_(uint64 * X, Index n, Index bits){
+    uint64 M = uint64(1) << (bits - 1), P, Q, t;
+    for (Q = M; Q > 1; Q >>= 1){
+        P = Q - 1;
+        for (Index i = 0; i < n; i ++){
+            if (X[i] & Q) X[0] ^= P;
+            else {
+                t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+    for (Index i = 1; i < n; i ++) X[i] ^= X[i - 1];
+    t = 0;
+    for (Q = M; Q > 1; Q >>= 1) if (X[n - 1] & Q) t ^= Q - 1;
+    for (Index i = 0; i < n; i ++) X[i] ^= t;
+
+    uint64 key = 0;
+    for (Index b = bits; b-- > 0;){
+        for (Index i = 0; i < n; i ++) key = (key << 1) | ((X[i] >> b) & 1);
+    }
+    return key;
+}
+
+/*! Order of the positions along a Morton or Hilbert curve. */
+static IndexArray curveOrder_(const R3Vector & pos, bool hilbert, Index dim){
+    IndexArray order(pos.size());
+    if (pos.size() == 0) return order;
+
+    RVector3 pMin(pos[0]), pMax(pos[0]);
+    for (Index i = 1; i < pos.size(); i ++){
+        for (Index d = 0; d < 3; d ++){
+            pMin[d] = std::min(pMin[d], pos[i][d]);
+            pMax[d] = std::max(pMax[d], pos[i][d]);
+        }
+    }
+    RVector3 ext(pMax - pMin);
+    Index n = std::max(Index(1), std::min(dim, Index(3)));
+
+    std::vector < std::pair < uint64, Index > > keys(pos.size());
+    for (Index i = 0; i < pos.size(); i ++){
+        uint64 X[3] = {0, 0, 0};
+        for (Index d = 0; d < n; d ++){
+            double t = ext[d] > 0.0 ? (pos[i][d] - pMin[d]) / ext[d] : 0.0;
+            X[d] = uint64(t * 2097151.0);
+        }
+        uint64 key = 0;
+        if (hilbert){
+            key = hilbertKey_(X, n, 21);
+        } else {
+            for (Index d = 0; d < n; d ++) key |= mortonSpread_(X[d]) << d;
+        }
+        keys[i] = std::pair< uint64, Index >(key, i);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (Index i = 0; i < pos.size(); i ++) order[i] = keys[i].second;
+    return order;
+}
+
+/*! Symmetric adjacency (rowPtr, colIdx) of n vertices from the
+ * edge keys (a << 32 | b), which are sorted and made unique. */
+static void graphFromKeys_(std::vector < Index > & keys, Index n,
+                           std::vector < int > & rowPtr,
+                           std::vector < int > & colIdx){
+    parallelSort(keys, threadCount());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    rowPtr.assign(n + 1, 0);
+    colIdx.resize(keys.size());
+    for (Index k = 0; k < keys.size(); k ++){
+        rowPtr[(keys[k] >> 32) + 1] ++;
+        colIdx[k] = int(keys[k] & 0xffffffff);
+    }
+    for (Index i = 0; i < n; i ++) rowPtr[i + 1] += rowPtr[i];
+}
+
+/*! Reverse Cuthill-McKee order of the graph (rowPtr, colIdx). Every
+ * component starts at a pseudo peripheral vertex. */
+static IndexArray reverseCuthillMcKee_(const std::vector < int > & rowPtr,
+                                       const std::vector < int > & colIdx){
+    Index n = rowPtr.size() - 1;
+    std::vector < int > order;
+    order.reserve(n);
+    std::vector < bool > done(n, false);
+    std::vector < int > seen(n, -1);
+    std::vector < int > lev(n, 0);
+    std::vector < int > bfs;
+    int visit = 0;
+
+    struct DegreeLess{
+        const std::vector < int > * rowPtr;
+        bool operator()(int a, int b) const {
+            int da = (*rowPtr)[a + 1] - (*rowPtr)[a];
+            int db = (*rowPtr)[b + 1] - (*rowPtr)[b];
+            return da < db || (da == db && a < b);
+        }
+    } degreeLess;
+    degreeLess.rowPtr = &rowPtr;
+
+    for (Index s = 0; s < n; s ++){
+        if (done[s]) continue;
+
+        //** pseudo peripheral root of the component of s
+        int root = s;
+        int ecc = -1;
+        for (Index iter = 0; iter < 5; iter ++){
+            visit ++;
+            bfs.assign(1, root);
+            seen[root] = visit;
+            lev[root] = 0;
+            for (Index q = 0; q < bfs.size(); q ++){
+                int v = bfs[q];
+                for (int k = rowPtr[v]; k < rowPtr[v + 1]; k ++){
+                    int w = colIdx[k];
+                    if (seen[w] != visit){
+                        seen[w] = visit;
+                        lev[w] = lev[v] + 1;
+                        bfs.push_back(w);
+                    }
+                }
+            }
+            int last = lev[bfs.back()];
+            if (last <= ecc) break;
+            ecc = last;
+            int next = bfs.back();
+            for (Index q = bfs.size(); q -- > 0 && lev[bfs[q]] == last;){
+                if (degreeLess(bfs[q], next)) next = bfs[q];
+            }
+            root = next;
+        }
+
+        //** Cuthill-McKee: breadth first with increasing degree
+        Index first = order.size();
+        order.push_back(root);
+        done[root] = true;
+        for (Index q = first; q < order.size(); q ++){
+            int v = order[q];
+            Index start = order.size();
+            for (int k = rowPtr[v]; k < rowPtr[v + 1]; k ++){
+                int w = colIdx[k];
+                if (!done[w]){
+                    done[w] = true;
+                    order.push_back(w);
+                }
+            }
+            std::sort(order.begin() + start, order.end(), degreeLess);
+        }
+    }
+
+    IndexArray ret(n);
+    for (Index i = 0; i < n; i ++) ret[i] = order[n - 1 - i];
+    return ret;
+}
+
+IndexArray Mesh::nodeOrdering(MeshOrdering ordering) const {
+    IndexArray order;
+    switch (ordering){
+        case ORDERING_MORTON:
+        case ORDERING_HILBERT:
+            order = curveOrder_(this->positions(), ordering == ORDERING_HILBERT, dim());
+            break;
+        case ORDERING_RCM:
+        case ORDERING_ND: {
+            //** nodes are neighbours if they share a cell
+            std::vector < Index > keys;
+            for (Index i = 0; i < cellCount(); i ++){
+                const Cell & c = *cellVector_[i];
+                for (Index j = 0; j < c.nodeCount(); j ++){
+                    for (Index k = 0; k < c.nodeCount(); k ++){
+                        if (j == k) continue;
+                        keys.push_back(Index(c.node(j).id()) << 32 | Index(c.node(k).id()));
+                    }
+                }
+            }
+            std::vector < int > rowPtr, colIdx;
+            graphFromKeys_(keys, nodeCount(), rowPtr, colIdx);
+            if (ordering == ORDERING_RCM) order = reverseCuthillMcKee_(rowPtr, colIdx);
+            else order = nestedDissection(rowPtr, colIdx);
+        } break;
+        default:
+            order = IndexArray(nodeCount());
+            for (Index i = 0; i < nodeCount(); i ++) order[i] = i;
+    }
+    return inversePermutation_(order);
+}
+
+IndexArray Mesh::cellOrdering(MeshOrdering ordering) const {
+    IndexArray order;
+    switch (ordering){
+        case ORDERING_MORTON:
+        case ORDERING_HILBERT:
+            order = curveOrder_(this->cellCenters(), ordering == ORDERING_HILBERT, dim());
+            break;
+        case ORDERING_RCM:
+        case ORDERING_ND: {
+            //** cells are neighbours if they share a boundary
+            if (!neighboursKnown_) const_cast<Mesh*>(this)->createNeighbourInfos();
+            std::vector < Index > keys;
+            for (Index i = 0; i < cellCount(); i ++){
+                Cell & c = *cellVector_[i];
+                for (Index j = 0; j < c.neighbourCellCount(); j ++){
+                    Cell * n = c.neighbourCell(j);
+                    if (n) keys.push_back(Index(c.id()) << 32 | Index(n->id()));
+                }
+            }
+            std::vector < int > rowPtr, colIdx;
+            graphFromKeys_(keys, cellCount(), rowPtr, colIdx);
+            if (ordering == ORDERING_RCM) order = reverseCuthillMcKee_(rowPtr, colIdx);
+            else order = nestedDissection(rowPtr, colIdx);
+        } break;
+        default:
+            order = IndexArray(cellCount());
+            for (Index i = 0; i < cellCount(); i ++) order[i] = i;
+    }
+    return inversePermutation_(order);
+}
+
+void Mesh::reorder(MeshOrdering nodes, MeshOrdering cells){
+    if (nodes != ORDERING_NONE) sortNodes(nodeOrdering(nodes));
+    if (cells != ORDERING_NONE) sortCells(cellOrdering(cells));
 }
 
 void Mesh::recountNodes(){
@@ -1002,9 +1562,16 @@ void Mesh::createClosedGeometryParaMesh(const std::vector < RVector3 > & vPos, i
 //   for (Index i = 0; i < cellCount(); i ++) cell(i).setMarker(i);
 }
 
-Mesh Mesh::createH2() const {
+Mesh Mesh::createH2(Index levels) const {
+    if (levels == 0) return *this;
+
     Mesh ret(this->dimension());
     ret.createRefined_(*this, false, true);
+    for (Index i = 1; i < levels; i ++){
+        Mesh tmp(this->dimension());
+        tmp.createRefined_(ret, false, true);
+        ret = tmp;
+    }
     ret.setCellAttributes(ret.cellMarkers());
     return ret;
 }
@@ -1039,14 +1606,154 @@ Node * Mesh::createRefinementNode_(Node * n0, Node * n1, std::map< std::pair < I
     return n;
 }
 
+inline void appendEdgeKey_(const MeshEntity & e, Index i, Index j,
+                           std::vector < Index > & keys){
+    Index a = e.node(i).id();
+    Index b = e.node(j).id();
+    if (a == b) return;
+    keys.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+}
+
+inline void appendSplitKeys_(const MeshEntity & e, const uint8 split[][2],
+                             Index n, std::vector < Index > & keys){
+    for (Index j = 0; j < n; j ++) appendEdgeKey_(e, split[j][0], split[j][1], keys);
+}
+
+/*! Append the keys of all edges of e that get a refinement node. */
+void appendRefinementKeys_(const MeshEntity & e, bool oldTet10,
+                           std::vector < Index > & keys){
+    switch (e.rtti()){
+        case MESH_EDGE_CELL_RTTI:
+        case MESH_EDGE_RTTI:
+            appendEdgeKey_(e, 0, 1, keys);
+            break;
+        case MESH_TRIANGLE_RTTI:
+        case MESH_TRIANGLEFACE_RTTI:
+            for (Index j = 0; j < 3; j ++) appendEdgeKey_(e, j, (j + 1) % 3, keys);
+            break;
+        case MESH_QUADRANGLE_RTTI:
+        case MESH_QUADRANGLEFACE_RTTI:
+            for (Index j = 0; j < 4; j ++) appendEdgeKey_(e, j, (j + 1) % 4, keys);
+            break;
+        case MESH_TETRAHEDRON_RTTI:
+            if (oldTet10) appendSplitKeys_(e, Tet10NodeSplitZienk, 10, keys);
+            else appendSplitKeys_(e, Tet10NodeSplit, 10, keys);
+            break;
+        case MESH_HEXAHEDRON_RTTI:
+            appendSplitKeys_(e, Hex20NodeSplit, 20, keys);
+            break;
+        case MESH_TRIPRISM_RTTI:
+            appendSplitKeys_(e, Prism15NodeSplit, 15, keys);
+            break;
+        case MESH_PYRAMID_RTTI:
+            appendSplitKeys_(e, Pyramid13NodeSplit, 13, keys);
+            break;
+        default: break;
+    }
+}
+
+class RefinementEdgesMT : public BaseCalcMT{
+public:
+    RefinementEdgesMT(const Mesh & mesh, bool oldTet10,
+                      std::vector < std::vector < Index > > & keys)
+    : BaseCalcMT(false), mesh_(&mesh), oldTet10_(oldTet10), keys_(&keys){
+    }
+
+    virtual ~RefinementEdgesMT(){}
+
+    virtual void calc(Index tNr=0){
+        std::vector < Index > & keys = (*keys_)[tNr];
+        Index nCells = mesh_->cellCount();
+        for (Index i = start_; i < end_; i ++){
+            if (i < nCells) {
+                appendRefinementKeys_(mesh_->cell(i), oldTet10_, keys);
+            } else {
+                appendRefinementKeys_(mesh_->boundary(i - nCells), oldTet10_, keys);
+            }
+        }
+    }
+
+protected:
+    const Mesh * mesh_;
+    bool oldTet10_;
+    std::vector < std::vector < Index > > * keys_;
+};
+
+//! Refinement nodes of the edges of a mesh.
+/*! The edges (min id, max id) of all cells and boundaries are collected in
+ * parallel, sorted and made unique, so the refinement node of an edge is
+ * found by binary search in a flat array. Pairs of new nodes, e.g., for face
+ * and cell centers of hexahedrons, are not known in advance and are stored
+ * in nodeMatrix. */
+class RefinementEdgeMap{
+public:
+    void build(const Mesh & mesh, bool oldTet10, Index nThreads){
+        if (mesh.nodeCount() >= (Index(1) << 32)){
+            throwLengthError(1, WHERE_AM_I + " too many nodes: " + str(mesh.nodeCount()));
+        }
+        Index nEntities = mesh.cellCount() + mesh.boundaryCount();
+        nThreads = std::max(Index(1), std::min(nThreads, nEntities / 1000));
+
+        std::vector < std::vector < Index > > keys(nThreads);
+        distributeCalc(RefinementEdgesMT(mesh, oldTet10, keys), nEntities, nThreads);
+
+        Index nKeys = 0;
+        for (Index i = 0; i < keys.size(); i ++) nKeys += keys[i].size();
+        keys_.clear();
+        keys_.reserve(nKeys);
+        for (Index i = 0; i < keys.size(); i ++){
+            keys_.insert(keys_.end(), keys[i].begin(), keys[i].end());
+            std::vector < Index >().swap(keys[i]);
+        }
+        parallelSort(keys_, nThreads);
+        keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+        nodes_.assign(keys_.size(), NULL);
+        nodeMatrix.clear();
+    }
+
+    /*! Return the amount of unique edges. */
+    inline Index size() const { return keys_.size(); }
+
+    /*! Return the slot of the refinement node of the edge (a, b) or NULL
+     * if the edge is unknown. */
+    inline Node ** find(Index a, Index b){
+        Index k = a < b ? (a << 32) | b : (b << 32) | a;
+        std::vector < Index >::const_iterator it =
+            std::lower_bound(keys_.begin(), keys_.end(), k);
+        if (it == keys_.end() || *it != k) return NULL;
+        return &nodes_[it - keys_.begin()];
+    }
+
+    std::map< std::pair < Index, Index >, Node * > nodeMatrix;
+
+protected:
+    std::vector < Index > keys_;
+    std::vector < Node * > nodes_;
+};
+
+Node * Mesh::createRefinementNode_(Node * n0, Node * n1, RefinementEdgeMap & edges){
+    if (n0 == n1) return n0;
+
+    Node ** n = edges.find(n0->id(), n1->id());
+    if (!n) return createRefinementNode_(n0, n1, edges.nodeMatrix);
+
+    if (!*n) *n = this->createNode((n0->pos() + n1->pos()) / 2.0, markerT(n0, n1));
+    return *n;
+}
+
 void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
 
     this->clear();
 
-    std::map< std::pair < Index, Index >, Node * > nodeMatrix;
+    RefinementEdgeMap edges;
+    edges.build(mesh, oldTet10NumberingStyle_, threadCount());
+
+    nodeVector_.reserve(mesh.nodeCount() + edges.size());
+    cellVector_.reserve(h2 ? 8 * mesh.cellCount() : mesh.cellCount());
+    boundaryVector_.reserve(h2 ? 4 * mesh.boundaryCount() : mesh.boundaryCount());
 
     for (Index i = 0, imax = mesh.nodeCount(); i < imax; i ++) {
-        this->createRefinementNode_(&mesh.node(i), &mesh.node(i), nodeMatrix);
+        this->createNode(mesh.node(i).pos(), mesh.node(i).marker());
     }
 
     std::vector < Node * > n;
@@ -1059,7 +1766,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n.resize(3);
                 n[0] = &node(mesh.cell(i).node(0).id());
                 n[1] = &node(mesh.cell(i).node(1).id());
-                n[2] = createRefinementNode_(n[0], n[1], nodeMatrix);
+                n[2] = createRefinementNode_(n[0], n[1], edges);
 
                 if (h2){
                     std::vector < Node * > e1(2);
@@ -1075,9 +1782,9 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n[1] = &node(mesh.cell(i).node(1).id());
                 n[2] = &node(mesh.cell(i).node(2).id());
 
-                n[3] = createRefinementNode_(n[0], n[1], nodeMatrix);
-                n[4] = createRefinementNode_(n[1], n[2], nodeMatrix);
-                n[5] = createRefinementNode_(n[2], n[0], nodeMatrix);
+                n[3] = createRefinementNode_(n[0], n[1], edges);
+                n[4] = createRefinementNode_(n[1], n[2], edges);
+                n[5] = createRefinementNode_(n[2], n[0], edges);
 
                 if (h2){
                     this->createTriangle(*n[0], *n[3], *n[5], cID);
@@ -1094,10 +1801,10 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n[2] = &node(mesh.cell(i).node(2).id());
                 n[3] = &node(mesh.cell(i).node(3).id());
 
-                n[4] = createRefinementNode_(n[0], n[1], nodeMatrix);
-                n[5] = createRefinementNode_(n[1], n[2], nodeMatrix);
-                n[6] = createRefinementNode_(n[2], n[3], nodeMatrix);
-                n[7] = createRefinementNode_(n[3], n[0], nodeMatrix);
+                n[4] = createRefinementNode_(n[0], n[1], edges);
+                n[5] = createRefinementNode_(n[1], n[2], edges);
+                n[6] = createRefinementNode_(n[2], n[3], edges);
+                n[7] = createRefinementNode_(n[3], n[0], edges);
 
                 if (h2){
                     Node *n8 = this->createNode(c.shape().xyz(RVector3(0.5, 0.5)));
@@ -1116,7 +1823,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
 
                         n[j] = createRefinementNode_(& this->node(c.node(Tet10NodeSplitZienk[j][0]).id()),
                                                         & this->node(c.node(Tet10NodeSplitZienk[j][1]).id()),
-                                                        nodeMatrix);
+                                                        edges);
                     }
 
                     if (h2){
@@ -1134,7 +1841,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                     for (Index j = 0; j < n.size(); j ++) {
                         n[j] = createRefinementNode_(& this->node(c.node(Tet10NodeSplit[j][0]).id()),
                                                         & this->node(c.node(Tet10NodeSplit[j][1]).id()),
-                                                        nodeMatrix);
+                                                        edges);
                     }
 
                     if (h2){
@@ -1148,7 +1855,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 for (Index j = 0; j < n.size(); j ++) {
                     n[j] = createRefinementNode_(& this->node(c.node(Hex20NodeSplit[j][0]).id()),
                                                  & this->node(c.node(Hex20NodeSplit[j][1]).id()),
-                                                 nodeMatrix);
+                                                 edges);
                 }
                 if (h2){
 /* 27 new nodes 3 x 9 = 8 nodes + 12 edges + 6 facets + 1 center
@@ -1168,14 +1875,14 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
     0------8------1        \n
 
 */
-                    Node *n20 = createRefinementNode_(n[8], n[10], nodeMatrix);
-                    Node *n21 = createRefinementNode_(n[12], n[14], nodeMatrix);
-                    Node *n22 = createRefinementNode_(n[8], n[12], nodeMatrix);
-                    Node *n23 = createRefinementNode_(n[9], n[13], nodeMatrix);
-                    Node *n24 = createRefinementNode_(n[10], n[14], nodeMatrix);
-                    Node *n25 = createRefinementNode_(n[11], n[15], nodeMatrix);
+                    Node *n20 = createRefinementNode_(n[8], n[10], edges);
+                    Node *n21 = createRefinementNode_(n[12], n[14], edges);
+                    Node *n22 = createRefinementNode_(n[8], n[12], edges);
+                    Node *n23 = createRefinementNode_(n[9], n[13], edges);
+                    Node *n24 = createRefinementNode_(n[10], n[14], edges);
+                    Node *n25 = createRefinementNode_(n[11], n[15], edges);
 
-                    Node *n26 = createRefinementNode_(n20, n21, nodeMatrix);
+                    Node *n26 = createRefinementNode_(n20, n21, edges);
 
                     std::vector < Node* > ns(8);
                     Node *n1_[]={ n[0], n[8], n20, n[11], n[16], n22, n26, n25 }; std::copy(&n1_[0], &n1_[8], &ns[0]);
@@ -1210,13 +1917,13 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 for (Index j = 0; j < n.size(); j ++) {
                     n[j] = createRefinementNode_(& this->node(c.node(Prism15NodeSplit[j][0]).id()),
                                                  & this->node(c.node(Prism15NodeSplit[j][1]).id()),
-                                                 nodeMatrix);
+                                                 edges);
                 }
                 if (h2){
 
-                    Node *nf1 = createRefinementNode_(n[6], n[9], nodeMatrix);
-                    Node *nf2 = createRefinementNode_(n[7], n[10], nodeMatrix);
-                    Node *nf3 = createRefinementNode_(n[8], n[11], nodeMatrix);
+                    Node *nf1 = createRefinementNode_(n[6], n[9], edges);
+                    Node *nf2 = createRefinementNode_(n[7], n[10], edges);
+                    Node *nf3 = createRefinementNode_(n[8], n[11], edges);
 
                     std::vector < Node* > ns(6);
                     Node *n1_[]={ n[0], n[6], n[8], n[12], nf1, nf3 }; std::copy(&n1_[0], &n1_[6], &ns[0]);
@@ -1244,7 +1951,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 for (Index j = 0; j < n.size(); j ++) {
                     n[j] = createRefinementNode_(& this->node(c.node(Pyramid13NodeSplit[j][0]).id()),
                                                     & this->node(c.node(Pyramid13NodeSplit[j][1]).id()),
-                                                    nodeMatrix);
+                                                    edges);
                 }
                 if (h2){
                     THROW_TO_IMPL
@@ -1272,7 +1979,7 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n.resize(3);
                 n[0] = &node(b.node(0).id());
                 n[1] = &node(b.node(1).id());
-                n[2] = createRefinementNode_(n[0], n[1], nodeMatrix);
+                n[2] = createRefinementNode_(n[0], n[1], edges);
                 break;
             case MESH_TRIANGLEFACE_RTTI:
                 n.resize(6);
@@ -1280,9 +1987,9 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n[1] = &node(b.node(1).id());
                 n[2] = &node(b.node(2).id());
 
-                n[3] = createRefinementNode_(n[0], n[1], nodeMatrix);
-                n[4] = createRefinementNode_(n[1], n[2], nodeMatrix);
-                n[5] = createRefinementNode_(n[2], n[0], nodeMatrix);
+                n[3] = createRefinementNode_(n[0], n[1], edges);
+                n[4] = createRefinementNode_(n[1], n[2], edges);
+                n[5] = createRefinementNode_(n[2], n[0], edges);
                 break;
             case MESH_QUADRANGLEFACE_RTTI:
                 n.resize(8);
@@ -1291,10 +1998,10 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                 n[2] = &node(b.node(2).id());
                 n[3] = &node(b.node(3).id());
 
-                n[4] = createRefinementNode_(n[0], n[1], nodeMatrix);
-                n[5] = createRefinementNode_(n[1], n[2], nodeMatrix);
-                n[6] = createRefinementNode_(n[2], n[3], nodeMatrix);
-                n[7] = createRefinementNode_(n[3], n[0], nodeMatrix);
+                n[4] = createRefinementNode_(n[0], n[1], edges);
+                n[5] = createRefinementNode_(n[1], n[2], edges);
+                n[6] = createRefinementNode_(n[2], n[3], edges);
+                n[7] = createRefinementNode_(n[3], n[0], edges);
                 break;
             default: std::cerr << b.rtti() <<" " << std::endl; THROW_TO_IMPL  break;
         }
@@ -1324,8 +2031,8 @@ void Mesh::createRefined_(const Mesh & mesh, bool p2, bool h2){
                      * |   |   |
                      * 0---4---1
                     */
-                    Node *n8 = nodeMatrix[std::make_pair(n[4]->id(), n[6]->id())];
-                    if (!n8) n8 = createRefinementNode_(n[5], n[7], nodeMatrix);
+                    Node *n8 = edges.nodeMatrix[std::make_pair(n[4]->id(), n[6]->id())];
+                    if (!n8) n8 = createRefinementNode_(n[5], n[7], edges);
 
                     this->createQuadrangleFace(*n[0], *n[4], *n8, *n[7], b.marker());
                     this->createQuadrangleFace(*n[1], *n[5], *n8, *n[4], b.marker());
@@ -2097,7 +2804,7 @@ Mesh & Mesh::scale(const RVector3 & s){
     std::for_each(regionMarker_.begin(), regionMarker_.end(),
                   boost::bind(& RVector3::scale, _1, boost::ref(s)));
 
-    rangesKnown_ = false;
+    nodePositionsChanged_();
     return *this;
 }
 
@@ -2109,7 +2816,7 @@ Mesh & Mesh::translate(const RVector3 & t){
     std::for_each(regionMarker_.begin(), regionMarker_.end(),
                   boost::bind(& RVector3::translate, _1, boost::ref(t)));
 
-    rangesKnown_ = false;
+    nodePositionsChanged_();
     return *this;
 }
 
@@ -2121,22 +2828,29 @@ Mesh & Mesh::rotate(const RVector3 & r){
     std::for_each(regionMarker_.begin(), regionMarker_.end(),
                   boost::bind(& RVector3::rotate, _1, boost::ref(r)));
 
-    rangesKnown_ = false;
+    nodePositionsChanged_();
     return *this;
 }
 
 void Mesh::swapCoordinates(Index i, Index j){
     if (i != j){
-        if (i < dimension_ && i < dimension_){
+        if (i < dimension_ && j < dimension_){
             for (Index n = 0; n < nodeVector_.size(); n++){
                 double tmp = nodeVector_[n]->at(i);
                 nodeVector_[n]->at(i) = nodeVector_[n]->at(j);
                 nodeVector_[n]->at(j) = tmp;
             }
+            nodePositionsChanged_();
         }
     }
 }
 
+void Mesh::nodePositionsChanged_(){
+    rangesKnown_ = false;
+    //** the kd-tree stores copies of the node positions
+    if (tree_) tree_->clear();
+}
+
 void Mesh::relax(){
    THROW_TO_IMPL
    //  int E = 0;
@@ -2232,11 +2946,9 @@ void Mesh::fillKDTree_() const {
     
     if (tree_->size() != nodeCount(true)){
         if (tree_->size() == 0){
-
-            for_each(nodeVector_.begin(), nodeVector_.end(), boost::bind(&KDTreeWrapper::insert, tree_, _1));
-            for_each(secNodeVector_.begin(), secNodeVector_.end(), boost::bind(&KDTreeWrapper::insert, tree_, _1));
-
-            tree_->tree()->optimize();
+            std::vector < Node * > nodes(nodeVector_);
+            nodes.insert(nodes.end(), secNodeVector_.begin(), secNodeVector_.end());
+            tree_->build(nodes);
         } else {
             throwError(1, WHERE_AM_I + toStr(this) + " kd-tree is only partially filled: this should no happen: nodeCount = " + toStr(nodeCount())
                                       + " tree-size() " + toStr(tree_->size()));
@@ -2264,18 +2976,19 @@ void Mesh::addHoleMarker(const RVector3 & pos){
 void Mesh::interpolationMatrix(const R3Vector & q, RSparseMapMatrix & I){
     I.resize(q.size(), this->nodeCount());
 
-    Index count = 0;
-    Cell * c = 0;
-    RVector cI;
+    IVector cellIds;
+    RVector rst;
+    this->findCells(q, cellIds, rst);
 
+    RVector cI;
     for (Index i = 0; i < q.size(); i ++ ){
-        c = this->findCell(q[i], count, false);
-        if (c){
-            cI.resize(c->nodeCount());
-            c->N(c->shape().rst(q[i]), cI);
+        if (cellIds[i] > -1){
+            const Cell & c = *cellVector_[cellIds[i]];
+            cI.resize(c.nodeCount());
+            c.N(RVector3(rst[3 * i], rst[3 * i + 1], rst[3 * i + 2]), cI);
 
-            for (Index j = 0; j < c->nodeCount(); j ++){
-                I.addVal(i, c->ids()[j], cI[j]);
+            for (Index j = 0; j < c.nodeCount(); j ++){
+                I.addVal(i, c.node(j).id(), cI[j]);
             }
         }
     }
@@ -33,6 +33,13 @@
 namespace GIMLI{
 
 class KDTreeWrapper;
+class RefinementEdgeMap;
+
+/*! Strategies for the renumbering of nodes and cells, see \ref Mesh::reorder.
+ * Space-filling curves (Morton, Hilbert) sort by position, reverse
+ * Cuthill-McKee (RCM) reduces the bandwidth and nested dissection (ND) the
+ * fill-in of the node or cell neighbour graph. */
+enum MeshOrdering{ORDERING_NONE,ORDERING_MORTON,ORDERING_HILBERT,ORDERING_RCM,ORDERING_ND};
 
 //! A BoundingBox
 /*! A BoundingBox which contains a min and max Vector3< double >*/
@@ -288,8 +295,10 @@ public:
     void createClosedGeometryParaMesh(const std::vector < RVector3 > & vPos, int nSegments, double dxInner,
                                         const std::vector < RVector3 > & addit);
 
-    /*! Create and copy global H2 mesh of this mesh.*/
-    Mesh createH2() const;
+    /*! Create and copy global H2 mesh of this mesh. The refinement is
+     * repeated levels times, i.e., every edge is split into 2^levels parts.
+     * levels = 0 returns an unrefined copy. */
+    Mesh createH2(Index levels=1) const;
 
     /*! Create and copy global P2 mesh of this mesh.*/
     Mesh createP2() const;
@@ -441,9 +450,27 @@ public:
     Cell * findCell(const RVector3 & pos, bool extensive=true) const {
         size_t counter; return findCell(pos, counter, extensive); }
 
+    /*! Locate the cells for all positions in pos at once.
+     * The positions are sorted along a space-filling curve (Morton order)
+     * and each search walks from the last found cell, so neighboring
+     * queries need only a few steps. If the walk fails the kd-tree is used
+     * like in \ref findCell. The search is multithreaded.
+     * cellIds[i] is the id of the cell that contains pos[i] or -1.
+     * rst[3*i, 3*i+3) holds the local coordinates of pos[i] in this cell,
+     * which are the barycentric coordinates for simplex cells. */
+    void findCells(const R3Vector & pos, IVector & cellIds, RVector & rst) const;
+
+    /*! Shortcut for \ref findCells(const R3Vector & pos, IVector & cellIds, RVector & rst). */
+    IVector findCells(const R3Vector & pos) const {
+        IVector cellIds; RVector rst; findCells(pos, cellIds, rst); return cellIds; }
+
     /*! Return the index to the node of this mesh with the smallest distance to pos. */
     Index findNearestNode(const RVector3 & pos);
 
+    /*! Return the indices to the nearest nodes for all positions in pos.
+     * The search is multithreaded. */
+    IndexArray findNearestNodes(const R3Vector & pos);
+
     /*! Return vector of cell ptrs with marker match the range [from .. to). \n
         For single marker match to is set to 0, for open end set to = -1 */
     std::vector < Cell * > findCellByMarker(int from, int to=0) const;
@@ -453,13 +480,40 @@ public:
     std::vector < Cell * > findCellByAttribute(double from, double to=0.0) const;
 
     /*! Return vector of cells that are intersected with a given ray from start
-     * to end. Intersecting positions, i.e., the travel path are stored in pos.
-     Note this will not yet check if the ray lies completely along a boundary.
-     This will probably fail and need to be implemented.
-     */
+     * in direction dir until it leaves the mesh. Intersecting positions,
+     * i.e., the travel path are stored in pos, so cell i is passed from
+     * pos[i] to pos[i+1]. If start is outside the mesh the ray starts at the
+     * nearest node. See \ref walkRay. */
     std::vector < Cell * > findCellsAlongRay(const RVector3 & start,
                                              const RVector3 & dir,
                                              R3Vector & pos) const;
+
+    /*! Return vector of cells that are intersected with the segment from
+     * start to end. The lengths of the segment within each cell are stored
+     * in lengths. The lengths sum up to the segment length if the segment
+     * is completely inside the mesh. See \ref walkRay. */
+    std::vector < Cell * > findCellsAlongSegment(const RVector3 & start,
+                                                 const RVector3 & end,
+                                                 RVector & lengths) const;
+
+    /*! Return the cell that contains the ray start + t * dir for small t > 0,
+     * or NULL if the ray does not start inside the mesh. Uses \ref findCell,
+     * so this is not thread safe. */
+    Cell * findRayStartCell(const RVector3 & start, const RVector3 & dir) const;
+
+    /*! Walk the ray start + t * dir, with |dir| = 1, from cell c through the
+     * neighbouring cells until it leaves the mesh or t reaches length.
+     * The exits of each cell are calculated exactly with
+     * Shape::intersectRay of the cell boundaries. Rays through nodes and
+     * edges continue in the cell behind them, rays along a boundary are
+     * assigned to one of the adjacent cells. The passed cells are appended
+     * to cells and the ray parameters t of their entries and exits to t, so
+     * cell i is passed from t[i] to t[i+1]. tol is the smallest distance
+     * that is treated as step along the ray. The search needs the
+     * neighbour infos (\ref createNeighbourInfos) and is thread safe. */
+    void walkRay(Cell * c, const RVector3 & start, const RVector3 & dir,
+                 double length, double tol,
+                 std::vector < Cell * > & cells, std::vector < double > & t) const;
     //** end get infos stuff
 
     //** start mesh modification stuff
@@ -482,8 +536,36 @@ public:
 
     void recountNodes();
 
+    /*! Renumber the nodes, node i gets the id perm[i]. Node data in the
+     * data map are permuted accordingly if nodeCount() != cellCount(). */
     void sortNodes(const IndexArray & perm);
 
+    /*! Renumber the cells, cell i gets the id perm[i]. Cell data in the
+     * data map are permuted accordingly. */
+    void sortCells(const IndexArray & perm);
+
+    /*! Return a node permutation for \ref sortNodes with better memory
+     * locality for the given strategy. */
+    IndexArray nodeOrdering(MeshOrdering ordering) const;
+
+    /*! Return a cell permutation for \ref sortCells with better memory
+     * locality for the given strategy. RCM and ND use the cell neighbours. */
+    IndexArray cellOrdering(MeshOrdering ordering) const;
+
+    /*! Renumber nodes and cells with the given strategies. Markers,
+     * attributes and thus the region parameter mapping move with their
+     * entities, data are permuted, see \ref nodeOrigin. */
+    void reorder(MeshOrdering nodes=ORDERING_HILBERT,
+                 MeshOrdering cells=ORDERING_HILBERT);
+
+    /*! Return the original id of each node after \ref sortNodes, i.e., the
+     * inverse of all node permutations. Empty if never sorted. Use it to
+     * write results in the original order. */
+    const IndexArray & nodeOrigin() const { return nodeOrigin_; }
+
+    /*! Return the original id of each cell after \ref sortCells. */
+    const IndexArray & cellOrigin() const { return cellOrigin_; }
+
     /*! Return true if createNeighbourInfos is called once */
     inline bool neighboursKnown() const { return neighboursKnown_; }
 
@@ -526,7 +608,7 @@ public:
 //         std::for_each(nodeVector_.begin(), nodeVector_.end(),
 //                        bind2nd(std::mem_fun(&Node::pos().transform), mat));
         for (uint i = 0; i < nodeVector_.size(); i ++) nodeVector_[i]->pos().transform(mat);
-        rangesKnown_ = false;
+        nodePositionsChanged_();
         return *this;
     }
 
@@ -611,17 +693,29 @@ public:
 
     /*! Export the mesh in filename using vtu format:
     Visualization Toolkit Unstructured Points Data (http://www.vtk.org)
-    Set binary to true writes the data content in binary format.
+    Set binary to true writes all arrays raw binary into the appended data
+    section. Set compress to true for zlib compressed blocks (binary only and
+    if build with zlib). The encoding of the arrays is multithreaded.
     The file suffix .vtu will be added or substituted if .vtu or .vtk is found.
     \ref exportData, cell.marker and cell.attribute will be exported as data. */
-    void exportVTU(const std::string & filename, bool binary = false) const ;
+    void exportVTU(const std::string & filename, bool binary=false,
+                   bool compress=false) const ;
+
+    /*! Export a time series into one vtu file. The geometry is written once,
+    followed by one data array for each row of steps named name_0000,
+    name_0001, ... Each row need to be of size nodeCount or cellCount.
+    \ref exportData and cell.marker will be exported as well. */
+    void exportVTUTimeSteps(const std::string & filename, const std::string & name,
+                            const RMatrix & steps, bool binary=true,
+                            bool compress=false) const ;
 
     /*! Export the boundary of this mesh in vtu format: Visualization Toolkit Unstructured Points Data (http://www.vtk.org) Set Binary to true writes the datacontent in binary format. The file suffix .vtu will be added or substituted if .vtu or .vtk is found. */
     void exportBoundaryVTU(const std::string & fbody, bool binary = false) const ;
 
     /*! Internal function for exporting VTU */
     void addVTUPiece_(std::fstream & file, const Mesh & mesh,
-                        const std::map < std::string, RVector > & data) const;
+                      const std::map < std::string, RVector > & data,
+                      bool binary=false, bool compress=false) const;
 
     void exportAsTetgenPolyFile(const std::string & filename);
     //** end I/O stuff
@@ -776,6 +870,10 @@ protected:
 
     void findRange_() const ;
 
+    /*! Reset the caches that store node positions, i.e., the ranges and
+     * the kd-tree. Call it after moving nodes. */
+    void nodePositionsChanged_();
+
     /*!Ensure is geometry check*/
     Node * createNodeGC_(const RVector3 & pos, int marker);
 
@@ -820,8 +918,13 @@ protected:
 //    Node * createRefinementNode_(Node * n0, Node * n1, SparseMapMatrix < Node *, Index > & nodeMatrix);
     Node * createRefinementNode_(Node * n0, Node * n1, std::map< std::pair < Index, Index >, Node * > & nodeMatrix);
 
+    Node * createRefinementNode_(Node * n0, Node * n1, RefinementEdgeMap & edges);
+
     void createRefined_(const Mesh & mesh, bool p2, bool r2);
 
+    /*! Permute all data of length size: v[perm[i]] = v_old[i]. */
+    void permuteData_(const IndexArray & perm, Index size);
+
     Cell * findCellBySlopeSearch_(const RVector3 & pos, Cell * start, size_t & count, bool tagging) const;
 
     void fillKDTree_() const;
@@ -853,6 +956,10 @@ protected:
     bool oldTet10NumberingStyle_;
 
     std::map< std::string, RVector > exportDataMap_;
+
+    IndexArray nodeOrigin_;
+    IndexArray cellOrigin_;
+
     std::string commentString_;
 
     // for PLC creation
@@ -17,17 +17,29 @@
  ******************************************************************************/
 
 #include "mesh.h"
+#include "calculateMultiThread.h"
 #include "node.h"
 #include "matrix.h"
+#include "memwatch.h"
 #include "pos.h"
+#include "profiler.h"
 #include "vectortemplates.h"
 
 #include <map>
 #include <fstream>
+#include <sstream>
+#include <cstring>
+
+#if ZLIB_FOUND
+    #include <zlib.h>
+    #define USE_ZLIB 1
+#endif
 
 namespace GIMLI{
 
 void Mesh::load(const std::string & fbody, bool createNeighbours, IOFormat format){
+    GIMLI_PROFILE("Mesh::load");
+    MemoryScope memoryScope(MEMORY_MESH);
     if (fbody.find(".mod") != std::string::npos){
         importMod(fbody);
     } else if (fbody.find(".vtk") != std::string::npos){
@@ -1179,15 +1191,137 @@ void Mesh::importVTU(const std::string & fbody) {
     THROW_TO_IMPL
 }
 
-void Mesh::exportVTU(const std::string & fbody, bool binary) const {
+//** helper for the vtu export
+#define VTU_BLOCKSIZE 65536
+
+//! One DataArray of a vtu piece. Values are referenced or owned raw bytes.
+struct VTUArray_{
+    VTUArray_(const std::string & t, const std::string & n, Index nc=1)
+        : type(t), name(n), nComp(nc), src(0), nBytes(0){}
+
+    template < class T > void set(const std::vector < T > & v){
+        own.resize(v.size() * sizeof(T));
+        if (v.size()) std::memcpy(&own[0], &v[0], own.size());
+        src = own.size() ? &own[0] : 0;
+        nBytes = own.size();
+    }
+
+    void reference(const RVector & v){
+        src = v.size() ? (const char *)&v[0] : 0;
+        nBytes = v.size() * sizeof(double);
+    }
+
+    Index typeSize() const {
+        if (type == "Float64") return sizeof(double);
+        if (type == "Int32") return sizeof(int32);
+        return sizeof(uint8);
+    }
+
+    Index blockCount() const { return (nBytes + VTU_BLOCKSIZE - 1) / VTU_BLOCKSIZE; }
+
+    std::string type;
+    std::string name;
+    Index nComp;
+    std::vector < char > own;
+    const char * src;
+    Index nBytes;
+    /*! ascii text or compressed data for each block */
+    std::vector < std::string > blocks;
+};
+
+class VTUEncodeMT : public BaseCalcMT{
+public:
+    VTUEncodeMT(std::vector < VTUArray_ > & arrays,
+                const std::vector < std::pair < Index, Index > > & jobs,
+                bool binary, std::streamsize precision)
+    : BaseCalcMT(false), arrays_(&arrays), jobs_(&jobs),
+      binary_(binary), precision_(precision){
+    }
+
+    virtual ~VTUEncodeMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index j = start_; j < end_; j ++){
+            VTUArray_ & a = (*arrays_)[(*jobs_)[j].first];
+            Index b = (*jobs_)[j].second;
+            const char * src = a.src + b * VTU_BLOCKSIZE;
+            Index n = std::min(Index(VTU_BLOCKSIZE), a.nBytes - b * VTU_BLOCKSIZE);
+
+            if (binary_){
+#if USE_ZLIB
+                uLongf len = compressBound(n);
+                a.blocks[b].resize(len);
+                if (compress2((Bytef*)&a.blocks[b][0], &len, (const Bytef*)src, n,
+                              Z_DEFAULT_COMPRESSION) == Z_OK){
+                    a.blocks[b].resize(len);
+                } else {
+                    //** empty block marks the failure, see addVTUPiece_
+                    a.blocks[b].clear();
+                }
+#endif
+            } else {
+                std::ostringstream os;
+                os.precision(precision_);
+                if (a.type == "Float64"){
+                    const double * v = (const double *)src;
+                    for (Index i = 0; i < n / sizeof(double); i ++) os << v[i] << " ";
+                } else if (a.type == "Int32"){
+                    const int32 * v = (const int32 *)src;
+                    for (Index i = 0; i < n / sizeof(int32); i ++) os << v[i] << " ";
+                } else {
+                    const uint8 * v = (const uint8 *)src;
+                    for (Index i = 0; i < n; i ++) os << int(v[i]) << " ";
+                }
+                a.blocks[b] = os.str();
+            }
+        }
+    }
+
+protected:
+    std::vector < VTUArray_ > * arrays_;
+    const std::vector < std::pair < Index, Index > > * jobs_;
+    bool binary_;
+    std::streamsize precision_;
+};
+
+static bool isLittleEndian_(){
+    uint16 one = 1;
+    return *((uint8 *)&one) == 1;
+}
+
+static bool useVTUCompression_(bool binary, bool compress){
+#if USE_ZLIB
+    return binary && compress;
+#else
+    if (binary && compress){
+        std::cerr << WHERE_AM_I << " compiled without zlib, "
+                     "write uncompressed binary data." << std::endl;
+    }
+    return false;
+#endif
+}
+
+/*! The appended raw data must not be translated, e.g., on windows. */
+static int openVTUFile_(const std::string & fileName, std::fstream * file){
+    return openFile(fileName, file, std::ios::out | std::ios::binary, true);
+}
+
+static void writeVTUHeader_(std::fstream & file, bool binary, bool compress){
+    file << "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\""
+         << (isLittleEndian_() ? "LittleEndian" : "BigEndian") << "\"";
+    if (binary) file << " header_type=\"UInt64\"";
+    if (useVTUCompression_(binary, compress)) file << " compressor=\"vtkZLibDataCompressor\"";
+    file << ">" << std::endl;
+}
+
+void Mesh::exportVTU(const std::string & fbody, bool binary, bool compress) const {
     std::string filename(fbody);
     if (filename.rfind(".vtu") == std::string::npos){
         filename = fbody.substr(0, filename.rfind(".vtk")) + ".vtu";
     }
-    std::fstream file; if (!openOutFile(filename, & file)) { return ; }
+    std::fstream file; if (!openVTUFile_(filename, & file)) { return ; }
     file.precision(14);
-    file << "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"LittleEndian\">" << std::endl;
-    file << "<UnstructuredGrid>" << std::endl;
+    writeVTUHeader_(file, binary, compress);
 
     std::map< std::string, RVector > data(exportDataMap_);
     if (cellCount() > 0){
@@ -1196,9 +1330,38 @@ void Mesh::exportVTU(const std::string & fbody, bool binary) const {
         if (!data.count("_Marker")) data.insert(std::make_pair("_Marker",  tmp));
         if (!data.count("_Attribute")) data.insert(std::make_pair("_Attribute",  cellAttributes()));
     }
-    addVTUPiece_(file, *this, data);
+    addVTUPiece_(file, *this, data, binary, compress);
+
+    file << "</VTKFile>" << std::endl;
+    file.close();
+}
+
+void Mesh::exportVTUTimeSteps(const std::string & fbody, const std::string & name,
+                              const RMatrix & steps,
+                              bool binary, bool compress) const {
+    std::string filename(fbody);
+    if (filename.rfind(".vtu") == std::string::npos){
+        filename = fbody.substr(0, filename.rfind(".vtk")) + ".vtu";
+    }
+    std::fstream file; if (!openVTUFile_(filename, & file)) { return ; }
+    file.precision(14);
+    writeVTUHeader_(file, binary, compress);
+
+    std::map< std::string, RVector > data(exportDataMap_);
+    if (cellCount() > 0){
+        RVector tmp(cellCount());
+        std::transform(cellVector_.begin(), cellVector_.end(), &tmp[0], std::mem_fun(&Cell::marker));
+        if (!data.count("_Marker")) data.insert(std::make_pair("_Marker",  tmp));
+    }
+
+    //** zero padded step numbers keep the arrays in time order
+    Index width = std::max(size_t(4), str(steps.rows()).size());
+    for (Index i = 0; i < steps.rows(); i ++){
+        std::string n(str(i));
+        data[name + "_" + std::string(width - n.size(), '0') + n] = steps[i];
+    }
+    addVTUPiece_(file, *this, data, binary, compress);
 
-    file << "</UnstructuredGrid>" << std::endl;
     file << "</VTKFile>" << std::endl;
     file.close();
 }
@@ -1208,10 +1371,9 @@ void Mesh::exportBoundaryVTU(const std::string & fbody, bool binary) const {
     if (filename.rfind(".vtu") == std::string::npos){
         filename = fbody.substr(0, filename.rfind(".vtk")) + ".vtu";
     }
-    std::fstream file; if (!openOutFile(filename, & file)) { return ; }
+    std::fstream file; if (!openVTUFile_(filename, & file)) { return ; }
 
-    file << "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"LittleEndian\">" << std::endl;
-    file << "<UnstructuredGrid>" << std::endl;
+    writeVTUHeader_(file, binary, false);
 
     std::vector < Boundary * > bs;
     for (uint i = 0; i < boundaryCount(); i ++) {
@@ -1237,17 +1399,17 @@ void Mesh::exportBoundaryVTU(const std::string & fbody, bool binary) const {
     if (!boundData.count("_BoundaryMarker")) boundData.insert(std::make_pair("_BoundaryMarker",  tmp));
 
     //boundMesh.exportVTK(fbody, boundData);
-    addVTUPiece_(file, boundMesh, boundData);
+    addVTUPiece_(file, boundMesh, boundData, binary, false);
 
-    file << "</UnstructuredGrid>" << std::endl;
     file << "</VTKFile>" << std::endl;
     file.close();
 }
 
 void Mesh::addVTUPiece_(std::fstream & file, const Mesh & mesh,
-                  const std::map < std::string, RVector > & data) const{
+                        const std::map < std::string, RVector > & data,
+                        bool binary, bool compress) const{
 
-    bool binary = false;
+    compress = useVTUCompression_(binary, compress);
     bool cellsAreBoundaries = false;
 
     std::vector < MeshEntity * > cells;
@@ -1264,121 +1426,165 @@ void Mesh::addVTUPiece_(std::fstream & file, const Mesh & mesh,
     uint nNodes = mesh.nodeCount();
     uint nCells = cells.size();
 
-    file << "<Piece NumberOfPoints=\"" << nNodes << "\" NumberOfCells=\"" << nCells << "\">" << std::endl;
+    //** collect all arrays: points, connectivity, offsets, types, point data, cell data
+    std::vector < VTUArray_ > arrays;
 
-    file << "<Points>" << std::endl;
-    file << "<DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"ascii\">" << std::endl;
-    for (uint i = 0; i < mesh.nodeCount(); i ++) {
-        file << mesh.node(i).x() << " " << mesh.node(i).y() << " " << mesh.node(i).z() << " ";
+    std::vector < double > xyz(3 * nNodes);
+    for (uint i = 0; i < nNodes; i ++) {
+        xyz[3 * i]     = mesh.node(i).x();
+        xyz[3 * i + 1] = mesh.node(i).y();
+        xyz[3 * i + 2] = mesh.node(i).z();
     }
-    file << std::endl << "</DataArray>" << std::endl;
-    file << "</Points>" << std::endl;
+    arrays.push_back(VTUArray_("Float64", "", 3));
+    arrays.back().set(xyz);
 
-    file << "<Cells>" << std::endl;
-    file << "<DataArray type=\"Int32\" Name=\"connectivity\" format=\"ascii\">" << std::endl;
+    std::vector < int32 > connectivity;
+    std::vector < int32 > offsets(nCells);
+    std::vector < uint8 > types(nCells, 0);
     for (uint i = 0; i < nCells; i ++) {
         MeshEntity * cell = cells[i];
         if (cell->rtti() == MESH_TETRAHEDRON10_RTTI){
+            static const Index tet10[10] = {0, 1, 2, 3, 4, 7, 5, 6, 9, 8};
+            for (uint j = 0; j < 10; j ++) connectivity.push_back(cell->node(tet10[j]).id());
+        } else for (uint j = 0; j < cell->nodeCount(); j ++) connectivity.push_back(cell->node(j).id());
+        offsets[i] = connectivity.size();
 
-            file << cell->node(0).id() << " " << cell->node(1).id() << " "
-                << cell->node(2).id() << " " << cell->node(3).id() << " "
-                << cell->node(4).id() << " " << cell->node(7).id() << " "
-                << cell->node(5).id() << " " << cell->node(6).id() << " "
-                << cell->node(9).id() << " " << cell->node(8).id() << " ";
-        } else for (uint j = 0; j < cell->nodeCount(); j ++) file << cell->node(j).id() << " ";
-    }
-    file << std::endl << "</DataArray>" << std::endl;
-    file << "<DataArray type=\"Int32\" Name=\"offsets\" format=\"ascii\">" << std::endl;
-    uint count = 0;
-
-    for (uint i = 0; i < nCells; i ++) {
-        count += cells[i]->nodeCount();
-        file << count << " ";
-    }
-    file << std::endl << "</DataArray>" << std::endl;
-    file << "<DataArray type=\"UInt8\" Name=\"types\" format=\"ascii\">" << std::endl;
-
-    for (uint i = 0; i < nCells; i ++) {
-        switch (cells[i]->rtti()){
-            case MESH_BOUNDARY_NODE_RTTI: file     << "1 "; break;
+        switch (cell->rtti()){
+            case MESH_BOUNDARY_NODE_RTTI: types[i] = 1; break;
             case MESH_EDGE_CELL_RTTI:
-            case MESH_EDGE_RTTI: file          << "3 "; break;
+            case MESH_EDGE_RTTI: types[i] = 3; break;
             case MESH_EDGE3_CELL_RTTI:
-            case MESH_EDGE3_RTTI: file         << "21 "; break;
+            case MESH_EDGE3_RTTI: types[i] = 21; break;
             case MESH_TRIANGLEFACE_RTTI:
-            case MESH_TRIANGLE_RTTI: file      << "5 "; break;
+            case MESH_TRIANGLE_RTTI: types[i] = 5; break;
             case MESH_TRIANGLEFACE6_RTTI:
-            case MESH_TRIANGLE6_RTTI: file     << "22 "; break;
+            case MESH_TRIANGLE6_RTTI: types[i] = 22; break;
             case MESH_QUADRANGLEFACE_RTTI:
-            case MESH_QUADRANGLE_RTTI: file    << "9 "; break;
+            case MESH_QUADRANGLE_RTTI: types[i] = 9; break;
             case MESH_QUADRANGLEFACE8_RTTI:
-            case MESH_QUADRANGLE8_RTTI: file   << "23 "; break;
-            case MESH_TETRAHEDRON_RTTI: file   << "10 "; break;
-            case MESH_TETRAHEDRON10_RTTI: file << "24 "; break;
-            case MESH_HEXAHEDRON_RTTI: file    << "12 "; break;
-            case MESH_HEXAHEDRON20_RTTI: file  << "25 "; break;
-            case MESH_POLYGON_FACE_RTTI: file  << "7 "; break; // VTK_POLYGON
-            default: std::cerr << WHERE_AM_I << " nothing know about." << cells[i]->rtti() << std::endl;
+            case MESH_QUADRANGLE8_RTTI: types[i] = 23; break;
+            case MESH_TETRAHEDRON_RTTI: types[i] = 10; break;
+            case MESH_TETRAHEDRON10_RTTI: types[i] = 24; break;
+            case MESH_HEXAHEDRON_RTTI: types[i] = 12; break;
+            case MESH_HEXAHEDRON20_RTTI: types[i] = 25; break;
+            case MESH_POLYGON_FACE_RTTI: types[i] = 7; break; // VTK_POLYGON
+            default: std::cerr << WHERE_AM_I << " nothing know about." << cell->rtti() << std::endl;
         }
     }
-    file << std::endl << "</DataArray>" << std::endl;
-    file << "</Cells>" << std::endl;
+    arrays.push_back(VTUArray_("Int32", "connectivity"));
+    arrays.back().set(connectivity);
+    arrays.push_back(VTUArray_("Int32", "offsets"));
+    arrays.back().set(offsets);
+    arrays.push_back(VTUArray_("UInt8", "types"));
+    arrays.back().set(types);
 
-    uint nodeData = 0, cellData = 0;
+    Index nodeData = 0, cellData = 0;
 
     for (std::map < std::string, RVector >::const_iterator it = data.begin();
          it != data.end(); it ++){
-
-
+        //NodeCount == Cellcount for cellsAreBoundaries(2d)
         if (it->second.size() == nNodes && !cellsAreBoundaries) {
-            //NodeCount == Cellcount for cellsAreBoundaries(2d)
+            arrays.push_back(VTUArray_("Float64", it->first));
+            arrays.back().reference(it->second);
             nodeData++;
-        } else if (it->second.size() == nCells) {
+        }
+    }
+    for (std::map < std::string, RVector >::const_iterator it = data.begin();
+         it != data.end(); it ++){
+        if (it->second.size() == nCells) {
+            arrays.push_back(VTUArray_("Float64", it->first));
+            arrays.back().reference(it->second);
             cellData++;
-        } else {
+        } else if (it->second.size() != nNodes || cellsAreBoundaries) {
             std::cerr << WHERE_AM_I << " dont know how to handle data array: " << it->first
                         << " with size " << it->second.size() << " nodesize = " << nNodes
                         << " cellsize = " << nCells << std::endl;
         }
     }
 
-    if (nodeData > 0){
-        file << "<PointData>" << std::endl;
-        for (std::map < std::string, RVector >::const_iterator it = data.begin();
-              it != data.end(); it ++){
-            if (it->second.size() == nNodes && !cellsAreBoundaries ) {
-                 file << "<DataArray type=\"Float32\" Name=\""
-                      << it->first << "\" format=\"ascii\">" << std::endl;
-                 for (uint i = 0; i < it->second.size(); i ++) file << it->second[i] << " ";
-                 file << std::endl << "</DataArray>" << std::endl;
+    //** ascii formatting or compression of all blocks in parallel
+    if (!binary || compress){
+        std::vector < std::pair < Index, Index > > jobs;
+        for (Index i = 0; i < arrays.size(); i ++){
+            arrays[i].blocks.resize(arrays[i].blockCount());
+            for (Index b = 0; b < arrays[i].blocks.size(); b ++){
+                jobs.push_back(std::make_pair(i, b));
+            }
+        }
+        if (jobs.size()){
+            distributeCalc(VTUEncodeMT(arrays, jobs, binary, file.precision()),
+                           jobs.size(), std::min(threadCount(), Index(jobs.size())));
+        }
+        for (Index j = 0; j < jobs.size(); j ++){
+            if (arrays[jobs[j].first].blocks[jobs[j].second].empty()){
+                throwError(1, WHERE_AM_I + " zlib compression of " +
+                           arrays[jobs[j].first].name + " failed.");
             }
         }
-        file << "</PointData>" << std::endl;
     }
 
-     if (cellData > 0){
-        file << "<CellData>" << std::endl;
-        for (std::map < std::string, RVector >::const_iterator it = data.begin();
-             it != data.end(); it ++){
+    //** xml description, binary arrays are written into the appended section
+    uint64 offset = 0;
+
+    file << "<UnstructuredGrid>" << std::endl;
+    file << "<Piece NumberOfPoints=\"" << nNodes << "\" NumberOfCells=\"" << nCells << "\">" << std::endl;
 
-            if (it->second.size() == nCells) {
-                 file << "<DataArray type=\"Float64\" Name=\"" << it->first;
-                 if (!binary){
-                    file << "\" format=\"ascii\">" << std::endl;
-                    for (uint i = 0; i < it->second.size(); i ++) file << it->second[i] << " ";
-                 } else {
-                    file << "\" format=\"binary\">";
-                    file.write((char*)&it->second[0], it->second.size() * sizeof(double));
-                 }
+    for (Index i = 0; i < arrays.size(); i ++){
+        const VTUArray_ & a = arrays[i];
 
+        if (i == 0) file << "<Points>" << std::endl;
+        if (i == 1) file << "<Cells>" << std::endl;
+        if (i == 4 && nodeData > 0) file << "<PointData>" << std::endl;
+        if (i == 4 + nodeData && cellData > 0) file << "<CellData>" << std::endl;
 
-                 file << std::endl << "</DataArray>" << std::endl;
+        file << "<DataArray type=\"" << a.type << "\"";
+        if (a.name.size()) file << " Name=\"" << a.name << "\"";
+        if (a.nComp > 1) file << " NumberOfComponents=\"" << a.nComp << "\"";
+        if (binary){
+            file << " format=\"appended\" offset=\"" << offset << "\"/>" << std::endl;
+            if (compress){
+                offset += sizeof(uint64) * (3 + a.blocks.size());
+                for (Index b = 0; b < a.blocks.size(); b ++) offset += a.blocks[b].size();
+            } else {
+                offset += sizeof(uint64) + a.nBytes;
             }
+        } else {
+            file << " format=\"ascii\">" << std::endl;
+            for (Index b = 0; b < a.blocks.size(); b ++) file << a.blocks[b];
+            file << std::endl << "</DataArray>" << std::endl;
         }
-        file << "</CellData>" << std::endl;
+
+        if (i == 0) file << "</Points>" << std::endl;
+        if (i == 3) file << "</Cells>" << std::endl;
+        if (i == 3 + nodeData && nodeData > 0) file << "</PointData>" << std::endl;
+        if (i == 3 + nodeData + cellData && cellData > 0) file << "</CellData>" << std::endl;
     }
 
     file << "</Piece>" << std::endl;
+    file << "</UnstructuredGrid>" << std::endl;
+
+    if (binary){
+        file << "<AppendedData encoding=\"raw\">" << std::endl << "_";
+        for (Index i = 0; i < arrays.size(); i ++){
+            const VTUArray_ & a = arrays[i];
+            if (compress){
+                uint64 head[3] = {a.blocks.size(), VTU_BLOCKSIZE, a.nBytes % VTU_BLOCKSIZE};
+                file.write((const char*)head, sizeof(uint64) * 3);
+                for (Index b = 0; b < a.blocks.size(); b ++){
+                    uint64 s = a.blocks[b].size();
+                    file.write((const char*)&s, sizeof(uint64));
+                }
+                for (Index b = 0; b < a.blocks.size(); b ++){
+                    file.write(a.blocks[b].data(), a.blocks[b].size());
+                }
+            } else {
+                uint64 s = a.nBytes;
+                file.write((const char*)&s, sizeof(uint64));
+                if (a.nBytes) file.write(a.src, a.nBytes);
+            }
+        }
+        file << std::endl << "</AppendedData>" << std::endl;
+    }
 }
 
 void Mesh::importMod(const std::string & filename){
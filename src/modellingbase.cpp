@@ -19,7 +19,10 @@
 #include "modellingbase.h"
 
 #include "datacontainer.h"
+#include "interpolate.h"
+#include "memwatch.h"
 #include "mesh.h"
+#include "profiler.h"
 #include "regionManager.h"
 #include "stopwatch.h"
 #include "vector.h"
@@ -59,6 +62,7 @@ ModellingBase::~ModellingBase() {
     if (mesh_) delete mesh_;
     if (jacobian_ && ownJacobian_) delete jacobian_;
     if (constraints_ && ownConstraints_) delete constraints_;
+    if (paraMeshInterpolation_) delete paraMeshInterpolation_;
 }
 
 void ModellingBase::init_() {
@@ -69,6 +73,7 @@ void ModellingBase::init_() {
     jacobian_           = 0;
     constraints_        = 0;
     dataContainer_      = 0;
+    paraMeshInterpolation_ = 0;
 
     nThreads_           = numberOfCPU();
     nThreadsJacobian_   = 1;
@@ -151,6 +156,18 @@ void ModellingBase::createRefinedForwardMesh(bool refine, bool pRefine){
     }
 }
 
+const InterpolationOperator & ModellingBase::paraMeshInterpolation() const {
+    if (!mesh_ || !regionManager_->pMesh()){
+        throwError(1, WHERE_AM_I + " need a forward and a parameter mesh.");
+    }
+    if (!paraMeshInterpolation_){
+        paraMeshInterpolation_ = new InterpolationOperator(verbose_);
+        paraMeshInterpolation_->setThreadCount(nThreads_);
+        paraMeshInterpolation_->build(regionManager_->mesh(), mesh_->positions());
+    }
+    return *paraMeshInterpolation_;
+}
+
 void ModellingBase::setMesh(const Mesh & mesh, bool ignoreRegionManager) {
     Stopwatch swatch(true);
     if (regionManagerInUse_ && !ignoreRegionManager){
@@ -175,6 +192,9 @@ void ModellingBase::setMesh_(const Mesh & mesh, bool update){
 
     if (!mesh_) mesh_ = new Mesh();
 
+    if (paraMeshInterpolation_) delete paraMeshInterpolation_;
+    paraMeshInterpolation_ = 0;
+
     if (update) deleteMeshDependency_();
     (*mesh_) = mesh;
     if (update) updateMeshDependency_();
@@ -183,6 +203,8 @@ void ModellingBase::setMesh_(const Mesh & mesh, bool update){
 void ModellingBase::deleteMesh(){
     if (mesh_) delete mesh_;
     mesh_ = 0;
+    if (paraMeshInterpolation_) delete paraMeshInterpolation_;
+    paraMeshInterpolation_ = 0;
 }
 
 void ModellingBase::initJacobian(){
@@ -260,6 +282,8 @@ void ModellingBase::createJacobian_mt(const RVector & model,
 
 void ModellingBase::createJacobian(const RVector & model,
                                    const RVector & resp){
+    GIMLI_PROFILE("ModellingBase::createJacobian");
+    MemoryScope memoryScope(MEMORY_JACOBIAN);
     if (verbose_) std::cout << "Create Jacobian matrix (brute force) ...";
 
     Stopwatch swatch(true);
@@ -340,6 +364,10 @@ void ModellingBase::setConstraints(MatrixBase * C){
 
 void ModellingBase::createConstraints(){
 //     __MS(constraints_->rtti())
+    if (constraints_ && constraints_->rtti() == GIMLI_DIFFERENCEOPERATOR_RTTI){
+        this->regionManager().fillConstraints(*dynamic_cast < DifferenceOperator * >(constraints_));
+        return;
+    }
     this->regionManager().fillConstraints(constraintsRef());
 }
 
@@ -89,6 +89,15 @@ public:
 
     void createRefinedForwardMesh(bool refine=true, bool pRefine=false);
 
+    /*! Return the interpolation operator from node values of the parameter
+     * mesh (region manager) to the nodes of the forward mesh, e.g., after
+     * \ref createRefinedForwardMesh. The operator is build on first call
+     * and reused until the forward mesh is replaced by \ref setMesh or
+     * \ref createRefinedForwardMesh. Cell models are still mapped by
+     * cell marker, the operator is meant for node based quantities, see
+     * \ref TimeLapseModelling::forwardMeshFrames. */
+    const InterpolationOperator & paraMeshInterpolation() const;
+
     /*! Delete the actual mesh. */
     void deleteMesh();
 
@@ -127,14 +136,22 @@ public:
         if (! jacobian_) {
             throwError(1, WHERE_AM_I + " Jacobian matrix is not initialized.");
         }
-        return *dynamic_cast< RMatrix * >(jacobian_);
+        RMatrix * J = dynamic_cast< RMatrix * >(jacobian_);
+        if (!J) {
+            throwError(1, WHERE_AM_I + " Jacobian matrix is no RMatrix, use jacobian().");
+        }
+        return *J;
     }
 
     virtual RMatrix & jacobianRef() {
         if (! jacobian_) {
             throwError(1, WHERE_AM_I + " Jacobian matrix is not initialized.");
         }
-        return *dynamic_cast< RMatrix * >(jacobian_);
+        RMatrix * J = dynamic_cast< RMatrix * >(jacobian_);
+        if (!J) {
+            throwError(1, WHERE_AM_I + " Jacobian matrix is no RMatrix, use jacobian().");
+        }
+        return *J;
     }
 
     /*! Clear Jacobian matrix. */
@@ -231,6 +248,8 @@ protected:
     MatrixBase              * constraints_;
     bool                    ownConstraints_;
 
+    mutable InterpolationOperator * paraMeshInterpolation_;
+
     RMatrix                 solutions_;
 
     RVector                 startModel_;
@@ -0,0 +1,532 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "pcgWrapper.h"
+#include "calculateMultiThread.h"
+#include "vectortemplates.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GIMLI{
+
+//! Row wise sparse matrix product C = A * B.
+/*! First call with count=true to get the row sizes of C in ptr[i + 1],
+ * then with count=false and the accumulated ptr to fill idx and vals. */
+class SparseProductMT : public BaseCalcMT{
+public:
+    SparseProductMT(const RSparseMatrix & A, const RSparseMatrix & B,
+                    const std::vector < Index > & part, bool count,
+                    std::vector < int > * ptr, std::vector < int > * idx,
+                    RVector * vals)
+    : BaseCalcMT(false), A_(&A), B_(&B), part_(&part), count_(count),
+      ptr_(ptr), idx_(idx), vals_(vals){
+    }
+
+    virtual ~SparseProductMT(){}
+
+    virtual void calc(Index tNr=0){
+        const std::vector < int > & aPtr = A_->vecColPtr();
+        const std::vector < int > & aIdx = A_->vecRowIdx();
+        const RVector & aVal = A_->vecVals();
+        const std::vector < int > & bPtr = B_->vecColPtr();
+        const std::vector < int > & bIdx = B_->vecRowIdx();
+        const RVector & bVal = B_->vecVals();
+
+        std::vector < int > mark(B_->cols(), -1);
+        std::vector < std::pair < int, double > > row;
+
+        for (Index t = start_; t < end_; t ++){
+            for (Index i = (*part_)[t]; i < (*part_)[t + 1]; i ++){
+                if (count_){
+                    int n = 0;
+                    for (int ka = aPtr[i]; ka < aPtr[i + 1]; ka ++){
+                        for (int kb = bPtr[aIdx[ka]]; kb < bPtr[aIdx[ka] + 1]; kb ++){
+                            if (mark[bIdx[kb]] != int(i)){
+                                mark[bIdx[kb]] = i;
+                                n ++;
+                            }
+                        }
+                    }
+                    (*ptr_)[i + 1] = n;
+                } else {
+                    int start = (*ptr_)[i];
+                    int n = start;
+                    for (int ka = aPtr[i]; ka < aPtr[i + 1]; ka ++){
+                        double a = aVal[ka];
+                        for (int kb = bPtr[aIdx[ka]]; kb < bPtr[aIdx[ka] + 1]; kb ++){
+                            int j = bIdx[kb];
+                            if (mark[j] < start){
+                                mark[j] = n;
+                                (*idx_)[n] = j;
+                                (*vals_)[n] = a * bVal[kb];
+                                n ++;
+                            } else {
+                                (*vals_)[mark[j]] += a * bVal[kb];
+                            }
+                        }
+                    }
+                    row.clear();
+                    for (int k = start; k < n; k ++) row.push_back(std::make_pair((*idx_)[k], (*vals_)[k]));
+                    std::sort(row.begin(), row.end());
+                    for (int k = start; k < n; k ++){
+                        (*idx_)[k] = row[k - start].first;
+                        (*vals_)[k] = row[k - start].second;
+                    }
+                }
+            }
+        }
+    }
+
+protected:
+    const RSparseMatrix * A_;
+    const RSparseMatrix * B_;
+    const std::vector < Index > * part_;
+    bool count_;
+    std::vector < int > * ptr_;
+    std::vector < int > * idx_;
+    RVector * vals_;
+};
+
+static RSparseMatrix sparseProduct_(const RSparseMatrix & A, const RSparseMatrix & B){
+    Index n = A.rows();
+    Index nThreads = std::max(Index(1), std::min(threadCount(), n / 1000 + 1));
+    std::vector < Index > part(nThreads + 1);
+    for (Index t = 0; t <= nThreads; t ++) part[t] = n * t / nThreads;
+
+    std::vector < int > ptr(n + 1, 0);
+    std::vector < int > idx;
+    RVector vals;
+    distributeCalc(SparseProductMT(A, B, part, true, &ptr, &idx, &vals),
+                   nThreads, nThreads);
+    for (Index i = 0; i < n; i ++) ptr[i + 1] += ptr[i];
+
+    idx.resize(ptr[n]);
+    vals.resize(ptr[n]);
+    distributeCalc(SparseProductMT(A, B, part, false, &ptr, &idx, &vals),
+                   nThreads, nThreads);
+    return RSparseMatrix(n, B.cols(), ptr, idx, vals);
+}
+
+static RSparseMatrix transposed_(const RSparseMatrix & A){
+    const std::vector < int > & aPtr = A.vecColPtr();
+    const std::vector < int > & aIdx = A.vecRowIdx();
+    const RVector & aVal = A.vecVals();
+
+    std::vector < int > ptr(A.cols() + 1, 0);
+    for (Index k = 0; k < aIdx.size(); k ++) ptr[aIdx[k] + 1] ++;
+    for (Index i = 0; i < A.cols(); i ++) ptr[i + 1] += ptr[i];
+
+    std::vector < int > idx(aIdx.size());
+    RVector vals(aIdx.size());
+    std::vector < int > pos(ptr.begin(), ptr.end() - 1);
+    for (Index i = 0; i < A.rows(); i ++){
+        for (int k = aPtr[i]; k < aPtr[i + 1]; k ++){
+            int p = pos[aIdx[k]] ++;
+            idx[p] = i;
+            vals[p] = aVal[k];
+        }
+    }
+    return RSparseMatrix(A.cols(), A.rows(), ptr, idx, vals);
+}
+
+static RVector diagonal_(const RSparseMatrix & A){
+    RVector d(A.rows(), 0.0);
+    for (Index i = 0; i < A.rows(); i ++){
+        for (int k = A.vecColPtr()[i]; k < A.vecColPtr()[i + 1]; k ++){
+            if (A.vecRowIdx()[k] == int(i)) d[i] += A.vecVals()[k];
+        }
+    }
+    return d;
+}
+
+/*! Estimate the largest eigenvalue of D^-1 A by power iteration. */
+static double spectralRadius_(const RSparseMatrix & A, const RVector & dInv){
+    RVector x(A.rows());
+    for (Index i = 0; i < x.size(); i ++) x[i] = 1.0 + double(i % 7) / 7.0;
+    double rho = 1.0;
+    for (Index i = 0; i < 15; i ++){
+        RVector y(dInv * A.mult(x));
+        double ny = norml2(y);
+        if (ny == 0.0) break;
+        rho = ny / norml2(x);
+        x = y / ny;
+    }
+    return rho;
+}
+
+PCGWrapper::PCGWrapper(RSparseMatrix & S, bool verbose, int stype,
+                       PCGPreconditioner preconditioner)
+    : SolverWrapper(S, verbose), preconditioner_(preconditioner){
+    dummy_ = false;
+    warmStart_ = true;
+    iterations_ = 0;
+    residual_ = 0.0;
+    tolerance_ = 1e-10;
+    maxiter_ = 1000;
+    smoothSteps_ = 1;
+
+    //** full matrix with sorted rows, only the triangle given by stype
+    //** is used (like CHOLMOD) and mirrored
+    if (stype == -2 || S.stype() != 0) stype = S.stype();
+
+    RSparseAssembler full(S.rows(), S.cols());
+    full.reserve(S.nVals() * (stype == 0 ? 1 : 2));
+    for (Index i = 0; i < S.rows(); i ++){
+        for (int k = S.vecColPtr()[i]; k < S.vecColPtr()[i + 1]; k ++){
+            Index j = S.vecRowIdx()[k];
+            double v = S.vecVals()[k];
+            if (stype == 0){
+                full.addVal(i, j, v);
+            } else if ((stype < 0 && j >= i) || (stype > 0 && j <= i)){
+                full.addVal(i, j, v);
+                if (j != i) full.addVal(j, i, v);
+            }
+        }
+    }
+    IndexArray rowPtr, colIdx;
+    RVector vals;
+    full.compress(rowPtr, colIdx, vals);
+    std::vector < int > ptr(rowPtr.size()), idx(colIdx.size());
+    for (Index i = 0; i < ptr.size(); i ++) ptr[i] = rowPtr[i];
+    for (Index i = 0; i < idx.size(); i ++) idx[i] = colIdx[i];
+    A_.push_back(RSparseMatrix(S.rows(), S.cols(), ptr, idx, vals));
+    dim_ = S.rows();
+    nVals_ = vals.size();
+
+    switch (preconditioner_){
+        case PCG_AMG: setupAMG_(); break;
+        case PCG_IC: setupIC_(); break;
+        case PCG_JACOBI:{
+            RVector d(diagonal_(A_[0]));
+            smoothDiag_.push_back(RVector(d.size(), 0.0));
+            for (Index i = 0; i < d.size(); i ++) if (d[i] != 0.0) smoothDiag_[0][i] = 1.0 / d[i];
+        } break;
+    }
+}
+
+PCGWrapper::~PCGWrapper(){
+}
+
+void PCGWrapper::setupAMG_(){
+    //** smoothed aggregation
+    double theta = 0.08;
+    const Index coarseSize = 400;
+    const Index maxLevels = 12;
+    const Index maxDenseSize = 5000;
+
+    while (true){
+        const RSparseMatrix & A = A_.back();
+        Index n = A.rows();
+        const std::vector < int > & ptr = A.vecColPtr();
+        const std::vector < int > & idx = A.vecRowIdx();
+        const RVector & val = A.vecVals();
+
+        RVector d(diagonal_(A));
+        RVector dInv(n, 0.0);
+        for (Index i = 0; i < n; i ++) if (d[i] != 0.0) dInv[i] = 1.0 / d[i];
+        double omega = 4.0 / (3.0 * spectralRadius_(A, dInv));
+        smoothDiag_.push_back(dInv * omega);
+
+        if (n <= coarseSize || A_.size() >= maxLevels) break;
+
+        //** strong connections
+        std::vector < bool > strong(idx.size(), false);
+        for (Index i = 0; i < n; i ++){
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+                Index j = idx[k];
+                strong[k] = (j != i && val[k] * val[k] > theta * theta * std::fabs(d[i] * d[j]));
+            }
+        }
+
+        //** greedy aggregation
+        std::vector < int > agg(n, -1);
+        int nAgg = 0;
+        for (Index i = 0; i < n; i ++){
+            if (agg[i] != -1) continue;
+            bool free = true, hasStrong = false;
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+                if (strong[k]){
+                    hasStrong = true;
+                    if (agg[idx[k]] != -1) { free = false; break; }
+                }
+            }
+            if (!free || !hasStrong) continue;
+            agg[i] = nAgg;
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++) if (strong[k]) agg[idx[k]] = nAgg;
+            nAgg ++;
+        }
+        std::vector < int > first(agg);
+        for (Index i = 0; i < n; i ++){
+            if (agg[i] != -1) continue;
+            double best = 0.0;
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+                if (strong[k] && first[idx[k]] != -1 && std::fabs(val[k]) > best){
+                    best = std::fabs(val[k]);
+                    agg[i] = first[idx[k]];
+                }
+            }
+        }
+        for (Index i = 0; i < n; i ++){
+            if (agg[i] != -1) continue;
+            agg[i] = nAgg;
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++) {
+                if (strong[k] && agg[idx[k]] == -1) agg[idx[k]] = nAgg;
+            }
+            nAgg ++;
+        }
+        if (Index(nAgg) > 0.9 * n) break;
+
+        //** tentative prolongator for the constant vector
+        std::vector < int > aggSize(nAgg, 0);
+        for (Index i = 0; i < n; i ++) aggSize[agg[i]] ++;
+        std::vector < int > tPtr(n + 1), tIdx(n);
+        RVector tVal(n);
+        for (Index i = 0; i < n; i ++){
+            tPtr[i] = i;
+            tIdx[i] = agg[i];
+            tVal[i] = 1.0 / std::sqrt(double(aggSize[agg[i]]));
+        }
+        tPtr[n] = n;
+        RSparseMatrix T(n, nAgg, tPtr, tIdx, tVal);
+
+        //** P = (I - omega D^-1 A) T
+        RSparseMatrix P(sparseProduct_(A, T));
+        RVector & pVal = P.vecVals();
+        const RVector & sd = smoothDiag_.back();
+        for (Index i = 0; i < n; i ++){
+            for (int k = P.vecColPtr()[i]; k < P.vecColPtr()[i + 1]; k ++){
+                pVal[k] *= -sd[i];
+                if (P.vecRowIdx()[k] == agg[i]) pVal[k] += tVal[i];
+            }
+        }
+
+        RSparseMatrix Ac(sparseProduct_(transposed_(P), sparseProduct_(A, P)));
+        P_.push_back(P);
+        A_.push_back(Ac);
+        theta *= 0.5;
+    }
+
+    //** dense Cholesky for the coarsest level, zero pivots (singular
+    //** matrices) are skipped
+    const RSparseMatrix & Ac = A_.back();
+    Index n = Ac.rows();
+    coarseL_.clear();
+    if (n <= maxDenseSize){
+        coarseL_.resize(n, n);
+        for (Index i = 0; i < n; i ++){
+            coarseL_[i].fill(0.0);
+            for (int k = Ac.vecColPtr()[i]; k < Ac.vecColPtr()[i + 1]; k ++){
+                coarseL_[i][Ac.vecRowIdx()[k]] = Ac.vecVals()[k];
+            }
+        }
+        for (Index j = 0; j < n; j ++){
+            double piv = coarseL_[j][j];
+            for (Index k = 0; k < j; k ++) piv -= coarseL_[j][k] * coarseL_[j][k];
+            if (piv <= 1e-12 * std::fabs(coarseL_[j][j])){
+                for (Index i = j; i < n; i ++) coarseL_[i][j] = 0.0;
+                continue;
+            }
+            coarseL_[j][j] = std::sqrt(piv);
+            for (Index i = j + 1; i < n; i ++){
+                double s = coarseL_[i][j];
+                for (Index k = 0; k < j; k ++) s -= coarseL_[i][k] * coarseL_[j][k];
+                coarseL_[i][j] = s / coarseL_[j][j];
+            }
+        }
+    }
+
+    if (verbose_){
+        std::cout << "AMG levels:";
+        for (Index i = 0; i < A_.size(); i ++) std::cout << " " << A_[i].rows();
+        std::cout << std::endl;
+    }
+}
+
+void PCGWrapper::setupIC_(){
+    const RSparseMatrix & A = A_[0];
+    Index n = A.rows();
+    const std::vector < int > & ptr = A.vecColPtr();
+    const std::vector < int > & idx = A.vecRowIdx();
+    const RVector & val = A.vecVals();
+
+    //** lower triangle with the diagonal as last entry of each row
+    icPtr_.assign(n + 1, 0);
+    icIdx_.clear();
+    std::vector < double > lower;
+    for (Index i = 0; i < n; i ++){
+        double d = 0.0;
+        for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+            if (idx[k] < int(i)){
+                icIdx_.push_back(idx[k]);
+                lower.push_back(val[k]);
+            } else if (idx[k] == int(i)) d = val[k];
+        }
+        icIdx_.push_back(i);
+        lower.push_back(d);
+        icPtr_[i + 1] = icIdx_.size();
+    }
+
+    //** IC(0), shift the diagonal on breakdown
+    std::vector < int > pos(n, -1);
+    double shift = 0.0;
+    for (Index iter = 0; iter < 20; iter ++){
+        icVal_ = lower;
+        bool ok = true;
+        for (Index i = 0; i < n && ok; i ++){
+            int diag = icPtr_[i + 1] - 1;
+            icVal_[diag] *= (1.0 + shift);
+            for (int k = icPtr_[i]; k < diag; k ++) pos[icIdx_[k]] = k;
+
+            double s = icVal_[diag];
+            for (int k = icPtr_[i]; k < diag; k ++){
+                int j = icIdx_[k];
+                double v = icVal_[k];
+                for (int m = icPtr_[j]; m < icPtr_[j + 1] - 1; m ++){
+                    if (pos[icIdx_[m]] >= 0) v -= icVal_[pos[icIdx_[m]]] * icVal_[m];
+                }
+                icVal_[k] = v / icVal_[icPtr_[j + 1] - 1];
+                s -= icVal_[k] * icVal_[k];
+            }
+            for (int k = icPtr_[i]; k < diag; k ++) pos[icIdx_[k]] = -1;
+
+            if (s <= 0.0) ok = false;
+            else icVal_[diag] = std::sqrt(s);
+        }
+        if (ok) break;
+        shift = (shift == 0.0) ? 1e-3 : shift * 2.0;
+        if (verbose_) std::cout << "IC breakdown, diagonal shift: " << shift << std::endl;
+    }
+}
+
+void PCGWrapper::coarseSolve_(const RVector & b, RVector & x) const {
+    Index n = b.size();
+    if (coarseL_.rows() == n && n > 0){
+        for (Index i = 0; i < n; i ++){
+            if (coarseL_[i][i] == 0.0) { x[i] = 0.0; continue; }
+            double s = b[i];
+            for (Index k = 0; k < i; k ++) s -= coarseL_[i][k] * x[k];
+            x[i] = s / coarseL_[i][i];
+        }
+        for (Index i = n; i > 0; i --){
+            if (coarseL_[i - 1][i - 1] == 0.0) { x[i - 1] = 0.0; continue; }
+            double s = x[i - 1];
+            for (Index k = i; k < n; k ++) s -= coarseL_[k][i - 1] * x[k];
+            x[i - 1] = s / coarseL_[i - 1][i - 1];
+        }
+    } else {
+        const RVector & sd = smoothDiag_.back();
+        x = sd * b;
+        for (Index i = 1; i < 20; i ++) x += sd * (b - A_.back().mult(x));
+    }
+}
+
+void PCGWrapper::vCycle_(Index level, const RVector & b, RVector & x) const {
+    if (level == A_.size() - 1){
+        coarseSolve_(b, x);
+        return;
+    }
+    const RSparseMatrix & A = A_[level];
+    const RVector & sd = smoothDiag_[level];
+
+    x = sd * b;
+    for (Index i = 1; i < smoothSteps_; i ++) x += sd * (b - A.mult(x));
+
+    RVector xc(P_[level].cols(), 0.0);
+    vCycle_(level + 1, P_[level].transMult(RVector(b - A.mult(x))), xc);
+    x += P_[level].mult(xc);
+
+    for (Index i = 0; i < smoothSteps_; i ++) x += sd * (b - A.mult(x));
+}
+
+void PCGWrapper::precondition(const RVector & r, RVector & z) const {
+    z.resize(r.size());
+    switch (preconditioner_){
+        case PCG_AMG: vCycle_(0, r, z); break;
+        case PCG_JACOBI: z = smoothDiag_[0] * r; break;
+        case PCG_IC:{
+            Index n = r.size();
+            z = r;
+            for (Index i = 0; i < n; i ++){
+                int diag = icPtr_[i + 1] - 1;
+                double s = z[i];
+                for (int k = icPtr_[i]; k < diag; k ++) s -= icVal_[k] * z[icIdx_[k]];
+                z[i] = s / icVal_[diag];
+            }
+            for (Index i = n; i > 0; i --){
+                int diag = icPtr_[i] - 1;
+                z[i - 1] /= icVal_[diag];
+                for (int k = icPtr_[i - 1]; k < diag; k ++) z[icIdx_[k]] -= icVal_[k] * z[i - 1];
+            }
+        } break;
+    }
+}
+
+int PCGWrapper::solve(const RVector & rhs, RVector & solution){
+    const RSparseMatrix & A = A_[0];
+    if (rhs.size() != dim_){
+        throwLengthError(1, WHERE_AM_I + " rhs size mismatch: " + str(dim_) + " != " + str(rhs.size()));
+    }
+    if (!warmStart_ || solution.size() != dim_){
+        solution.resize(dim_);
+        solution.fill(0.0);
+    }
+
+    iterations_ = 0;
+    residual_ = 0.0;
+    double normB = norml2(rhs);
+    if (normB == 0.0){
+        solution.fill(0.0);
+        return 1;
+    }
+
+    RVector r(rhs - A.mult(solution));
+    residual_ = norml2(r) / normB;
+
+    RVector z(dim_), q(dim_);
+    precondition(r, z);
+    RVector p(z);
+    double rz = dot(r, z);
+
+    while (residual_ > tolerance_ && iterations_ < maxiter_){
+        iterations_ ++;
+        q = A.mult(p);
+        double pq = dot(p, q);
+        if (pq == 0.0) break;
+        double alpha = rz / pq;
+        solution += p * alpha;
+        r -= q * alpha;
+        residual_ = norml2(r) / normB;
+        if (residual_ <= tolerance_) break;
+
+        precondition(r, z);
+        double rzNew = dot(r, z);
+        p = z + p * (rzNew / rz);
+        rz = rzNew;
+    }
+
+    if (verbose_) std::cout << "PCG: " << iterations_ << " iterations, |b-Ax|/|b| = " << residual_ << std::endl;
+    if (residual_ > tolerance_){
+        std::cerr << WHERE_AM_I << " no convergence after " << iterations_
+                  << " iterations: " << residual_ << std::endl;
+        return 0;
+    }
+    return 1;
+}
+
+} //namespace GIMLI;
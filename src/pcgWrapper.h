@@ -0,0 +1,108 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_PCGWRAPPER__H
+#define _GIMLI_PCGWRAPPER__H
+
+#include "gimli.h"
+#include "linSolver.h"
+#include "matrix.h"
+#include "solverWrapper.h"
+#include "sparsematrix.h"
+
+namespace GIMLI{
+
+//! Preconditioned conjugate gradient solver for symmetric positive definite matrices.
+/*! Iterative alternative to the direct solvers that needs no factorization
+ * of the whole matrix. Available preconditioners are smoothed aggregation
+ * algebraic multigrid (PCG_AMG, one V-cycle with damped Jacobi smoothing),
+ * incomplete Cholesky without fill-in (PCG_IC) and the diagonal (PCG_JACOBI).
+ * Matrix vector products and the multigrid setup are multithreaded.
+ * The content of solution is used as starting vector if it has the
+ * correct size (warm start), e.g., the solution of the previous source or
+ * wavenumber. */
+class DLLEXPORT PCGWrapper : public SolverWrapper {
+public:
+    /*! stype = -2 -> use S.stype(). If S stores only one triangle it will
+     * be expanded, else S is assumed to be symmetric. */
+    PCGWrapper(RSparseMatrix & S, bool verbose=false, int stype=-2,
+               PCGPreconditioner preconditioner=PCG_AMG);
+
+    virtual ~PCGWrapper();
+
+    static bool valid(){ return true; }
+
+    /*! Return 1 if the relative residual norm reached the tolerance. */
+    virtual int solve(const RVector & rhs, RVector & solution);
+
+    /*! Set the relative residual tolerance |b - Ax| / |b|. Default is 1e-10. */
+    void setTolerance(double tolerance){ tolerance_ = tolerance; }
+
+    /*! Set the maximum amount of iterations. Default is 1000. */
+    void setMaxIter(Index maxIter){ maxiter_ = maxIter; }
+
+    /*! Start from the given solution vector (default) or from zero. */
+    void setWarmStart(bool warmStart){ warmStart_ = warmStart; }
+
+    /*! Amount of iterations of the last solve. */
+    Index iterations() const { return iterations_; }
+
+    /*! Relative residual norm of the last solve. */
+    double residual() const { return residual_; }
+
+    /*! Amount of multigrid levels including the finest. */
+    Index levels() const { return A_.size(); }
+
+    /*! Apply the preconditioner z = M^-1 r. */
+    void precondition(const RVector & r, RVector & z) const;
+
+protected:
+    void setupAMG_();
+
+    void setupIC_();
+
+    void vCycle_(Index level, const RVector & b, RVector & x) const;
+
+    void coarseSolve_(const RVector & b, RVector & x) const;
+
+    PCGPreconditioner preconditioner_;
+    bool warmStart_;
+    Index iterations_;
+    double residual_;
+
+    /*! Full (non symmetric stored) matrix per multigrid level, A_[0] is
+     * the system matrix. */
+    std::vector < RSparseMatrix > A_;
+    /*! Prolongation from level i + 1 to level i */
+    std::vector < RSparseMatrix > P_;
+    /*! Damping over diagonal per level */
+    std::vector < RVector > smoothDiag_;
+    Index smoothSteps_;
+
+    /*! Dense Cholesky factor of the coarsest level */
+    RMatrix coarseL_;
+
+    /*! Incomplete Cholesky factor, row wise with the diagonal last. */
+    std::vector < int > icPtr_;
+    std::vector < int > icIdx_;
+    std::vector < double > icVal_;
+};
+
+} //namespace GIMLI;
+
+#endif // _GIMLI_PCGWRAPPER__H
@@ -0,0 +1,283 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace GIMLI{
+
+template < > DLLEXPORT Profiler * Singleton < Profiler >::pInstance_ = NULL;
+
+std::atomic < bool > Profiler::enabled_(false);
+
+static std::mutex __GIMLI_PROFILER_MUTEX__;
+
+static const Index __NO_PARENT__ = Index(-1);
+
+class ProfileEvent{
+public:
+    const char * name;
+    /*! Start time and duration in microseconds, duration < 0 for open zones */
+    double start;
+    double duration;
+    Index parent;
+};
+
+//! Zones of one thread, only written by the owning thread.
+/*! The owner locks mutex for each zone, readers lock it while they walk
+ * the zones. It is uncontended unless a trace or summary is taken. */
+class ProfileThread{
+public:
+    ProfileThread(Index id) : id(id), alive(true) {}
+
+    Index id;
+    std::atomic < bool > alive;
+    std::mutex mutex;
+    std::vector < ProfileEvent > events;
+    std::vector < Index > stack;
+};
+
+namespace {
+    //** release the buffer for reuse if the thread ends
+    struct ProfileSlot__{
+        ~ProfileSlot__(){ if (thread) thread->alive = false; }
+        ProfileThread * thread;
+    };
+    thread_local ProfileSlot__ __profileSlot__ = {NULL};
+}
+
+Profiler::Profiler(){
+    epoch_ = std::chrono::steady_clock::now();
+}
+
+Profiler::~Profiler(){
+    for (std::list < ProfileThread * >::iterator it = threads_.begin();
+         it != threads_.end(); it ++) delete *it;
+}
+
+void Profiler::setEnabled(bool enabled){
+    enabled_ = enabled;
+}
+
+double Profiler::now() const {
+    return std::chrono::duration< double, std::micro >(
+                        std::chrono::steady_clock::now() - epoch_).count();
+}
+
+ProfileThread * Profiler::thread_(){
+    ProfileThread * t = __profileSlot__.thread;
+    if (t) return t;
+
+    std::unique_lock < std::mutex > lock(__GIMLI_PROFILER_MUTEX__);
+    for (std::list < ProfileThread * >::iterator it = threads_.begin();
+         it != threads_.end(); it ++){
+        if (!(*it)->alive){
+            t = *it;
+            t->alive = true;
+            std::unique_lock < std::mutex > slotLock(t->mutex);
+            t->stack.clear();
+            break;
+        }
+    }
+    if (!t){
+        t = new ProfileThread(threads_.size());
+        threads_.push_back(t);
+    }
+    __profileSlot__.thread = t;
+    return t;
+}
+
+void Profiler::begin(const char * str){
+    ProfileThread * t = thread_();
+    ProfileEvent e;
+    e.name = str;
+    e.start = now();
+    e.duration = -1.0;
+    std::unique_lock < std::mutex > lock(t->mutex);
+    e.parent = t->stack.empty() ? __NO_PARENT__ : t->stack.back();
+    t->stack.push_back(t->events.size());
+    t->events.push_back(e);
+}
+
+void Profiler::end(){
+    ProfileThread * t = thread_();
+    double tNow = now();
+    std::unique_lock < std::mutex > lock(t->mutex);
+    //** the zone was removed by clear
+    if (t->stack.empty()) return;
+    ProfileEvent & e = t->events[t->stack.back()];
+    e.duration = tNow - e.start;
+    t->stack.pop_back();
+}
+
+void Profiler::clear(){
+    std::unique_lock < std::mutex > lock(__GIMLI_PROFILER_MUTEX__);
+    for (std::list < ProfileThread * >::iterator it = threads_.begin();
+         it != threads_.end(); it ++){
+        std::unique_lock < std::mutex > slotLock((*it)->mutex);
+        (*it)->events.clear();
+        (*it)->stack.clear();
+    }
+}
+
+Index Profiler::size() const {
+    std::unique_lock < std::mutex > lock(__GIMLI_PROFILER_MUTEX__);
+    Index n = 0;
+    for (std::list < ProfileThread * >::const_iterator it = threads_.begin();
+         it != threads_.end(); it ++){
+        std::unique_lock < std::mutex > slotLock((*it)->mutex);
+        n += (*it)->events.size();
+    }
+    return n;
+}
+
+static std::string jsonEscape_(const char * str){
+    std::string ret;
+    for (const char * c = str; *c; c ++){
+        switch (*c){
+            case '"':  ret += "\\\""; break;
+            case '\\': ret += "\\\\"; break;
+            case '\n': ret += "\\n"; break;
+            case '\t': ret += "\\t"; break;
+            default:
+                if ((unsigned char)(*c) >= 0x20) ret += *c;
+        }
+    }
+    return ret;
+}
+
+void Profiler::saveTrace(const std::string & fileName) const {
+    std::fstream file;
+    if (!openOutFile(fileName, & file)) return;
+
+    double tNow = now();
+    std::unique_lock < std::mutex > lock(__GIMLI_PROFILER_MUTEX__);
+
+    file << "{\"traceEvents\":[" << std::endl;
+    file.precision(3);
+    file.setf(std::ios::fixed, std::ios::floatfield);
+    bool first = true;
+    for (std::list < ProfileThread * >::const_iterator it = threads_.begin();
+         it != threads_.end(); it ++){
+        ProfileThread & t = **it;
+        std::unique_lock < std::mutex > slotLock(t.mutex);
+        if (!first) file << "," << std::endl;
+        first = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+             << t.id << ",\"args\":{\"name\":\"thread " << t.id << "\"}}";
+
+        for (Index i = 0; i < t.events.size(); i ++){
+            const ProfileEvent & e = t.events[i];
+            double dur = e.duration < 0.0 ? tNow - e.start : e.duration;
+            file << "," << std::endl
+                 << "{\"name\":\"" << jsonEscape_(e.name)
+                 << "\",\"cat\":\"gimli\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t.id
+                 << ",\"ts\":" << e.start << ",\"dur\":" << dur << "}";
+        }
+    }
+    file << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    file.close();
+}
+
+namespace {
+    struct ProfileTreeNode__{
+        std::string name;
+        Index calls;
+        double total;
+        double children;
+        std::map < std::string, Index > childs;
+    };
+
+    void printTree__(std::stringstream & out,
+                     const std::vector < ProfileTreeNode__ > & tree,
+                     Index node, Index depth){
+        const ProfileTreeNode__ & n = tree[node];
+        if (depth > 0){
+            std::string name(2 * depth, ' ');
+            name += n.name;
+            out << std::left << std::setw(48) << name << std::right
+                << std::setw(10) << n.calls
+                << std::setw(14) << n.total * 1e-6
+                << std::setw(14) << (n.total - n.children) * 1e-6 << std::endl;
+        }
+        //** sort children by total time
+        std::vector < std::pair < double, Index > > childs;
+        for (std::map < std::string, Index >::const_iterator it = n.childs.begin();
+             it != n.childs.end(); it ++){
+            childs.push_back(std::make_pair(-tree[it->second].total, it->second));
+        }
+        std::sort(childs.begin(), childs.end());
+        for (Index i = 0; i < childs.size(); i ++){
+            printTree__(out, tree, childs[i].second, depth + 1);
+        }
+    }
+}
+
+std::string Profiler::summary() const {
+    double tNow = now();
+    std::unique_lock < std::mutex > lock(__GIMLI_PROFILER_MUTEX__);
+
+    std::stringstream out;
+    out.precision(6);
+    out.setf(std::ios::fixed, std::ios::floatfield);
+    for (std::list < ProfileThread * >::const_iterator it = threads_.begin();
+         it != threads_.end(); it ++){
+        ProfileThread & t = **it;
+        std::unique_lock < std::mutex > slotLock(t.mutex);
+        if (t.events.empty()) continue;
+
+        //** merge the zones with equal path into one tree node
+        std::vector < ProfileTreeNode__ > tree(1);
+        tree[0].calls = 0; tree[0].total = 0.0; tree[0].children = 0.0;
+        std::vector < Index > node(t.events.size());
+
+        for (Index i = 0; i < t.events.size(); i ++){
+            const ProfileEvent & e = t.events[i];
+            double dur = e.duration < 0.0 ? tNow - e.start : e.duration;
+            Index p = e.parent == __NO_PARENT__ ? 0 : node[e.parent];
+
+            std::map < std::string, Index >::iterator c = tree[p].childs.find(e.name);
+            if (c == tree[p].childs.end()){
+                ProfileTreeNode__ n;
+                n.name = e.name; n.calls = 0; n.total = 0.0; n.children = 0.0;
+                tree.push_back(n);
+                c = tree[p].childs.insert(std::make_pair(std::string(e.name),
+                                                         tree.size() - 1)).first;
+            }
+            node[i] = c->second;
+            tree[node[i]].calls ++;
+            tree[node[i]].total += dur;
+            tree[p].children += dur;
+        }
+
+        out << "Thread " << t.id << std::endl
+            << std::left << std::setw(48) << "  zone" << std::right
+            << std::setw(10) << "calls" << std::setw(14) << "total/s"
+            << std::setw(14) << "self/s" << std::endl;
+        printTree__(out, tree, 0, 0);
+    }
+    return out.str();
+}
+
+} // namespace GIMLI
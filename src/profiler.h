@@ -0,0 +1,132 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_PROFILER__H
+#define _GIMLI_PROFILER__H
+
+#include "gimli.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+
+#ifndef USE_PROFILER
+    #define USE_PROFILER 1
+#endif
+
+#define GIMLI_PROFILE_CAT__(a, b) a##b
+#define GIMLI_PROFILE_CAT_(a, b) GIMLI_PROFILE_CAT__(a, b)
+
+/*! Profile the enclosing scope as zone with the name str (a string literal).
+ * Zones vanish if the library is build with USE_PROFILER 0. */
+#if USE_PROFILER
+    #define GIMLI_PROFILE(str) \
+        GIMLI::ProfileZone GIMLI_PROFILE_CAT_(__gimliProfileZone__, __LINE__)(str)
+#else
+    #define GIMLI_PROFILE(str)
+#endif
+
+#define GIMLI_PROFILE_FUNCTION GIMLI_PROFILE(__FUNCTION__)
+
+namespace GIMLI{
+
+class ProfileThread;
+
+//! Hierarchical profiler.
+/*! Records nested, named time zones, e.g., GIMLI_PROFILE("solve"), for
+ * each thread separately. Collection is off by default and switched on
+ * with \ref setEnabled, a disabled zone costs a single atomic load.
+ * The collected zones can be written as Chrome trace, readable by
+ * chrome://tracing or https://ui.perfetto.dev, and summarized as
+ * call tree with calls, total and self time per zone.
+ * This is a singleton class to ensure a single instance.
+ * To call it use e.g.: Profiler::instance().saveTrace("trace.json"); */
+class DLLEXPORT Profiler : public Singleton< Profiler > {
+public:
+    friend class Singleton< Profiler >;
+
+    /*! Switch collection on or off. */
+    void setEnabled(bool enabled);
+
+    /*! Return true if zones are collected. */
+    static inline bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /*! Open a zone with the name str for the current thread. str needs to
+     * stay valid until the zones are cleared, use string literals. */
+    void begin(const char * str);
+
+    /*! Close the last opened zone of the current thread. */
+    void end();
+
+    /*! Remove all collected zones. Do not call while other threads are
+     * inside a zone. */
+    void clear();
+
+    /*! Return the amount of collected zones. */
+    Index size() const;
+
+    /*! Return the time in microseconds since creation of the profiler. */
+    double now() const;
+
+    /*! Write the collected zones in Chrome trace event format (JSON). */
+    void saveTrace(const std::string & fileName) const;
+
+    /*! Return the call tree of each thread with calls, total and self
+     * time of each zone. */
+    std::string summary() const;
+
+protected:
+    ProfileThread * thread_();
+
+    static std::atomic < bool > enabled_;
+
+    /*! Buffers of all threads, a buffer is reused after its thread ended. */
+    std::list < ProfileThread * > threads_;
+    std::chrono::steady_clock::time_point epoch_;
+
+private:
+    /*! Private so that it can not be called */
+    Profiler();
+    /*! Private so that it can not be called */
+    virtual ~Profiler();
+    /*! Copy constructor is private, so don't use it */
+    Profiler(const Profiler &){};
+    /*! Assignment operator is private, so don't use it */
+    void operator = (const Profiler &){ };
+};
+
+//! Scoped zone of the \ref Profiler, use it by GIMLI_PROFILE(str).
+class DLLEXPORT ProfileZone{
+public:
+    ProfileZone(const char * str) : active_(Profiler::enabled()) {
+        if (active_) Profiler::instance().begin(str);
+    }
+
+    ~ProfileZone(){
+        if (active_) Profiler::instance().end();
+    }
+
+protected:
+    bool active_;
+};
+
+} // namespace GIMLI
+
+#endif // _GIMLI_PROFILER__H
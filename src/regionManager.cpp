@@ -18,6 +18,7 @@
 
 #include "regionManager.h"
 
+#include "calculateMultiThread.h"
 #include "mesh.h"
 #include "node.h"
 #include "shape.h"
@@ -26,9 +27,282 @@
 #include "trans.h"
 #include "vectortemplates.h"
 
+#include <algorithm>
+
 
 namespace GIMLI{
 
+//################ matrix-free constraints operator
+DifferenceOperator::DifferenceOperator(Index rows, Index cols)
+    : MatrixBase(), rows_(rows), cols_(cols), rowPtrValid_(false){
+    nThreads_ = threadCount();
+}
+
+void DifferenceOperator::clear(){
+    rows_ = 0;
+    cols_ = 0;
+    row_.clear();
+    a_.clear();
+    b_.clear();
+    wa_.clear();
+    wb_.clear();
+    rowPtr_.clear();
+    perm_.clear();
+    rowPtrValid_ = false;
+}
+
+Index DifferenceOperator::addTerms(Index n){
+    Index k = row_.size();
+    row_.resize(k + n, 0);
+    a_.resize(k + n, -1);
+    b_.resize(k + n, -1);
+    if (wa_.size()){
+        wa_.resize(k + n, 1.0);
+        wb_.resize(k + n, -1.0);
+    }
+    rowPtrValid_ = false;
+    return k;
+}
+
+void DifferenceOperator::setTerm(Index k, Index row, SIndex a, SIndex b,
+                                 double wa, double wb){
+    row_[k] = row;
+    a_[k] = a;
+    b_[k] = b;
+    if (wa_.empty() && (wa != 1.0 || (b >= 0 && wb != -1.0))){
+        wa_.resize(row_.size(), 1.0);
+        wb_.resize(row_.size(), -1.0);
+    }
+    if (wa_.size()){
+        wa_[k] = wa;
+        wb_[k] = wb;
+    }
+}
+
+void DifferenceOperator::ensureRowPtr_() const {
+    if (rowPtrValid_) return;
+    rowPtr_.assign(rows_ + 1, 0);
+    for (Index k = 0; k < row_.size(); k ++){
+        if (Index(row_[k]) >= rows_ || a_[k] >= int(cols_) || b_[k] >= int(cols_)){
+            throwLengthError(1, WHERE_AM_I + " term " + str(k) + " exceeds size: "
+                             + str(rows_) + "x" + str(cols_));
+        }
+        rowPtr_[row_[k] + 1] ++;
+    }
+    for (Index i = 0; i < rows_; i ++) rowPtr_[i + 1] += rowPtr_[i];
+    perm_.resize(row_.size());
+    std::vector < int > pos(rowPtr_.begin(), rowPtr_.end() - 1);
+    for (Index k = 0; k < row_.size(); k ++) perm_[pos[row_[k]] ++] = k;
+    rowPtrValid_ = true;
+}
+
+class DifferenceOperatorMultMT : public BaseCalcMT{
+public:
+    DifferenceOperatorMultMT(const std::vector < int > & rowPtr,
+                             const std::vector < int > & perm,
+                             const std::vector < int > & a,
+                             const std::vector < int > & b,
+                             const std::vector < double > & wa,
+                             const std::vector < double > & wb,
+                             const RVector & m, RVector & y)
+    : BaseCalcMT(false), rowPtr_(&rowPtr), perm_(&perm), a_(&a), b_(&b),
+      wa_(&wa), wb_(&wb), m_(&m), y_(&y){
+    }
+
+    virtual ~DifferenceOperatorMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        bool weights = wa_->size() > 0;
+        for (Index i = start_; i < end_; i ++){
+            double v = 0.0;
+            for (int q = (*rowPtr_)[i]; q < (*rowPtr_)[i + 1]; q ++){
+                int k = (*perm_)[q];
+                int a = (*a_)[k], b = (*b_)[k];
+                if (weights){
+                    if (a >= 0) v += (*wa_)[k] * (*m_)[a];
+                    if (b >= 0) v += (*wb_)[k] * (*m_)[b];
+                } else {
+                    if (a >= 0) v += (*m_)[a];
+                    if (b >= 0) v -= (*m_)[b];
+                }
+            }
+            (*y_)[i] = v;
+        }
+    }
+
+protected:
+    const std::vector < int > * rowPtr_;
+    const std::vector < int > * perm_;
+    const std::vector < int > * a_;
+    const std::vector < int > * b_;
+    const std::vector < double > * wa_;
+    const std::vector < double > * wb_;
+    const RVector * m_;
+    RVector * y_;
+};
+
+/*! Scatter of the terms into one result vector per thread. */
+class DifferenceOperatorTransMultMT : public BaseCalcMT{
+public:
+    DifferenceOperatorTransMultMT(const std::vector < int > & row,
+                                  const std::vector < int > & a,
+                                  const std::vector < int > & b,
+                                  const std::vector < double > & wa,
+                                  const std::vector < double > & wb,
+                                  const RVector & c, std::vector < RVector > & x)
+    : BaseCalcMT(false), row_(&row), a_(&a), b_(&b), wa_(&wa), wb_(&wb),
+      c_(&c), x_(&x){
+    }
+
+    virtual ~DifferenceOperatorTransMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        RVector & x = (*x_)[tNr];
+        bool weights = wa_->size() > 0;
+        for (Index k = start_; k < end_; k ++){
+            double c = (*c_)[(*row_)[k]];
+            int a = (*a_)[k], b = (*b_)[k];
+            if (weights){
+                if (a >= 0) x[a] += (*wa_)[k] * c;
+                if (b >= 0) x[b] += (*wb_)[k] * c;
+            } else {
+                if (a >= 0) x[a] += c;
+                if (b >= 0) x[b] -= c;
+            }
+        }
+    }
+
+protected:
+    const std::vector < int > * row_;
+    const std::vector < int > * a_;
+    const std::vector < int > * b_;
+    const std::vector < double > * wa_;
+    const std::vector < double > * wb_;
+    const RVector * c_;
+    std::vector < RVector > * x_;
+};
+
+RVector DifferenceOperator::mult(const RVector & m) const {
+    if (m.size() != cols_){
+        throwLengthError(1, WHERE_AM_I + " wrong size: " + str(m.size()) + " != " + str(cols_));
+    }
+    this->ensureRowPtr_();
+    RVector ret(rows_, 0.0);
+    if (rows_ == 0) return ret;
+    Index nThreads = std::max(Index(1), std::min(nThreads_, Index(row_.size() / 50000 + 1)));
+    distributeCalc(DifferenceOperatorMultMT(rowPtr_, perm_, a_, b_, wa_, wb_, m, ret),
+                   rows_, nThreads);
+    return ret;
+}
+
+RVector DifferenceOperator::transMult(const RVector & c) const {
+    if (c.size() != rows_){
+        throwLengthError(1, WHERE_AM_I + " wrong size: " + str(c.size()) + " != " + str(rows_));
+    }
+    Index nTerms = row_.size();
+    Index nThreads = std::max(Index(1), std::min(nThreads_, Index(nTerms / 50000 + 1)));
+    std::vector < RVector > x(nThreads, RVector(cols_, 0.0));
+    if (nTerms > 0){
+        distributeCalc(DifferenceOperatorTransMultMT(row_, a_, b_, wa_, wb_, c, x),
+                       nTerms, nThreads);
+    }
+    for (Index t = 1; t < nThreads; t ++) x[0] += x[t];
+    return x[0];
+}
+
+class DifferenceOperatorAssembleMT : public BaseCalcMT{
+public:
+    DifferenceOperatorAssembleMT(const std::vector < int > & row,
+                                 const std::vector < int > & a,
+                                 const std::vector < int > & b,
+                                 const std::vector < double > & wa,
+                                 const std::vector < double > & wb,
+                                 RSparseAssembler & A)
+    : BaseCalcMT(false), row_(&row), a_(&a), b_(&b), wa_(&wa), wb_(&wb),
+      A_(&A){
+    }
+
+    virtual ~DifferenceOperatorAssembleMT(){}
+
+    virtual void calc(Index tNr=0){
+        bool weights = wa_->size() > 0;
+        for (Index k = start_; k < end_; k ++){
+            Index row = (*row_)[k];
+            if ((*a_)[k] >= 0) A_->addVal(row, (*a_)[k], weights ? (*wa_)[k] : 1.0, tNr);
+            if ((*b_)[k] >= 0) A_->addVal(row, (*b_)[k], weights ? (*wb_)[k] : -1.0, tNr);
+        }
+    }
+
+protected:
+    const std::vector < int > * row_;
+    const std::vector < int > * a_;
+    const std::vector < int > * b_;
+    const std::vector < double > * wa_;
+    const std::vector < double > * wb_;
+    RSparseAssembler * A_;
+};
+
+void DifferenceOperator::fillSparseMatrix(RSparseMapMatrix & C) const {
+    Index nTerms = row_.size();
+    Index nThreads = std::max(Index(1), std::min(nThreads_, Index(nTerms / 50000 + 1)));
+    RSparseAssembler A(rows_, cols_, nThreads);
+    A.reserve(2 * nTerms);
+    if (nTerms > 0){
+        distributeCalc(DifferenceOperatorAssembleMT(row_, a_, b_, wa_, wb_, A),
+                       nTerms, nThreads);
+    }
+    C.assemble(A);
+}
+
+/*! First or second order terms for the boundaries of one region. */
+class RegionConstraintsMT : public BaseCalcMT{
+public:
+    RegionConstraintsMT(const std::vector < Boundary * > & bounds,
+                        DifferenceOperator & C, Index termStart, Index rowStart,
+                        SIndex paraStart, SIndex paraEnd, bool secondOrder,
+                        const std::vector < char > * repeated=0)
+    : BaseCalcMT(false), bounds_(&bounds), C_(&C), termStart_(termStart),
+      rowStart_(rowStart), paraStart_(paraStart), paraEnd_(paraEnd),
+      secondOrder_(secondOrder), repeated_(repeated){
+    }
+
+    virtual ~RegionConstraintsMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index i = start_; i < end_; i ++){
+            Boundary * b = (*bounds_)[i];
+            SIndex l = -1, r = -1;
+            if (b->leftCell()) l = b->leftCell()->marker();
+            if (b->rightCell()) r = b->rightCell()->marker();
+            bool valid = (l >= paraStart_ && l < paraEnd_ &&
+                          r >= paraStart_ && r < paraEnd_ && l != r);
+            if (secondOrder_){
+                if (valid && repeated_ && (*repeated_)[i]){
+                    //** C[l][r] = -1 is set once per pair, C[l][l] += 1 per boundary
+                    C_->setTerm(termStart_ + 2 * i, l, l, -1);
+                    C_->setTerm(termStart_ + 2 * i + 1, r, r, -1);
+                } else if (valid){
+                    C_->setTerm(termStart_ + 2 * i, l, l, r);
+                    C_->setTerm(termStart_ + 2 * i + 1, r, r, l);
+                }
+            } else {
+                if (valid) C_->setTerm(termStart_ + i, rowStart_ + i, l, r);
+                else C_->setTerm(termStart_ + i, rowStart_ + i, -1, -1);
+            }
+        }
+    }
+
+protected:
+    const std::vector < Boundary * > * bounds_;
+    DifferenceOperator * C_;
+    Index termStart_;
+    Index rowStart_;
+    SIndex paraStart_;
+    SIndex paraEnd_;
+    bool secondOrder_;
+    const std::vector < char > * repeated_;
+};
+
 Region::Region(SIndex marker, RegionManager * parent, bool single)
     : marker_(marker), parent_(parent),
     isBackground_(false), isSingle_(single), parameterCount_(0)
@@ -334,6 +608,64 @@ void Region::fillConstraints(RSparseMapMatrix & C, Index startConstraintsID){
     }
 }
 
+void Region::fillConstraints(DifferenceOperator & C, Index startConstraintsID){
+    if (isBackground_) return;
+
+    if (isSingle_ && constraintType_ == 1) return;
+
+    double cMixRatio = 1.0; // for mixing 1st or 2nd order with 0th order (constraintTypes 10 and 20)
+
+    if (constraintType_ == 0 || constraintType_ == 20){ //purely 0th or mixed 2nd+0th
+        Index k = C.addTerms(parameterCount_);
+        for (Index i = 0; i < parameterCount_; i++) {
+            C.setTerm(k + i, startConstraintsID + i, startParameter_ + i, -1, cMixRatio);
+        }
+        if (constraintType_ == 0) return;
+    }
+
+    bool secondOrder = (constraintType_ == 2 || constraintType_ == 20);
+    Index nBounds = bounds_.size();
+    Index k = C.addTerms(secondOrder ? 2 * nBounds : nBounds);
+
+    //** second order: mark boundaries that repeat the parameter pair of an
+    //** earlier one, to keep the assignment C[l][r] = -1 of the sparse matrix
+    std::vector < char > repeated;
+    if (secondOrder && nBounds > 0){
+        std::vector < std::pair < uint64, Index > > pairs;
+        pairs.reserve(nBounds);
+        for (Index i = 0; i < nBounds; i ++){
+            Boundary * b = bounds_[i];
+            if (!b->leftCell() || !b->rightCell()) continue;
+            uint64 l = uint32(b->leftCell()->marker());
+            uint64 r = uint32(b->rightCell()->marker());
+            pairs.push_back(std::make_pair(std::min(l, r) << 32 | std::max(l, r), i));
+        }
+        std::sort(pairs.begin(), pairs.end());
+        repeated.resize(nBounds, 0);
+        for (Index i = 1; i < pairs.size(); i ++){
+            if (pairs[i].first == pairs[i - 1].first) repeated[pairs[i].second] = 1;
+        }
+    }
+
+    if (nBounds > 0){
+        Index nThreads = std::max(Index(1), std::min(threadCount(), nBounds / 10000 + 1));
+        distributeCalc(RegionConstraintsMT(bounds_, C, k, startConstraintsID,
+                                           startParameter_, endParameter_,
+                                           secondOrder,
+                                           secondOrder ? &repeated : 0),
+                       nBounds, nThreads);
+    }
+    if (secondOrder) return;
+
+    if (constraintType_ == 10) { //** combination with 0th order
+        Index cID = startConstraintsID + nBounds;
+        k = C.addTerms(parameterCount_);
+        for (Index i = 0; i < parameterCount_; i++) {
+            C.setTerm(k + i, cID + i, startParameter_ + i, -1, cMixRatio);
+        }
+    }
+}
+
 void Region::setConstraintType(Index type) {
     constraintType_ = type;
 }
@@ -750,9 +1082,13 @@ RVector RegionManager::createConstraintsWeight(){
 
 void RegionManager::fillConstraintsWeight(RVector & vec){
 
-    //!** no regions: fill 0th-order constraints
+    //!** no regions: given weights or 0th-order constraints
     if (regionMap_.empty()){
-        vec.resize(this->parameterCount(), 1.0);
+        if (constraintsWeight_.size()){
+            vec = constraintsWeight_;
+        } else {
+            vec.resize(this->parameterCount(), 1.0);
+        }
         return;
     }
 
@@ -886,6 +1222,7 @@ Index RegionManager::parameterCount() const {
 
 Index RegionManager::constraintCount() const {
     if (regionMap_.empty()) {
+        if (constraintsWeight_.size()) return constraintsWeight_.size();
         return parameterCount_;
     }
 
@@ -921,6 +1258,12 @@ Index RegionManager::interRegionConstraintsCount() const {
 }
 
 void RegionManager::fillConstraints(RSparseMapMatrix & C){
+    DifferenceOperator D;
+    this->fillConstraints(D);
+    D.fillSparseMatrix(C);
+}
+
+void RegionManager::fillConstraints(DifferenceOperator & C){
 //     __MS(&C)
 //     __MS(C.rtti())
 
@@ -931,15 +1274,14 @@ void RegionManager::fillConstraints(RSparseMapMatrix & C){
 
     //!** no regions: fill 0th-order constraints
     if (regionMap_.empty() || nConstr == 0){
-        C.setCols(nModel);
-        C.setRows(nModel);
+        C.resize(nModel, nModel);
 
-        for (size_t i = 0; i < parameterCount(); i++) C[i][i] = 1;
+        Index k = C.addTerms(nModel);
+        for (Index i = 0; i < nModel; i++) C.setTerm(k + i, i, i, -1);
         return;
     }
 
-    C.setRows(nConstr);
-    C.setCols(nModel);
+    C.resize(nConstr, nModel);
 
     Index consCount = 0;
 
@@ -989,8 +1331,9 @@ void RegionManager::fillConstraints(RSparseMapMatrix & C){
                     }
 //                    std::cout << lMarker << " " << rMarker << " " << lMarker - lStart << " " << rMarker - rStart << std::endl;
 
-                    C[consCount][lMarker] = +1.0 / (*lMC)[size_t(lMarker - lStart)];
-                    C[consCount][rMarker] = -1.0 / (*rMC)[size_t(rMarker - rStart)];
+                    C.addTerm(consCount, lMarker, rMarker,
+                              +1.0 / (*lMC)[size_t(lMarker - lStart)],
+                              -1.0 / (*rMC)[size_t(rMarker - rStart)]);
                     consCount ++;
 
                     if (regionMap_.find(it->first.first )->second->isSingle() &&
@@ -21,6 +21,7 @@
 #define _GIMLI_REGIONMANAGER__H
 
 #include "gimli.h"
+#include "matrix.h"
 #include "vector.h"
 #include "trans.h"
 
@@ -35,6 +36,80 @@ public:
     virtual const double operator()(const RVector3 & pos) const = 0;
 };
 
+//! Matrix-free constraints operator of zeroth, first or second order.
+/*! Every row i of the operator is a sum of terms wa * m[a] + wb * m[b],
+ * a zeroth order term has b < 0. Each term holds the two parameter ids
+ * from the boundary to cell adjacency, weights are stored only if any term
+ * differs from the default (+1, -1). Thus C * m and C^T * c are calculated
+ * without the sparse matrix, both are multithreaded.
+ * Can be used as constraints matrix, see \ref ModellingBase::setConstraints
+ * and \ref RegionManager::fillConstraints. */
+class DLLEXPORT DifferenceOperator : public MatrixBase{
+public:
+    DifferenceOperator(Index rows=0, Index cols=0);
+
+    virtual ~DifferenceOperator(){}
+
+    virtual uint rtti() const { return GIMLI_DIFFERENCEOPERATOR_RTTI; }
+
+    virtual Index rows() const { return rows_; }
+
+    virtual Index cols() const { return cols_; }
+
+    virtual void resize(Index rows, Index cols){
+        rows_ = rows; cols_ = cols; rowPtrValid_ = false;
+    }
+
+    /*! Remove all terms and set the size to 0. */
+    virtual void clear();
+
+    /*! Append n empty terms and return the index of the first. */
+    Index addTerms(Index n);
+
+    /*! Set term k of row. Can be called in parallel for different k as
+     * long as the weights are default or weights have been set before. */
+    void setTerm(Index k, Index row, SIndex a, SIndex b,
+                 double wa=1.0, double wb=-1.0);
+
+    /*! Append a term to row. */
+    void addTerm(Index row, SIndex a, SIndex b, double wa=1.0, double wb=-1.0){
+        setTerm(addTerms(1), row, a, b, wa, wb);
+    }
+
+    /*! Return the amount of terms. */
+    Index nTerms() const { return row_.size(); }
+
+    /*! Return C * m. */
+    virtual RVector mult(const RVector & m) const;
+
+    /*! Return C^T * c. */
+    virtual RVector transMult(const RVector & c) const;
+
+    /*! Fill the terms into a sparse matrix. */
+    void fillSparseMatrix(RSparseMapMatrix & C) const;
+
+    /*! Set the amount of threads. Default is \ref threadCount(). */
+    void setThreadCount(Index nThreads) { nThreads_ = std::max(Index(1), nThreads); }
+
+protected:
+    /*! Terms sorted by row for mult */
+    void ensureRowPtr_() const;
+
+    Index rows_;
+    Index cols_;
+    Index nThreads_;
+
+    std::vector < int > row_;
+    std::vector < int > a_;
+    std::vector < int > b_;
+    std::vector < double > wa_;
+    std::vector < double > wb_;
+
+    mutable std::vector < int > rowPtr_;
+    mutable std::vector < int > perm_;
+    mutable bool rowPtrValid_;
+};
+
 class DLLEXPORT Region{
 public:
     Region(SIndex marker, RegionManager * parent, bool single=false);
@@ -108,6 +183,10 @@ public:
                   (startConstraintsID + i, Boundary_i_rightNeightbourParameterID) = -1, i = 1..nBoundaries.*/
     void fillConstraints(RSparseMapMatrix & C, Index startConstraintsID);
 
+    /*! Fill the local constraints like \ref fillConstraints as terms
+     * of the matrix-free operator C. The boundaries are processed in parallel. */
+    void fillConstraints(DifferenceOperator & C, Index startConstraintsID);
+
     /*! Set region wide constant constraints weight, (default = 1). If this method is called background is forced to false. */
     void setConstraintsWeight(double bc);
 
@@ -301,6 +380,11 @@ public:
     /*! Set the amount of parameter, will be override if regions are defined */
     inline void setParameterCount(Index count) { parameterCount_ = count; }
 
+    /*! Set the global constraints weights, will be override if regions are
+     * defined. Useful if the constraints are combined from other
+     * forward operators, see \ref TimeLapseModelling. */
+    inline void setConstraintsWeight(const RVector & cw) { constraintsWeight_ = cw; }
+
     /*! Return global amount of parameter */
     Index parameterCount() const;
 
@@ -339,6 +423,11 @@ public:
         no regions: fill with 0th-order constraints */
     void fillConstraints(RSparseMapMatrix & C);
 
+    /*! Fill global constraints as matrix-free operator. The sparse matrix
+     * version is created from this and stored directly in compressed row
+     * storage. */
+    void fillConstraints(DifferenceOperator & C);
+
     /*! Syntactic sugar: set zweight/constraintType to all regions. */
     void setZWeight(double z);
 
@@ -393,6 +482,7 @@ protected:
     bool verbose_;
 
     Index parameterCount_;
+    RVector constraintsWeight_;
 
     Mesh * mesh_;
     Mesh * paraDomain_;
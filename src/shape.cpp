@@ -25,6 +25,8 @@
 
 #include "inversion.h"
 
+#include <mutex>
+
 #if USE_BOOST_THREAD
         boost::mutex ShapeFunctionWriteCacheMutex__;
 #else
@@ -36,6 +38,49 @@ namespace GIMLI{
 
 template < > DLLEXPORT ShapeFunctionCache * Singleton < ShapeFunctionCache >::pInstance_ = NULL;
 
+//** serializes the writers only, the readers see published tables
+static std::mutex __GIMLI_SHAPE_TABLE_MUTEX__;
+
+const ShapeFunctionTable * ShapeFunctionCache::findTable_(uint8 rtti,
+                                                          const R3Vector & x) const {
+    for (const TableNode_ * n = tables_[rtti].load(std::memory_order_acquire);
+         n; n = n->next){
+        const R3Vector & tx = n->table.x;
+        if (tx.size() != x.size()) continue;
+        Index k = 0;
+        while (k < x.size() && tx[k][0] == x[k][0] && tx[k][1] == x[k][1] &&
+               tx[k][2] == x[k][2]) k ++;
+        if (k == x.size()) return &n->table;
+    }
+    return NULL;
+}
+
+const ShapeFunctionTable & ShapeFunctionCache::insertTable_(uint8 rtti,
+                                        const ShapeFunctionTable & table) const {
+    std::unique_lock < std::mutex > lock(__GIMLI_SHAPE_TABLE_MUTEX__);
+    //** another thread may have been faster
+    const ShapeFunctionTable * t = findTable_(rtti, table.x);
+    if (t) return *t;
+
+    TableNode_ * n = new TableNode_();
+    n->table = table;
+    n->next = tables_[rtti].load(std::memory_order_relaxed);
+    tables_[rtti].store(n, std::memory_order_release);
+    return n->table;
+}
+
+void ShapeFunctionCache::clearTables_(){
+    std::unique_lock < std::mutex > lock(__GIMLI_SHAPE_TABLE_MUTEX__);
+    for (Index i = 0; i < 256; i ++){
+        TableNode_ * n = tables_[i].exchange(NULL);
+        while (n){
+            TableNode_ * next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+}
+
 std::vector < PolynomialFunction < double > >
 createPolynomialShapeFunctions(const std::vector < RVector3 > & pnts,
                                uint dim, uint nCoeff, bool pascale,
@@ -492,13 +537,39 @@ void TriangleShape::xyz2rst(const RVector3 & pos, RVector3 & rst ) const {
     rst[1] = (x21 * yp1 - y21 * xp1) / J; // s
 }
 
+/*! Intersection of the ray start + t * dir, t >= 0, with the triangle
+ * p0, p1, p2 in 3D (Moeller-Trumbore). On boundary means inside too. */
+static bool intersectRayTriangle__(const RVector3 & p0, const RVector3 & p1,
+                                   const RVector3 & p2, const RVector3 & start,
+                                   const RVector3 & dir, RVector3 & pos){
+    RVector3 e1(p1 - p0);
+    RVector3 e2(p2 - p0);
+    RVector3 p(dir.cross(e2));
+    double det = e1.dot(p);
+
+    //** ray parallel to the triangle plane
+    if (std::fabs(det) < TOLERANCE * e1.abs() * e2.abs() * dir.abs()) return false;
+
+    double tol = 1e-10;
+    RVector3 s(start - p0);
+    double u = s.dot(p) / det;
+    if (u < -tol || u > 1.0 + tol) return false;
+
+    RVector3 q(s.cross(e1));
+    double v = dir.dot(q) / det;
+    if (v < -tol || u + v > 1.0 + tol) return false;
+
+    double t = e2.dot(q) / det;
+    if (t < 0.0) return false;
+
+    pos = start + dir * t;
+    return true;
+}
+
 bool TriangleShape::intersectRay(const RVector3 & start, const RVector3 & dir,
                                  RVector3 & pos){
-
-    Plane plane(node(0).pos(), node(1).pos(), node(2).pos());
-    pos = plane.intersect(Line(start, start + dir*1e6));
-    if (this->isInside(pos)) return true;
-    return false;
+    return intersectRayTriangle__(node(0).pos(), node(1).pos(), node(2).pos(),
+                                  start, dir, pos);
 }
 
 
@@ -537,10 +608,11 @@ RVector3 QuadrangleShape::norm() const {
 
 bool QuadrangleShape::intersectRay(const RVector3 & start, const RVector3 & dir,
                                     RVector3 & pos){
-    Plane plane(node(0).pos(), node(1).pos(), node(2).pos());
-    pos = plane.intersect(Line(start, start + dir*1e6));
-    if (this->isInside(pos)) return true;
-    return false;
+    //** planar quadrangle as two triangles
+    if (intersectRayTriangle__(node(0).pos(), node(1).pos(), node(2).pos(),
+                               start, dir, pos)) return true;
+    return intersectRayTriangle__(node(0).pos(), node(2).pos(), node(3).pos(),
+                                  start, dir, pos);
 }
 
 
@@ -23,6 +23,8 @@
 #include "polynomial.h"
 #include "curvefitting.h"
 
+#include <atomic>
+
 #ifndef PYGIMLI_CAST // fails because of boost threads and clang problems
     #if USE_BOOST_THREAD
         #include <boost/thread.hpp>
@@ -65,6 +67,18 @@ template < class Ent > std::vector < PolynomialFunction < double > >
     return createPolynomialShapeFunctions(ent, nCoeff, pascale, serendipity, start);
 }
 
+//! Shape functions and their derivatives tabulated at a set of points.
+/*! Row i holds the values of the i-th shape function at all points x,
+ * i.e., N[i][k] = N_i(x_k) and dNdr[i][k] = dN_i/dr(x_k). */
+class DLLEXPORT ShapeFunctionTable{
+public:
+    R3Vector x;
+    RMatrix N;
+    RMatrix dNdr;
+    RMatrix dNds;
+    RMatrix dNdt;
+};
+
 class DLLEXPORT ShapeFunctionCache : public Singleton< ShapeFunctionCache > {
 public:
     friend class Singleton< ShapeFunctionCache >;
@@ -92,10 +106,43 @@ public:
         return (*it).second[dim];
     }
 
-    /*! Clear the cache. */
+    /*! Return the shape functions of e and their derivatives tabulated at
+     * the points x, e.g., the abscissa of \ref IntegrationRules. The table
+     * is created once for each entity type and set of points, so assembly
+     * loops need no polynomial evaluation. */
+    template < class Ent > const ShapeFunctionTable &
+    shapeFunctionTable(const Ent & e, const R3Vector & x) const {
+        const ShapeFunctionTable * t = findTable_(e.rtti(), x);
+        if (t) return *t;
+
+        const std::vector < PolynomialFunction < double > > & N = shapeFunctions(e);
+        const std::vector < PolynomialFunction < double > > & dNr = deriveShapeFunctions(e, 0);
+        const std::vector < PolynomialFunction < double > > & dNs = deriveShapeFunctions(e, 1);
+        const std::vector < PolynomialFunction < double > > & dNt = deriveShapeFunctions(e, 2);
+
+        ShapeFunctionTable table;
+        table.x = x;
+        table.N.resize(N.size(), x.size());
+        table.dNdr.resize(N.size(), x.size());
+        table.dNds.resize(N.size(), x.size());
+        table.dNdt.resize(N.size(), x.size());
+        for (Index i = 0; i < N.size(); i ++){
+            for (Index k = 0; k < x.size(); k ++){
+                table.N[i][k] = N[i](x[k]);
+                table.dNdr[i][k] = dNr[i](x[k]);
+                table.dNds[i][k] = dNs[i](x[k]);
+                table.dNdt[i][k] = dNt[i](x[k]);
+            }
+        }
+        return insertTable_(e.rtti(), table);
+    }
+
+    /*! Clear the cache. References to shape function tables are invalid
+     * afterwards. */
     void clear() {
         shapeFunctions_.clear();
         dShapeFunctions_.clear();
+        clearTables_();
     }
 
     inline std::vector< RMatrix3 > & RMatrix3Cache() { return rmatrix3Cache_; }
@@ -106,6 +153,13 @@ public:
 
 private:
 
+    const ShapeFunctionTable * findTable_(uint8 rtti, const R3Vector & x) const;
+
+    const ShapeFunctionTable & insertTable_(uint8 rtti,
+                                            const ShapeFunctionTable & table) const;
+
+    void clearTables_();
+
     /*! probably threading problems .. pls check*/
     template < class Ent > void createShapeFunctions_(const Ent & e) const {
         #if USE_BOOST_THREAD
@@ -139,9 +193,11 @@ private:
     }
 
     /*! Private so that it can not be called */
-    ShapeFunctionCache(){}
+    ShapeFunctionCache(){
+        for (Index i = 0; i < 256; i ++) tables_[i] = NULL;
+    }
     /*! Private so that it can not be called */
-    virtual ~ShapeFunctionCache(){}
+    virtual ~ShapeFunctionCache(){ clearTables_(); }
     /*! Copy constructor is private, so don't use it */
     ShapeFunctionCache(const ShapeFunctionCache &){};
     /*! Assignment operator is private, so don't use it */
@@ -157,6 +213,16 @@ protected:
     /*! Cache for shape functions derivatives. */
     mutable std::map < uint8, std::vector< std::vector < PolynomialFunction < double > > > > dShapeFunctions_;
 
+    /*! Tabulated shape function for one entity type. */
+    struct TableNode_{
+        ShapeFunctionTable table;
+        TableNode_ * next;
+    };
+
+    /*! Tabulated shape functions for each entity type. A new table is
+     * prepended and published once, so the lookup needs no lock. */
+    mutable std::atomic< TableNode_ * > tables_[256];
+
     mutable std::vector< RMatrix3 > rmatrix3Cache_;
     mutable std::map< uint, std::vector< RMatrix > > rmatrixCache_;
 
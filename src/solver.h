@@ -22,6 +22,7 @@
 
 #include "gimli.h"
 #include "matrix.h"
+#include "profiler.h"
 #include "vectortemplates.h"
 
 namespace GIMLI{
@@ -34,6 +35,7 @@ int solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
                         double lambda, const Vec & roughness,
                         int maxIter=200, double tol=-1.0,
                         bool verbose=false){ //ALLOW_PYTHON_THREADS
+    GIMLI_PROFILE("CGLS");
 
     uint nData = b.size();
     uint nModel = x.size();
@@ -113,6 +115,7 @@ int solveCGLSCDWWtrans(const MatrixBase & S, const MatrixBase & C,
                        const Vec & wc, const Vec & mc, const Vec & tm,
                        const Vec & td, double lambda, const Vec & deltaX,
                        int maxIter=200, bool verbose=false){ //ALLOW_PYTHON_THREADS
+  GIMLI_PROFILE("CGLS");
 
   uint nData = b.size();
   uint nModel = x.size();
@@ -179,6 +182,7 @@ int solveCGLSCDWW(const Mat & S, const CMatrix & C, const Vec & dWeight,
                   const Vec & b, Vec & x, const Vec & wc, const Vec & mc,
                   double lambda, const Vec & deltaX, int maxIter=200,
                   bool verbose=false){ //ALLOW_PYTHON_THREADS
+  GIMLI_PROFILE("CGLS");
 
   uint nData = b.size();
   uint nModel = x.size();
@@ -37,6 +37,13 @@ public:
 
     virtual int solve(const CVector & rhs, CVector & solution){ THROW_TO_IMPL return 0;}
 
+    /*! Factorize S with the same sparsity pattern as the initial matrix
+     * again, reusing the symbolic analysis. S need to be valid as long
+     * as the initial matrix. Return 0 if this is not supported. */
+    virtual int refactorise(RSparseMatrix & S){ return 0; }
+
+    virtual int refactorise(CSparseMatrix & S){ return 0; }
+
 protected:
 
     bool dummy_;
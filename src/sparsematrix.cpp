@@ -0,0 +1,36 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "sparsematrix.h"
+
+#include <mutex>
+
+namespace GIMLI{
+
+//** recursive, since a cache may be build from another one
+static std::recursive_mutex __GIMLI_SPARSE_CACHE_MUTEX__;
+
+SparseMatrixCacheLock::SparseMatrixCacheLock(){
+    __GIMLI_SPARSE_CACHE_MUTEX__.lock();
+}
+
+SparseMatrixCacheLock::~SparseMatrixCacheLock(){
+    __GIMLI_SPARSE_CACHE_MUTEX__.unlock();
+}
+
+} // namespace GIMLI
@@ -24,11 +24,14 @@
 #include "vector.h"
 #include "vectortemplates.h"
 #include "matrix.h"
+#include "memwatch.h"
 #include "mesh.h"
 #include "meshentities.h"
 #include "node.h"
 #include "stopwatch.h"
+#include "calculateMultiThread.h"
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -42,13 +45,23 @@ namespace GIMLI{
 #define SPARSE_NOT_VALID throwError(EXIT_SPARSE_INVALID, WHERE_AM_I + " no data/or sparsity pattern defined.");
 
 //! based on: Ulrich Breymann, Addison Wesley Longman 2000 , revised edition ISBN 0-201-67488-2, Designing Components with the C++ STL
+/*! Scoped lock that serializes the lazy build of the caches of the sparse
+ * matrices, since const products may request them concurrently. */
+class DLLEXPORT SparseMatrixCacheLock{
+public:
+    SparseMatrixCacheLock();
+    ~SparseMatrixCacheLock();
+};
+
 template< class ValueType, class IndexType, class ContainerType > class MatrixElement {
 public:
   typedef std::pair< IndexType, IndexType > IndexPair;
   typedef MatrixElement< ValueType, IndexType, ContainerType > & Reference;
 
-  MatrixElement(ContainerType & Cont, IndexType r, IndexType c)
-    : C(Cont), I(C.find(IndexPair(r, c))), row(r), column(c) {
+  /*! If valid is given, it is reset with any write access. */
+  MatrixElement(ContainerType & Cont, IndexType r, IndexType c,
+                std::atomic< bool > * valid=0)
+    : C(Cont), I(C.find(IndexPair(r, c))), row(r), column(c), valid_(valid) {
   }
 
   /* An assignment operator is required which in turn requires a
@@ -85,6 +98,7 @@ public:
      stored in the container. */
 
   Reference operator = (const ValueType & x) {
+    if (valid_) *valid_ = false;
     // not equal 0?
     if (x != ValueType(0)) {
       /* If the element does not yet exist, it is put, together
@@ -117,6 +131,7 @@ public:
   }
 
   Reference operator += (const ValueType & x) {
+    if (valid_) *valid_ = false;
     if (x != ValueType(0)) {
       if (I == C.end()) {
         assert(C.size() < C.max_size());
@@ -127,6 +142,7 @@ public:
   }
 
   Reference operator -= (const ValueType & x) {
+    if (valid_) *valid_ = false;
     if (x != ValueType(0)) {
       if (I == C.end()) {
         assert(C.size() < C.max_size());
@@ -140,50 +156,183 @@ private:
   ContainerType & C;
   typename ContainerType::iterator I;
   IndexType row, column;
+  std::atomic< bool > * valid_;
 
 };  // class MatrixElement
 
 
+//! Fast assembly buffer for sparse matrices.
+/*! Collects (row, col, value) triplets in one coordinate (COO) buffer per
+ * thread without any search or tree insertion. Each thread nr tNr may call
+ * \ref addVal(i, j, v, tNr) concurrently. \ref compress sums duplicate
+ * entries and returns the matrix in sorted compressed row storage (CRS).
+ * Use it to fill a \ref SparseMapMatrix (\ref SparseMapMatrix::assemble)
+ * or a \ref SparseMatrix for huge matrices, e.g., ray path Jacobians. */
+template < class ValueType > class SparseAssembler{
+public:
+    struct Entry {
+        Index row;
+        Index col;
+        ValueType val;
+    };
+
+    SparseAssembler(Index rows=0, Index cols=0, Index nThreads=1)
+        : rows_(rows), cols_(cols), buffers_(std::max(Index(1), nThreads)){
+    }
+
+    /*! Set the matrix dimension. Already collected entries are kept. */
+    void resize(Index rows, Index cols){ rows_ = rows; cols_ = cols; }
+
+    /*! Set the number of thread buffers. Already collected entries are kept. */
+    void setThreadCount(Index nThreads){
+        if (nThreads > buffers_.size()) buffers_.resize(nThreads);
+    }
+
+    /*! Return the number of thread buffers. */
+    Index threadCount() const { return buffers_.size(); }
+
+    /*! Reserve memory for nVals entries for each thread buffer. */
+    void reserve(Index nVals){
+        for (Index t = 0; t < buffers_.size(); t ++) buffers_[t].reserve(nVals);
+    }
+
+    /*! Remove all entries and free the memory. */
+    void clear(){
+        for (Index t = 0; t < buffers_.size(); t ++) {
+            std::vector < Entry >().swap(buffers_[t]);
+        }
+    }
+
+    inline Index rows() const { return rows_; }
+    inline Index cols() const { return cols_; }
+
+    /*! Return the amount of collected entries including duplicates. */
+    Index size() const {
+        Index n = 0;
+        for (Index t = 0; t < buffers_.size(); t ++) n += buffers_[t].size();
+        return n;
+    }
+
+    /*! Add val to the entry (i, j) into the buffer of thread tNr. */
+    inline void addVal(Index i, Index j, const ValueType & val, Index tNr=0){
+        if (i >= rows_ || j >= cols_ || tNr >= buffers_.size()){
+            throwLengthError(EXIT_SPARSE_SIZE, WHERE_AM_I +
+                             " i = " + toStr(i) + " max_row = " + toStr(rows_) +
+                             " j = " + toStr(j) + " max_col = " + toStr(cols_) +
+                             " tNr = " + toStr(tNr));
+        }
+        Entry e; e.row = i; e.col = j; e.val = val;
+        buffers_[tNr].push_back(e);
+    }
+
+    /*! Sum all duplicates and fill the compressed row storage: the column
+     * indices colIdx[rowPtr[i]] .. colIdx[rowPtr[i + 1] - 1] of row i are
+     * sorted ascending. If dropZeros is set, entries summing up to zero are
+     * removed. */
+    void compress(IndexArray & rowPtr, IndexArray & colIdx,
+                  Vector < ValueType > & vals, bool dropZeros=false) const {
+        //** counting sort by rows
+        rowPtr.resize(rows_ + 1);
+        rowPtr.fill(0);
+        for (Index t = 0; t < buffers_.size(); t ++){
+            for (Index k = 0; k < buffers_[t].size(); k ++) rowPtr[buffers_[t][k].row + 1] ++;
+        }
+        for (Index i = 0; i < rows_; i ++) rowPtr[i + 1] += rowPtr[i];
+
+        std::vector < std::pair < Index, ValueType > > tmp(rowPtr[rows_]);
+        IndexArray pos(rowPtr);
+        for (Index t = 0; t < buffers_.size(); t ++){
+            for (Index k = 0; k < buffers_[t].size(); k ++){
+                const Entry & e = buffers_[t][k];
+                tmp[pos[e.row] ++] = std::make_pair(e.col, e.val);
+            }
+        }
+
+        //** sort each row by column and sum duplicates in place
+        Index n = 0;
+        Index start = 0;
+        for (Index i = 0; i < rows_; i ++){
+            Index end = rowPtr[i + 1];
+            std::sort(tmp.begin() + start, tmp.begin() + end, lesserFirst_);
+            rowPtr[i] = n;
+            for (Index k = start; k < end; k ++){
+                if (n > rowPtr[i] && tmp[n - 1].first == tmp[k].first){
+                    tmp[n - 1].second += tmp[k].second;
+                } else {
+                    tmp[n ++] = tmp[k];
+                }
+            }
+            if (dropZeros){
+                Index m = rowPtr[i];
+                for (Index k = rowPtr[i]; k < n; k ++){
+                    if (tmp[k].second != ValueType(0)) tmp[m ++] = tmp[k];
+                }
+                n = m;
+            }
+            start = end;
+        }
+        rowPtr[rows_] = n;
+
+        colIdx.resize(n);
+        vals.resize(n);
+        for (Index k = 0; k < n; k ++){
+            colIdx[k] = tmp[k].first;
+            vals[k] = tmp[k].second;
+        }
+    }
+
+protected:
+    static bool lesserFirst_(const std::pair < Index, ValueType > & a,
+                             const std::pair < Index, ValueType > & b){
+        return a.first < b.first;
+    }
+
+    Index rows_;
+    Index cols_;
+    std::vector < std::vector < Entry > > buffers_;
+};
+
 //! based on: Ulrich Breymann, Addison Wesley Longman 2000 , revised edition ISBN 0-201-67488-2, Designing Components with the C++ STL
 template< class ValueType, class IndexType >
 class SparseMapMatrix : public MatrixBase {
 public:
     typedef std::pair< IndexType, IndexType > IndexPair;
-    typedef std::map< IndexPair, ValueType, std::less< IndexPair > > ContainerType;
+    typedef std::map< IndexPair, ValueType, std::less< IndexPair >,
+                      MemoryAllocator< std::pair< const IndexPair, ValueType > > > ContainerType;
     typedef typename ContainerType::iterator          iterator;
     typedef typename ContainerType::const_iterator    const_iterator;
     typedef MatrixElement< ValueType, IndexType, ContainerType > MatElement;
 
     /*!stype .. symmetric style. stype=0 (full), stype=1 (UpperRight), stype=2 (LowerLeft)*/
     SparseMapMatrix(IndexType r=0, IndexType c=0, int stype=0)
-        : MatrixBase(), rows_(r), cols_(c), stype_(stype) {
+        : MatrixBase(), rows_(r), cols_(c), stype_(stype),
+          mapValid_(true), crsValid_(false) {
     }
 
     SparseMapMatrix(const std::string & filename)
-        : MatrixBase(){
+        : MatrixBase(), mapValid_(true), crsValid_(false){
         this->load(filename);
     }
 
     SparseMapMatrix(const SparseMapMatrix< ValueType, IndexType > & S)
-        : MatrixBase(){
-        clear();
-        cols_ = S.cols();
-        rows_ = S.rows();
-        stype_ = S.stype();
-
-        for (const_iterator it = S.begin(); it != S.end(); it ++){
-            this->setVal(it->first.first, it->first.second, it->second);
-        }
+        : MatrixBase(), mapValid_(true), crsValid_(false){
+        this->copyFrom_(S);
     }
     SparseMapMatrix(const SparseMatrix< ValueType > & S)
-        : MatrixBase(){
+        : MatrixBase(), mapValid_(true), crsValid_(false){
         this->copy_(S);
     }
 
+    /*! Construct from the (compressed) content of an assembly buffer. */
+    SparseMapMatrix(const SparseAssembler< ValueType > & A)
+        : MatrixBase(), stype_(0), mapValid_(true), crsValid_(false){
+        this->assemble(A);
+    }
+
     /*! Contruct Map Matrix from 3 arrays of the same length.
      *Number of colums are max(j)+1 and Number of rows are max(i)+1.*/
     SparseMapMatrix(const IndexArray & i, const IndexArray & j, const RVector & v)
-        : MatrixBase(){
+        : MatrixBase(), mapValid_(true), crsValid_(false){
         ASSERT_EQUAL(i.size(), j.size())
         ASSERT_EQUAL(i.size(), v.size())
         stype_ = 0;
@@ -194,16 +343,15 @@ public:
 
     SparseMapMatrix< ValueType, IndexType > & operator = (const SparseMapMatrix< ValueType, IndexType > & S){
         if (this != &S){
-            clear();
-            cols_ = S.cols();
-            rows_ = S.rows();
-            stype_ = S.stype();
-            for (const_iterator it = S.begin(); it != S.end(); it ++){
-                this->setVal(it->first.first, it->first.second, it->second);
-            }
+            this->copyFrom_(S);
         } return *this;
     }
 
+    SparseMapMatrix & operator = (const SparseAssembler< ValueType > & A){
+        this->assemble(A);
+        return *this;
+    }
+
     SparseMapMatrix & operator = (const SparseMatrix< ValueType > & S){
         this->copy_(S);
         return *this;
@@ -215,8 +363,8 @@ public:
     virtual uint rtti() const { return GIMLI_SPARSE_MAP_MATRIX_RTTI; }
 
     void resize(Index rows, Index cols){
-        rows_ = rows;
-        cols_ = cols;
+        this->setRows(rows);
+        this->setCols(cols);
     }
 
     void copy_(const SparseMatrix< ValueType > & S){
@@ -247,29 +395,96 @@ public:
 
     virtual void clear() {
         C_.clear();
+        clearCRS_();
+        mapValid_ = true;
         cols_ = 0; rows_ = 0; stype_ = 0;
     }
 
+    /*! Replace the content by the compressed content of the assembly buffer A.
+     * The values are only hold in compressed row storage until an
+     * element wise access is needed. */
+    void assemble(const SparseAssembler< ValueType > & A){
+        C_.clear();
+        rows_ = A.rows();
+        cols_ = A.cols();
+        //** zeros are not stored, like for the element wise access
+        A.compress(rowPtr_, colIdx_, vals_, true);
+        mapValid_ = false;
+        crsValid_ = true;
+
+        if (stype_ != 0){
+            //** drop the entries that are not part of the stored triangle
+            Index n = 0, start = 0;
+            for (Index i = 0; i < Index(rows_); i ++){
+                Index end = rowPtr_[i + 1];
+                rowPtr_[i] = n;
+                for (Index k = start; k < end; k ++){
+                    Index j = colIdx_[k];
+                    if ((stype_ < 0 && i > j) || (stype_ > 0 && i < j)) continue;
+                    colIdx_[n] = j;
+                    vals_[n] = vals_[k];
+                    n ++;
+                }
+                start = end;
+            }
+            rowPtr_[rows_] = n;
+            colIdx_.resize(n);
+            vals_.resize(n);
+        }
+    }
+
+    /*! Build the compressed row storage and release the map storage.
+     * Matrix vector products and \ref fillArrays work directly on the
+     * compressed storage. Any element wise access restores the map. */
+    void compress() const {
+        SparseMatrixCacheLock lock;
+        this->ensureCRS_();
+        ContainerType().swap(C_);
+        mapValid_ = false;
+    }
+
+    /*! Return true if the values are currently hold in compressed row
+     * storage only. */
+    inline bool isCompressed() const { return !mapValid_; }
+
+    /*! Read only access to the compressed row storage. Build it if necessary. */
+    const IndexArray & vecRowPtr() const { this->ensureCRS_(); return rowPtr_; }
+    const IndexArray & vecColIdx() const { this->ensureCRS_(); return colIdx_; }
+    const Vector < ValueType > & vecVals() const { this->ensureCRS_(); return vals_; }
+
     /*! symmetric type. 0 = nonsymmetric, -1 symmetric lower part, 1 symmetric upper part.*/
     inline int stype() const {return stype_;}
 
-    inline void setRows(IndexType r) { rows_ = r ; }
+    /*! Entries outside a shrinked matrix are removed. */
+    inline void setRows(IndexType r) {
+        this->modify_();
+        if (r < rows_) C_.erase(C_.lower_bound(IndexPair(r, 0)), C_.end());
+        rows_ = r;
+    }
     virtual IndexType rows()     const { return rows_; }
     virtual IndexType nRows()     const { return rows_; }
 
-    inline void setCols(IndexType c) { cols_ = c ; }
+    inline void setCols(IndexType c) {
+        this->modify_();
+        if (c < cols_){
+            for (iterator it = C_.begin(); it != C_.end();){
+                if (it->first.second >= c) C_.erase(it ++); else ++ it;
+            }
+        }
+        cols_ = c;
+    }
     virtual IndexType cols()     const { return cols_; }
     virtual IndexType nCols()     const { return cols_; }
 
-    inline IndexType size()     const { return C_.size(); }
+    inline IndexType size()     const { return mapValid_ ? C_.size() : vals_.size(); }
     inline IndexType max_size() const { return C_.max_size(); }
-    inline IndexType nVals()    const { return C_.size(); }
+    inline IndexType nVals()    const { return this->size(); }
 
-    inline iterator begin() { return C_.begin(); }
-    inline iterator end() { return C_.end(); }
+    inline iterator begin() { this->modify_(); return C_.begin(); }
+    inline iterator end() { this->modify_(); return C_.end(); }
 
-    inline const_iterator begin() const { return C_.begin(); }
-    inline const_iterator end()   const { return C_.end(); }
+    inline const_iterator begin() const { this->ensureMap_(); return C_.begin(); }
+    inline const_iterator end()   const { this->ensureMap_(); return C_.end(); }
 
     void addToCol(Index id, const ElementMatrix < double > & A, bool isDiag=false){
         for (Index i = 0, imax = A.size(); i < imax; i++){
@@ -336,8 +551,9 @@ public:
 
     class Aux {  // for index operator below
     public:
-        Aux(IndexType r, IndexType maxs, ContainerType & Cont, int stype)
-            : Row(r), maxColumns(maxs), C(Cont), stype_(stype) { }
+        Aux(IndexType r, IndexType maxs, ContainerType & Cont, int stype,
+            std::atomic< bool > * valid)
+            : Row(r), maxColumns(maxs), C(Cont), stype_(stype), valid_(valid) { }
 
         MatElement operator [] (IndexType c) {
 //             __MS( stype_ << " " << c << " " << Row )
@@ -346,12 +562,13 @@ public:
                                   WHERE_AM_I + " idx = " + toStr(c) + ", " + str(Row) + " maxcol = "
                                   + toStr(maxColumns) + " stype: " + toStr(stype_));
             }
-            return MatElement(C, Row, c);
+            return MatElement(C, Row, c, valid_);
         }
     protected:
         IndexType Row, maxColumns;
         ContainerType & C;
         int stype_;
+        std::atomic< bool > * valid_;
     };
 
     Aux operator [] (IndexType r) {
@@ -360,7 +577,9 @@ public:
                               WHERE_AM_I + " idx = " + toStr(r) + " maxrow = "
                               + toStr(rows_));
         }
-        return Aux(r, cols(), C_, stype_);
+        //** the compressed storage is only invalidated by a write access
+        this->ensureMap_();
+        return Aux(r, cols(), C_, stype_, &crsValid_);
     }
 
     inline IndexType idx1(const const_iterator & I) const { return (*I).first.first; }
@@ -371,7 +590,7 @@ public:
 
     inline const ValueType & val(const const_iterator & I) const { return (*I).second;  }
 
-    inline ValueType & val(const iterator & I) { return (*I).second;  }
+    inline ValueType & val(const iterator & I) { this->modify_(); return (*I).second;  }
 
     inline ValueType getVal(IndexType i, IndexType j) { return (*this)[i][j]; }
 
@@ -403,59 +622,47 @@ public:
     }
     
 
-    /*! Return this * a  */
+    /*! Return this * a. Works on the compressed row storage. */
     virtual Vector < ValueType > mult(const Vector < ValueType > & a) const {
         Vector < ValueType > ret(this->rows(), 0.0);
 
         ASSERT_EQUAL(this->cols(), a.size())
 
-        if (stype_ == 0){
-            for (const_iterator it = this->begin(); it != this->end(); it ++){
-                ret[it->first.first] += a[it->first.second] * it->second;
-            }
-        } else if (stype_ == -1){
-
-            for (const_iterator it = this->begin(); it != this->end(); it ++){
-                IndexType I = it->first.first;
-                IndexType J = it->first.second;
-
-                ret[I] += a[J] * conj(it->second);
-
-                if (J > I){
-                    ret[J] += a[I] * it->second;
-                }
-            }
-        } else if (stype_ ==  1){
-            for (const_iterator it = this->begin(); it != this->end(); it ++){
-                IndexType I = it->first.first;
-                IndexType J = it->first.second;
-
-                ret[I] += a[J] * conj(it->second);
-
-                if (J < I){
-                    ret[J] += a[I] * it->second;
+        this->ensureCRS_();
+        for (Index i = 0; i < rows_; i ++){
+            for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++){
+                Index J = colIdx_[k];
+                if (stype_ == 0){
+                    ret[i] += a[J] * vals_[k];
+                } else {
+                    ret[i] += a[J] * conj(vals_[k]);
+                    if ((stype_ == -1 && J > i) || (stype_ == 1 && J < i)){
+                        ret[J] += a[i] * vals_[k];
+                    }
                 }
             }
-
         }
         return ret;
     }
 
-    /*! Return this.T * a */
+    /*! Return this.T * a. Works on the compressed row storage. */
     virtual Vector < ValueType > transMult(const Vector < ValueType > & a) const {
         Vector < ValueType > ret(this->cols(), 0.0);
 
         ASSERT_EQUAL(this->rows(), a.size())
 
-        if (stype_ == 0){
-            for (const_iterator it = this->begin(); it != this->end(); it ++){
-                ret[it->first.second] += a[it->first.first] * it->second;
-            }
-        } else if (stype_ == -1){
+        if (stype_ == -1){
             THROW_TO_IMPL
         } else if (stype_ ==  1){
             THROW_TO_IMPL
         }
+
+        this->ensureCRS_();
+        for (Index i = 0; i < rows_; i ++){
+            for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++){
+                ret[colIdx_[k]] += a[i] * vals_[k];
+            }
+        }
         return ret;
     }
 
@@ -476,8 +683,11 @@ public:
     void save(const std::string & filename) const {
         std::fstream file; openOutFile(filename, &file);
 
-        for (const_iterator it = begin(); it != end(); it ++){
-            file <<  idx1(it) << " " << idx2(it) << " " << val(it) << std::endl;
+        this->ensureCRS_();
+        for (Index i = 0; i < rows_; i ++){
+            for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++){
+                file << i << " " << colIdx_[k] << " " << vals_[k] << std::endl;
+            }
         }
 
         file.close();
@@ -539,24 +749,91 @@ public:
     /*! Fill existing arrays with values, row and column indieces of this
      * SparseMapMatrix*/
     void fillArrays(Vector < ValueType > & vals, IndexArray & rows, IndexArray & cols){
-        vals.resize(C_.size());
-        rows.resize(C_.size());
-        cols.resize(C_.size());
-        Index i = 0;
-
-        for (const_iterator it = this->begin(); it != this->end(); it ++, i ++){
-            rows[i] = idx1(it);
-            cols[i] = idx2(it);
-            vals[i] = val(it);
+        this->ensureCRS_();
+        vals = vals_;
+        cols = colIdx_;
+        rows.resize(vals_.size());
+        for (Index i = 0; i < rows_; i ++){
+            for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++) rows[k] = i;
         }
     }
 
 protected:
+    void copyFrom_(const SparseMapMatrix< ValueType, IndexType > & S){
+        cols_ = S.cols();
+        rows_ = S.rows();
+        stype_ = S.stype();
+        mapValid_ = bool(S.mapValid_);
+        crsValid_ = bool(S.crsValid_);
+        if (mapValid_) C_ = S.C_; else C_.clear();
+        if (crsValid_){
+            rowPtr_ = S.rowPtr_;
+            colIdx_ = S.colIdx_;
+            vals_ = S.vals_;
+        } else {
+            clearCRS_();
+        }
+    }
+
+    void clearCRS_() const {
+        rowPtr_.clear();
+        colIdx_.clear();
+        vals_.clear();
+        crsValid_ = false;
+    }
+
+    /*! The map is sorted by (row, col), so it can be compressed in one pass. */
+    void ensureCRS_() const {
+        if (crsValid_) return;
+        SparseMatrixCacheLock lock;
+        if (crsValid_) return;
+        rowPtr_.resize(rows_ + 1);
+        rowPtr_.fill(0);
+        colIdx_.resize(C_.size());
+        vals_.resize(C_.size());
+        Index k = 0;
+        for (const_iterator it = C_.begin(); it != C_.end(); it ++, k ++){
+            rowPtr_[it->first.first + 1] ++;
+            colIdx_[k] = it->first.second;
+            vals_[k] = it->second;
+        }
+        for (Index i = 0; i < rows_; i ++) rowPtr_[i + 1] += rowPtr_[i];
+        crsValid_ = true;
+    }
+
+    /*! Restore the map from the compressed row storage. */
+    void ensureMap_() const {
+        if (mapValid_) return;
+        SparseMatrixCacheLock lock;
+        if (mapValid_) return;
+        C_.clear();
+        for (Index i = 0; i < rows_; i ++){
+            for (Index k = rowPtr_[i]; k < rowPtr_[i + 1]; k ++){
+                C_.insert(C_.end(), std::make_pair(IndexPair(i, colIdx_[k]), vals_[k]));
+            }
+        }
+        mapValid_ = true;
+    }
+
+    /*! Need to be called before any write access to the map. */
+    void modify_(){
+        this->ensureMap_();
+        if (crsValid_) clearCRS_();
+    }
 
   IndexType rows_, cols_;
-  ContainerType C_;
+  mutable ContainerType C_;
   // 0 .. nonsymmetric, -1 symmetric lower part, 1 symmetric upper part
   int stype_;
+
+  /*! Compressed row storage, build on demand or by \ref assemble. */
+  mutable IndexArray rowPtr_;
+  mutable IndexArray colIdx_;
+  mutable Vector < ValueType > vals_;
+  /*! C_ holds the actual values */
+  mutable std::atomic< bool > mapValid_;
+  /*! rowPtr_, colIdx_ and vals_ hold the actual values */
+  mutable std::atomic< bool > crsValid_;
 };// class SparseMapMatrix
 
 
@@ -679,6 +956,96 @@ void rank1Update(SparseMapMatrix< double, Index > & S, const Vec & u, const Vec
 //     return S * Vector< V2 >(a);
 // }
 
+//! Threaded kernel for sparse matrix (multi-) vector products.
+/*! Each thread works on one block of rows [part[t], part[t + 1]) with about
+ * the same amount of nonzeros, so every output entry is written by one
+ * thread only. For each row i of the block and each of the nVec vectors:
+ * y[i] = sum_k val(k) * x[idx[k]], k = ptr[i] .. ptr[i + 1] - 1,
+ * optionally plus the same sum over a second (transposed) layout
+ * (tPtr, tIdx, tVal) where val(q) = vals[tVal[q]]. The single vector loop
+ * uses four independent sums, so compilers can use SIMD gathers. */
+template < class ValueType > class SparseMatrixMultMT : public BaseCalcMT{
+public:
+    SparseMatrixMultMT(const int * ptr, const int * idx, const int * valIdx,
+                       const ValueType * vals, bool conjugate,
+                       const int * tPtr, const int * tIdx, const int * tVal,
+                       const Index * part, Index nVec,
+                       const ValueType * const * x, ValueType * const * y)
+    : BaseCalcMT(false), ptr_(ptr), idx_(idx), valIdx_(valIdx), vals_(vals),
+      conj_(conjugate), tPtr_(tPtr), tIdx_(tIdx), tVal_(tVal),
+      part_(part), nVec_(nVec), x_(x), y_(y){
+    }
+
+    virtual ~SparseMatrixMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index t = start_; t < end_; t ++){
+            if (nVec_ == 1){
+                rowSums_(ptr_, idx_, valIdx_, conj_, part_[t], part_[t + 1], false);
+                if (tPtr_) rowSums_(tPtr_, tIdx_, tVal_, false, part_[t], part_[t + 1], true);
+            } else {
+                multiSums_(ptr_, idx_, valIdx_, conj_, part_[t], part_[t + 1]);
+                if (tPtr_) multiSums_(tPtr_, tIdx_, tVal_, false, part_[t], part_[t + 1]);
+            }
+        }
+    }
+
+protected:
+    inline ValueType val_(const int * valIdx, bool conjugate, int k) const {
+        const ValueType & v = valIdx ? vals_[valIdx[k]] : vals_[k];
+        return conjugate ? ValueType(conj(v)) : v;
+    }
+
+    void rowSums_(const int * ptr, const int * idx, const int * valIdx,
+                  bool conjugate, Index start, Index end, bool add){
+        const ValueType * x = x_[0];
+        ValueType * y = y_[0];
+
+        for (Index i = start; i < end; i ++){
+            int k = ptr[i];
+            const int kE = ptr[i + 1];
+            ValueType s0(0), s1(0), s2(0), s3(0);
+            if (!valIdx && !conjugate){
+                for (; k + 3 < kE; k += 4){
+                    s0 += vals_[k]     * x[idx[k]];
+                    s1 += vals_[k + 1] * x[idx[k + 1]];
+                    s2 += vals_[k + 2] * x[idx[k + 2]];
+                    s3 += vals_[k + 3] * x[idx[k + 3]];
+                }
+            }
+            for (; k < kE; k ++) s0 += val_(valIdx, conjugate, k) * x[idx[k]];
+
+            if (add) y[i] += (s0 + s1) + (s2 + s3);
+            else y[i] = (s0 + s1) + (s2 + s3);
+        }
+    }
+
+    /*! Values and indices are loaded once for all vectors. */
+    void multiSums_(const int * ptr, const int * idx, const int * valIdx,
+                    bool conjugate, Index start, Index end){
+        for (Index i = start; i < end; i ++){
+            for (int k = ptr[i]; k < ptr[i + 1]; k ++){
+                const ValueType v(val_(valIdx, conjugate, k));
+                const int j = idx[k];
+                for (Index m = 0; m < nVec_; m ++) y_[m][i] += v * x_[m][j];
+            }
+        }
+    }
+
+    const int * ptr_;
+    const int * idx_;
+    const int * valIdx_;
+    const ValueType * vals_;
+    bool conj_;
+    const int * tPtr_;
+    const int * tIdx_;
+    const int * tVal_;
+    const Index * part_;
+    Index nVec_;
+    const ValueType * const * x_;
+    ValueType * const * y_;
+};
+
 //! Sparse matrix in compressed row storage (CRS) form
 /*! Sparse matrix in compressed row storage (CRS) form.
 * IF you need native CCS format you need to transpose CRS
@@ -688,28 +1055,45 @@ public:
 
   /*! Default constructor. Builds invalid sparse matrix */
     SparseMatrix()
-        : MatrixBase(), valid_(false), stype_(0), rows_(0), cols_(0){ }
+        : MatrixBase(), valid_(false), stype_(0), rows_(0), cols_(0),
+          transValid_(false){ }
 
     /*! Copy constructor. */
     SparseMatrix(const SparseMatrix < ValueType > & S)
         : MatrixBase(),
           colPtr_(S.vecColPtr()),
           rowIdx_(S.vecRowIdx()),
-          vals_(S.vecVals()), valid_(true), stype_(0){
+          vals_(S.vecVals()), valid_(true), stype_(S.stype()),
+          transValid_(false){
           rows_ = S.rows();
           cols_ = S.cols();
     }
 
     /*! Copy constructor. */
     SparseMatrix(const SparseMapMatrix< ValueType, Index > & S)
-        : MatrixBase(), valid_(true){
+        : MatrixBase(), valid_(true), transValid_(false){
         copy_(S);
     }
 
+    /*! Create Sparsematrix from compressed row arrays, i.e., the column
+     * indices and values of row i are at rowPtr[i] .. rowPtr[i + 1] - 1. */
+    SparseMatrix(Index rows, Index cols,
+                 const std::vector < int > & rowPtr,
+                 const std::vector < int > & colIdx,
+                 const Vector < ValueType > & vals, int stype=0)
+        : MatrixBase(), colPtr_(rowPtr), rowIdx_(colIdx), vals_(vals),
+          valid_(true), stype_(stype), rows_(rows), cols_(cols),
+          transValid_(false){
+        if (colPtr_.size() != rows + 1 || rowIdx_.size() != vals_.size() ||
+            Index(colPtr_.back()) != vals_.size()){
+            throwLengthError(1, WHERE_AM_I + " invalid compressed row arrays.");
+        }
+    }
+
     /*! Create Sparsematrix from c-arrays. Can't check for valid ranges, so please be carefull. */
     SparseMatrix(uint dim, Index * colPtr, Index nVals, Index * rowIdx,
                  ValueType * vals, int stype=0)
-        : MatrixBase(){
+        : MatrixBase(), transValid_(false){
         colPtr_.reserve(dim + 1);
         colPtr_.resize(dim + 1);
 
@@ -737,6 +1121,7 @@ public:
             vals_   = S.vecVals();
             stype_  = S.stype();
             valid_  = true;
+            transValid_ = false;
             cols_ = S.cols();
             rows_ = S.rows();
 
@@ -797,7 +1182,7 @@ public:
 
     virtual uint rtti() const { return GIMLI_SPARSE_CRS_MATRIX_RTTI; }
 
-    /*! Return this * a  */
+    /*! Return this * a. Multithreaded for large matrices, see \ref SparseMatrixMultMT. */
     virtual Vector < ValueType > mult(const Vector < ValueType > & a) const {
         if (a.size() < this->cols()){
             throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->cols()) + " a.size(): " +
@@ -805,46 +1190,11 @@ public:
         }
 
         Vector < ValueType > ret(this->rows(), 0.0);
+        if (ret.size() == 0 || this->nVals() == 0) return ret;
 
-        if (stype_ == 0){
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    ret[i] += a[this->vecRowIdx()[j]] * this->vecVals()[j];
-                }
-            }
-        } else if (stype_ == -1){
-            Index J;
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    J = this->vecRowIdx()[j];
-
-//                     __MS( i << "  " << J << " " << this->vecVals()[j])
-                    ret[i] += a[J] * conj(this->vecVals()[j]);
-
-                    if (J > i){
-//                         __MS( J << "  " << i << " " << this->vecVals()[j])
-                        ret[J] += a[i] * this->vecVals()[j];
-                    }
-                }
-            }
-
-            //#THROW_TO_IMPL
-        } else if (stype_ == 1){
-            Index J;
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    J = this->vecRowIdx()[j];
-
-//                     __MS( i << "  " << J << " " << this->vecVals()[j])
-                    ret[i] += a[J] * conj(this->vecVals()[j]);
-
-                    if (J < i){
-//                         __MS( J << "  " << i << " " << this->vecVals()[j])
-                        ret[J] += a[i] * this->vecVals()[j];
-                    }
-                }
-            }
-        }
+        const ValueType * x = &a[0];
+        ValueType * y = &ret[0];
+        this->multMT_(1, &x, &y, false);
         return ret;
     }
 
@@ -858,18 +1208,59 @@ public:
 
         Vector < ValueType > ret(this->cols(), 0.0);
 
-        if (stype_ == 0){
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    ret[this->vecRowIdx()[j]] += a[i] * this->vecVals()[j];
-                }
-            }
-
-        } else if (stype_ == -1){
+        if (stype_ == -1){
             THROW_TO_IMPL
         } else if (stype_ ==  1){
             THROW_TO_IMPL
         }
+        if (ret.size() == 0 || this->nVals() == 0) return ret;
+
+        const ValueType * x = &a[0];
+        ValueType * y = &ret[0];
+        this->multMT_(1, &x, &y, true);
+        return ret;
+    }
+
+    /*! Return this * X for each row of X (multiple right hand sides).
+     * The result has X.rows() rows of length this->rows(). */
+    Matrix < ValueType > mult(const Matrix < ValueType > & X) const {
+        Matrix < ValueType > ret(X.rows(), this->rows());
+        if (X.rows() == 0) return ret;
+        if (X.cols() < this->cols()){
+            throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->cols()) + " X.cols(): " +
+                                toStr(X.cols())) ;
+        }
+        if (this->rows() == 0 || this->nVals() == 0) return ret;
+
+        std::vector < const ValueType * > x(X.rows());
+        std::vector < ValueType * > y(X.rows());
+        for (Index i = 0; i < X.rows(); i ++){
+            x[i] = &X[i][0];
+            y[i] = &ret[i][0];
+        }
+        this->multMT_(X.rows(), &x[0], &y[0], false);
+        return ret;
+    }
+
+    /*! Return this.T * X for each row of X (multiple right hand sides).
+     * The result has X.rows() rows of length this->cols(). */
+    Matrix < ValueType > transMult(const Matrix < ValueType > & X) const {
+        Matrix < ValueType > ret(X.rows(), this->cols());
+        if (X.rows() == 0) return ret;
+        if (X.cols() < this->rows()){
+            throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->rows()) + " X.cols(): " +
+                                toStr(X.cols())) ;
+        }
+        if (stype_ != 0) THROW_TO_IMPL
+        if (this->cols() == 0 || this->nVals() == 0) return ret;
+
+        std::vector < const ValueType * > x(X.rows());
+        std::vector < ValueType * > y(X.rows());
+        for (Index i = 0; i < X.rows(); i ++){
+            x[i] = &X[i][0];
+            y[i] = &ret[i][0];
+        }
+        this->multMT_(X.rows(), &x[0], &y[0], true);
         return ret;
     }
 
@@ -896,6 +1287,7 @@ public:
         valid_ = false;
         cols_ = 0;
         rows_ = 0;
+        transValid_ = false;
     }
 
     void setVal(int i, int j, ValueType val){
@@ -940,50 +1332,22 @@ public:
     }
 
     void copy_(const SparseMapMatrix< ValueType, Index > & S){
-
         this->clear();
-        Index col = 0, row = 0;
-        ValueType val;
         cols_ = S.cols();
         rows_ = S.rows();
+        stype_ = S.stype();
 
-        std::vector < std::map < Index, ValueType > > idxMap(S.cols());
-
-        for (typename SparseMapMatrix< ValueType, Index>::const_iterator
-            it = S.begin(); it != S.end(); it ++){
-
-            col = S.idx1(it);
-            row = S.idx2(it);
-            val = S.val(it);
-            idxMap[col].insert(std::pair< Index, ValueType >(row, val));
-        }
-
-        colPtr_.reserve(S.cols() + 1);
-        colPtr_.resize(S.cols() + 1);
-
-        rowIdx_.reserve(S.nVals());
-        rowIdx_.resize(S.nVals());
-
-        vals_.resize(S.nVals());
-        stype_  = S.stype();
-
-        colPtr_[0] = 0;
-
-        Index colCounter = 0, rowCounter = 0;
-        for (typename std::vector < std::map < Index, ValueType > >::iterator
-            it = idxMap.begin(); it != idxMap.end(); it++){
+        const IndexArray & rowPtr = S.vecRowPtr();
+        const IndexArray & colIdx = S.vecColIdx();
 
-            for (typename std::map < Index, ValueType >::iterator
-                itR = (*it).begin(); itR != (*it).end(); itR++){
+        colPtr_.resize(rowPtr.size());
+        for (Index i = 0; i < rowPtr.size(); i ++) colPtr_[i] = rowPtr[i];
+        rowIdx_.resize(colIdx.size());
+        for (Index i = 0; i < colIdx.size(); i ++) rowIdx_[i] = colIdx[i];
+        vals_ = S.vecVals();
 
-                rowIdx_[rowCounter] = itR->first;
-                vals_[rowCounter] = (ValueType)itR->second;
-                rowCounter ++;
-            }
-            colCounter ++;
-            colPtr_[colCounter] = rowCounter;
-        }
         valid_ = true;
+        transValid_ = false;
     }
 
     void buildSparsityPattern(const Mesh & mesh){
@@ -1050,6 +1414,7 @@ public:
             colPtr_[row] = k;
         }
         valid_ = true;
+        transValid_ = false;
         cols_ = colPtr_.size() - 1;
         rows_ = max(rowIdx_) + 1;
         //** freeing idxMap ist expensive
@@ -1091,11 +1456,11 @@ public:
     /*! symmetric type. 0 = nonsymmetric, -1 symmetric lower part, 1 symmetric upper part.*/
     inline int stype() const {return stype_;}
 
-    inline int * colPtr() { if (valid_) return &colPtr_[0]; else SPARSE_NOT_VALID;  return 0; }
+    inline int * colPtr() { transValid_ = false; if (valid_) return &colPtr_[0]; else SPARSE_NOT_VALID;  return 0; }
     inline const int & colPtr() const { if (valid_) return colPtr_[0]; else SPARSE_NOT_VALID; return colPtr_[0]; }
     inline const std::vector < int > & vecColPtr() const { return colPtr_; }
 
-    inline int * rowIdx() { if (valid_) return &rowIdx_[0]; else SPARSE_NOT_VALID; return 0; }
+    inline int * rowIdx() { transValid_ = false; if (valid_) return &rowIdx_[0]; else SPARSE_NOT_VALID; return 0; }
     inline const int & rowIdx() const { if (valid_) return rowIdx_[0]; else SPARSE_NOT_VALID; return rowIdx_[0]; }
     inline const std::vector < int > & vecRowIdx() const { return rowIdx_; }
 
@@ -1131,8 +1496,90 @@ public:
 
     bool valid() const { return valid_; }
 
+    /*! Build the transposed index layout used by \ref transMult and by
+     * \ref mult of the symmetric types. It is build on demand anyway,
+     * call this before sharing the matrix between threads. */
+    void buildTransposed() const {
+        if (!valid_) SPARSE_NOT_VALID;
+        this->ensureTransposed_();
+    }
+
 protected:
 
+    /*! Transposed index layout: for stype == 0 of all entries, for the
+     * symmetric types of the entries that are mirrored by \ref mult.
+     * Only the indices are stored, the values are taken from vals_. */
+    void ensureTransposed_() const {
+        if (transValid_) return;
+        SparseMatrixCacheLock lock;
+        if (transValid_) return;
+        Index n = cols_;
+        transPtr_.assign(n + 1, 0);
+        for (Index i = 0; i < rows_; i ++){
+            for (int k = colPtr_[i]; k < colPtr_[i + 1]; k ++){
+                if (isMirrored_(i, rowIdx_[k])) transPtr_[rowIdx_[k] + 1] ++;
+            }
+        }
+        for (Index i = 0; i < n; i ++) transPtr_[i + 1] += transPtr_[i];
+
+        transIdx_.resize(transPtr_[n]);
+        transVal_.resize(transPtr_[n]);
+        std::vector < int > pos(transPtr_.begin(), transPtr_.end() - 1);
+        for (Index i = 0; i < rows_; i ++){
+            for (int k = colPtr_[i]; k < colPtr_[i + 1]; k ++){
+                int j = rowIdx_[k];
+                if (isMirrored_(i, j)){
+                    transIdx_[pos[j]] = i;
+                    transVal_[pos[j]] = k;
+                    pos[j] ++;
+                }
+            }
+        }
+        transValid_ = true;
+    }
+
+    inline bool isMirrored_(Index i, Index j) const {
+        if (stype_ == 0) return true;
+        if (stype_ == -1) return j > i;
+        return j < i;
+    }
+
+    /*! y[m] = this * x[m] (or this.T * x[m]) for nVec vectors. */
+    void multMT_(Index nVec, const ValueType * const * x, ValueType * const * y,
+                 bool trans) const {
+        if (!valid_) SPARSE_NOT_VALID;
+        if (trans || stype_ != 0) this->ensureTransposed_();
+
+        const int * ptr = trans ? &transPtr_[0] : &colPtr_[0];
+        const int * idx = trans ? (transIdx_.size() ? &transIdx_[0] : 0) : &rowIdx_[0];
+        const int * valIdx = trans ? (transVal_.size() ? &transVal_[0] : 0) : 0;
+        Index n = trans ? cols_ : rows_;
+        bool sym = !trans && stype_ != 0;
+
+        //** row blocks with about the same amount of nonzeros
+        Index nnz = ptr[n] + (sym ? transPtr_[n] : 0);
+        Index nThreads = 1;
+        if (nnz * nVec > 32768) {
+            nThreads = std::max(Index(1), std::min(threadCount(), n));
+        }
+        std::vector < Index > part(nThreads + 1, n);
+        part[0] = 0;
+        Index i = 0;
+        for (Index t = 1; t < nThreads; t ++){
+            Index target = nnz * t / nThreads;
+            while (i < n && Index(ptr[i] + (sym ? transPtr_[i] : 0)) < target) i ++;
+            part[t] = i;
+        }
+
+        distributeCalc(SparseMatrixMultMT< ValueType >(ptr, idx, valIdx,
+                            &vals_[0], sym,
+                            sym ? &transPtr_[0] : 0,
+                            sym && transIdx_.size() ? &transIdx_[0] : 0,
+                            sym && transVal_.size() ? &transVal_[0] : 0,
+                            &part[0], nVec, x, y),
+                       nThreads, nThreads);
+    }
+
     // int to be cholmod compatible!!!!!!!!
 
     std::vector < int > colPtr_;
@@ -1143,6 +1590,11 @@ protected:
     int stype_;
     Index rows_;
     Index cols_;
+
+    mutable std::vector < int > transPtr_;
+    mutable std::vector < int > transIdx_;
+    mutable std::vector < int > transVal_;
+    mutable std::atomic< bool > transValid_;
 };
 
 template < class ValueType >
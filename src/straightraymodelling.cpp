@@ -0,0 +1,216 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "straightraymodelling.h"
+
+#include "datacontainer.h"
+#include "mesh.h"
+#include "meshentities.h"
+#include "regionManager.h"
+#include "stopwatch.h"
+#include "vectortemplates.h"
+
+namespace GIMLI{
+
+StraightRayModelling::StraightRayModelling(bool verbose)
+    : ModellingBase(verbose){
+    this->initJacobian();
+}
+
+StraightRayModelling::StraightRayModelling(Mesh & mesh,
+                                           DataContainer & dataContainer,
+                                           bool verbose)
+    : ModellingBase(dataContainer, verbose){
+    this->initJacobian();
+    this->setMesh(mesh);
+}
+
+void StraightRayModelling::initJacobian(){
+    if (jacobian_ && ownJacobian_){
+        delete jacobian_;
+    }
+    jacobian_ = new RSparseMatrix();
+    ownJacobian_ = true;
+}
+
+void StraightRayModelling::updateMeshDependency_(){
+    RSparseMatrix * J = dynamic_cast < RSparseMatrix * >(jacobian_);
+    if (J) J->clear();
+}
+
+void StraightRayModelling::updateDataDependency_(){
+    RSparseMatrix * J = dynamic_cast < RSparseMatrix * >(jacobian_);
+    if (J) J->clear();
+}
+
+RVector StraightRayModelling::getApparentSlowness() const {
+    if (!dataContainer_) return 0.0;
+
+    Index nData = dataContainer_->size();
+    RVector apparentSlowness(nData);
+
+    for (Index dataIdx = 0; dataIdx < nData; dataIdx ++) {
+        SIndex s = (SIndex)(*dataContainer_)("s")[dataIdx];
+        SIndex g = (SIndex)(*dataContainer_)("g")[dataIdx];
+        if (s == g){
+            throwError(1, WHERE_AM_I + ": shot point equals geophon point. " +
+                       str(s) + "==" + str(g));
+        }
+        double dist = dataContainer_->sensorPosition(s).distance(
+                                        dataContainer_->sensorPosition(g));
+        apparentSlowness[dataIdx] = dataContainer_->get("t")[dataIdx] / dist;
+    }
+    return apparentSlowness;
+}
+
+double StraightRayModelling::findMedianSlowness() const {
+    return median(getApparentSlowness());
+}
+
+RVector StraightRayModelling::createDefaultStartModel() {
+    return RVector(this->regionManager().parameterCount(), findMedianSlowness());
+}
+
+class CreateStraightRayMT : public GIMLI::BaseCalcMT{
+public:
+    CreateStraightRayMT(const Mesh & mesh,
+                        const R3Vector & shots,
+                        const R3Vector & receivers,
+                        const std::vector < Cell * > & startCells,
+                        double tol,
+                        RSparseAssembler & J,
+                        bool verbose)
+    : BaseCalcMT(verbose), mesh_(&mesh), shots_(&shots),
+      receivers_(&receivers), startCells_(&startCells), tol_(tol), J_(&J){
+    }
+
+    virtual ~CreateStraightRayMT(){}
+
+    virtual void calc(Index tNr=0){
+        std::vector < Cell * > cells;
+        std::vector < double > t;
+        Index nModel = J_->cols();
+
+        for (Index i = start_; i < end_; i ++){
+            const RVector3 & a = (*shots_)[i];
+            const RVector3 & b = (*receivers_)[i];
+            double length = a.dist(b);
+            if (length == 0.0 || !(*startCells_)[i]) continue;
+
+            cells.clear();
+            t.clear();
+            mesh_->walkRay((*startCells_)[i], a, (b - a) / length, length, tol_,
+                           cells, t);
+
+            for (Index k = 0; k < cells.size(); k ++){
+                SIndex marker = cells[k]->marker();
+                if (marker >= 0 && Index(marker) < nModel){
+                    J_->addVal(i, marker, t[k + 1] - t[k], tNr);
+                }
+            }
+        }
+    }
+
+protected:
+    const Mesh * mesh_;
+    const R3Vector * shots_;
+    const R3Vector * receivers_;
+    const std::vector < Cell * > * startCells_;
+    double tol_;
+    RSparseAssembler * J_;
+};
+
+void StraightRayModelling::createJacobian(const RVector & slowness) {
+    Stopwatch swatch(true);
+    if (!dataContainer_) throwError(1, "We have no dataContainer defined");
+    if (!mesh_) throwError(1, "We have no mesh defined");
+
+    Index nData = dataContainer_->size();
+    Index nModel = slowness.size();
+
+    //** the rays do not depend on the slowness, mesh and data changes clear J
+    RSparseMatrix * J0 = dynamic_cast < RSparseMatrix * >(jacobian_);
+    if (J0 && J0->rows() == nData && J0->cols() == nModel) return;
+
+    //** the start cells are searched serially, findCell is not thread safe
+    R3Vector shots(nData), receivers(nData);
+    std::vector < Cell * > startCells(nData, NULL);
+    Index nMissed = 0;
+    for (Index i = 0; i < nData; i ++){
+        shots[i] = dataContainer_->sensorPosition((Index)(*dataContainer_)("s")[i]);
+        receivers[i] = dataContainer_->sensorPosition((Index)(*dataContainer_)("g")[i]);
+        if (shots[i] != receivers[i]){
+            startCells[i] = mesh_->findRayStartCell(shots[i],
+                                                    receivers[i] - shots[i]);
+            if (!startCells[i]) nMissed ++;
+        }
+    }
+    if (nMissed > 0){
+        log(Warning, str(nMissed) + " of " + str(nData) + " rays do not hit "
+            "the mesh, their travel times are zero.");
+    }
+    double tol = 1e-10 * std::max(1.0, mesh_->boundingBox().max().dist(
+                                        mesh_->boundingBox().min()));
+
+    Index nThreads = getEnvironment("GIMLI_NUM_THREADS", 0, verbose_);
+    if (nThreads > 0) this->setThreadCount(nThreads);
+    nThreads = std::max(Index(1), std::min(this->threadCount(),
+                                           Index(nData / 100 + 1)));
+
+    RSparseAssembler J(nData, nModel, nThreads);
+    if (nData > 0){
+        distributeCalc(CreateStraightRayMT(*mesh_, shots, receivers, startCells,
+                                           tol, J, verbose_),
+                       nData, nThreads, verbose_);
+    }
+
+    IndexArray rowPtr, colIdx;
+    RVector vals;
+    J.compress(rowPtr, colIdx, vals);
+    std::vector < int > ptr(rowPtr.size()), idx(colIdx.size());
+    for (Index i = 0; i < ptr.size(); i ++) ptr[i] = rowPtr[i];
+    for (Index i = 0; i < idx.size(); i ++) idx[i] = colIdx[i];
+
+    if (!dynamic_cast < RSparseMatrix * >(jacobian_)) this->initJacobian();
+    *dynamic_cast < RSparseMatrix * >(jacobian_) =
+        RSparseMatrix(nData, nModel, ptr, idx, vals);
+
+    if (verbose_){
+        std::cout << "J(" << nThreads << ") " << nData << " rays, "
+                  << vals.size() << " values: " << swatch.duration(true)
+                  << " s" << std::endl;
+    }
+}
+
+RSparseMatrix & StraightRayModelling::rayMatrix_(Index nModel){
+    this->createJacobian(RVector(nModel, 0.0));
+    return *dynamic_cast < RSparseMatrix * >(jacobian_);
+}
+
+RVector StraightRayModelling::response(const RVector & slowness) {
+    if (!dataContainer_) throwError(1, "We have no dataContainer defined");
+    return rayMatrix_(slowness.size()).mult(slowness);
+}
+
+RVector StraightRayModelling::rayLengths() const {
+    RSparseMatrix * J = dynamic_cast < RSparseMatrix * >(jacobian_);
+    if (!J || J->rows() == 0) return RVector(0);
+    return J->mult(RVector(J->cols(), 1.0));
+}
+
+} // namespace GIMLI
@@ -0,0 +1,85 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_STRAIGHTRAYMODELLING__H
+#define _GIMLI_STRAIGHTRAYMODELLING__H
+
+#include "gimli.h"
+#include "modellingbase.h"
+#include "sparsematrix.h"
+
+namespace GIMLI{
+
+//! Modelling class for travel time tomography with straight rays
+/*! StraightRayModelling(mesh, datacontainer)
+ * The data container needs the shot and receiver indices "s" and "g" and
+ * the travel times "t". The rays from shot to receiver are traced exactly
+ * through the mesh (\ref Mesh::walkRay), so the Jacobian holds the ray
+ * lengths in each model cell. It is a sparse matrix in compressed row
+ * storage, built in parallel over the rays, and does not depend on the
+ * slowness. The response is the Jacobian times the slowness. Cells with a
+ * marker outside the parameter range, e.g., background cells, are
+ * ignored. */
+class DLLEXPORT StraightRayModelling : public ModellingBase {
+public:
+    StraightRayModelling(bool verbose=false);
+
+    StraightRayModelling(Mesh & mesh, DataContainer & dataContainer,
+                         bool verbose=false);
+
+    virtual ~StraightRayModelling() { }
+
+    /*! Interface. Homogeneous model with the median apparent slowness. */
+    virtual RVector createDefaultStartModel();
+
+    /*! Interface. Calculate the travel times for the slowness. */
+    virtual RVector response(const RVector & slowness);
+
+    /*! Interface. Trace the rays and fill the ray lengths into the
+     * Jacobian. Only the size of the slowness is used, so an existing
+     * Jacobian of the right size is kept. Rays that do not hit the mesh
+     * give zero rows and a warning. */
+    virtual void createJacobian(const RVector & slowness);
+
+    /*! Interface. */
+    virtual void initJacobian();
+
+    /*! Return the travel time divided by the distance of shot and receiver. */
+    RVector getApparentSlowness() const;
+
+    /*! Return the median of \ref getApparentSlowness. */
+    double findMedianSlowness() const;
+
+    /*! Return the total lengths of the rays inside the mesh. They differ
+     * from the shot-receiver distances if the rays leave the mesh. */
+    RVector rayLengths() const;
+
+protected:
+    /*! Rays change with the mesh. */
+    virtual void updateMeshDependency_();
+
+    /*! Rays change with the data. */
+    virtual void updateDataDependency_();
+
+    /*! Return the Jacobian with at least nModel columns, build it if needed. */
+    RSparseMatrix & rayMatrix_(Index nModel);
+};
+
+} // namespace GIMLI
+
+#endif // _GIMLI_STRAIGHTRAYMODELLING__H
@@ -0,0 +1,228 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "timelapsemodelling.h"
+
+#include "calculateMultiThread.h"
+#include "interpolate.h"
+#include "matrix.h"
+#include "stopwatch.h"
+#include "vectortemplates.h"
+
+namespace GIMLI{
+
+TimeLapseModelling::TimeLapseModelling(ModellingBase & fop, Index nFrames,
+                                       bool verbose)
+    : ModellingBase(verbose){
+    fops_.push_back(&fop);
+    init_(nFrames);
+}
+
+TimeLapseModelling::TimeLapseModelling(const std::vector < ModellingBase * > & fops,
+                                       Index nFrames, bool verbose)
+    : ModellingBase(verbose), fops_(fops){
+    init_(nFrames);
+}
+
+TimeLapseModelling::~TimeLapseModelling(){
+    for_each(frameJacobian_.begin(), frameJacobian_.end(), deletePtr());
+}
+
+void TimeLapseModelling::init_(Index nFrames){
+    if (fops_.empty() || nFrames == 0){
+        throwError(1, WHERE_AM_I + " need at least one forward operator and one frame.");
+    }
+    nFrames_ = nFrames;
+    nModel_ = 0;
+    temporalWeight_ = 1.0;
+    //** more operators than frames are useless
+    if (fops_.size() > nFrames_) fops_.resize(nFrames_);
+
+    lastModel_.resize(fops_.size());
+    frameResponse_.resize(nFrames_);
+    if (fops_.size() < nFrames_) frameJacobian_.resize(nFrames_, NULL);
+
+    setJacobian(&J_);
+    setConstraints(&C_);
+}
+
+Index TimeLapseModelling::frameModelSize(){
+    if (nModel_ == 0) nModel_ = fops_[0]->startModel().size();
+    return nModel_;
+}
+
+RVector TimeLapseModelling::frameModel(const RVector & model, Index i){
+    Index n = frameModelSize();
+    if (model.size() != n * nFrames_){
+        throwLengthError(1, WHERE_AM_I + " model size " + str(model.size())
+                         + " != " + str(n) + " * " + str(nFrames_));
+    }
+    return model(i * n, (i + 1) * n);
+}
+
+Index TimeLapseModelling::frameStart(Index f) const {
+    return (f * nFrames_) / fops_.size();
+}
+
+ModellingBase * TimeLapseModelling::frameOperator(Index i) const {
+    for (Index f = 0; f < fops_.size(); f ++){
+        if (i < frameStart(f + 1)) return fops_[f];
+    }
+    return fops_.back();
+}
+
+RMatrix TimeLapseModelling::forwardMeshFrames(const RMatrix & paraNodeValues){
+    if (paraNodeValues.rows() != nFrames_){
+        throwLengthError(1, WHERE_AM_I + " " + str(paraNodeValues.rows()) +
+                            " != " + str(nFrames_));
+    }
+    RMatrix ret;
+    for (Index f = 0; f < fops_.size(); f ++){
+        RMatrix frames;
+        for (Index i = frameStart(f); i < frameStart(f + 1); i ++){
+            frames.push_back(paraNodeValues[i]);
+        }
+        if (frames.rows() == 0) continue;
+        RMatrix fwd(fops_[f]->paraMeshInterpolation().apply(frames));
+        for (Index i = 0; i < fwd.rows(); i ++) ret.push_back(fwd[i]);
+    }
+    return ret;
+}
+
+RVector TimeLapseModelling::createDefaultStartModel(){
+    RVector m(fops_[0]->startModel());
+    nModel_ = m.size();
+    RVector ret(nModel_ * nFrames_);
+    for (Index i = 0; i < nFrames_; i ++) ret.setVal(m, i * nModel_, (i + 1) * nModel_);
+    return ret;
+}
+
+void TimeLapseModelling::calculateFrames(Index f, const RVector & model,
+                                         bool jacobian){
+    ModellingBase * fop = fops_[f];
+    for (Index i = frameStart(f); i < frameStart(f + 1); i ++){
+        RVector m(frameModel(model, i));
+        //** e.g. the DC Jacobian needs the potentials of its model
+        if (!jacobian || lastModel_[f].size() != m.size() || !(lastModel_[f] == m)){
+            frameResponse_[i] = fop->response(m);
+            lastModel_[f] = m;
+        }
+        if (!jacobian) continue;
+
+        fop->createJacobian(m);
+        if (frameJacobian_.size()){
+            RMatrix * J = dynamic_cast< RMatrix * >(fop->jacobian());
+            if (!J){
+                throwError(1, WHERE_AM_I + " shared forward operators need a RMatrix Jacobian.");
+            }
+            if (!frameJacobian_[i]) frameJacobian_[i] = new RMatrix(*J);
+            else *frameJacobian_[i] = *J;
+        }
+    }
+}
+
+class TimeLapseModellingMT : public BaseCalcMT{
+public:
+    TimeLapseModellingMT(TimeLapseModelling & fop, const RVector & model,
+                         bool jacobian)
+    : BaseCalcMT(false), fop_(&fop), model_(&model), jacobian_(jacobian){
+    }
+
+    virtual ~TimeLapseModellingMT(){}
+
+    virtual void calc(Index tNr=0){
+        for (Index f = start_; f < end_; f ++){
+            fop_->calculateFrames(f, *model_, jacobian_);
+        }
+    }
+
+protected:
+    TimeLapseModelling * fop_;
+    const RVector * model_;
+    bool jacobian_;
+};
+
+RVector TimeLapseModelling::response(const RVector & model){
+    frameModelSize();
+    Index nThreads = std::max(Index(1), std::min(threadCount(), Index(fops_.size())));
+    distributeCalc(TimeLapseModellingMT(*this, model, false), fops_.size(), nThreads);
+
+    Index nData = 0;
+    for (Index i = 0; i < nFrames_; i ++) nData += frameResponse_[i].size();
+    RVector ret(nData);
+    nData = 0;
+    for (Index i = 0; i < nFrames_; i ++){
+        ret.setVal(frameResponse_[i], nData, nData + frameResponse_[i].size());
+        nData += frameResponse_[i].size();
+    }
+    return ret;
+}
+
+void TimeLapseModelling::createJacobian(const RVector & model){
+    Stopwatch swatch(true);
+    Index n = frameModelSize();
+    Index nThreads = std::max(Index(1), std::min(threadCount(), Index(fops_.size())));
+    distributeCalc(TimeLapseModellingMT(*this, model, true), fops_.size(), nThreads);
+
+    J_.clear();
+    Index rowStart = 0;
+    for (Index i = 0; i < nFrames_; i ++){
+        MatrixBase * J = frameJacobian_.size() ? frameJacobian_[i] : fops_[i]->jacobian();
+        J_.addMatrix(J, rowStart, i * n);
+        rowStart += J->rows();
+    }
+    if (verbose_) std::cout << "Time-lapse Jacobian: " << J_.rows() << " x "
+                            << J_.cols() << " (" << swatch.duration() << "s)" << std::endl;
+}
+
+void TimeLapseModelling::createConstraints(){
+    ModellingBase * fop = fops_[0];
+    fop->initConstraints();
+    if (fop->constraints()->rows() == 0) fop->createConstraints();
+    MatrixBase * Cs = fop->constraints();
+
+    Index n = frameModelSize();
+    Index nC = Cs->rows();
+
+    Ct_.clear();
+    Ct_.resize((nFrames_ - 1) * n, nFrames_ * n);
+    Index k = Ct_.addTerms((nFrames_ - 1) * n);
+    for (Index t = 0; t + 1 < nFrames_; t ++){
+        for (Index j = 0; j < n; j ++){
+            Ct_.setTerm(k + t * n + j, t * n + j, (t + 1) * n + j, t * n + j,
+                        temporalWeight_, -temporalWeight_);
+        }
+    }
+
+    C_.clear();
+    Index cs = C_.addMatrix(Cs);
+    for (Index t = 0; t < nFrames_; t ++) C_.addMatrixEntry(cs, t * nC, t * n);
+    if (nFrames_ > 1) C_.addMatrix(&Ct_, nFrames_ * nC, 0);
+
+    regionManager().setParameterCount(nFrames_ * n);
+
+    //** the weights of the spatial constraints for each frame, the
+    //** temporal weight is part of the temporal constraints
+    RVector cw(fop->regionManager().createConstraintsWeight());
+    if (cw.size() != nC) cw.resize(nC, 1.0);
+    RVector w(C_.rows(), 1.0);
+    for (Index t = 0; t < nFrames_; t ++) w.setVal(cw, t * nC, (t + 1) * nC);
+    regionManager().setConstraintsWeight(w);
+}
+
+} // namespace GIMLI
@@ -0,0 +1,119 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2018 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_TIMELAPSEMODELLING__H
+#define _GIMLI_TIMELAPSEMODELLING__H
+
+#include "gimli.h"
+#include "blockmatrix.h"
+#include "modellingbase.h"
+#include "regionManager.h"
+
+namespace GIMLI{
+
+//! Joint (4D) inversion of time-lapse frames.
+/*! The model is the concatenation of the models of nFrames frames and the
+ * response the concatenation of the frame responses of the forward
+ * operator(s). The Jacobian is block diagonal with the frame Jacobians.
+ * The constraints are the constraints of the forward operator for each
+ * frame and first order differences of each parameter between neighbouring
+ * frames, weighted with \ref setTemporalWeight.
+ *
+ * The frames are given in consecutive chunks to the forward operators and
+ * the operators are calculated in parallel. If there are less operators
+ * than frames, an operator calculates a sequence of similar models and
+ * can reuse its factorization, e.g.,
+ * \ref DCMultiElectrodeModelling::setFactorizationReuse.
+ * The forward operators need own meshes and a RMatrix Jacobian if they
+ * calculate more than one frame. */
+class DLLEXPORT TimeLapseModelling : public ModellingBase{
+public:
+    /*! All frames are calculated by fop. */
+    TimeLapseModelling(ModellingBase & fop, Index nFrames, bool verbose=false);
+
+    /*! The frames are distributed to the forward operators fops. */
+    TimeLapseModelling(const std::vector < ModellingBase * > & fops,
+                       Index nFrames, bool verbose=false);
+
+    virtual ~TimeLapseModelling();
+
+    /*! Return the concatenated responses of all frames. */
+    virtual RVector response(const RVector & model);
+
+    /*! Start model of the forward operator for each frame. */
+    virtual RVector createDefaultStartModel();
+
+    /*! Calculate the Jacobian of all frames. */
+    virtual void createJacobian(const RVector & model);
+
+    /*! Build spatial and temporal constraints. */
+    virtual void createConstraints();
+
+    /*! Set the weight of the temporal constraints (default 1). */
+    void setTemporalWeight(double w) { temporalWeight_ = w; }
+
+    double temporalWeight() const { return temporalWeight_; }
+
+    /*! Return the number of frames. */
+    inline Index frameCount() const { return nFrames_; }
+
+    /*! Return the model size of a single frame. */
+    Index frameModelSize();
+
+    /*! Return the model of frame i. */
+    RVector frameModel(const RVector & model, Index i);
+
+    /*! Return the forward operator calculating frame i. */
+    ModellingBase * frameOperator(Index i) const;
+
+    /*! Return the first frame calculated by forward operator f.
+     * The last is frameStart(f + 1) - 1. */
+    Index frameStart(Index f) const;
+
+    /*! Interpolate node values of the parameter mesh, one row per frame,
+     * to the nodes of the forward mesh of the frame operator. Each forward
+     * operator builds its \ref ModellingBase::paraMeshInterpolation once and
+     * applies it to all of its frames at once. */
+    RMatrix forwardMeshFrames(const RMatrix & paraNodeValues);
+
+    /*! Calculate frames [frameStart(f), frameStart(f + 1)) with operator f.
+     * Used by the threads. */
+    void calculateFrames(Index f, const RVector & model, bool jacobian);
+
+protected:
+    void init_(Index nFrames);
+
+    std::vector < ModellingBase * > fops_;
+    Index nFrames_;
+    Index nModel_;
+    double temporalWeight_;
+
+    /*! The model of the last response of each forward operator */
+    std::vector < RVector > lastModel_;
+    std::vector < RVector > frameResponse_;
+    /*! Copies of the frame Jacobians if operators are shared */
+    std::vector < RMatrix * > frameJacobian_;
+
+    RBlockMatrix J_;
+    RBlockMatrix C_;
+    DifferenceOperator Ct_;
+};
+
+} // namespace GIMLI
+
+#endif // _GIMLI_TIMELAPSEMODELLING__H
@@ -449,8 +449,8 @@ void TravelTimeDijkstraModelling::createJacobian(RSparseMapMatrix & jacobian,
     Index nModel = slowness.size();
 
     jacobian.clear();
-    jacobian.setRows(nData);
-    jacobian.setCols(nModel);
+    //** collect the entries without map insertion, see SparseAssembler
+    RSparseAssembler J(nData, nModel);
 
     //** for each shot: vector<  way(shot->geoph) >;
     wayMatrix_.clear();
@@ -523,10 +523,14 @@ void TravelTimeDijkstraModelling::createJacobian(RSparseMapMatrix & jacobian,
             }
 
             for (const auto &c : neighborCells){
-                jacobian[dataIdx][c->marker()] += edgeLength / neighborCells.size();
+                //** background cells carry no model parameter
+                if (c->marker() < 0 || Index(c->marker()) >= nModel) continue;
+                J.addVal(dataIdx, c->marker(), edgeLength / neighborCells.size());
             } 
         }
     }
+    jacobian.assemble(J);
+
     if (verbose){
         std::cout << "/" << swatch.duration(true) << " ";
     }
@@ -19,8 +19,139 @@
 #include "gimli.h"
 #include "vector.h"
 #include "elementmatrix.h"
+#include "calculateMultiThread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
 
 namespace GIMLI{
+
+static Index __GIMLI_VECTOR_PARALLEL_SIZE__ = 262144;
+
+void setVectorParallelSize(Index n){ __GIMLI_VECTOR_PARALLEL_SIZE__ = n; }
+Index vectorParallelSize(){ return __GIMLI_VECTOR_PARALLEL_SIZE__; }
+
+static long processId_(){
+#ifdef _WIN32
+    return _getpid();
+#else
+    return getpid();
+#endif
+}
+
+//! Persistent worker threads for the chunked evaluation of vector expressions.
+/*! The workers are detached and wait for the next job. Only one job runs
+ * at a time, concurrent callers get false and evaluate serially. */
+class VectorThreadPool{
+public:
+    struct Job{
+        VectorChunkFunction f;
+        const void * ctx;
+        Index n;
+        Index nChunks;
+        std::atomic < Index > next;
+    };
+
+    VectorThreadPool()
+        : pid_(processId_()), job_(NULL), generation_(0), users_(0), nWorkers_(0){
+    }
+
+    inline long pid() const { return pid_; }
+
+    bool run(VectorChunkFunction f, const void * ctx, Index n, Index nChunks){
+        std::unique_lock < std::mutex > busy(busy_, std::try_to_lock);
+        if (!busy.owns_lock()) return false;
+
+        while (nWorkers_ + 1 < nChunks){
+            std::thread(&VectorThreadPool::worker_, this).detach();
+            nWorkers_ ++;
+        }
+
+        Job job;
+        job.f = f;
+        job.ctx = ctx;
+        job.n = n;
+        job.nChunks = nChunks;
+        job.next = 0;
+        {
+            std::lock_guard < std::mutex > lock(mutex_);
+            job_ = &job;
+            generation_ ++;
+        }
+        wake_.notify_all();
+
+        work_(job);
+
+        //** every chunk is taken, wait for the workers still busy with one
+        std::unique_lock < std::mutex > lock(mutex_);
+        finished_.wait(lock, [this]{ return users_ == 0; });
+        job_ = NULL;
+        return true;
+    }
+
+protected:
+    void work_(Job & job){
+        for (Index c = job.next ++; c < job.nChunks; c = job.next ++){
+            job.f(job.ctx, (c * job.n) / job.nChunks, ((c + 1) * job.n) / job.nChunks);
+        }
+    }
+
+    void worker_(){
+        std::unique_lock < std::mutex > lock(mutex_);
+        Index seen = generation_;
+        while (true){
+            wake_.wait(lock, [&]{ return generation_ != seen; });
+            seen = generation_;
+            Job * job = job_;
+            if (!job) continue;
+
+            users_ ++;
+            lock.unlock();
+            work_(*job);
+            lock.lock();
+            users_ --;
+            if (users_ == 0) finished_.notify_all();
+        }
+    }
+
+    long pid_;
+    std::mutex busy_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    Job * job_;
+    Index generation_;
+    Index users_;
+    Index nWorkers_;
+};
+
+static std::mutex __GIMLI_VECTOR_POOL_MUTEX__;
+static VectorThreadPool * __GIMLI_VECTOR_POOL__ = NULL;
+
+bool evalVectorChunks(VectorChunkFunction f, const void * ctx,
+                      Index n, Index nChunks){
+    //** nested in a threaded calculation the threads are busy anyway
+    if (nChunks < 2 || insideCalcMT()) return false;
+    VectorThreadPool * pool = NULL;
+    {
+        std::lock_guard < std::mutex > lock(__GIMLI_VECTOR_POOL_MUTEX__);
+        //** the workers do not survive fork(), so the child needs a new
+        //** pool; the old one is left alone since it may be locked.
+        if (!__GIMLI_VECTOR_POOL__ || __GIMLI_VECTOR_POOL__->pid() != processId_()){
+            __GIMLI_VECTOR_POOL__ = new VectorThreadPool();
+        }
+        pool = __GIMLI_VECTOR_POOL__;
+    }
+    return pool->run(f, ctx, n, nChunks);
+}
     
 template<>
 void Vector<double>::add(const ElementMatrix < double >& A){
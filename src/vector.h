@@ -34,12 +34,24 @@
 
 #define EXPRVEC_USE_TEMPORARY_EXPRESSION
 
-//#define EXPRVEC_USE_BOOST_THREAD // case 1
-//#define EXPRVEC_USE_STD_ALGORITHM // case 2
-#define EXPRVEC_USE_INDIRECTION // case 3 #current default
+/*! Alignment in bytes of the Vector storage (one cache line). */
+#define GIMLI_VECTOR_ALIGNMENT 64
+
+/*! The iterations of an expression assignment are independent, every
+ * expression reads only the element it writes. */
+#if defined(__clang__)
+    #define GIMLI_VECTORIZE_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+    #define GIMLI_VECTORIZE_LOOP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+    #define GIMLI_VECTORIZE_LOOP __pragma(loop(ivdep))
+#else
+    #define GIMLI_VECTORIZE_LOOP
+#endif
 
 #include "gimli.h"
 #include "expressions.h"
+#include "memwatch.h"
 
 #include <string>
 #include <vector>
@@ -50,7 +62,13 @@
 #include <cstring>
 #include <fstream>
 #include <cerrno>
+#include <cstdlib>
 #include <iterator>
+#include <new>
+
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
 
 #ifdef USE_BOOST_BIND
     #include <boost/bind.hpp>
@@ -74,6 +92,43 @@ inline void Dump(const void * mem, unsigned int n) {
 }
 #endif
 
+/*! Set the minimal size of a vector expression to be evaluated in
+ * parallel chunks on \ref threadCount() threads (default 262144).
+ * 0 disables the parallel evaluation. */
+DLLEXPORT void setVectorParallelSize(Index n);
+DLLEXPORT Index vectorParallelSize();
+
+#ifndef PYGIMLI_CAST
+typedef void (*VectorChunkFunction)(const void * ctx, Index start, Index end);
+
+/*! Call f(ctx, start, end) for nChunks consecutive chunks of [0, n) on a
+ * shared pool of persistent worker threads and the calling thread.
+ * Return false without any call if the pool is busy, e.g., for calls
+ * from other threads, the caller then needs to evaluate serially. */
+DLLEXPORT bool evalVectorChunks(VectorChunkFunction f, const void * ctx,
+                                Index n, Index nChunks);
+#endif
+
+/*! Allocate n bytes aligned to GIMLI_VECTOR_ALIGNMENT. */
+inline void * alignedMalloc(Index n){
+    void * p = NULL;
+#ifdef _WIN32
+    p = _aligned_malloc(std::max(n, Index(1)), GIMLI_VECTOR_ALIGNMENT);
+#else
+    if (posix_memalign(&p, GIMLI_VECTOR_ALIGNMENT, std::max(n, Index(1)))) p = NULL;
+#endif
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+inline void alignedFree(void * p){
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
 template < class ValueType > class DLLEXPORT VectorIterator {
 public:
     typedef ValueType value_type;
@@ -191,13 +246,13 @@ public:
 // this constructor is dangerous for IndexArray in pygimli ..
 // there is an autocast from int -> IndexArray(int)
     Vector()
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
     // explicit Vector(Index n = 0) : data_(NULL), begin_(NULL), end_(NULL) {
         resize(0);
         clean();
     }
     Vector(Index n)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
     // explicit Vector(Index n = 0) : data_(NULL), begin_(NULL), end_(NULL) {
         resize(n);
         clean();
@@ -207,7 +262,7 @@ public:
      * Construct one-dimensional array of size n, and fill it with val
      */
     Vector(Index n, const ValueType & val)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(n);
         fill(val);
     }
@@ -216,7 +271,7 @@ public:
      * Construct vector from file. Shortcut for Vector::load
      */
     Vector(const std::string & filename, IOFormat format=Ascii)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         this->load(filename, format);
     }
 
@@ -224,7 +279,7 @@ public:
      * Copy constructor. Create new vector as a deep copy of v.
      */
     Vector(const Vector< ValueType > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(v.size());
         copy_(v);
     }
@@ -233,7 +288,7 @@ public:
      * Copy constructor. Create new vector as a deep copy of the slice v[start, end)
      */
     Vector(const Vector< ValueType > & v, Index start, Index end)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(end - start);
         std::copy(&v[start], &v[end], data_);
     }
@@ -242,7 +297,7 @@ public:
      * Copy constructor. Create new vector from expression
      */
     template < class A > Vector(const __VectorExpr< ValueType, A > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(v.size());
         assign_(v);
     }
@@ -252,14 +307,14 @@ public:
      * Copy constructor. Create new vector as a deep copy of std::vector(Valuetype)
      */
     Vector(const std::vector< ValueType > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(v.size());
         for (Index i = 0; i < v.size(); i ++) data_[i] = v[i];
         //std::copy(&v[0], &v[v.size()], data_);
     }
 
     template < class ValueType2 > Vector(const Vector< ValueType2 > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), ownsData_(true), memoryTag_(MEMORY_OTHER){
         resize(v.size());
         for (Index i = 0; i < v.size(); i ++) data_[i] = ValueType(v[i]);
         //std::copy(&v[0], &v[v.size()], data_);
@@ -690,12 +745,15 @@ DEFINE_UNARY_MOD_OPERATOR__(*, MULT)
 //         __MS(n << " " << capacity_ << " " << newCapacity)
 
         if (newCapacity != capacity_) {
-            ValueType * buffer = new ValueType[newCapacity];
+            MemoryTag tag = memoryTag();
+            ValueType * buffer = allocate_(newCapacity, tag);
 
             std::memcpy(buffer, data_, sizeof(ValueType) * min(capacity_, newCapacity));
-            if (data_)  delete [] data_;
+            if (data_ && ownsData_) deallocate_(data_, capacity_, memoryTag_);
             data_  = buffer;
+            memoryTag_ = tag;
             capacity_ = newCapacity;
+            ownsData_ = true;
             //std::copy(&tmp[0], &tmp[min(tmp.size(), n)], data_);
         }
      }
@@ -740,6 +798,26 @@ DEFINE_UNARY_MOD_OPERATOR__(*, MULT)
     /*! Empty the vector. Frees memory and resize to 0.*/
     void clear(){ free_(); }
 
+    /*! Use the external memory [data, data + n) as storage without copying,
+     * e.g., the buffer of a numpy array or a memory mapped file.
+     * The old content is freed. The vector does not own the memory,
+     * so the caller needs to keep the buffer alive during the lifetime
+     * of this vector. Any reallocation, i.e., resize to a different size,
+     * copies the content into an own buffer and decouples the vector
+     * from the external memory. */
+    Vector< ValueType > & wrap(ValueType * data, Index n){
+        free_();
+        data_ = data;
+        size_ = n;
+        capacity_ = n;
+        ownsData_ = false;
+        return *this;
+    }
+
+    /*! Return false if the vector only refers to external memory,
+     * see \ref wrap. */
+    inline bool ownsData() const { return ownsData_; }
+
     /*! Round all values of this array to a given tolerance. */
     Vector< ValueType > & round(const ValueType & tolerance){
 #ifdef USE_BOOST_BIND
@@ -759,10 +837,6 @@ tolerance);
 
     inline Index capacity() const { return capacity_; }
 
-    inline Index nThreads() const { return nThreads_; }
-
-    inline Index singleCalcCount() const { return singleCalcCount_; }
-
     ValueType * data() { return data_; }
 
     /*! Save the object to file. Returns true on success and in case of trouble an exception is thrown.
@@ -884,10 +958,25 @@ tolerance);
 protected:
 
     void free_(){
+        if (data_ && ownsData_) deallocate_(data_, capacity_, memoryTag_);
         size_ = 0;
         capacity_ = 0;
-        if (data_)  delete [] data_;
         data_  = NULL;
+        ownsData_ = true;
+    }
+
+    /*! Aligned storage for n default initialized values, accounted to tag. */
+    static ValueType * allocate_(Index n, MemoryTag tag){
+        ValueType * buffer = static_cast< ValueType * >(alignedMalloc(sizeof(ValueType) * n));
+        for (Index i = 0; i < n; i ++) new (buffer + i) ValueType;
+        memoryAllocated(tag, sizeof(ValueType) * n);
+        return buffer;
+    }
+
+    static void deallocate_(ValueType * buffer, Index n, MemoryTag tag){
+        for (Index i = 0; i < n; i ++) buffer[i].~ValueType();
+        alignedFree(buffer);
+        memoryReleased(tag, sizeof(ValueType) * n);
     }
 
     void copy_(const Vector< ValueType > & v){
@@ -915,11 +1004,9 @@ protected:
     Index size_;
     ValueType * data_;
     Index capacity_;
-
-    static const Index minSizePerThread = 10000;
-    static const int maxThreads = 8;
-    int nThreads_;
-    Index singleCalcCount_;
+    bool ownsData_;
+    /*! Tag the own storage is accounted to */
+    MemoryTag memoryTag_;
 };
 
 // /*! Implement specialized type traits in vector.cpp */
@@ -939,10 +1026,18 @@ public:
     AssignResult(Vector< ValueType > & a, const Iter & result, Index start, Index end)
      : a_(&a), iter_(result), start_(start), end_(end){
     }
-    void operator()() {
+    void operator()() { assign(start_, end_); }
+
+    /*! Evaluate the expression for [start, end). */
+    inline void assign(Index start, Index end) const {
         ValueType * iter = a_->begin().ptr();
-        //std::cout << start_ << " " << end_ << std::endl;
-        for (Index i = start_; i < end_; i++) iter[i] = iter_[i];
+        const Iter & result = iter_;
+        GIMLI_VECTORIZE_LOOP
+        for (Index i = start; i < end; i ++) iter[i] = result[i];
+    }
+
+    static void chunk(const void * ctx, Index start, Index end){
+        static_cast< const AssignResult< ValueType, Iter > * >(ctx)->assign(start, end);
     }
 
     Vector< ValueType > * a_;
@@ -953,57 +1048,30 @@ public:
 
 struct BINASSIGN { template < class T > inline T operator()(const T & a, const T & b) const { return b; } };
 
+/*! Evaluate the expression result into v. The elements are indexed
+ * independently so the loop vectorizes. Expressions of at least
+ * \ref vectorParallelSize() elements are split into \ref threadCount()
+ * chunks that are evaluated on the shared thread pool. */
 template< class ValueType, class Iter > void assignResult(Vector< ValueType > & v, const Iter & result) {
+    Index n = v.size();
+    if (n == 0) return;
 #ifdef EXPRVEC_USE_TEMPORARY_EXPRESSION
-  // Make a temporary copy of the iterator.  This is faster on segmented
-  // architectures, since all the iterators are in the same segment.
-    Iter result2 = result;
+    // Make a temporary copy of the iterator.  This is faster on segmented
+    // architectures, since all the iterators are in the same segment.
+    typedef AssignResult< ValueType, Iter > Assign;
 #else
-    // Otherwise, cast away const (eek!).  No harmful side effects.
-    Iter& result2 = (Iter&)result;
+    typedef AssignResult< ValueType, const Iter & > Assign;
 #endif
+    Assign a(v, result, 0, n);
 
-
-#ifdef EXPRVEC_USE_BOOST_THREAD
-//DEPRECATED
-#error DONT  USE THIS
-    if (v.nThreads() == 1) {
-      AssignResult< ValueType, Iter >(v, result, 0, v.size())();
-    } else {
-      boost::thread_group threads;
-      for (Index i = 0; i < v.nThreads(); i ++){
-	Index start = v.singleCalcCount() * i;
-	Index end   = v.singleCalcCount() * (i + 1);
-	if (i == v.nThreads() -1) end = v.size();
-	threads.create_thread(AssignResult< ValueType, Iter >(v, result, start, end));
-      }
-      threads.join_all();
-    }
-#else // no boost thread
-    #ifdef EXPRVEC_USE_STD_ALGORITHM
-
-    std::transform(v.begin().ptr(),
-                   v.end().ptr(),
-                   result,
-                   v.begin().ptr(), BINASSIGN());
-
-    #else  // no std algo
-        #ifdef EXPRVEC_USE_INDIRECTION
-            ValueType * iter = v.begin().ptr();
-
-            // Inlined expression
-            for (Index i = v.size(); i--;) iter[i] = result2[i];
-        #else
-            ValueType * iter = v.begin().ptr();
-            ValueType * end  = v.end().ptr();
-
-            do {
-                *iter = *result2;       // Inlined expression
-                ++result2;
-            } while (++iter != end);
-        #endif
-    #endif
+#ifndef PYGIMLI_CAST
+    Index minSize = vectorParallelSize();
+    if (minSize > 0 && n >= minSize){
+        Index nChunks = std::min(threadCount(), n / std::max(Index(1), minSize / 4));
+        if (nChunks > 1 && evalVectorChunks(&Assign::chunk, &a, n, nChunks)) return;
+    }
 #endif
+    a.assign(0, n);
 }
 
 template< class ValueType, class A > class __VectorExpr {
@@ -7,6 +7,7 @@
 #include <datacontainer.h>
 #include <pos.h>
 
+#include <fstream>
 #include <stdexcept>
 
 using namespace GIMLI;
@@ -93,7 +94,62 @@ public:
     }   
     
     void testIO(){
-        
+        DataContainer data;
+        for (uint i = 0; i < 5; i++) data.createSensor(RVector3(double(i), 0.0, -0.5 * i));
+        data.registerSensorIndex("a");
+        data.registerSensorIndex("m");
+        data.resize(4);
+        RVector idx(data.size()); idx.fill(x__);
+        data.set("a", idx);
+        data.set("m", idx + 1.0);
+        data.set("rhoa", RVector(data.size(), 0.1) + idx * 1e-13);
+        data.set("valid", RVector(data.size(), 1.0));
+        data.markInvalid(IndexArray(1, 2));
+
+        // ascii with comment, empty row and to few columns
+        std::ofstream file("test.io.dat");
+        file << "5\n# x y z\n";
+        for (uint i = 0; i < 5; i++) file << i << " 0 " << -0.5 * i << "\n";
+        file << "4\n# a m rhoa\n1 2 0.1\n\n# comment\n2 3 1.000000000000000001e-1 # comment\n"
+             << "3 4 nan\n4\t5\n0\n";
+        file.close();
+        DataContainer asc("test.io.dat", "a m", true, false);
+        CPPUNIT_ASSERT(asc.size() == 4);
+        CPPUNIT_ASSERT(asc("a") == idx);
+        CPPUNIT_ASSERT(asc("rhoa")[0] == 0.1);
+        CPPUNIT_ASSERT(asc("rhoa")[1] == 0.1);
+        CPPUNIT_ASSERT(asc("rhoa")[3] == 0.0);
+        CPPUNIT_ASSERT(asc("valid")[2] == 0.0);
+
+        data.saveBinary("test.io.bdat");
+        DataContainer bin;
+        bin.loadBinary("test.io.bdat");
+        CPPUNIT_ASSERT(bin.size() == data.size());
+        CPPUNIT_ASSERT(bin.sensorCount() == data.sensorCount());
+        CPPUNIT_ASSERT(bin.sensorPosition(4) == data.sensorPosition(4));
+        CPPUNIT_ASSERT(bin.isSensorIndex("m"));
+        CPPUNIT_ASSERT(bin("m") == data("m"));
+        CPPUNIT_ASSERT(bin("rhoa") == data("rhoa"));
+        CPPUNIT_ASSERT(bin("valid") == data("valid"));
+
+        // load recognizes the binary format
+        DataContainer bin2("test.io.bdat", true, true);
+        CPPUNIT_ASSERT(bin2.size() == data.size() - 1);
+
+        // empty container and truncated file
+        DataContainer empty;
+        empty.saveBinary("test.io.empty.bdat");
+        bin.loadBinary("test.io.empty.bdat");
+        CPPUNIT_ASSERT(bin.size() == 0);
+        CPPUNIT_ASSERT(bin.sensorCount() == 0);
+
+        std::ofstream trunc("test.io.trunc.bdat", std::ios::binary);
+        std::ifstream full("test.io.bdat", std::ios::binary);
+        std::vector < char > buf(100);
+        full.read(&buf[0], buf.size());
+        trunc.write(&buf[0], buf.size());
+        trunc.close();
+        CPPUNIT_ASSERT_THROW(bin.loadBinary("test.io.trunc.bdat"), std::exception);
     }
     
     void testEdit(){
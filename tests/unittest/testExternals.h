@@ -6,6 +6,8 @@
 #include <gimli.h>
 #include <triangleWrapper.h>
 #include <cholmodWrapper.h>
+#include <pcgWrapper.h>
+#include <ldltWrapper.h>
 #include <sparsematrix.h>
 #include <mesh.h>
 #include <pos.h>
@@ -14,6 +16,8 @@ class GIMLIExternalTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST_SUITE(GIMLIExternalTest);
     CPPUNIT_TEST(testTriangle);
     CPPUNIT_TEST(testCHOLMOD);
+    CPPUNIT_TEST(testPCG);
+    CPPUNIT_TEST(testLDLT);
     CPPUNIT_TEST_SUITE_END();
     
 public:    
@@ -169,6 +173,67 @@ public:
         testCHOLMODSolve< GIMLI::CSparseMapMatrix, GIMLI::Complex >(SmCN);
         
     }
+
+    void testPCG(){
+        //** 2D Laplacian, large enough for some multigrid levels
+        GIMLI::Index m = 40, n = m * m;
+        GIMLI::RSparseMapMatrix Sm(n, n);
+        for (GIMLI::Index i = 0; i < n; i ++){
+            Sm.setVal(i, i, 4.0 + (i < m ? 1.0 : 0.0));
+            if (i % m > 0) Sm.setVal(i, i - 1, -1.0);
+            if (i % m < m - 1) Sm.setVal(i, i + 1, -1.0);
+            if (i >= m) Sm.setVal(i, i - m, -1.0);
+            if (i < n - m) Sm.setVal(i, i + m, -1.0);
+        }
+        GIMLI::RSparseMatrix S(Sm);
+        GIMLI::RVector b(n, 1.0);
+
+        for (GIMLI::Index p = 0; p < 3; p ++){
+            GIMLI::PCGWrapper solver(S, false, -2, GIMLI::PCGPreconditioner(p));
+            GIMLI::RVector x(n, 0.0);
+            CPPUNIT_ASSERT(solver.solve(b, x) == 1);
+            CPPUNIT_ASSERT(GIMLI::norml2(b - S * x) < 1e-9 * GIMLI::norml2(b));
+            if (p == GIMLI::PCG_AMG) CPPUNIT_ASSERT(solver.levels() > 1);
+
+            //** warm start from the solution
+            solver.solve(b, x);
+            CPPUNIT_ASSERT(solver.iterations() == 0);
+        }
+
+        GIMLI::LinSolver ls(S, GIMLI::PCG);
+        CPPUNIT_ASSERT(GIMLI::norml2(b - S * ls.solve(b)) < 1e-9 * GIMLI::norml2(b));
+    }
+
+    void testLDLT(){
+        //** non-hermetian symmetric
+        GIMLI::Index m = 30, n = m * m;
+        GIMLI::CSparseMapMatrix Sm(n, n);
+        for (GIMLI::Index i = 0; i < n; i ++){
+            GIMLI::Complex c(1.0, 0.1 * (i % 3));
+            Sm.setVal(i, i, c * 4.0 + GIMLI::Complex(0.0, 1.0));
+            if (i % m > 0) Sm.setVal(i, i - 1, -c);
+            if (i % m < m - 1) Sm.setVal(i, i + 1, -GIMLI::Complex(1.0, 0.1 * ((i + 1) % 3)));
+            if (i >= m) Sm.setVal(i, i - m, -c);
+            if (i < n - m) Sm.setVal(i, i + m, -GIMLI::Complex(1.0, 0.1 * ((i + m) % 3)));
+        }
+        GIMLI::CSparseMatrix S(Sm);
+        GIMLI::CVector b(n, GIMLI::Complex(1.0, -1.0));
+        GIMLI::CVector x(n);
+
+        GIMLI::LDLTWrapper solver(S);
+        CPPUNIT_ASSERT(solver.solve(b, x) == 1);
+        CPPUNIT_ASSERT(GIMLI::norm(b - S * x) < 1e-10 * GIMLI::norm(b));
+        CPPUNIT_ASSERT(solver.factorNonZeros() < n * m);
+
+        GIMLI::LinSolver ls(S, GIMLI::LDLT);
+        CPPUNIT_ASSERT(GIMLI::norm(b - S * ls.solve(b)) < 1e-10 * GIMLI::norm(b));
+
+        //** same pattern, new values: the ordering is reused
+        GIMLI::CSparseMatrix S2(S);
+        S2 += S;
+        ls.refactorize(S2);
+        CPPUNIT_ASSERT(GIMLI::norm(b - S2 * ls.solve(b)) < 1e-10 * GIMLI::norm(b));
+    }
     
 };
 
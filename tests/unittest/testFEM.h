@@ -7,6 +7,12 @@
 #include <meshentities.h>
 #include <elementmatrix.h>
 #include <integration.h>
+#include <meshgenerators.h>
+
+#include <bert/bertDataContainer.h>
+#include <bert/bertMisc.h>
+#include <bert/dcfemmodelling.h>
+#include <bert/electrode.h>
 
 class FEMTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST_SUITE(FEMTest);
@@ -16,6 +22,7 @@ class FEMTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testFEM1D);
     CPPUNIT_TEST(testFEM2D);
     CPPUNIT_TEST(testFEM3D);
+    CPPUNIT_TEST(testExactDCSolution);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -68,6 +75,85 @@ public:
         testStiffness3D();
     }
 
+    void testExactDCSolution(){
+        GIMLI::Placeholder x__;
+        GIMLI::RVector x(21); x.fill(x__);
+        GIMLI::RVector z(9); z.fill(x__ - 8.0);
+        GIMLI::Mesh mesh(GIMLI::createMesh3D(x, x, z));
+        CPPUNIT_ASSERT(mesh.nodeCount() > 256);
+
+        std::vector < GIMLI::ElectrodeShape * > elecs;
+        for (GIMLI::Index i = 0; i < 4; i ++){
+            GIMLI::Index n = mesh.findNearestNode(GIMLI::RVector3(4.0 * i, 10.0, 0.0));
+            elecs.push_back(new GIMLI::ElectrodeShapeNode(mesh.node(n)));
+        }
+        elecs.push_back(new GIMLI::ElectrodeShape(GIMLI::RVector3(3.3, 4.4, -1.1)));
+
+        //** all electrodes at once is bit identical to one by one
+        double surfaces[2] = {0.0, -MAX_DOUBLE};
+        double ks[2] = {0.0, 0.3};
+        for (GIMLI::Index s = 0; s < 2; s ++){
+            for (GIMLI::Index j = 0; j < 2; j ++){
+                GIMLI::RMatrix pots;
+                GIMLI::exactDCSolution(pots, mesh, elecs, ks[j], surfaces[s], true, 3);
+                CPPUNIT_ASSERT(pots.rows() == elecs.size());
+                for (GIMLI::Index i = 0; i < elecs.size(); i ++){
+                    CPPUNIT_ASSERT(pots[i] == GIMLI::exactDCSolution(mesh, elecs[i], ks[j],
+                                                                     surfaces[s], true));
+                }
+            }
+        }
+        for (GIMLI::Index i = 0; i < elecs.size(); i ++) delete elecs[i];
+
+        //** the primary potential cache reproduces the calculated potentials
+        GIMLI::Mesh mesh2(GIMLI::createMesh2D(x, z));
+        for (GIMLI::Index i = 0; i < mesh2.boundaryCount(); i ++){
+            if (mesh2.boundary(i).center()[1] == 0.0){
+                mesh2.boundary(i).setMarker(GIMLI::MARKER_BOUND_HOMOGEN_NEUMANN);
+            } else {
+                mesh2.boundary(i).setMarker(GIMLI::MARKER_BOUND_MIXED);
+            }
+        }
+        GIMLI::DataContainerERT data;
+        for (GIMLI::Index i = 0; i < 5; i ++){
+            data.createSensor(GIMLI::RVector3(4.0 * i + 2.0, 0.0));
+        }
+        data.addFourPointData(0, 4, 1, 2);
+        data.addFourPointData(0, 1, 2, 3);
+        data.addFourPointData(1, 4, 2, 3);
+        GIMLI::RVector model(mesh2.cellCount(), 100.0);
+        model[mesh2.findCell(GIMLI::RVector3(10.5, -1.5))->id()] = 10.0;
+
+        GIMLI::DCSRMultiElectrodeModelling fop(mesh2, data);
+        fop.setThreadCount(2);
+        GIMLI::RVector resp(fop.response(model));
+
+        GIMLI::DCSRMultiElectrodeModelling fopLDLT(mesh2, data);
+        fopLDLT.setSolverType(GIMLI::LDLT);
+        CPPUNIT_ASSERT(fopLDLT.solverType() == GIMLI::LDLT);
+        CPPUNIT_ASSERT(GIMLI::norml2(fopLDLT.response(model) - resp) <
+                       1e-8 * GIMLI::norml2(resp));
+
+        GIMLI::DCSRMultiElectrodeModelling fopSave(mesh2, data);
+        fopSave.setPrimaryPotentialCache("test.primpot");
+        CPPUNIT_ASSERT(fopSave.response(model) == resp);
+        GIMLI::Index nK = fopSave.kValues().size();
+        CPPUNIT_ASSERT(fopSave.primaryPotentialCacheHits() == 0);
+        for (GIMLI::Index k = 0; k < nK; k ++){
+            CPPUNIT_ASSERT(GIMLI::fileExist(fopSave.primaryPotentialCacheFile(k)));
+        }
+
+        GIMLI::DCSRMultiElectrodeModelling fopLoad(mesh2, data);
+        fopLoad.setPrimaryPotentialCache("test.primpot");
+        CPPUNIT_ASSERT(fopLoad.response(model) == resp);
+        CPPUNIT_ASSERT(fopLoad.primaryPotentialCacheHits() == nK);
+        for (GIMLI::Index k = 0; k < nK; k ++){
+            CPPUNIT_ASSERT(fopLoad.primaryPotentialCacheFile(k) ==
+                           fopSave.primaryPotentialCacheFile(k));
+            std::remove(fopSave.primaryPotentialCacheFile(k).c_str());
+        }
+    }
+
     void testStiffness1D(){
         
         std::vector < GIMLI::Node * > n(2);
@@ -4,13 +4,38 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include <gimli.h>
+#include <calculateMultiThread.h>
+#include <gravimetry.h>
+#include <hmatrix.h>
+#include <interpolate.h>
 #include <ipcClient.h>
 #include <memwatch.h>
+#include <mesh.h>
+#include <meshgenerators.h>
 
 #include <matrix.h>
+#include <node.h>
+#include <sparsematrix.h>
 
 #include <polynomial.h>
 #include <pos.h>
+#include <profiler.h>
+#include <timelapsemodelling.h>
+
+#include <sstream>
+#include <thread>
+
+class MemoryTagCalcMT : public GIMLI::BaseCalcMT{
+public:
+    MemoryTagCalcMT(std::vector < int > & tags) : BaseCalcMT(), tags_(&tags){ }
+
+    virtual void calc(GIMLI::Index tNr=0){
+        for (GIMLI::Index i = start_; i < end_; i ++) (*tags_)[i] = GIMLI::memoryTag();
+    }
+
+protected:
+    std::vector < int > * tags_;
+};
 
 class GIMLIMiscTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST_SUITE(GIMLIMiscTest);
@@ -19,8 +44,13 @@ class GIMLIMiscTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testFunctorTemplates);
     CPPUNIT_TEST(testStringFunctions);
     //CPPUNIT_TEST(testIPCSHM);
+    CPPUNIT_TEST(testIPCStoreSHM);
     CPPUNIT_TEST(testMemWatch);
+    CPPUNIT_TEST(testProfiler);
+    CPPUNIT_TEST(testMemoryAccounting);
     CPPUNIT_TEST(testPolynomialFunction);
+    CPPUNIT_TEST(testTimeLapseModelling);
+    CPPUNIT_TEST(testHMatrix);
 //     CPPUNIT_TEST(testRotationByQuaternion);
     
 	//CPPUNIT_TEST_EXCEPTION(funct, exception);
@@ -103,7 +133,140 @@ public:
         // free the shared memory
         ipc.free("unittest");
     }
+
+    void testIPCStoreSHM(){
+        GIMLI::IPCStoreSHM store("gimliunittest");
+
+        GIMLI::RVector v(1000); for (GIMLI::Index i = 0; i < v.size(); i ++) v[i] = i * 0.5;
+        GIMLI::RMatrix A(7, 5);
+        for (GIMLI::Index i = 0; i < A.rows(); i ++) A[i] = GIMLI::RVector(5, double(i));
+        GIMLI::Mesh mesh(GIMLI::createMesh2D(4, 3));
+        for (GIMLI::Index i = 0; i < mesh.cellCount(); i ++) mesh.cell(i).setMarker(i);
+
+        store.publish("v", v);
+        store.publish("A", A);
+        store.publish("mesh", mesh);
+        CPPUNIT_ASSERT(store.exists("v"));
+
+        // this can by done by any other process on the same machine
+        GIMLI::IPCStoreSHM reader("gimliunittest");
+        const GIMLI::RVector & v2 = reader.vector("v");
+        CPPUNIT_ASSERT(!v2.ownsData());
+        CPPUNIT_ASSERT(v2 == v);
+        const GIMLI::RMatrix & A2 = reader.matrix("A");
+        CPPUNIT_ASSERT(A2.rows() == 7 && A2.cols() == 5);
+        CPPUNIT_ASSERT(A2[6] == A[6]);
+        CPPUNIT_ASSERT_THROW(reader.matrix("v"), std::exception);
+
+        GIMLI::Mesh mesh2(reader.mesh("mesh"));
+        CPPUNIT_ASSERT(mesh2.nodeCount() == mesh.nodeCount());
+        CPPUNIT_ASSERT(mesh2.cellCount() == mesh.cellCount());
+        CPPUNIT_ASSERT(mesh2.boundaryCount() == mesh.boundaryCount());
+        CPPUNIT_ASSERT(mesh2.cellMarkers() == mesh.cellMarkers());
+        CPPUNIT_ASSERT(mesh2.cell(5).node(2).pos() == mesh.cell(5).node(2).pos());
+
+        store.remove("v");
+        store.remove("A");
+        store.remove("mesh");
+        CPPUNIT_ASSERT(!store.exists("v"));
+        CPPUNIT_ASSERT(!store.exists("mesh.nodes"));
+    }
     
+    void testTimeLapseModelling(){
+        GIMLI::RMatrix A(4, 3);
+        for (GIMLI::Index i = 0; i < 4; i ++) A[i] = GIMLI::RVector(3, 1.0) * double(i + 1);
+        GIMLI::LinearModelling f1(A), f2(A);
+        std::vector < GIMLI::ModellingBase * > fops;
+        fops.push_back(&f1);
+        fops.push_back(&f2);
+
+        //** 2 operators for 3 frames, the Jacobian of f1 is copied
+        GIMLI::TimeLapseModelling fop(fops, 3);
+        GIMLI::RVector m(fop.startModel());
+        CPPUNIT_ASSERT(m.size() == 9);
+        for (GIMLI::Index i = 0; i < m.size(); i ++) m[i] = i;
+        GIMLI::RVector r(fop.response(m));
+        CPPUNIT_ASSERT(r.size() == 12);
+        CPPUNIT_ASSERT(r[4] == 12.0 && r[11] == 4.0 * 21.0);
+
+        fop.createJacobian(m);
+        CPPUNIT_ASSERT(fop.jacobian()->rows() == 12 && fop.jacobian()->cols() == 9);
+        CPPUNIT_ASSERT(fop.jacobian()->mult(m) == r);
+
+        fop.setTemporalWeight(2.0);
+        fop.createConstraints();
+        //** 3 x identity (no regions) + 2 x 3 temporal differences
+        CPPUNIT_ASSERT(fop.constraints()->rows() == 15);
+        GIMLI::RVector c(fop.constraints()->mult(m));
+        CPPUNIT_ASSERT(c[8] == 8.0 && c[9] == 6.0 && c[14] == 6.0);
+
+        //** the constraint weights of the operator are used for each frame
+        GIMLI::RVector cw(3, 1.0);
+        cw[1] = 0.5;
+        f1.regionManager().setConstraintsWeight(cw);
+        fop.createConstraints();
+        GIMLI::RVector w(fop.regionManager().createConstraintsWeight());
+        CPPUNIT_ASSERT(w.size() == 15);
+        CPPUNIT_ASSERT(w[1] == 0.5 && w[7] == 0.5 && w[8] == 1.0 && w[10] == 1.0);
+
+        //** node frames on the parameter mesh to the refined forward meshes,
+        //** linear values are interpolated exactly
+        GIMLI::RVector x(5); for (GIMLI::Index i = 0; i < x.size(); i ++) x[i] = 0.25 * i;
+        GIMLI::Mesh mesh(GIMLI::createMesh2D(x, x));
+        GIMLI::ModellingBase g1(mesh), g2(mesh);
+        g1.createRefinedForwardMesh(true);
+        g2.createRefinedForwardMesh(true);
+        const GIMLI::InterpolationOperator * I = &g1.paraMeshInterpolation();
+        CPPUNIT_ASSERT(&g1.paraMeshInterpolation() == I);
+        CPPUNIT_ASSERT(I->rows() == g1.mesh()->nodeCount() && I->cols() == mesh.nodeCount());
+
+        std::vector < GIMLI::ModellingBase * > gops;
+        gops.push_back(&g1);
+        gops.push_back(&g2);
+        GIMLI::TimeLapseModelling tl(gops, 3);
+        GIMLI::RMatrix frames(3, mesh.nodeCount());
+        for (GIMLI::Index i = 0; i < 3; i ++){
+            for (GIMLI::Index j = 0; j < mesh.nodeCount(); j ++){
+                frames[i][j] = (i + 1.0) * mesh.node(j).pos()[0] - mesh.node(j).pos()[1];
+            }
+        }
+        GIMLI::RMatrix fwd(tl.forwardMeshFrames(frames));
+        CPPUNIT_ASSERT(fwd.rows() == 3);
+        double err = 0.0;
+        for (GIMLI::Index i = 0; i < 3; i ++){
+            const GIMLI::Mesh & fm = *tl.frameOperator(i)->mesh();
+            CPPUNIT_ASSERT(fwd[i].size() == fm.nodeCount());
+            for (GIMLI::Index j = 0; j < fm.nodeCount(); j ++){
+                err = std::max(err, std::fabs(fwd[i][j] - ((i + 1.0) * fm.node(j).pos()[0] -
+                                                          fm.node(j).pos()[1])));
+            }
+        }
+        CPPUNIT_ASSERT(err < TOLERANCE);
+        //** a new forward mesh invalidates the operator
+        g1.createRefinedForwardMesh(false);
+        CPPUNIT_ASSERT(g1.paraMeshInterpolation().rows() == mesh.nodeCount());
+    }
+
+    void testHMatrix(){
+        GIMLI::RVector x(41), y(21);
+        for (GIMLI::Index i = 0; i < x.size(); i ++) x[i] = -100.0 + 5.0 * i;
+        for (GIMLI::Index i = 0; i < y.size(); i ++) y[i] = -101.0 + 5.0 * i;
+        GIMLI::Mesh mesh(GIMLI::createMesh2D(x, y));
+
+        std::vector < GIMLI::RVector3 > pos;
+        for (GIMLI::Index i = 0; i < 200; i ++) pos.push_back(GIMLI::RVector3(-150.0 + 1.5 * i, 0.0));
+
+        GIMLI::RVector model(mesh.cellCount());
+        for (GIMLI::Index i = 0; i < model.size(); i ++) model[i] = 1.0 + (i * 37) % 11;
+
+        //** the kernel is tiny (mGal per kg/m^3), the accuracy must not depend on it
+        GIMLI::HMatrix H(GIMLI::GravimetryCellKernel(pos, mesh), 1e-6);
+        GIMLI::RVector dense(GIMLI::calcGCells(pos, mesh, model));
+        GIMLI::RVector hm(H.mult(model));
+        CPPUNIT_ASSERT(hm.size() == dense.size());
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(hm - dense)) < 1e-5 * GIMLI::max(GIMLI::abs(dense)));
+    }
+
     void testMemWatch(){
         std::cout << "MemWatch" << std::endl;
         GIMLI::setDebug(true);
@@ -117,6 +280,89 @@ public:
         mat.clear();
         GIMLI::MemWatch::pInstance()->info(WHERE);
     }
+
+    void testProfiler(){
+        GIMLI::Profiler & p = GIMLI::Profiler::instance();
+        p.clear();
+        { GIMLI_PROFILE("disabled"); }
+        CPPUNIT_ASSERT(p.size() == 0);
+
+        p.setEnabled(true);
+        {
+            GIMLI_PROFILE("outer");
+            for (int i = 0; i < 3; i ++){ GIMLI_PROFILE("inner"); }
+        }
+        std::thread t([](){ GIMLI_PROFILE("thread"); });
+        t.join();
+        p.setEnabled(false);
+
+        CPPUNIT_ASSERT(p.size() == 5);
+        std::string s(p.summary());
+        CPPUNIT_ASSERT(s.find("Thread 1") != std::string::npos);
+        CPPUNIT_ASSERT(s.find("    inner") != std::string::npos);
+        p.saveTrace("profile.json");
+        CPPUNIT_ASSERT(GIMLI::fileExist("profile.json"));
+        p.clear();
+    }
+
+    void testMemoryAccounting(){
+        GIMLI::Index jac = GIMLI::memoryUsage(GIMLI::MEMORY_JACOBIAN);
+        GIMLI::Index con = GIMLI::memoryUsage(GIMLI::MEMORY_CONSTRAINTS);
+        GIMLI::resetMemoryPeak();
+        {
+            GIMLI::MemoryScope scope(GIMLI::MEMORY_JACOBIAN);
+            GIMLI::RMatrix J(100, 1000);
+            CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_JACOBIAN) >= jac + 800000);
+            {
+                GIMLI::MemoryScope scope(GIMLI::MEMORY_CONSTRAINTS);
+                GIMLI::RSparseMapMatrix C(10, 10);
+                C.setVal(0, 0, 1.0);
+                C.setVal(1, 2, 1.0);
+                CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_CONSTRAINTS) > con);
+                GIMLI::RSparseMapMatrix C2(C);
+                C = C2;
+                C.clear();
+            }
+            CPPUNIT_ASSERT(GIMLI::memoryTag() == GIMLI::MEMORY_JACOBIAN);
+            CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_CONSTRAINTS) == con);
+        }
+        CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_JACOBIAN) == jac);
+        CPPUNIT_ASSERT(GIMLI::memoryPeak(GIMLI::MEMORY_JACOBIAN) >= jac + 800000);
+
+        GIMLI::Index mesh = GIMLI::memoryUsage(GIMLI::MEMORY_MESH);
+        GIMLI::Node * n = new GIMLI::Node(1.0, 2.0, 3.0);
+        CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_MESH) == mesh + sizeof(GIMLI::Node));
+        delete n;
+        CPPUNIT_ASSERT(GIMLI::memoryUsage(GIMLI::MEMORY_MESH) == mesh);
+
+        //** worker threads account to the tag of the calling thread
+        std::vector < int > tags(8, GIMLI::MEMORY_OTHER);
+        {
+            GIMLI::MemoryScope scope(GIMLI::MEMORY_POTENTIALS);
+            GIMLI::distributeCalc(MemoryTagCalcMT(tags), tags.size(), 4);
+        }
+        for (GIMLI::Index i = 0; i < tags.size(); i ++){
+            CPPUNIT_ASSERT(tags[i] == GIMLI::MEMORY_POTENTIALS);
+        }
+
+        //** one row per tag, the Jacobian peak is reported in MByte
+        std::stringstream report(GIMLI::memoryReport());
+        std::string line;
+        GIMLI::Index nTags = 0;
+        double current = -1.0, peak = -1.0;
+        while (std::getline(report, line)){
+            std::stringstream row(line);
+            std::string name;
+            row >> name;
+            for (GIMLI::Index i = 0; i < GIMLI::MEMORY_TAG_COUNT; i ++){
+                if (name == GIMLI::memoryTagName(GIMLI::MemoryTag(i))) nTags ++;
+            }
+            if (name == "jacobian") row >> current >> peak;
+        }
+        CPPUNIT_ASSERT(nTags == GIMLI::MEMORY_TAG_COUNT);
+        CPPUNIT_ASSERT(current >= 0.0);
+        CPPUNIT_ASSERT(peak >= GIMLI::mByte(800000) - 0.01);
+    }
     
     void testPolynomialFunction(){
         CPPUNIT_ASSERT(GIMLI::PolynomialFunction< double > (GIMLI::RVector(0.0))(GIMLI::RVector3(3.14, 0.0, 0.0)) == 0.0);
@@ -1,10 +1,24 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include <gimli.h>
+#include <datacontainer.h>
 #include <mesh.h>
 #include <meshgenerators.h>
+#include <kdtreeWrapper.h>
+#include <interpolate.h>
+#include <regionManager.h>
+#include <shape.h>
+#include <sparsematrix.h>
+#include <straightraymodelling.h>
 
 #include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#if ZLIB_FOUND
+    #include <zlib.h>
+#endif
 
 using namespace GIMLI;
 
@@ -13,6 +27,14 @@ class MeshTest : public CppUnit::TestFixture{
     CPPUNIT_TEST(testSimple);
     CPPUNIT_TEST(testRefine2d);
     CPPUNIT_TEST(testRefine3d);
+    CPPUNIT_TEST(testKDTree);
+    CPPUNIT_TEST(testInterpolationOperator);
+    CPPUNIT_TEST(testDifferenceOperator);
+    CPPUNIT_TEST(testReorder);
+    CPPUNIT_TEST(testRayTraversal);
+    CPPUNIT_TEST(testStraightRayModelling);
+    CPPUNIT_TEST(testFindCells);
+    CPPUNIT_TEST(testExportVTU);
         
     //CPPUNIT_TEST_EXCEPTION(funct, exception);
     CPPUNIT_TEST_SUITE_END();
@@ -28,6 +50,152 @@ public:
         delete tri;
     }
     
+    void testKDTree(){
+        Mesh mesh(2);
+        for (Index i = 0; i < 400; i ++){
+            mesh.createNodeWithCheck(RVector3(double(i % 20), double(i / 20)));
+        }
+        for (Index i = 0; i < 400; i ++){
+            mesh.createNodeWithCheck(RVector3(double(i % 20), double(i / 20)));
+        }
+        CPPUNIT_ASSERT(mesh.nodeCount() == 400);
+        CPPUNIT_ASSERT(mesh.findNearestNode(RVector3(3.1, 4.2)) == 83);
+
+        R3Vector pos(2);
+        pos[0] = RVector3(-1.0, -1.0); pos[1] = RVector3(18.8, 19.3);
+        IndexArray ids(mesh.findNearestNodes(pos));
+        CPPUNIT_ASSERT(ids[0] == 0 && ids[1] == 399);
+
+        //** moving the nodes invalidates the tree
+        Mesh swapped(mesh);
+        CPPUNIT_ASSERT(swapped.findNearestNode(RVector3(4.1, 3.2)) == 64);
+        swapped.swapCoordinates(0, 1);
+        CPPUNIT_ASSERT(swapped.findNearestNode(RVector3(4.1, 3.2)) == 83);
+
+        KDTreeWrapper tree;
+        tree.build(mesh.nodes());
+        std::vector < Node * > k(tree.kNearest(RVector3(5.0, 5.4), 2));
+        CPPUNIT_ASSERT(k.size() == 2 && k[0]->id() == 105 && k[1]->id() == 125);
+        CPPUNIT_ASSERT(tree.radius(RVector3(5.0, 5.0), 1.0).size() == 5);
+    }
+
+    void testInterpolationOperator(){
+        RVector x(11); for (Index i = 0; i < x.size(); i ++) x[i] = i * 0.1;
+        Mesh mesh(createMesh2D(x, x));
+
+        R3Vector pos(3);
+        pos[0] = RVector3(0.25, 0.33); pos[1] = RVector3(0.9, 0.05);
+        pos[2] = RVector3(2.0, 0.5);
+
+        RVector f(mesh.nodeCount());
+        for (Index i = 0; i < f.size(); i ++) f[i] = 2.0 * mesh.node(i).pos()[0] - mesh.node(i).pos()[1];
+
+        InterpolationOperator I(mesh, pos);
+        CPPUNIT_ASSERT(I.rows() == 3 && I.cols() == mesh.nodeCount());
+        RVector fi(I.apply(f, -1.0));
+        CPPUNIT_ASSERT(std::fabs(fi[0] - 0.17) < TOLERANCE);
+        CPPUNIT_ASSERT(std::fabs(fi[1] - 1.75) < TOLERANCE);
+        CPPUNIT_ASSERT(fi[2] == -1.0);
+        CPPUNIT_ASSERT(I.mult(f)[2] == 0.0);
+
+        I.save("interpolationOperator.bin");
+        InterpolationOperator J;
+        J.load("interpolationOperator.bin");
+        CPPUNIT_ASSERT(J.rows() == 3 && J.cols() == I.cols());
+        CPPUNIT_ASSERT(J.apply(f, -1.0) == fi);
+
+        InterpolationOperator C(mesh, pos, true);
+        RVector c(mesh.cellCount()); for (Index i = 0; i < c.size(); i ++) c[i] = i;
+        CPPUNIT_ASSERT(C.apply(c, -1.0)[0] == double(mesh.findCell(pos[0])->id()));
+    }
+
+    void testDifferenceOperator(){
+        // 3 x 2 cells, parameter i is cell i
+        // 3 4 5
+        // 0 1 2
+        RVector x(4); x[0] = 0.0; x[1] = 1.0; x[2] = 2.0; x[3] = 3.0;
+        RVector y(3); y[0] = 0.0; y[1] = 1.0; y[2] = 2.0;
+        Mesh mesh(createMesh2D(x, y));
+        for (Index i = 0; i < mesh.cellCount(); i ++) mesh.cell(i).setMarker(1);
+
+        RVector m(6); for (Index i = 0; i < m.size(); i ++) m[i] = (i + 1) * (i + 1);
+        // C^T C m for 1st order and C m for 2nd order: neighbour count * m[i] - sum of neighbours
+        RVector lap(6);
+        lap[0] = 2. * m[0] - m[1] - m[3];
+        lap[1] = 3. * m[1] - m[0] - m[2] - m[4];
+        lap[2] = 2. * m[2] - m[1] - m[5];
+        lap[3] = 2. * m[3] - m[0] - m[4];
+        lap[4] = 3. * m[4] - m[1] - m[3] - m[5];
+        lap[5] = 2. * m[5] - m[2] - m[4];
+
+        RegionManager rm(false);
+        rm.setMesh(mesh);
+        rm.setConstraintType(1);
+        DifferenceOperator C;
+        rm.fillConstraints(C);
+        C.setThreadCount(2);
+        // 7 inner boundaries with one difference each
+        CPPUNIT_ASSERT(C.rows() == 7 && C.cols() == 6);
+        CPPUNIT_ASSERT(max(abs(C.transMult(C.mult(m)) - lap)) < TOLERANCE);
+        RSparseMapMatrix S;
+        rm.fillConstraints(S);
+        CPPUNIT_ASSERT(S.nVals() == 2 * 7);
+
+        rm.setConstraintType(2);
+        rm.fillConstraints(C);
+        CPPUNIT_ASSERT(C.rows() == 6 && C.cols() == 6);
+        CPPUNIT_ASSERT(max(abs(C.mult(m) - lap)) < TOLERANCE);
+        rm.fillConstraints(S);
+        CPPUNIT_ASSERT(S.getVal(0, 0) == 2.0 && S.getVal(0, 1) == -1.0 &&
+                       S.getVal(0, 3) == -1.0 && S.getVal(0, 4) == 0.0);
+        CPPUNIT_ASSERT(S.getVal(4, 4) == 3.0 && S.getVal(4, 1) == -1.0 &&
+                       S.getVal(4, 3) == -1.0 && S.getVal(4, 5) == -1.0);
+
+        // two regions of one cell each, coupled by an inter-region constraint
+        // with model control weights 1/2 and 1/4
+        Mesh mesh2(createMesh2D(Index(2), Index(1)));
+        mesh2.cell(0).setMarker(1);
+        mesh2.cell(1).setMarker(2);
+        RegionManager rm2(false);
+        rm2.setMesh(mesh2);
+        rm2.setConstraintType(1);
+        rm2.region(1)->setModelControl(2.0);
+        rm2.region(2)->setModelControl(4.0);
+        rm2.setInterRegionConstraint(1, 2, 0.3);
+        rm2.fillConstraints(C);
+        CPPUNIT_ASSERT(C.rows() == 1 && C.cols() == 2);
+        RVector m2(2); m2[0] = 3.0; m2[1] = 5.0;
+        CPPUNIT_ASSERT(std::fabs(C.mult(m2)[0] - (3.0 / 2.0 - 5.0 / 4.0)) < TOLERANCE);
+        RVector c2(1, 2.0);
+        CPPUNIT_ASSERT(std::fabs(C.transMult(c2)[0] - 1.0) < TOLERANCE);
+        CPPUNIT_ASSERT(std::fabs(C.transMult(c2)[1] + 0.5) < TOLERANCE);
+        RVector w;
+        rm2.fillConstraintsWeight(w);
+        CPPUNIT_ASSERT(w.size() == 1 && std::fabs(w[0] - 0.3) < TOLERANCE);
+
+        // a dart quadrangle and the triangle in its notch share more than one
+        // edge, 2nd order keeps C[l][r] = -1 while the diagonal counts every edge
+        Mesh mesh3(2);
+        Node * n0 = mesh3.createNode(RVector3(0.0, 0.0));
+        Node * n1 = mesh3.createNode(RVector3(2.0, 0.0));
+        Node * n2 = mesh3.createNode(RVector3(1.0, 2.0));
+        Node * n3 = mesh3.createNode(RVector3(1.0, 0.5));
+        mesh3.createQuadrangle(*n0, *n3, *n1, *n2, 1);
+        mesh3.createTriangle(*n0, *n1, *n3, 1);
+        mesh3.createNeighbourInfos();
+        RegionManager rm3(false);
+        rm3.setMesh(mesh3);
+        rm3.setConstraintType(2);
+        rm3.fillConstraints(S);
+        double nShared = 0.0;
+        for (Index i = 0; i < mesh3.boundaryCount(); i ++){
+            if (mesh3.boundary(i).leftCell() && mesh3.boundary(i).rightCell()) nShared += 1.0;
+        }
+        CPPUNIT_ASSERT(nShared > 1.0);
+        CPPUNIT_ASSERT(S.getVal(0, 0) == nShared && S.getVal(0, 1) == -1.0);
+        CPPUNIT_ASSERT(S.getVal(1, 1) == nShared && S.getVal(1, 0) == -1.0);
+    }
+
     void testRefine2d(){
                 
         Mesh mesh(2);
@@ -65,6 +233,17 @@ public:
                  
         tmp.findCell(RVector3(0.5, 0.5));
         
+        // two levels: 15 tri nodes + 25 quad nodes - 5 shared
+        tmp = mesh.createH2(2);
+        CPPUNIT_ASSERT(tmp.cellCount() == 32);
+        CPPUNIT_ASSERT(tmp.nodeCount() == 35);
+        CPPUNIT_ASSERT(tmp.createH2().nodeCount() == 
+                       tmp.createP2().nodeCount() + 16);
+
+        // no level, no refinement
+        tmp = mesh.createH2(0);
+        CPPUNIT_ASSERT(tmp.cellCount() == mesh.cellCount());
+        CPPUNIT_ASSERT(tmp.nodeCount() == mesh.nodeCount());
         
         tmp = mesh.createP2();
         
@@ -76,6 +255,223 @@ public:
         CPPUNIT_ASSERT(tmp.boundaryCount() == 6);
     }
     
+    Index bandwidth(const Mesh & mesh){
+        Index bw = 0;
+        for (Index i = 0; i < mesh.cellCount(); i ++){
+            const Cell & c = mesh.cell(i);
+            for (Index j = 0; j < c.nodeCount(); j ++){
+                for (Index k = 0; k < c.nodeCount(); k ++){
+                    if (c.node(j).id() > c.node(k).id()){
+                        bw = std::max(bw, Index(c.node(j).id() - c.node(k).id()));
+                    }
+                }
+            }
+        }
+        return bw;
+    }
+
+    void testReorder(){
+        RVector x(21); for (Index i = 0; i < x.size(); i ++) x[i] = i;
+        RVector y(11); for (Index i = 0; i < y.size(); i ++) y[i] = i;
+        Mesh orig(createMesh2D(x, y));
+        Mesh grid(orig);
+        CPPUNIT_ASSERT(bandwidth(grid) == 22);
+
+        //** scramble the grid
+        IndexArray perm(grid.nodeCount());
+        for (Index i = 0; i < perm.size(); i ++) perm[i] = (i * 97) % perm.size();
+        grid.sortNodes(perm);
+        CPPUNIT_ASSERT(bandwidth(grid) > 100);
+
+        RVector cData(grid.cellCount());
+        for (Index i = 0; i < cData.size(); i ++) cData[i] = grid.cell(i).center()[0];
+        grid.addData("cx", cData);
+
+        MeshOrdering orderings[] = {ORDERING_MORTON, ORDERING_HILBERT,
+                                    ORDERING_RCM, ORDERING_ND};
+        for (Index o = 0; o < 4; o ++){
+            Mesh mesh(grid);
+            mesh.reorder(orderings[o], orderings[o]);
+            CPPUNIT_ASSERT(mesh.nodeCount() == grid.nodeCount());
+            CPPUNIT_ASSERT(mesh.cellOrigin().size() == grid.cellCount());
+
+            for (Index i = 0; i < mesh.nodeCount(); i ++){
+                CPPUNIT_ASSERT(mesh.node(i).pos() ==
+                               orig.node(mesh.nodeOrigin()[i]).pos());
+            }
+            for (Index i = 0; i < mesh.cellCount(); i ++){
+                CPPUNIT_ASSERT(mesh.data("cx")[i] == mesh.cell(i).center()[0]);
+                CPPUNIT_ASSERT(mesh.cell(i).center() ==
+                               grid.cell(mesh.cellOrigin()[i]).center());
+            }
+        }
+        grid.reorder(ORDERING_RCM, ORDERING_NONE);
+        CPPUNIT_ASSERT(bandwidth(grid) <= 22);
+        //** the origin is the inverse of all permutations
+        for (Index i = 0; i < grid.nodeCount(); i ++){
+            CPPUNIT_ASSERT(grid.node(i).pos() == orig.node(grid.nodeOrigin()[i]).pos());
+        }
+    }
+
+    void testFindCells(){
+        RVector x(9), y(7);
+        for (Index i = 0; i < x.size(); i ++) x[i] = i * i * 0.5;
+        for (Index i = 0; i < y.size(); i ++) y[i] = -std::sqrt(double(i));
+        Mesh meshes[] = {createMesh2D(x, y), createMesh3D(Index(4), Index(5), Index(3))};
+
+        for (Index m = 0; m < 2; m ++){
+            Mesh & mesh = meshes[m];
+            RVector3 pMin(mesh.boundingBox().min()), pMax(mesh.boundingBox().max());
+
+            //** quasi random positions, some outside the mesh
+            R3Vector pos(500);
+            for (Index i = 0; i < pos.size(); i ++){
+                for (Index d = 0; d < mesh.dim(); d ++){
+                    double t = std::fmod((i + 1) * (0.6180339887 + 0.2 * d), 1.0) * 1.1 - 0.05;
+                    pos[i][d] = pMin[d] + t * (pMax[d] - pMin[d]);
+                }
+            }
+            IVector ids;
+            RVector rst;
+            mesh.findCells(pos, ids, rst);
+
+            for (Index i = 0; i < pos.size(); i ++){
+                Cell * c = mesh.findCell(pos[i]);
+                CPPUNIT_ASSERT(ids[i] == (c ? SIndex(c->id()) : -1));
+                if (!c) continue;
+                RVector3 r(c->shape().rst(pos[i]));
+                for (Index d = 0; d < 3; d ++){
+                    CPPUNIT_ASSERT(std::fabs(rst[3 * i + d] - r[d]) < 1e-12);
+                }
+            }
+        }
+    }
+
+    /*! Return the first appended array of a binary vtu file. */
+    std::vector < double > readVTUPoints(const std::string & fileName, bool compressed){
+        std::ifstream file(fileName.c_str(), std::ios::binary);
+        std::string content((std::istreambuf_iterator< char >(file)),
+                            std::istreambuf_iterator< char >());
+        size_t pos = content.find("<AppendedData encoding=\"raw\">");
+        pos = content.find('_', pos) + 1;
+        const char * p = content.data() + pos;
+
+        std::vector < double > ret;
+        if (!compressed){
+            uint64 n = *(const uint64 *)p;
+            ret.resize(n / sizeof(double));
+            std::memcpy(&ret[0], p + sizeof(uint64), n);
+            return ret;
+        }
+#if ZLIB_FOUND
+        const uint64 * head = (const uint64 *)p;
+        //** single block: count, block size, last size, compressed size
+        uLongf n = head[2] ? head[2] : head[1];
+        ret.resize(n / sizeof(double));
+        CPPUNIT_ASSERT(head[0] == 1);
+        CPPUNIT_ASSERT(uncompress((Bytef*)&ret[0], &n, (const Bytef*)(head + 4),
+                                  head[3]) == Z_OK);
+#endif
+        return ret;
+    }
+
+    void testExportVTU(){
+        Mesh mesh(createMesh2D(4, 3));
+        for (Index i = 0; i < mesh.nodeCount(); i ++){
+            mesh.node(i).setPos(mesh.node(i).pos() * 0.1);
+        }
+
+        for (Index c = 0; c < 2; c ++){
+            bool compress = c == 1;
+#if !ZLIB_FOUND
+            if (compress) continue;
+#endif
+            mesh.exportVTU("unittest_vtu.vtu", true, compress);
+            std::vector < double > p(readVTUPoints("unittest_vtu.vtu", compress));
+            CPPUNIT_ASSERT(p.size() == 3 * mesh.nodeCount());
+            for (Index i = 0; i < mesh.nodeCount() && p.size() == 3 * mesh.nodeCount(); i ++){
+                for (Index d = 0; d < 3; d ++){
+                    CPPUNIT_ASSERT(p[3 * i + d] == mesh.node(i).pos()[d]);
+                }
+            }
+        }
+        std::remove("unittest_vtu.vtu");
+    }
+
+    void testRayTraversal(){
+        Mesh mesh2(createMesh2D(10, 10));
+        Mesh mesh3(createMesh3D(Index(4), Index(4), Index(4)));
+
+        //** arbitrary, through nodes and along edges
+        RVector3 a[] = {RVector3(0.3, 0.1), RVector3(0.0, 0.0), RVector3(0.0, 2.0)};
+        RVector3 b[] = {RVector3(9.1, 7.7), RVector3(7.0, 7.0), RVector3(10.0, 2.0)};
+        for (Index i = 0; i < 3; i ++){
+            RVector l;
+            std::vector < Cell * > cells(mesh2.findCellsAlongSegment(a[i], b[i], l));
+            CPPUNIT_ASSERT(cells.size() == l.size());
+            CPPUNIT_ASSERT(std::fabs(sum(l) - a[i].dist(b[i])) < 1e-12);
+        }
+        RVector l;
+        CPPUNIT_ASSERT(mesh2.findCellsAlongSegment(a[1], b[1], l).size() == 7);
+        CPPUNIT_ASSERT(mesh2.findCellsAlongSegment(a[2], b[2], l).size() == 10);
+
+        RVector3 a3(0.1, 0.2, 0.0), b3(4.0, 3.5, 3.1);
+        mesh3.findCellsAlongSegment(a3, b3, l);
+        CPPUNIT_ASSERT(std::fabs(sum(l) - a3.dist(b3)) < 1e-12);
+        mesh3.findCellsAlongSegment(RVector3(0.0, 0.0, 0.0), RVector3(4.0, 4.0, 4.0), l);
+        CPPUNIT_ASSERT(l.size() == 4);
+
+        //** the ray ends at the mesh boundary
+        R3Vector pos;
+        std::vector < Cell * > cells(mesh2.findCellsAlongRay(RVector3(0.5, 0.5),
+                                                             RVector3(1.0, 0.0), pos));
+        CPPUNIT_ASSERT(cells.size() == 10);
+        CPPUNIT_ASSERT(pos.size() == 11);
+        CPPUNIT_ASSERT(pos[10].dist(RVector3(10.0, 0.5)) < 1e-12);
+    }
+
+    void testStraightRayModelling(){
+        Mesh mesh(createMesh2D(10, 10));
+        DataContainer data;
+        data.registerSensorIndex("s");
+        data.registerSensorIndex("g");
+        RVector3 sensors[] = {RVector3(0.0, 0.5), RVector3(10.0, 0.5),
+                              RVector3(0.0, 0.0), RVector3(10.0, 10.0),
+                              RVector3(-5.0, -5.0), RVector3(-1.0, -1.0)};
+        for (Index i = 0; i < 6; i ++) data.createSensor(sensors[i]);
+        data.resize(3);
+        RVector s(3), g(3);
+        s[0] = 0; g[0] = 1;
+        s[1] = 2; g[1] = 3;
+        s[2] = 4; g[2] = 5; // misses the mesh
+        data.set("s", s);
+        data.set("g", g);
+        data.set("t", RVector(3, 1.0));
+
+        StraightRayModelling fop(mesh, data);
+        Index nModel = fop.regionManager().parameterCount();
+        CPPUNIT_ASSERT(nModel == 100);
+        RVector slowness(nModel);
+        for (Index i = 0; i < nModel; i ++) slowness[i] = 1.0 + 0.01 * i;
+
+        fop.createJacobian(slowness);
+        const RSparseMatrix & J = dynamic_cast < const RSparseMatrix & >(*fop.jacobian());
+        CPPUNIT_ASSERT(J.rows() == 3);
+        CPPUNIT_ASSERT(J.cols() == nModel);
+
+        RVector lengths(fop.rayLengths());
+        CPPUNIT_ASSERT(std::fabs(lengths[0] - 10.0) < 1e-12);
+        CPPUNIT_ASSERT(std::fabs(lengths[1] - 10.0 * std::sqrt(2.0)) < 1e-12);
+        CPPUNIT_ASSERT(lengths[2] == 0.0);
+
+        //** the Jacobian is kept and the response is J * s
+        const double * vals = &J.vecVals()[0];
+        RVector resp(fop.response(slowness));
+        CPPUNIT_ASSERT(&dynamic_cast < const RSparseMatrix & >(*fop.jacobian()).vecVals()[0] == vals);
+        CPPUNIT_ASSERT(resp == J.mult(slowness));
+        CPPUNIT_ASSERT(std::fabs(fop.response(RVector(nModel, 2.0))[1] - 20.0 * std::sqrt(2.0)) < 1e-12);
+    }
+
      void testRefine3d(){
                 
         Mesh mesh(3);
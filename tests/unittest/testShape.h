@@ -7,6 +7,8 @@
 #include <meshentities.h>
 #include <mesh.h>
 #include <meshgenerators.h>
+#include <integration.h>
+#include <vectortemplates.h>
 
 using namespace GIMLI;
 
@@ -51,6 +53,17 @@ public:
         CPPUNIT_ASSERT(q1_->shape().createShapeFunctions()[1] == Q4_2);
         CPPUNIT_ASSERT(q1_->shape().createShapeFunctions()[2] == Q4_3);
         CPPUNIT_ASSERT(q1_->shape().createShapeFunctions()[3] == Q4_4);
+
+        const GIMLI::R3Vector & x = GIMLI::IntegrationRules::instance().quaAbscissa(3);
+        const GIMLI::ShapeFunctionTable & T =
+            GIMLI::ShapeFunctionCache::instance().shapeFunctionTable(*q1_, x);
+        CPPUNIT_ASSERT(&T == &GIMLI::ShapeFunctionCache::instance().shapeFunctionTable(*q1_, x));
+        CPPUNIT_ASSERT(T.N.rows() == 4 && T.N.cols() == x.size());
+        for (GIMLI::Index k = 0; k < x.size(); k ++){
+            CPPUNIT_ASSERT(GIMLI::norm(T.N.col(k) - q1_->N(x[k])) < TOLERANCE);
+            CPPUNIT_ASSERT(GIMLI::norm(T.dNdr.col(k) - q1_->dNdL(x[k], 0)) < TOLERANCE);
+            CPPUNIT_ASSERT(GIMLI::norm(T.dNds.col(k) - q1_->dNdL(x[k], 1)) < TOLERANCE);
+        }
     }
     
     void testRSTXYZ(){
@@ -4,6 +4,7 @@
 #include <pos.h>
 #include <vector.h>
 #include <blockmatrix.h>
+#include <mappedmatrix.h>
 #include <matrix.h>
 #include <sparsematrix.h>
 #include <vectortemplates.h>
@@ -19,6 +20,7 @@ class VectorTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testIterator);
     CPPUNIT_TEST(testEquality);
     CPPUNIT_TEST(testFill);
+    CPPUNIT_TEST(testWrap);
     CPPUNIT_TEST(testSetVal);
     CPPUNIT_TEST(testUnaryOperations);
     CPPUNIT_TEST(testBinaryOperations);
@@ -29,6 +31,7 @@ class VectorTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testRVector3);
     CPPUNIT_TEST(testMatrix);
     CPPUNIT_TEST(testBlockMatrix);
+    CPPUNIT_TEST(testMappedMatrix);
     CPPUNIT_TEST(testSparseMapMatrix);
     CPPUNIT_TEST(testFind);
     CPPUNIT_TEST(testIO);
@@ -97,6 +100,26 @@ public:
         CPPUNIT_ASSERT(fliplr(fliplr(v1)) == v1);
     }
 
+    void testWrap(){
+        double buf[6]={0.0, 1.0, 2.0, 3.0, 4.0, 5.0};
+
+        RVector v; v.wrap(buf, 6);
+        CPPUNIT_ASSERT(!v.ownsData());
+        CPPUNIT_ASSERT(v.data() == buf);
+        v *= 2.0;
+        CPPUNIT_ASSERT(buf[5] == 10.0);
+        RVector c(v);
+        CPPUNIT_ASSERT(c.ownsData() && c == v);
+        v.resize(12);
+        CPPUNIT_ASSERT(v.ownsData() && v.data() != buf && v[5] == 10.0);
+
+        RMatrix A; A.wrap(buf, 2, 3);
+        CPPUNIT_ASSERT(A.rows() == 2 && A.cols() == 3);
+        CPPUNIT_ASSERT(&A[1][0] == &buf[3]);
+        A[1][2] = -1.0;
+        CPPUNIT_ASSERT(buf[5] == -1.0);
+    }
+
     void testUnaryOperations(){
         testUnaryOperations_< double > (3.1415);
         testUnaryOperations_< Complex > (Complex(3.1415, 1.0));
@@ -136,6 +159,25 @@ public:
 //         __MS(t2)
         CPPUNIT_ASSERT(t1 == t2);
 //         exit(0);
+
+        //** aligned storage and chunked evaluation on the thread pool
+        CPPUNIT_ASSERT(size_t(m.data()) % GIMLI_VECTOR_ALIGNMENT == 0);
+        Index nThreads = threadCount();
+        Index minSize = vectorParallelSize();
+        setThreadCount(4);
+        setVectorParallelSize(1000);
+
+        RVector a(100003), b(a.size());
+        for (Index i = 0; i < a.size(); i ++){ a[i] = i * 0.5; b[i] = 1.0 / (i + 1.0); }
+        RVector c(a * 2.0 + b * b - 1.0);
+        RVector d(a);
+        d *= b;
+        for (Index i = 0; i < c.size(); i ++){
+            CPPUNIT_ASSERT(std::fabs(c[i] - (a[i] * 2.0 + b[i] * b[i] - 1.0)) < 1e-12);
+            CPPUNIT_ASSERT(std::fabs(d[i] - a[i] * b[i]) < 1e-12);
+        }
+        setThreadCount(nThreads);
+        setVectorParallelSize(minSize);
     }
 
     void testSetVal(){
@@ -463,6 +505,83 @@ public:
         CPPUNIT_ASSERT(sum(A.mult(b)) == 18);
         GIMLI::RVector c(A.rows(), 1);
         CPPUNIT_ASSERT(sum(A.transMult(c)) == 18);
+
+        // threaded block products with overlapping output ranges
+        B.resize(60, 60);
+        for (uint i = 0; i < 60; i ++ ){
+            for (uint j = 0; j < 60; j ++ ) B[i][j] = i + 0.5 * j;
+        }
+        CPPUNIT_ASSERT(A.rows() == 63 && A.cols() == 63);
+        b.resize(A.cols(), 1.0);
+        c.resize(A.rows(), 1.0);
+        A.setThreadCount(1);
+        GIMLI::RVector y1(A.mult(b)), x1(A.transMult(c));
+        A.setThreadCount(3);
+        CPPUNIT_ASSERT(A.mult(b) == y1);
+        CPPUNIT_ASSERT(A.transMult(c) == x1);
+
+        // a shared block matrix is multiplied by one thread only
+        GIMLI::BlockMatrix < double > D(false);
+        D.addMatrixEntry(D.addMatrix(&B), 0, 0);
+        GIMLI::Index m3 = A.addMatrix(&D);
+        A.addMatrixEntry(m3, 63, 0);
+        A.addMatrixEntry(m3, 123, 0, 2.0);
+        b.resize(A.cols(), 1.0);
+        c.resize(A.rows(), 1.0);
+        A.setThreadCount(1);
+        y1 = A.mult(b); x1 = A.transMult(c);
+        A.setThreadCount(4);
+        CPPUNIT_ASSERT(A.mult(b) == y1);
+        CPPUNIT_ASSERT(A.transMult(c) == x1);
+    }
+
+    void testMappedMatrix(){
+        GIMLI::RMatrix B(37, 11);
+        for (uint i = 0; i < B.rows(); i ++ ){
+            for (uint j = 0; j < B.cols(); j ++ ) B[i][j] = i - 0.25 * j;
+        }
+        GIMLI::RVector b(B.cols(), 1.0), c(B.rows(), 1.0);
+        b[3] = 2.0; c[5] = -1.0;
+
+        GIMLI::MappedMatrix A("testMappedMatrix.bmat", B.rows(), B.cols());
+        CPPUNIT_ASSERT(A.rows() == 37 && A.cols() == 11);
+        CPPUNIT_ASSERT(sum(A.mult(b)) == 0.0);
+        GIMLI::RMatrix B1(20, B.cols()), B2(17, B.cols());
+        for (uint i = 0; i < 20; i ++ ) B1[i] = B[i];
+        for (uint i = 20; i < 37; i ++ ) B2[i - 20] = B[i];
+        A.setRows(0, B1);
+        A.setRows(20, B2);
+        CPPUNIT_ASSERT(A.toDense() == B);
+
+        // several tiles and threads
+        A.setTileSize(5 * 11 * sizeof(double));
+        A.setThreadCount(3);
+        A.setDropPages(true);
+        CPPUNIT_ASSERT(A.tileRows() == 5);
+        CPPUNIT_ASSERT(A.mult(b) == B.mult(b));
+        CPPUNIT_ASSERT(A.transMult(c) == B.transMult(c));
+
+        A.scale(c, b);
+        for (uint i = 0; i < B.rows(); i ++ ) B[i] *= b * c[i];
+        CPPUNIT_ASSERT(A.toDense() == B);
+
+        // the file is a binary matrix file
+        A.close();
+        GIMLI::RMatrix C;
+        CPPUNIT_ASSERT(load(C, "testMappedMatrix.bmat"));
+        CPPUNIT_ASSERT(C == B);
+        GIMLI::MappedMatrix D("testMappedMatrix.bmat");
+        CPPUNIT_ASSERT(D.row(7) == B[7]);
+        CPPUNIT_ASSERT(!D.writable());
+        std::remove("testMappedMatrix.bmat");
+
+        // a file shorter than the header is refused
+        std::ofstream file("testMappedMatrix.bmat");
+        file << "ab";
+        file.close();
+        CPPUNIT_ASSERT_THROW(GIMLI::MappedMatrix("testMappedMatrix.bmat"),
+                             std::exception);
+        std::remove("testMappedMatrix.bmat");
     }
 
     void testSparseMapMatrix(){
@@ -477,6 +596,44 @@ public:
         CPPUNIT_ASSERT((C+C).getVal(0, 0) == 4.0);
         CPPUNIT_ASSERT((C*2.0).getVal(0, 0) == 4.0);
         CPPUNIT_ASSERT(((C+C)*2.0).getVal(1, 1) == 8.0);
+
+        GIMLI::RSparseAssembler S(3, 2, 2);
+        S.addVal(2, 1, 1.0, 0);
+        S.addVal(0, 0, 2.0, 1);
+        S.addVal(2, 1, 3.0, 1);
+        S.addVal(2, 0, 1.0, 0);
+        CPPUNIT_ASSERT(S.size() == 4);
+        GIMLI::RSparseMapMatrix D(S);
+        CPPUNIT_ASSERT(D.isCompressed());
+        CPPUNIT_ASSERT(D.nVals() == 3);
+        GIMLI::RVector b(2, 1.0);
+        CPPUNIT_ASSERT(D.mult(b) == GIMLI::RVector(std::vector< double >{2.0, 0.0, 5.0}));
+        CPPUNIT_ASSERT(D.getVal(2, 1) == 4.0);
+        CPPUNIT_ASSERT(!D.isCompressed());
+
+        //** shrinking removes the entries outside
+        GIMLI::RSparseMapMatrix F(D);
+        F.setRows(2);
+        CPPUNIT_ASSERT(F.nVals() == 1);
+        CPPUNIT_ASSERT(F.mult(b) == GIMLI::RVector(std::vector< double >{2.0, 0.0}));
+        D.resize(3, 1);
+        CPPUNIT_ASSERT(D.mult(GIMLI::RVector(1, 1.0)) == GIMLI::RVector(std::vector< double >{2.0, 0.0, 1.0}));
+        CPPUNIT_ASSERT(D.nVals() == 2);
+        D.resize(3, 2);
+
+        GIMLI::RSparseMatrix E(D);
+        GIMLI::RMatrix X(2, 2);
+        X[0] = b; X[1] = b * 2.0;
+        GIMLI::RMatrix Y(E.mult(X));
+        CPPUNIT_ASSERT(Y.rows() == 2 && Y.cols() == 3);
+        CPPUNIT_ASSERT(Y[1] == E.mult(b) * 2.0);
+        CPPUNIT_ASSERT(E.transMult(Y)[0] == E.transMult(Y[0]));
+
+        GIMLI::RSparseMapMatrix L(2, 2, -1);
+        L.setVal(0, 0, 2.0);
+        L.setVal(0, 1, 1.0);
+        L.setVal(1, 1, 3.0);
+        CPPUNIT_ASSERT(GIMLI::RSparseMatrix(L).mult(b) == GIMLI::RVector(std::vector< double >{3.0, 4.0}));
     }
 
     void testIO(){